@@ -0,0 +1,261 @@
+// Windowed aggregation: Welford against a two-pass reference, the window grid
+// under jitter and gaps, quiet slaves, summary encodings and bytes saved
+#include <Arduino.h>
+#include <math.h>
+#include "sampleAggregator.h"
+#include "samplePack.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t WINDOW_MS = 60000;
+static const uint32_t BASE_TS = 1700000000;
+
+static uint32_t fieldBit(const char *key)
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (strcmp(CHAMBER_REGISTER_MAP[i].key, key) == 0)
+            return 1UL << i;
+    }
+    return 0;
+}
+
+static size_t fieldIndex(const char *key)
+{
+    uint32_t bit = fieldBit(key);
+    size_t i = 0;
+    while (bit > 1)
+        bit >>= 1, i++;
+    return i;
+}
+
+static TimedSample sample(uint8_t slaveAddr, float tempPV, float humiPV, uint16_t nowSTS, uint32_t timestamp)
+{
+    TimedSample timed;
+    memset(&timed, 0, sizeof(timed));
+    timed.data.slaveAddr = slaveAddr;
+    timed.data.tempPV = tempPV;
+    timed.data.tempSP = 25.0f;
+    timed.data.wetPV = 20.0f;
+    timed.data.wetSP = 20.0f;
+    timed.data.humiPV = humiPV;
+    timed.data.humiSP = 60.0f;
+    timed.data.nowSTS = nowSTS;
+    timed.data.validMask = CHAMBER_REGISTER_ALL;
+    timed.timestamp = timestamp;
+    return timed;
+}
+
+// The sample as polled at `capturedMs`
+static TimedSample at(TimedSample timed, uint32_t capturedMs)
+{
+    timed.capturedMs = capturedMs;
+    return timed;
+}
+
+// Register-resolution readings around 23.45 degrees, as a TEMI1500 reports them
+static float reading(uint32_t *seed)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return (2345 + (int)(*seed >> 28) - 8) / 100.0f;
+}
+
+int benchAggregate()
+{
+    int failures = 0;
+    printf("\n== Windowed aggregation ==\n");
+
+    // One hour at 1 Hz in one window: Welford against a two-pass reference in
+    // double, and the float sum/sum-of-squares shortcut it replaces
+    static SampleAggregator aggregator;
+    aggregator.begin(3600000);
+    static float values[3600];
+    uint32_t seed = 1;
+    SampleSummary summary;
+    float sum = 0, sumSquares = 0;
+    for (uint32_t i = 0; i < 3600; i++)
+    {
+        values[i] = reading(&seed);
+        sum += values[i];
+        sumSquares += values[i] * values[i];
+        aggregator.add(at(sample(1, values[i], 60.0f, 3, BASE_TS + i), i * 1000), &summary);
+    }
+    double mean = 0, squares = 0;
+    for (float value : values)
+        mean += value;
+    mean /= 3600;
+    for (float value : values)
+        squares += (value - mean) * (value - mean);
+    double sd = sqrt(squares / 3599);
+    double naiveSd = sqrt(fmax(0.0, (sumSquares - sum * sum / 3600) / 3599));
+    if (!aggregator.flush(&summary) || summary.samples != 3600)
+    {
+        printf("FAIL: hour window not closed\n");
+        failures++;
+    }
+    const RunningStats &temp = summary.fields[fieldIndex("tempPV")];
+    if (fabs(temp.mean - mean) > 1e-6 || fabs(runningStddev(temp) - sd) > 1e-5)
+    {
+        printf("FAIL: Welford mean %.6f sd %.6f, reference %.6f %.6f\n", temp.mean, runningStddev(temp), mean, sd);
+        failures++;
+    }
+    printf("sd over 3600 samples:      reference %.5f, Welford %.5f, float sum of squares %.5f\n",
+           sd, runningStddev(temp), naiveSd);
+
+    // Tumbling windows on a fixed grid: jitter and a dropped poll do not shift them
+    aggregator.begin(WINDOW_MS);
+    uint32_t closedAt = 0, closedCount = 0;
+    for (uint32_t s = 0; s <= 120; s++)
+    {
+        uint32_t nowMs = 500 + s * 1000 + (s % 7) * 40; // Up to 240 ms late
+        if (s == 30)
+            continue;
+        if (aggregator.add(at(sample(1, 20.0f + s, 60.0f, 3, BASE_TS + s), nowMs), &summary) == AGGREGATE_CLOSED)
+        {
+            closedAt = s, closedCount++;
+            const RunningStats &field = summary.fields[fieldIndex("tempPV")];
+            bool first = closedCount == 1;
+            uint32_t n = first ? 59 : 60, lo = first ? 0 : 60;
+            if (summary.samples != n || summary.timestamp != BASE_TS + lo || field.min != 20.0f + lo ||
+                field.max != 20.0f + lo + 59 || summary.windowMs != WINDOW_MS)
+            {
+                printf("FAIL: window %u: n %u, ts %u, min %.1f, max %.1f\n", closedCount, summary.samples,
+                       summary.timestamp, field.min, field.max);
+                failures++;
+            }
+        }
+    }
+    if (closedCount != 2 || closedAt != 120)
+    {
+        printf("FAIL: %u windows closed, last at sample %u\n", closedCount, closedAt);
+        failures++;
+    }
+
+    // A slave that goes quiet: its window closes on time, then its slot is freed
+    aggregator.begin(WINDOW_MS);
+    TimedSample timeout = sample(2, 0, 0, 0, BASE_TS + 1);
+    timeout.data.validMask = 0;
+    aggregator.add(at(sample(2, 21.0f, 55.0f, 1, BASE_TS), 0), &summary);
+    aggregator.add(at(timeout, 1000), &summary);
+    bool early = aggregator.expired(59999, &summary);
+    bool onTime = aggregator.expired(60000, &summary);
+    bool freed = !aggregator.expired(120000, &summary) && aggregator.openWindows() == 0;
+    if (early || !onTime || summary.samples != 1 || summary.missed != 1 || summary.slaveAddr != 2 || !freed)
+    {
+        printf("FAIL: quiet slave window (early %d, on time %d, freed %d)\n", early, onTime, freed);
+        failures++;
+    }
+
+    // A gap of several windows closes the last one, the grid skips the empty ones
+    aggregator.begin(WINDOW_MS);
+    aggregator.add(at(sample(3, 21.0f, 55.0f, 1, BASE_TS), 0), &summary);
+    if (aggregator.add(at(sample(3, 22.0f, 55.0f, 1, BASE_TS + 250), 250000), &summary) != AGGREGATE_CLOSED ||
+        summary.samples != 1 || aggregator.expired(299999, &summary) || !aggregator.expired(300000, &summary) ||
+        summary.fields[fieldIndex("tempPV")].last != 22.0f)
+    {
+        printf("FAIL: gap of several windows\n");
+        failures++;
+    }
+
+    // The MQTT loop stalls for two and a half minutes: the backlog of 1 Hz polls
+    // is drained at once, and still lands in the windows it was captured in
+    aggregator.begin(WINDOW_MS);
+    uint32_t stallWindows = 0;
+    bool stallOk = true;
+    for (uint32_t s = 0; s < 150; s++)
+    {
+        if (aggregator.add(at(sample(4, 20.0f + s, 55.0f, 1, BASE_TS + s), s * 1000), &summary) == AGGREGATE_CLOSED)
+        {
+            stallOk &= summary.samples == 60 && summary.fields[fieldIndex("tempPV")].min == 20.0f + stallWindows * 60;
+            stallWindows++;
+        }
+    }
+    stallOk &= !aggregator.expired(150000, &summary) && aggregator.expired(180000, &summary) && summary.samples == 30;
+    // One captured just before the window end, added after expired() closed it
+    TimedSample straggler = at(sample(4, 0, 55.0f, 1, BASE_TS + 179), 179999);
+    stallOk &= aggregator.add(straggler, &summary) == AGGREGATE_FOLDED && aggregator.stats().late == 1;
+    if (stallWindows != 2 || !stallOk)
+    {
+        printf("FAIL: backlog drained after a stall (%u windows closed)\n", stallWindows);
+        failures++;
+    }
+
+    // More slaves than windows: the extra one is left raw
+    aggregator.begin(WINDOW_MS);
+    for (uint8_t slave = 1; slave <= AGGREGATE_MAX_SLAVES; slave++)
+        aggregator.add(sample(slave, 21.0f, 55.0f, 1, 0), &summary);
+    if (aggregator.add(sample(AGGREGATE_MAX_SLAVES + 1, 21.0f, 55.0f, 1, 0), &summary) != AGGREGATE_NO_SLOT ||
+        aggregator.stats().noSlot != 1)
+    {
+        printf("FAIL: slave beyond AGGREGATE_MAX_SLAVES\n");
+        failures++;
+    }
+
+    // JSON summary; fields the slave did not return are left out
+    aggregator.begin(WINDOW_MS);
+    const float temps[] = {23.40f, 23.50f, 23.45f};
+    const uint16_t states[] = {3, 3, 5};
+    for (uint32_t i = 0; i < 3; i++)
+    {
+        TimedSample partial = sample(1, temps[i], 60.0f, states[i], BASE_TS + i);
+        partial.data.validMask = fieldBit("tempPV") | fieldBit("humiPV") | fieldBit("nowSTS");
+        aggregator.add(at(partial, i * 1000), &summary);
+    }
+    TimedSample missed = sample(1, 0, 0, 0, BASE_TS + 3);
+    missed.data.validMask = 0;
+    aggregator.add(at(missed, 3000), &summary);
+    aggregator.add(at(sample(1, 0, 0, 0, BASE_TS + 60), WINDOW_MS), &summary);
+    char json[SUMMARY_PAYLOAD_SIZE];
+    size_t jsonLength = writeSummaryJson(summary, "bench", json, sizeof(json));
+    const char *expected = "{\"client\":\"bench\",\"slave\":1,\"ts\":1700000000,\"windowMs\":60000,\"n\":3,\"missed\":1,"
+                           "\"tempPV\":{\"mean\":23.4500,\"sd\":0.0500,\"min\":23.40,\"max\":23.50},"
+                           "\"humiPV\":{\"mean\":60.0000,\"sd\":0.0000,\"min\":60.00,\"max\":60.00},\"nowSTS\":5}";
+    if (!jsonLength || strcmp(json, expected) != 0 || writeSummaryJson(summary, "bench", json, 64))
+    {
+        printf("FAIL: summary JSON %s\n", json);
+        failures++;
+    }
+    ChamberData means;
+    summaryMeans(summary, &means);
+    if (means.validMask != (fieldBit("tempPV") | fieldBit("humiPV") | fieldBit("nowSTS")) ||
+        fabsf(means.tempPV - 23.45f) > 1e-5f || means.nowSTS != 5)
+    {
+        printf("FAIL: journaled means\n");
+        failures++;
+    }
+
+    // What a minute at 1 Hz costs upstream, raw against one summary
+    aggregator.begin(WINDOW_MS);
+    SampleMeta meta = {"bench", -1, BASE_TS, false};
+    uint8_t packed[SUMMARY_PAYLOAD_SIZE];
+    size_t rawBytes = 0;
+    seed = 1;
+    for (uint32_t s = 0; s <= 60; s++)
+    {
+        TimedSample timed = sample(1, reading(&seed), 60.0f, 3, BASE_TS + s);
+        if (s < 60)
+            rawBytes += packSample(timed.data, meta, packed, sizeof(packed));
+        aggregator.add(at(timed, s * 1000), &summary);
+    }
+    size_t packedLength = packSummary(summary, meta, packed, sizeof(packed));
+    jsonLength = writeSummaryJson(summary, "bench", json, sizeof(json));
+    if (!packedLength || !jsonLength || packSummary(summary, meta, packed, 32))
+    {
+        printf("FAIL: summary encodings\n");
+        failures++;
+    }
+    printf("1 min at 1 Hz, MessagePack: %zu B raw, %zu B summary (%.0fx less); JSON summary %zu B\n",
+           rawBytes, packedLength, (double)rawBytes / packedLength, jsonLength);
+
+    // What the MQTT loop pays per sample to fold it in
+    aggregator.begin(3600000);
+    TimedSample timed = sample(1, 23.45f, 60.0f, 3, BASE_TS);
+    runBench("aggregate sample", sizeof(SampleSummary), 1000000, [&]()
+             {
+        timed.data.tempPV = reading(&seed);
+        timed.capturedMs = (timed.capturedMs + 1) & 0xFFFFF;
+        doNotOptimize(aggregator.add(timed, &summary)); });
+    runBench("summary JSON", jsonLength, 100000, [&]()
+             { doNotOptimize(writeSummaryJson(summary, "bench", json, sizeof(json))); });
+    return failures;
+}
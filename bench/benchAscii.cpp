@@ -0,0 +1,127 @@
+// Modbus ASCII codec: correctness, throughput and wire time against RTU
+#include <Arduino.h>
+#include "modbusHelper.h"
+#include "modbusAscii.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const uint32_t BAUD = 115200;
+static const uint16_t REG_QUANTITIES[] = {1, 10, 32, 64, 125};
+
+// Both 8N1 and 7E1 put 10 bits on the wire per character
+static double wireMicros(size_t characters)
+{
+    return characters * 10 * 1e6 / BAUD;
+}
+
+// Read response message: address, function, byte count, data (no checksum)
+static size_t buildReadResponse(uint8_t *message, uint16_t regQuantity)
+{
+    size_t length = 3 + regQuantity * 2;
+    message[0] = 0x01;
+    message[1] = 0x03;
+    message[2] = (uint8_t)(regQuantity * 2);
+    for (size_t i = 3; i < length; i++)
+    {
+        message[i] = (uint8_t)(i * 37);
+    }
+    return length;
+}
+
+static ModbusAsciiDecoder::Status feedAll(ModbusAsciiDecoder &decoder, const char *chars, size_t length)
+{
+    ModbusAsciiDecoder::Status status = ModbusAsciiDecoder::IN_PROGRESS;
+    for (size_t i = 0; i < length; i++)
+    {
+        status = decoder.feed(chars[i]);
+        if (status == ModbusAsciiDecoder::COMPLETE)
+            break;
+    }
+    return status;
+}
+
+int benchAscii()
+{
+    int failures = 0;
+    uint8_t message[256];
+    char frame[MODBUS_ASCII_MAX_FRAME];
+    uint8_t decoded[260];
+    ModbusAsciiDecoder decoder;
+
+    printf("\n== Modbus ASCII codec ==\n");
+
+    // Known request: slave 1, read 10 holding registers from 0
+    const uint8_t request[] = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+    size_t length = encodeModbusAsciiFrame(request, sizeof(request), frame, sizeof(frame));
+    if (length != 17 || memcmp(frame, ":01030000000AF2\r\n", 17) != 0)
+    {
+        printf("FAIL: ASCII request encoding\n");
+        failures++;
+    }
+
+    // Noise before the start character is ignored, lower-case hex is accepted
+    const char noisy[] = "\x7f\x00junk:01030000000af2\r\n";
+    decoder.reset(decoded, sizeof(decoded));
+    if (feedAll(decoder, noisy, sizeof(noisy) - 1) != ModbusAsciiDecoder::COMPLETE ||
+        decoder.length() != sizeof(request) || memcmp(decoded, request, sizeof(request)) != 0)
+    {
+        printf("FAIL: ASCII decode after noise\n");
+        failures++;
+    }
+
+    // A corrupted LRC is rejected
+    const char badLrc[] = ":01030000000AF3\r\n";
+    decoder.reset(decoded, sizeof(decoded));
+    if (feedAll(decoder, badLrc, sizeof(badLrc) - 1) != ModbusAsciiDecoder::FRAME_ERROR || !decoder.lrcFailed())
+    {
+        printf("FAIL: ASCII LRC error not detected\n");
+        failures++;
+    }
+
+    printf("Wire time per read transaction at %u baud:\n", BAUD);
+    printf("%-8s %10s %10s %12s %12s %7s\n", "regs", "RTU B", "ASCII ch", "RTU us", "ASCII us", "ratio");
+    for (uint16_t regQuantity : REG_QUANTITIES)
+    {
+        size_t messageLength = buildReadResponse(message, regQuantity);
+        size_t frameLength = encodeModbusAsciiFrame(message, messageLength, frame, sizeof(frame));
+
+        decoder.reset(decoded, sizeof(decoded));
+        if (feedAll(decoder, frame, frameLength) != ModbusAsciiDecoder::COMPLETE ||
+            decoder.length() != messageLength || memcmp(decoded, message, messageLength) != 0)
+        {
+            printf("FAIL: ASCII round trip for %u registers\n", regQuantity);
+            failures++;
+        }
+
+        // One transaction: request + response, RTU also waits 3.5 characters after each frame
+        size_t rtuBytes = 8 + messageLength + 2;
+        size_t asciiChars = 17 + frameLength;
+        double rtuUs = wireMicros(rtuBytes) + 2 * modbusSilenceMicros(BAUD);
+        double asciiUs = wireMicros(asciiChars);
+        printf("%-8u %10zu %10zu %12.0f %12.0f %6.2fx\n", regQuantity, rtuBytes, asciiChars, rtuUs, asciiUs, asciiUs / rtuUs);
+    }
+
+    for (uint16_t regQuantity : REG_QUANTITIES)
+    {
+        size_t messageLength = buildReadResponse(message, regQuantity);
+        size_t frameLength = encodeModbusAsciiFrame(message, messageLength, frame, sizeof(frame));
+
+        char name[32];
+        snprintf(name, sizeof(name), "ascii encode %u regs", regQuantity);
+        runBench(name, frameLength, ITERATIONS, [&]()
+                 {
+                     size_t n = encodeModbusAsciiFrame(message, messageLength, frame, sizeof(frame));
+                     doNotOptimize(n);
+                 });
+
+        snprintf(name, sizeof(name), "ascii decode %u regs", regQuantity);
+        runBench(name, frameLength, ITERATIONS, [&]()
+                 {
+                     decoder.reset(decoded, sizeof(decoded));
+                     ModbusAsciiDecoder::Status status = feedAll(decoder, frame, frameLength);
+                     doNotOptimize(status);
+                 });
+    }
+
+    return failures;
+}
@@ -0,0 +1,382 @@
+// Backend HTTP client against a stand-in server on a loopback socket:
+// keep-alive reuse, chunked and ranged bodies, idle-close retry (and none for a
+// slow answer or a POST), boot round trips
+#include <Arduino.h>
+#include <Client.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "backendClient.h"
+#include "benchHarness.h"
+
+static const uint32_t IMAGE_SIZE = 65536;
+static const uint32_t ROUND_TRIPS = 200;
+
+// Client over a POSIX socket, the host counterpart of WiFiClient
+class SocketClient : public Client
+{
+public:
+    int connect(const char *host, uint16_t port) override
+    {
+        stop();
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        inet_pton(AF_INET, host, &addr.sin_addr);
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd, (sockaddr *)&addr, sizeof(addr)) < 0)
+        {
+            stop();
+            return 0;
+        }
+        return 1;
+    }
+    size_t write(const uint8_t *buf, size_t size) override
+    {
+        ssize_t sent = fd < 0 ? -1 : send(fd, buf, size, MSG_NOSIGNAL);
+        return sent < 0 ? 0 : (size_t)sent;
+    }
+    // Waits up to 1 ms for data, so the caller's 1 ms poll does not dominate a loopback round trip
+    int available() override
+    {
+        int count = 0;
+        pollfd waitFor = {fd, POLLIN, 0};
+        if (fd < 0 || poll(&waitFor, 1, 1) < 0 || ioctl(fd, FIONREAD, &count) < 0)
+            return 0;
+        return count;
+    }
+    int read(uint8_t *buf, size_t size) override
+    {
+        return fd < 0 ? -1 : (int)recv(fd, buf, size, MSG_DONTWAIT);
+    }
+    uint8_t connected() override
+    {
+        char c;
+        return fd >= 0 && recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 0;
+    }
+    void stop() override
+    {
+        if (fd >= 0)
+            close(fd);
+        fd = -1;
+    }
+
+private:
+    int fd = -1;
+};
+
+// Stand-in for APPAPI: the endpoints the device calls, one connection at a time
+class StandInServer
+{
+public:
+    std::atomic<uint32_t> connections{0};
+    std::atomic<uint32_t> requests{0};
+    std::atomic<bool> dropNext{false}; // Close the connection on the next request without answering, as an idle timeout racing it would
+    std::atomic<uint32_t> delayNextMs{0}; // Answer the next request this late, as a slow backend would
+    std::atomic<uint32_t> dataPosts{0};
+    bool hasRegister = true;
+    std::vector<uint8_t> image;
+    std::string host; // Expected Host header
+
+    uint16_t start()
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listenFd, (sockaddr *)&addr, sizeof(addr));
+        listen(listenFd, 4);
+        socklen_t length = sizeof(addr);
+        getsockname(listenFd, (sockaddr *)&addr, &length);
+        host = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port)); // Not a default port, so it is in the header
+        worker = std::thread([this]()
+                             { serve(); });
+        return ntohs(addr.sin_port);
+    }
+
+    void stop()
+    {
+        shutdown(listenFd, SHUT_RDWR);
+        worker.join();
+        close(listenFd);
+    }
+
+private:
+    int listenFd = -1;
+    std::thread worker;
+
+    void serve()
+    {
+        int fd;
+        while ((fd = accept(listenFd, nullptr, nullptr)) >= 0)
+        {
+            connections++;
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            std::string pending;
+            while (handle(fd, pending))
+                requests++;
+            close(fd);
+        }
+    }
+
+    // Content-Length is added unless the head frames the body itself
+    static bool reply(int fd, std::string head, const std::string &body)
+    {
+        if (head.find("chunked") == std::string::npos && head.find(" 304 ") == std::string::npos)
+            head += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        std::string response = head + "\r\n" + body;
+        return send(fd, response.data(), response.size(), MSG_NOSIGNAL) == (ssize_t)response.size();
+    }
+
+    // One request on the connection; false when the client closed it or asked to close
+    bool handle(int fd, std::string &pending)
+    {
+        size_t end;
+        char buffer[4096];
+        while ((end = pending.find("\r\n\r\n")) == std::string::npos)
+        {
+            ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+            if (count <= 0)
+                return false;
+            pending.append(buffer, count);
+        }
+        std::string head = pending.substr(0, end + 2);
+        size_t bodyLength = 0;
+        size_t lengthAt = head.find("Content-Length: ");
+        if (lengthAt != std::string::npos)
+            bodyLength = strtoul(head.c_str() + lengthAt + 16, nullptr, 10);
+        while (pending.size() < end + 4 + bodyLength)
+        {
+            ssize_t count = recv(fd, buffer, sizeof(buffer), 0);
+            if (count <= 0)
+                return false;
+            pending.append(buffer, count);
+        }
+        pending.erase(0, end + 4 + bodyLength);
+        if (dropNext.exchange(false))
+            return false;
+        if (uint32_t delayMs = delayNextMs.exchange(0))
+            std::this_thread::sleep_for(std::chrono::milliseconds(delayMs));
+
+        auto has = [&](const char *text)
+        { return head.find(text) != std::string::npos; };
+        if (head.find("X-Secret-Key: key\r\n") == std::string::npos)
+            return reply(fd, "HTTP/1.1 401 Unauthorized\r\n", "");
+        if (!has(("\r\nHost: " + host + "\r\n").c_str()))
+            return reply(fd, "HTTP/1.1 400 Bad Request\r\n", "");
+        if (has("POST /api/register?u_id=dev1 "))
+            return hasRegister ? reply(fd, "HTTP/1.1 201 Created\r\n", "{}")
+                               : reply(fd, "HTTP/1.1 404 Not Found\r\n", "not found");
+        if (has("GET /api/checkexist?u_id=dev1 "))
+            return reply(fd, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n", "{\"firm_ver\":\"0.9.0\"}");
+        if (has("POST /api/data?u_id=dev1 "))
+            dataPosts++;
+        if (has("PUT /api/firmware?u_id=dev1 ") || has("POST /api/data?u_id=dev1 "))
+            return reply(fd, "HTTP/1.1 200 OK\r\n", "ok");
+        if (has("&update=N "))
+        {
+            if (has("If-None-Match: \"v2\"\r\n"))
+                return reply(fd, "HTTP/1.1 304 Not Modified\r\nETag: \"v2\"\r\n", "");
+            return reply(fd, "HTTP/1.1 200 OK\r\nETag: \"v2\"\r\nTransfer-Encoding: chunked\r\n",
+                         "7\r\n{\"hasne\r\ne\r\nwversion\":\"N\"}\r\n0\r\n\r\n");
+        }
+        if (has("&update=Y "))
+        {
+            size_t from = 0;
+            size_t rangeAt = head.find("Range: bytes=");
+            if (rangeAt != std::string::npos)
+                from = strtoul(head.c_str() + rangeAt + 13, nullptr, 10);
+            std::string status = from ? "HTTP/1.1 206 Partial Content\r\nContent-Range: bytes " + std::to_string(from) + "-" +
+                                            std::to_string(image.size() - 1) + "/" + std::to_string(image.size()) + "\r\n"
+                                      : std::string("HTTP/1.1 200 OK\r\n");
+            return reply(fd, status, std::string(image.begin() + from, image.end()));
+        }
+        if (has("GET /api/close "))
+        {
+            reply(fd, "HTTP/1.1 200 OK\r\nConnection: close\r\n", "bye");
+            return false;
+        }
+        return reply(fd, "HTTP/1.1 404 Not Found\r\n", "");
+    }
+};
+
+// Boot registration as the device does it: the combined call, or the three-call fallback
+static int registerDevice(BackendClient &client)
+{
+    int calls = 1;
+    int status = client.request("POST", "/register?u_id=dev1", "{\"u_id\":\"dev1\",\"device_type\":\"t\",\"firm_ver\":\"1.0\"}");
+    client.body();
+    client.end();
+    if (status == 404)
+    {
+        calls++;
+        client.request("GET", "/checkexist?u_id=dev1");
+        bool stale = strstr(client.body(), "\"0.9.0\"") != nullptr;
+        client.end();
+        if (stale)
+        {
+            calls++;
+            client.request("PUT", "/firmware?u_id=dev1", "{\"firm_ver\":\"1.0\"}");
+            client.body();
+            client.end();
+        }
+    }
+    return calls;
+}
+
+int benchBackend()
+{
+    int failures = 0;
+    StandInServer server;
+    server.image.resize(IMAGE_SIZE);
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++)
+        server.image[i] = (uint8_t)(i * 7 + (i >> 8));
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/api", server.start());
+
+    printf("\n== Backend client ==\n");
+
+    SocketClient socket;
+    BackendClient client;
+    if (!client.begin(socket, url, "key"))
+    {
+        printf("FAIL: base URL not parsed\n");
+        server.stop();
+        return 1;
+    }
+
+    // Boot: one round trip with /register, three without, all on one connection
+    int combined = registerDevice(client);
+    server.hasRegister = false;
+    int fallback = registerDevice(client);
+    if (combined != 1 || fallback != 3 || client.stats().connects != 1 || server.connections != 1)
+    {
+        printf("FAIL: registration took %d / %d calls over %u connections\n", combined, fallback, client.stats().connects);
+        failures++;
+    }
+
+    // Update check: chunked body with an ETag, then a 304 without a body on the same connection
+    static const char *const etagHeader[] = {"ETag"};
+    client.collectHeaders(etagHeader, 1);
+    int status = client.request("GET", "/firmware?filePrefix=x&update=N");
+    std::string check = client.body();
+    std::string etag = client.header("ETag");
+    client.end();
+    status = status == 200 ? client.request("GET", "/firmware?filePrefix=x&update=N", nullptr, "If-None-Match: \"v2\"\r\n") : status;
+    if (check != "{\"hasnewversion\":\"N\"}" || etag != "\"v2\"" || status != 304 || !client.bodyComplete() ||
+        (client.end(), client.stats().connects != 1))
+    {
+        printf("FAIL: chunked body / conditional request (%d, %s)\n", status, check.c_str());
+        failures++;
+    }
+
+    // Server closes the kept-alive connection as a request arrives: it is resent on a new one
+    server.dropNext = true;
+    uint32_t retries = client.stats().retries;
+    status = client.request("GET", "/checkexist?u_id=dev1");
+    client.body();
+    client.end();
+    if (status != 200 || client.stats().retries != retries + 1)
+    {
+        printf("FAIL: no retry after an idle close (%d)\n", status);
+        failures++;
+    }
+
+    // The same close under a POST: the server may have acted on it, so it is not resent
+    server.dropNext = true;
+    retries = client.stats().retries;
+    status = client.request("POST", "/data?u_id=dev1", "{}");
+    client.end();
+    if (status != -1 || client.stats().retries != retries)
+    {
+        printf("FAIL: POST resent after the connection closed (%d)\n", status);
+        failures++;
+    }
+
+    // A server slower than BACKEND_TIMEOUT got the request: it is not resent, even as a GET
+    retries = client.stats().retries;
+    client.request("GET", "/checkexist?u_id=dev1");
+    client.body();
+    client.end();
+    server.delayNextMs = BACKEND_TIMEOUT + 500;
+    status = client.request("GET", "/checkexist?u_id=dev1");
+    client.end();
+    uint32_t dataPosts = server.dataPosts;
+    int after = client.request("POST", "/data?u_id=dev1", "{}"); // Waits for the server to finish the slow one
+    client.body();
+    client.end();
+    if (status != -1 || client.stats().retries != retries || after != 200 || server.dataPosts != dataPosts + 1)
+    {
+        printf("FAIL: slow answer (%d), %u retries\n", status, client.stats().retries - retries);
+        failures++;
+    }
+
+    // Connection: close is honoured
+    uint32_t connects = client.stats().connects;
+    client.request("GET", "/close");
+    client.body();
+    client.end();
+    client.request("GET", "/checkexist?u_id=dev1");
+    client.body();
+    client.end();
+    if (client.stats().connects != connects + 1)
+    {
+        printf("FAIL: Connection: close not honoured\n");
+        failures++;
+    }
+
+    // Firmware body streamed from an offset, as an OTA resume does
+    static const char *const rangeHeader[] = {"Content-Range"};
+    client.collectHeaders(rangeHeader, 1);
+    status = client.request("GET", "/firmware?filePrefix=x&update=Y", nullptr, "Range: bytes=1000-\r\n");
+    std::vector<uint8_t> body;
+    uint8_t buffer[4096];
+    int count;
+    while ((count = client.readBody(buffer, sizeof(buffer))) >= 0)
+        body.insert(body.end(), buffer, buffer + count);
+    if (status != 206 || strncmp(client.header("Content-Range"), "bytes 1000-", 11) != 0 || !client.bodyComplete() ||
+        body != std::vector<uint8_t>(server.image.begin() + 1000, server.image.end()))
+    {
+        printf("FAIL: ranged body (%d, %zu bytes)\n", status, body.size());
+        failures++;
+    }
+    client.end();
+
+    // Cost of a small request on the kept-alive connection, and with a new connection each time
+    connects = client.stats().connects;
+    double reusedNs = runBench("request, keep-alive", 0, ROUND_TRIPS, [&]()
+                               {
+        client.request("GET", "/checkexist?u_id=dev1");
+        doNotOptimize(client.body());
+        client.end(); });
+    uint32_t reusedConnects = client.stats().connects - connects;
+    double freshNs = runBench("request, new connection", 0, ROUND_TRIPS, [&]()
+                              {
+        client.request("GET", "/checkexist?u_id=dev1");
+        doNotOptimize(client.body());
+        client.end();
+        socket.stop(); });
+    printf("keep-alive: %u requests over %u new connections; a handshake per request adds %.0f us on loopback\n",
+           ROUND_TRIPS + ROUND_TRIPS / 10 + 1, reusedConnects, (freshNs - reusedNs) / 1000.0);
+    if (reusedConnects != 0)
+    {
+        printf("FAIL: kept-alive requests reconnected\n");
+        failures++;
+    }
+
+    socket.stop();
+    server.stop();
+    return failures;
+}
@@ -0,0 +1,144 @@
+// Batching publisher: framing, flush policy and per-message overhead saved
+#include <Arduino.h>
+#include "sampleBatch.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const size_t TOPIC_LENGTH = 12; // "/ESPChamber" + "/mp"
+static const size_t TCP_IP_OVERHEAD = 40;
+
+// MQTT PUBLISH (QoS 0) overhead on top of the payload: fixed header, topic, TCP/IP headers
+static size_t publishOverhead(size_t payloadLength)
+{
+    size_t remaining = 2 + TOPIC_LENGTH + payloadLength;
+    size_t lengthBytes = remaining < 128 ? 1 : remaining < 16384 ? 2 : 3;
+    return 1 + lengthBytes + 2 + TOPIC_LENGTH + TCP_IP_OVERHEAD;
+}
+
+static bool sameMessage(SampleBatch &batch, const char *expected, size_t expectedLength)
+{
+    size_t length;
+    const uint8_t *message = batch.message(&length);
+    return length == expectedLength && memcmp(message, expected, length) == 0;
+}
+
+// Wire bytes for `samples` samples of `sampleBytes` each, sent `perMessage` to a message
+static void reportOverhead(size_t sampleBytes, uint16_t perMessage, uint32_t samples)
+{
+    SampleBatch batch;
+    batch.begin({perMessage, 60000, SAMPLE_BATCH_CAPACITY}, BATCH_MSGPACK_ARRAY);
+    uint8_t sample[256];
+    memset(sample, 0x80, sampleBytes);
+    size_t wire = 0;
+    size_t length;
+    for (uint32_t i = 0; i < samples; i++)
+    {
+        if (!batch.add(sample, sampleBytes, i))
+        {
+            batch.message(&length);
+            wire += length + publishOverhead(length);
+            batch.sent(FLUSH_BYTES);
+            batch.add(sample, sampleBytes, i);
+        }
+        if (batch.full() || i == samples - 1)
+        {
+            batch.message(&length);
+            wire += length + publishOverhead(length);
+            batch.sent(FLUSH_COUNT);
+        }
+    }
+    printf("%3zu B samples, %2u per message: %4u messages, %7zu B on the wire (%.1f B/sample)\n",
+           sampleBytes, perMessage, batch.stats().messages, wire, (double)wire / samples);
+}
+
+int benchBatch()
+{
+    int failures = 0;
+    SampleBatch batch;
+    const uint8_t a[] = {'{', '}'};
+    const uint8_t b[] = {'{', '"', 'x', '"', ':', '1', '}'};
+
+    printf("\n== Sample batching ==\n");
+
+    // One sample per message goes out unwrapped
+    batch.begin({1, 1000, 64}, BATCH_JSON_ARRAY);
+    if (!batch.add(b, sizeof(b), 0) || !batch.full() || !sameMessage(batch, "{\"x\":1}", 7) ||
+        batch.add(a, sizeof(a), 0))
+    {
+        printf("FAIL: unbatched sample\n");
+        failures++;
+    }
+
+    // JSON array, flushed on count
+    batch.begin({3, 1000, 64}, BATCH_JSON_ARRAY);
+    batch.add(a, sizeof(a), 0);
+    batch.add(b, sizeof(b), 10);
+    if (batch.full() || !batch.add(a, sizeof(a), 20) || !batch.full() ||
+        !sameMessage(batch, "[{},{\"x\":1},{}]", 15))
+    {
+        printf("FAIL: JSON batch\n");
+        failures++;
+    }
+    batch.sent(FLUSH_COUNT);
+
+    // Age is measured from the oldest sample
+    batch.add(a, sizeof(a), 100);
+    batch.add(a, sizeof(a), 900);
+    if (batch.expired(1099) || !batch.expired(1100))
+    {
+        printf("FAIL: max age\n");
+        failures++;
+    }
+    batch.sent(FLUSH_AGE);
+
+    // maxBytes counts the framing: 2 + 2 + 1 + 2 = 7 fits, a third sample would make 10
+    batch.begin({10, 1000, 9}, BATCH_JSON_ARRAY);
+    if (!batch.add(a, sizeof(a), 0) || !batch.add(a, sizeof(a), 0) || batch.add(a, sizeof(a), 0) ||
+        !sameMessage(batch, "[{},{}]", 7))
+    {
+        printf("FAIL: JSON max bytes\n");
+        failures++;
+    }
+
+    // MessagePack: fixarray up to 15 samples, array16 beyond
+    uint8_t one = 0x01;
+    batch.begin({20, 1000, 64}, BATCH_MSGPACK_ARRAY);
+    for (int i = 0; i < 15; i++)
+        batch.add(&one, 1, 0);
+    size_t length;
+    const uint8_t *message = batch.message(&length);
+    bool fixarray = length == 16 && message[0] == 0x9F && message[15] == 0x01;
+    batch.add(&one, 1, 0);
+    message = batch.message(&length);
+    if (!fixarray || length != 19 || message[0] != 0xDC || message[1] != 0 || message[2] != 16)
+    {
+        printf("FAIL: MessagePack array header\n");
+        failures++;
+    }
+    batch.sent(FLUSH_COUNT);
+    if (batch.stats().messages != 1 || batch.stats().samples != 16 || batch.stats().maxSamplesPerMessage != 16)
+    {
+        printf("FAIL: batch counters\n");
+        failures++;
+    }
+
+    uint8_t sample[40];
+    memset(sample, 0x80, sizeof(sample));
+    batch.begin({20, 1000, SAMPLE_BATCH_CAPACITY}, BATCH_MSGPACK_ARRAY);
+    runBench("batch 20 x 40 B", 20 * sizeof(sample), ITERATIONS / 20, [&]()
+             {
+        for (int i = 0; i < 20; i++)
+            batch.add(sample, sizeof(sample), 0);
+        size_t length;
+        doNotOptimize(batch.message(&length));
+        batch.clear(); });
+
+    printf("Wire bytes for 600 samples, %zu B of TCP/IP headers per message:\n", TCP_IP_OVERHEAD);
+    const uint16_t perMessage[] = {1, 5, 20};
+    for (uint16_t samples : perMessage)
+    {
+        reportOverhead(40, samples, 600);
+        reportOverhead(135, samples, 600);
+    }
+    return failures;
+}
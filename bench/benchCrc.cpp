@@ -0,0 +1,79 @@
+// Cross-check and throughput of the CRC-16/Modbus engines in crc16.cpp
+#include <Arduino.h>
+#include <stdlib.h>
+#include "crc16.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const size_t FRAME_SIZES[] = {8, 25, 69, 133, 255};
+
+typedef uint16_t (*Crc16Fn)(const uint8_t *, size_t, uint16_t);
+
+struct Crc16Engine
+{
+    const char *name;
+    Crc16Fn fn;
+};
+
+static const Crc16Engine ENGINES[] = {
+    {"bitwise", crc16Bitwise},
+    {"table", crc16Table},
+    {"slice4", crc16Slice4},
+};
+
+int benchCrc()
+{
+    int failures = 0;
+    uint8_t buffer[300];
+
+    printf("\n== CRC-16/Modbus engines (calculateCRC uses CRC16_IMPL=%d) ==\n", CRC16_IMPL);
+
+    // Standard check value for "123456789"
+    const uint8_t checkInput[] = {'1', '2', '3', '4', '5', '6', '7', '8', '9'};
+    for (const Crc16Engine &engine : ENGINES)
+    {
+        if (engine.fn(checkInput, sizeof(checkInput), 0xFFFF) != 0x4B37)
+        {
+            printf("FAIL: %s check value\n", engine.name);
+            failures++;
+        }
+    }
+
+    // Every length and start offset against the bitwise reference (the original calculateCRC)
+    srand(1500);
+    for (size_t i = 0; i < sizeof(buffer); i++)
+    {
+        buffer[i] = (uint8_t)rand();
+    }
+    for (size_t offset = 0; offset < 4; offset++)
+    {
+        for (size_t length = 0; length + offset <= sizeof(buffer); length++)
+        {
+            uint16_t expected = crc16Bitwise(buffer + offset, length);
+            for (const Crc16Engine &engine : ENGINES)
+            {
+                if (engine.fn(buffer + offset, length, 0xFFFF) != expected)
+                {
+                    printf("FAIL: %s differs from bitwise at offset %zu length %zu\n", engine.name, offset, length);
+                    failures++;
+                }
+            }
+        }
+    }
+
+    for (size_t frameSize : FRAME_SIZES)
+    {
+        for (const Crc16Engine &engine : ENGINES)
+        {
+            char name[32];
+            snprintf(name, sizeof(name), "crc16 %s", engine.name);
+            runBench(name, frameSize, ITERATIONS, [&]()
+                     {
+                         uint16_t crc = engine.fn(buffer, frameSize, 0xFFFF);
+                         doNotOptimize(crc);
+                     });
+        }
+    }
+
+    return failures;
+}
@@ -0,0 +1,112 @@
+// Report-by-exception filter: deadbands, heartbeat and fields saved on a slow-moving chamber
+#include <Arduino.h>
+#include "exceptionReporter.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const uint32_t HEARTBEAT_MS = 60000;
+
+static ChamberData chamber(uint8_t slaveAddr, float tempPV, float humiPV, uint16_t nowSTS)
+{
+    ChamberData data;
+    memset(&data, 0, sizeof(data));
+    data.slaveAddr = slaveAddr;
+    data.tempPV = tempPV;
+    data.tempSP = 25.0f;
+    data.wetPV = 20.0f;
+    data.wetSP = 20.0f;
+    data.humiPV = humiPV;
+    data.humiSP = 60.0f;
+    data.nowSTS = nowSTS;
+    data.validMask = CHAMBER_REGISTER_ALL;
+    return data;
+}
+
+static uint32_t fieldBit(const char *key)
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (strcmp(CHAMBER_REGISTER_MAP[i].key, key) == 0)
+            return 1UL << i;
+    }
+    return 0;
+}
+
+int benchException()
+{
+    int failures = 0;
+    ExceptionReporter reporter;
+    reporter.begin(HEARTBEAT_MS);
+
+    printf("\n== Report by exception ==\n");
+
+    // First sample of a slave goes out in full
+    ChamberData data = chamber(1, 25.00f, 60.0f, 3);
+    if (!reporter.filter(data, 0) || data.validMask != CHAMBER_REGISTER_ALL)
+    {
+        printf("FAIL: first sample\n");
+        failures++;
+    }
+
+    // Within every deadband: nothing to publish
+    data = chamber(1, 25.05f, 60.5f, 3);
+    if (reporter.filter(data, 1000) || data.validMask != 0)
+    {
+        printf("FAIL: within deadband\n");
+        failures++;
+    }
+
+    // Drift is measured from the last published value: 25.00 -> 25.11 crosses 0.1
+    data = chamber(1, 25.11f, 60.5f, 3);
+    if (!reporter.filter(data, 2000) || data.validMask != fieldBit("tempPV"))
+    {
+        printf("FAIL: absolute deadband drift\n");
+        failures++;
+    }
+
+    // Percent deadband (1% of 60 = 0.6) and any change of the status word
+    data = chamber(1, 25.11f, 60.7f, 4);
+    if (!reporter.filter(data, 3000) || data.validMask != (fieldBit("humiPV") | fieldBit("nowSTS")))
+    {
+        printf("FAIL: percent deadband / status\n");
+        failures++;
+    }
+
+    // Slaves are tracked separately
+    data = chamber(2, 25.11f, 60.7f, 4);
+    if (!reporter.filter(data, 3000) || data.validMask != CHAMBER_REGISTER_ALL)
+    {
+        printf("FAIL: second slave\n");
+        failures++;
+    }
+
+    // Heartbeat: a full snapshot even though nothing changed
+    data = chamber(1, 25.11f, 60.7f, 4);
+    if (!reporter.filter(data, HEARTBEAT_MS) || data.validMask != CHAMBER_REGISTER_ALL)
+    {
+        printf("FAIL: heartbeat snapshot\n");
+        failures++;
+    }
+
+    // One hour at 1 Hz: temperature wanders by +-0.04, humidity steps every 5 minutes
+    reporter.begin(HEARTBEAT_MS);
+    uint32_t published = 0;
+    for (uint32_t second = 0; second < 3600; second++)
+    {
+        float wobble = (float)((int)(second % 9) - 4) / 100.0f;
+        data = chamber(1, 25.0f + wobble, 60.0f + (float)((second + 150) / 300), 3);
+        if (reporter.filter(data, second * 1000))
+            published++;
+    }
+    const ExceptionStats &stats = reporter.stats();
+    printf("1 h at 1 Hz: %u of 3600 samples published, %u fields sent, %u suppressed (%u snapshots)\n",
+           published, stats.fieldsSent, stats.fieldsSuppressed, stats.snapshots);
+
+    ChamberData steady = chamber(1, 25.0f, 60.0f, 3);
+    runBench("filter, no change", sizeof(ChamberData), ITERATIONS, [&]()
+             {
+        data = steady;
+        doNotOptimize(reporter.filter(data, 1000)); });
+    return failures;
+}
@@ -0,0 +1,39 @@
+#ifndef BENCH_HARNESS_H
+#define BENCH_HARNESS_H
+
+#include <chrono>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Keep the compiler from optimising away the value under test
+template <typename T>
+inline void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Run fn() `iterations` times and print ns/frame and frames/second
+template <typename Fn>
+double runBench(const char *name, size_t frameBytes, uint32_t iterations, Fn fn)
+{
+    // Warm up caches and branch predictors before timing
+    for (uint32_t i = 0; i < iterations / 10 + 1; i++)
+    {
+        fn();
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+    {
+        fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    double totalNs = std::chrono::duration<double, std::nano>(end - start).count();
+    double nsPerFrame = totalNs / iterations;
+    printf("%-28s %5zu B %10.1f ns/frame %12.0f frames/s\n", name, frameBytes, nsPerFrame, 1e9 / nsPerFrame);
+    return nsPerFrame;
+}
+
+#endif
@@ -0,0 +1,491 @@
+// Streaming inflate: zlib vectors fed byte by byte, corrupt and fuzzed streams, and a
+// round trip of firmware-sized binaries
+#include <Arduino.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include <string>
+#include "inflateStream.h"
+#include "otaPipeline.h"
+#include "benchHarness.h"
+#if __has_include(<zlib.h>)
+#include <zlib.h>
+#define HAVE_ZLIB 1
+#endif
+
+static const size_t SEGMENT = 1460; // One TCP segment per feed
+static const uint32_t FUZZ_STREAMS = 20000;
+static const size_t FUZZ_OUTPUT_LIMIT = 1 << 20; // A corrupt stream may expand, the sink refuses beyond this
+
+static bool collect(void *context, const uint8_t *data, size_t len)
+{
+    std::vector<uint8_t> *out = static_cast<std::vector<uint8_t> *>(context);
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+// Inflate `stream` in pieces of `chunk` bytes
+static InflateResult inflateAll(InflateStream &inflater, const std::vector<uint8_t> &stream, size_t chunk,
+                                std::vector<uint8_t> &out)
+{
+    inflater.begin();
+    out.clear();
+    InflateResult result = INFLATE_MORE;
+    for (size_t pos = 0; pos < stream.size() && result == INFLATE_MORE; pos += chunk)
+        result = inflater.feed(stream.data() + pos, std::min(chunk, stream.size() - pos), collect, &out);
+    return result;
+}
+
+static bool collectLimited(void *context, const uint8_t *data, size_t len)
+{
+    std::vector<uint8_t> *out = static_cast<std::vector<uint8_t> *>(context);
+    if (out->size() + len > FUZZ_OUTPUT_LIMIT)
+        return false;
+    out->insert(out->end(), data, data + len);
+    return true;
+}
+
+static bool refuse(void *, const uint8_t *, size_t)
+{
+    return false;
+}
+
+// Inflate `stream` in pieces of random size, 1 to `maxChunk` bytes
+static InflateResult inflateRandomChunks(InflateStream &inflater, const std::vector<uint8_t> &stream, size_t maxChunk,
+                                         uint32_t *seed, std::vector<uint8_t> &out)
+{
+    inflater.begin();
+    out.clear();
+    InflateResult result = INFLATE_MORE;
+    for (size_t pos = 0; pos < stream.size() && result == INFLATE_MORE;)
+    {
+        *seed = *seed * 1664525u + 1013904223u;
+        size_t chunk = std::min<size_t>(1 + (*seed >> 8) % maxChunk, stream.size() - pos);
+        result = inflater.feed(stream.data() + pos, chunk, collectLimited, &out);
+        pos += chunk;
+    }
+    return result;
+}
+
+// DEFLATE bit stream for hand-made corrupt vectors: fields least significant
+// bit first, Huffman codes most significant bit first (RFC 1951 3.1.1)
+struct BitWriter
+{
+    std::vector<uint8_t> bytes;
+    uint32_t pending = 0;
+    uint8_t pendingBits = 0;
+
+    explicit BitWriter(uint8_t windowBits)
+    {
+        uint8_t cmf = (uint8_t)(((windowBits - 8) << 4) | 8);
+        bytes = {cmf, (uint8_t)((31 - (cmf << 8) % 31) % 31)};
+    }
+    void bit(uint32_t value)
+    {
+        pending |= (value & 1) << pendingBits;
+        if (++pendingBits == 8)
+        {
+            bytes.push_back((uint8_t)pending);
+            pending = 0;
+            pendingBits = 0;
+        }
+    }
+    void field(uint32_t value, uint8_t count)
+    {
+        for (uint8_t i = 0; i < count; i++)
+            bit(value >> i);
+    }
+    void code(uint32_t value, uint8_t count)
+    {
+        while (count--)
+            bit(value >> count);
+    }
+    // Fixed-Huffman literal/length symbol (RFC 1951 3.2.6)
+    void fixedSymbol(uint16_t symbol)
+    {
+        if (symbol < 144)
+            code(0x30 + symbol, 8);
+        else if (symbol < 256)
+            code(0x190 + symbol - 144, 9);
+        else if (symbol < 280)
+            code(symbol - 256, 7);
+        else
+            code(0xC0 + symbol - 280, 8);
+    }
+    // Padded with zero bytes, so every vector fails on what it contains, not on running out of input
+    std::vector<uint8_t> finish()
+    {
+        if (pendingBits)
+            bytes.push_back((uint8_t)pending);
+        pending = 0;
+        pendingBits = 0;
+        bytes.insert(bytes.end(), 8, 0);
+        return bytes;
+    }
+};
+
+// Dynamic block header whose code length code gives length 1 to `first` and `second`
+// (in RFC order positions), HLIT = 257, HDIST = 1
+static BitWriter dynamicHeader(uint8_t first, uint8_t second)
+{
+    static const uint8_t ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    BitWriter writer(15);
+    writer.field(1, 1); // Last block
+    writer.field(2, 2); // Dynamic Huffman
+    writer.field(0, 5);
+    writer.field(0, 5);
+    uint8_t used = 0;
+    for (uint8_t i = 0; i < 19; i++)
+        used = ORDER[i] == first || ORDER[i] == second ? i + 1 : used;
+    used = used < 4 ? 4 : used;
+    writer.field(used - 4, 4);
+    for (uint8_t i = 0; i < used; i++)
+        writer.field(ORDER[i] == first || ORDER[i] == second ? 1 : 0, 3);
+    return writer;
+}
+
+// Every validation path of the decoder, each fed byte by byte and whole
+static int corruptVectors(InflateStream &inflater)
+{
+    struct Vector
+    {
+        const char *name;
+        std::vector<uint8_t> stream;
+    };
+    std::vector<Vector> vectors;
+
+    BitWriter writer(15);
+    writer.field(1, 1), writer.field(1, 2);
+    writer.fixedSymbol('a'), writer.fixedSymbol(257), writer.code(1, 5); // Length 3, distance 2
+    vectors.push_back({"match before the first byte", writer.finish()});
+
+    writer = BitWriter(8);
+    writer.field(1, 1), writer.field(1, 2);
+    for (int i = 0; i < 300; i++)
+        writer.fixedSymbol('a' + i % 26);
+    writer.fixedSymbol(257), writer.code(16, 5), writer.field(0, 7); // Distance 257 in a 256-byte window
+    vectors.push_back({"match beyond the window", writer.finish()});
+
+    writer = BitWriter(15);
+    writer.field(1, 1), writer.field(3, 2);
+    vectors.push_back({"block type 3", writer.finish()});
+
+    writer = BitWriter(15);
+    writer.field(1, 1), writer.field(0, 2), writer.field(0, 5); // Stored, aligned
+    writer.field(5, 16), writer.field(0x1234, 16);
+    vectors.push_back({"stored length check", writer.finish()});
+
+    writer = BitWriter(15);
+    writer.field(1, 1), writer.field(1, 2), writer.fixedSymbol(286);
+    vectors.push_back({"length symbol 286", writer.finish()});
+
+    writer = BitWriter(15);
+    writer.field(1, 1), writer.field(1, 2), writer.fixedSymbol('a'), writer.fixedSymbol(257), writer.code(30, 5);
+    vectors.push_back({"distance symbol 30", writer.finish()});
+
+    writer = BitWriter(15);
+    writer.field(1, 1), writer.field(2, 2), writer.field(0, 5), writer.field(0, 5), writer.field(15, 4);
+    for (int i = 0; i < 19; i++)
+        writer.field(1, 3);
+    vectors.push_back({"over-subscribed code length code", writer.finish()});
+
+    writer = dynamicHeader(0, 16);
+    writer.code(1, 1), writer.field(0, 2);
+    vectors.push_back({"repeat with no previous length", writer.finish()});
+
+    writer = dynamicHeader(1, 18);
+    writer.code(1, 1), writer.field(127, 7), writer.code(1, 1), writer.field(108, 7), writer.code(0, 1);
+    vectors.push_back({"no end-of-block code", writer.finish()});
+
+    writer = dynamicHeader(1, 18);
+    writer.code(1, 1), writer.field(127, 7), writer.code(1, 1), writer.field(127, 7);
+    vectors.push_back({"code lengths past HLIT + HDIST", writer.finish()});
+
+    writer = dynamicHeader(1, 18);
+    writer.code(1, 1), writer.field(127, 7), writer.code(1, 1), writer.field(107, 7); // 256 zeros
+    writer.code(0, 1), writer.code(0, 1);                                                // 256 and the one distance
+    writer.code(1, 1); // Only end of block (code 0) exists, code 1 is unassigned
+    vectors.push_back({"symbol outside an incomplete code", writer.finish()});
+
+    vectors.push_back({"preset dictionary", {0x78, 0xbb, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01}});
+    vectors.push_back({"header check", {0x78, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01}});
+    vectors.push_back({"not deflate", {0x79, 0xdb, 0x03, 0x00, 0x00, 0x00, 0x00, 0x01}});
+
+    int failures = 0;
+    std::vector<uint8_t> out;
+    for (const Vector &vector : vectors)
+    {
+        for (size_t chunk : {(size_t)1, vector.stream.size()})
+        {
+            if (inflateAll(inflater, vector.stream, chunk, out) != INFLATE_ERROR)
+            {
+                printf("FAIL: corrupt stream accepted: %s (chunk %zu)\n", vector.name, chunk);
+                failures++;
+                break;
+            }
+        }
+    }
+    printf("%zu corrupt-stream vectors rejected\n", vectors.size() - failures);
+    return failures;
+}
+
+static bool samePrefix(const std::vector<uint8_t> &a, const std::vector<uint8_t> &b)
+{
+    size_t length = std::min(a.size(), b.size());
+    return std::equal(a.begin(), a.begin() + length, b.begin());
+}
+
+// Mutated copies of valid streams (bit flips, random bytes, cuts, repeats). Fed
+// byte by byte, whole and in random chunks, a stream must give the same result
+// and the same bytes every time: a rolled-back step leaves nothing behind.
+// Run the bench with -fsanitize=address,undefined to catch what a check missed.
+static int fuzzStreams(InflateStream &inflater, const std::vector<std::vector<uint8_t>> &seeds)
+{
+    int failures = 0;
+    uint32_t seed = 2024;
+    uint32_t outcomes[3] = {};
+    std::vector<uint8_t> stream, whole, bytewise, chunked;
+    auto next = [&]()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    for (uint32_t n = 0; n < FUZZ_STREAMS; n++)
+    {
+        stream = seeds[next() % seeds.size()];
+        if (n % 8 == 0)
+        {
+            // Random body behind a valid header
+            stream.resize(2 + next() % 96);
+            for (size_t i = 2; i < stream.size(); i++)
+                stream[i] = (uint8_t)next();
+        }
+        for (uint32_t mutations = 1 + next() % 4; mutations--;)
+        {
+            size_t at = next() % stream.size();
+            switch (next() % 4)
+            {
+            case 0:
+                stream[at] ^= (uint8_t)(1 << (next() % 8));
+                break;
+            case 1:
+                stream[at] = (uint8_t)next();
+                break;
+            case 2:
+                stream.resize(std::max<size_t>(at, 1));
+                break;
+            default:
+                stream.insert(stream.begin() + at, stream.begin() + at / 2, stream.begin() + at);
+                break;
+            }
+        }
+        InflateResult result = inflateAll(inflater, stream, stream.size(), whole);
+        whole.swap(chunked);
+        InflateResult bytewiseResult = inflateAll(inflater, stream, 1, bytewise);
+        InflateResult chunkedResult = inflateRandomChunks(inflater, stream, 64, &seed, whole);
+        whole.swap(chunked);
+        // A rejected stream stops without flushing, so each feeding delivered a prefix of the same bytes
+        bool sameBytes = result == INFLATE_ERROR ? samePrefix(bytewise, whole) && samePrefix(chunked, whole)
+                                                 : bytewise == whole && chunked == whole;
+        if (bytewiseResult != result || chunkedResult != result || !sameBytes)
+        {
+            if (failures++ < 3)
+                printf("FAIL: fuzzed stream %u decodes differently by chunk size\n", n);
+        }
+        outcomes[result]++;
+    }
+    printf("%u fuzzed streams: %u rejected, %u incomplete, %u passed the Adler-32 check\n", FUZZ_STREAMS,
+           outcomes[INFLATE_ERROR], outcomes[INFLATE_MORE], outcomes[INFLATE_DONE]);
+    return failures ? 1 : 0;
+}
+
+static bool expectText(InflateStream &inflater, const std::vector<uint8_t> &stream, const char *text)
+{
+    std::vector<uint8_t> out;
+    for (size_t chunk : {(size_t)1, stream.size()})
+    {
+        if (inflateAll(inflater, stream, chunk, out) != INFLATE_DONE || out != std::vector<uint8_t>(text, text + strlen(text)))
+            return false;
+    }
+    return true;
+}
+
+#ifdef HAVE_ZLIB
+static std::vector<uint8_t> compress(const std::vector<uint8_t> &data, int windowBits)
+{
+    z_stream z = {};
+    deflateInit2(&z, 9, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+    std::vector<uint8_t> out(deflateBound(&z, data.size()));
+    z.next_in = const_cast<uint8_t *>(data.data());
+    z.avail_in = data.size();
+    z.next_out = out.data();
+    z.avail_out = out.size();
+    deflate(&z, Z_FINISH);
+    out.resize(z.total_out);
+    deflateEnd(&z);
+    return out;
+}
+
+static bool readFile(const char *path, std::vector<uint8_t> &data)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return false;
+    data.clear();
+    uint8_t buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+    fclose(file);
+    return !data.empty();
+}
+
+// Compressed download through the OTA pipeline, reader and writer on two threads
+static bool pipelineRoundTrip(const std::vector<uint8_t> &image, const std::vector<uint8_t> &compressed)
+{
+    static OtaPipeline pipeline;
+    InflateStream inflater;
+    std::vector<uint8_t> flash;
+    pipeline.begin(&inflater);
+    std::thread writer([&]()
+                       {
+        while (!pipeline.failed() && !pipeline.drained())
+        {
+            if (!pipeline.consume([&](const uint8_t *data, size_t len)
+                                  { flash.insert(flash.end(), data, data + len); return true; }))
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+        } });
+    for (size_t pos = 0; pos < compressed.size();)
+    {
+        uint8_t *buffer = pipeline.acquire();
+        if (!buffer)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            continue;
+        }
+        size_t count = std::min<size_t>(OTA_BUFFER_SIZE, compressed.size() - pos);
+        memcpy(buffer, compressed.data() + pos, count);
+        pipeline.submit(buffer, count);
+        pos += count;
+    }
+    pipeline.close();
+    writer.join();
+
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    Sha256 hash;
+    hash.begin();
+    hash.update(image.data(), image.size());
+    hash.finish(expected);
+    return !pipeline.failed() && pipeline.imageComplete() && flash == image && pipeline.verify(expected);
+}
+#endif
+
+int benchInflate()
+{
+    int failures = 0;
+    InflateStream inflater;
+    std::vector<uint8_t> out;
+
+    printf("\n== Streaming inflate ==\n");
+
+    // zlib.compress(..., 9) gives a fixed-Huffman block with matches, level 0 a stored block
+    const std::vector<uint8_t> fixed = {0x78, 0xda, 0xcb, 0x48, 0xcd, 0xc9, 0xc9, 0x57, 0xc8, 0x40, 0x27, 0x75, 0x14,
+                                        0xd2, 0x32, 0x8b, 0x72, 0xcb, 0x13, 0x8b, 0x52, 0x01, 0xd0, 0xe9, 0x0c, 0x5a};
+    const std::vector<uint8_t> stored = {0x78, 0x01, 0x01, 0x07, 0x00, 0xf8, 0xff, 0x73, 0x74,
+                                         0x6f, 0x72, 0x65, 0x64, 0x21, 0x0b, 0xef, 0x02, 0xb3};
+    if (!expectText(inflater, fixed, "hello hello hello hello, firmware") || !expectText(inflater, stored, "stored!"))
+    {
+        printf("FAIL: zlib vectors\n");
+        failures++;
+    }
+    // Compressed with wbits=9: a 512-byte window is all it needs
+    const std::vector<uint8_t> smallWindow = {0x18, 0xd3, 0x2b, 0xce, 0x4d, 0xcc, 0xc9, 0x51, 0x28, 0xcf, 0xcc, 0x4b, 0xc9,
+                                              0x2f, 0xd7, 0x51, 0x28, 0x46, 0xe2, 0x01, 0x00, 0x85, 0x82, 0x09, 0xef};
+    if (!expectText(inflater, smallWindow, "small window, small window") || inflater.windowSize() != 512)
+    {
+        printf("FAIL: window not sized from the header (%u)\n", inflater.windowSize());
+        failures++;
+    }
+
+    // Bad checksum, bad header, truncated stream
+    std::vector<uint8_t> corrupt = fixed;
+    corrupt.back() ^= 1;
+    std::vector<uint8_t> badHeader = fixed;
+    badHeader[0] = 0x88; // 64 KB window
+    std::vector<uint8_t> truncated(fixed.begin(), fixed.end() - 5);
+    if (inflateAll(inflater, corrupt, 4, out) != INFLATE_ERROR || inflateAll(inflater, badHeader, 4, out) != INFLATE_ERROR ||
+        inflateAll(inflater, truncated, 4, out) != INFLATE_MORE)
+    {
+        printf("FAIL: corrupt stream accepted\n");
+        failures++;
+    }
+    // A sink that fails (flash write error) stops the stream
+    inflater.begin();
+    if (inflater.feed(fixed.data(), fixed.size(), refuse, nullptr) != INFLATE_ERROR)
+    {
+        printf("FAIL: sink failure ignored\n");
+        failures++;
+    }
+    failures += corruptVectors(inflater);
+
+    std::vector<std::vector<uint8_t>> seeds = {fixed, stored, smallWindow};
+#ifdef HAVE_ZLIB
+    // A dynamic-Huffman block too
+    std::string text;
+    for (int i = 0; i < 200; i++)
+        text += "chamber " + std::to_string(i % 7) + " tempPV=" + std::to_string(2000 + i * 37 % 500) + "; ";
+    seeds.push_back(compress(std::vector<uint8_t>(text.begin(), text.end()), 12));
+#endif
+    failures += fuzzStreams(inflater, seeds);
+
+#ifdef HAVE_ZLIB
+    // Firmware images from OTA_BENCH_IMAGES (':'-separated .bin paths), else this
+    // executable as a stand-in for machine code
+    std::vector<std::string> paths;
+    const char *list = getenv("OTA_BENCH_IMAGES");
+    std::string images = list ? list : "/proc/self/exe";
+    for (size_t start = 0, end; start < images.size(); start = end + 1)
+    {
+        end = images.find(':', start);
+        if (end == std::string::npos)
+            end = images.size();
+        paths.push_back(images.substr(start, end - start));
+    }
+
+    std::vector<uint8_t> image;
+    for (const std::string &path : paths)
+    {
+        if (!readFile(path.c_str(), image))
+        {
+            printf("skipped %s: cannot read\n", path.c_str());
+            continue;
+        }
+        for (int windowBits : {15, 12})
+        {
+            std::vector<uint8_t> compressed = compress(image, windowBits);
+            out.reserve(image.size());
+            auto start = std::chrono::steady_clock::now();
+            InflateResult result = inflateAll(inflater, compressed, SEGMENT, out);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            printf("%-28s %7zu B -> %7zu B (-%2.0f%%), %2u KB window, inflate %6.1f MB/s\n",
+                   path.substr(path.find_last_of('/') + 1).c_str(), image.size(), compressed.size(),
+                   100.0 * (1.0 - (double)compressed.size() / image.size()), inflater.windowSize() / 1024,
+                   image.size() / 1048576.0 / ms * 1000.0);
+            if (result != INFLATE_DONE || out != image)
+            {
+                printf("FAIL: round trip of %s\n", path.c_str());
+                failures++;
+            }
+        }
+        if (!pipelineRoundTrip(image, compress(image, 15)))
+        {
+            printf("FAIL: compressed download of %s through the OTA pipeline\n", path.c_str());
+            failures++;
+        }
+    }
+#else
+    printf("zlib.h not found, round trip of firmware images skipped\n");
+#endif
+
+    return failures;
+}
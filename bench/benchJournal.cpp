@@ -0,0 +1,165 @@
+// Sample journal: store-and-forward on a directory-backed flash stand-in, append/replay cost
+#include <Arduino.h>
+#include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string>
+#include "sampleJournal.h"
+#include "benchHarness.h"
+
+static const uint32_t SLOTS = 64;
+static const uint32_t SEGMENT = 16;
+static const uint32_t ITERATIONS = 2000;
+
+static ChamberData sample(uint8_t slaveAddr, float tempPV)
+{
+    ChamberData data;
+    memset(&data, 0, sizeof(data));
+    data.slaveAddr = slaveAddr;
+    data.tempPV = tempPV;
+    data.validMask = 1;
+    return data;
+}
+
+// Records are consecutive from `first`, with the timestamp and value they were appended with
+static bool inOrder(const JournalRecord *records, size_t count, uint32_t first)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (records[i].seq != first + i || records[i].timestamp != 1700000000 + first + i ||
+            records[i].data.tempPV != (float)(first + i))
+            return false;
+    }
+    return true;
+}
+
+// Files in the journal directory; with `wipe`, delete them
+static uint32_t files(const char *dir, bool wipe = false)
+{
+    uint32_t count = 0;
+    DIR *listing = opendir(dir);
+    struct dirent *entry;
+    while (listing != nullptr && (entry = readdir(listing)) != nullptr)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        count++;
+        if (wipe)
+            remove((std::string(dir) + "/" + entry->d_name).c_str());
+    }
+    if (listing != nullptr)
+        closedir(listing);
+    return count;
+}
+
+int benchJournal()
+{
+    int failures = 0;
+    char path[] = "/tmp/journalXXXXXX";
+    if (!mkdtemp(path))
+    {
+        printf("FAIL: cannot create journal directory\n");
+        return 1;
+    }
+
+    printf("\n== Sample journal ==\n");
+
+    SampleJournal journal;
+    JournalRecord records[SLOTS];
+    if (!journal.begin(path, SLOTS, SEGMENT) || journal.pending() != 0)
+    {
+        printf("FAIL: empty journal\n");
+        return 1;
+    }
+
+    // Offline: 10 samples appended, replay sees them oldest first
+    for (uint32_t seq = 1; seq <= 10; seq++)
+        journal.append(sample(1, (float)seq), 1700000000 + seq);
+    if (journal.pending() != 10 || journal.peek(records, 4) != 4 || !inOrder(records, 4, 1))
+    {
+        printf("FAIL: append/peek order\n");
+        failures++;
+    }
+
+    // Batch delivered: the cursor survives a restart
+    journal.ack(records[3].seq);
+    journal.end();
+    if (!journal.begin(path, SLOTS, SEGMENT) || journal.pending() != 6 ||
+        journal.peek(records, SLOTS) != 6 || !inOrder(records, 6, 5))
+    {
+        printf("FAIL: reopen after ack\n");
+        failures++;
+    }
+
+    // Torn write: a corrupted slot is skipped, the rest still replays, and
+    // appends go on in a new segment after the last good record
+    journal.end();
+    FILE *file = fopen((std::string(path) + "/00000001.seg").c_str(), "r+b");
+    fseek(file, -2, SEEK_END); // CRC of the newest slot (#10)
+    fputc(0xFF, file);
+    fputc(0xFF, file);
+    fclose(file);
+    bool recovered = journal.begin(path, SLOTS, SEGMENT) && journal.peek(records, SLOTS) == 5 && inOrder(records, 5, 5);
+    journal.append(sample(1, 10.0f), 1700000010);
+    if (!recovered || journal.segments() != 2 || journal.peek(records, SLOTS) != 6 || !inOrder(records, 6, 5))
+    {
+        printf("FAIL: torn slot recovery\n");
+        failures++;
+    }
+
+    // A reboot keeps appending to an intact segment with room
+    journal.end();
+    journal.begin(path, SLOTS, SEGMENT);
+    journal.append(sample(1, 11.0f), 1700000011);
+    if (journal.segments() != 2 || files(path) != 3 || journal.peek(records, SLOTS) != 7 || !inOrder(records, 7, 5))
+    {
+        printf("FAIL: tail segment not resumed (%u segments)\n", journal.segments());
+        failures++;
+    }
+
+    // Delivered segments are deleted; the cursor is a file of its own
+    for (uint32_t seq = 12; seq <= 40; seq++)
+        journal.append(sample(1, (float)seq), 1700000000 + seq);
+    uint32_t before = journal.segments();
+    journal.ack(32);
+    if (before != 3 || journal.segments() != 1 || files(path) != 2 || journal.pending() != 8 ||
+        journal.peek(records, SLOTS) != 8 || !inOrder(records, 8, 33))
+    {
+        printf("FAIL: delivered segments kept (%u -> %u)\n", before, journal.segments());
+        failures++;
+    }
+
+    // Overflow: the oldest segment is dropped whole, at least SLOTS samples are kept
+    journal.end();
+    files(path, true);
+    journal.begin(path, SLOTS, SEGMENT);
+    for (uint32_t seq = 1; seq <= SLOTS + SEGMENT + 10; seq++)
+        journal.append(sample(2, (float)seq), 1700000000 + seq);
+    uint32_t kept = SLOTS + 10;
+    if (journal.pending() != kept || journal.dropped() != SEGMENT || journal.segments() != SLOTS / SEGMENT + 1 ||
+        journal.peek(records, SLOTS) != SLOTS || !inOrder(records, SLOTS, SEGMENT + 1))
+    {
+        printf("FAIL: overflow, %u pending, %u dropped\n", journal.pending(), journal.dropped());
+        failures++;
+    }
+
+    // Cost of the offline path (one fsync'd slot) and of one replay batch
+    journal.end();
+    files(path, true);
+    journal.begin(path, 4096);
+    ChamberData data = sample(1, 25.0f);
+    uint32_t timestamp = 1700000000;
+    runBench("journal append", sizeof(JournalRecord), ITERATIONS, [&]()
+             { journal.append(data, timestamp++); });
+    runBench("journal peek+ack (5)", 5 * sizeof(JournalRecord), ITERATIONS, [&]()
+             {
+        size_t count = journal.peek(records, 5);
+        if (count)
+            journal.ack(records[count - 1].seq);
+        doNotOptimize(count); });
+
+    journal.end();
+    files(path, true);
+    rmdir(path);
+    return failures;
+}
@@ -0,0 +1,226 @@
+// Deferred logger: formatting on the drain side, long text, overflow, several producers
+#include <Arduino.h>
+#include <thread>
+#include <vector>
+#include "debugSerial.h"
+#include "benchHarness.h"
+
+static const uint32_t PRODUCER_LINES = 20000;
+static const uint32_t PRODUCERS = 3;
+static const uint32_t UART_BAUD = 115200;
+
+static char captured[8192];
+static size_t capturedLength = 0;
+
+static void capture(const char *text, size_t length)
+{
+    if (capturedLength + length < sizeof(captured))
+    {
+        memcpy(captured + capturedLength, text, length);
+        capturedLength += length;
+        captured[capturedLength] = '\0';
+    }
+}
+
+static void discard(const char *, size_t)
+{
+}
+
+static const char *drainAll()
+{
+    capturedLength = 0;
+    captured[0] = '\0';
+    while (DebugSerial::drain(capture))
+    {
+    }
+    return captured;
+}
+
+static int expect(const char *what, const char *got, const char *want)
+{
+    if (strcmp(got, want) == 0)
+        return 0;
+    printf("FAIL: %s\n  got  \"%s\"\n  want \"%s\"\n", what, got, want);
+    return 1;
+}
+
+static uint32_t sideEffects = 0;
+static uint32_t countedArgument()
+{
+    return ++sideEffects;
+}
+
+// Drain side of the producer test: splits lines and checks per-producer order
+static uint32_t lastLine[PRODUCERS];
+static uint32_t linesReceived = 0;
+static bool linesOrdered = true;
+static char partialLine[128];
+static size_t partialLength = 0;
+
+static void consumeLines(const char *text, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] != '\n')
+        {
+            if (partialLength + 1 < sizeof(partialLine))
+                partialLine[partialLength++] = text[i];
+            continue;
+        }
+        partialLine[partialLength] = '\0';
+        partialLength = 0;
+        unsigned producer, number;
+        if (sscanf(partialLine, "p%u line %u of producer", &producer, &number) != 2 || producer >= PRODUCERS || number <= lastLine[producer])
+        {
+            linesOrdered = false;
+            continue;
+        }
+        lastLine[producer] = number;
+        linesReceived++;
+    }
+}
+
+// Several tasks log while one drains: every line arrives whole and in per-producer
+// order, or is counted as dropped
+static bool producersInOrder(uint32_t *received, uint32_t *dropped)
+{
+    uint32_t droppedBefore = DebugSerial::stats().dropped;
+    std::vector<std::thread> producers;
+    std::atomic<uint32_t> running{PRODUCERS};
+    for (uint32_t t = 0; t < PRODUCERS; t++)
+    {
+        producers.emplace_back([t, &running]()
+                               {
+            for (uint32_t i = 1; i <= PRODUCER_LINES; i++)
+            {
+                DebugSerial::printf("p%u line %u of %s\n", t, i, "producer");
+                if (i % 16 == 0)
+                    std::this_thread::sleep_for(std::chrono::microseconds(20)); // Let the drain run on a single-core host
+            }
+            running--; });
+    }
+    while (running)
+    {
+        if (!DebugSerial::drain(consumeLines))
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    for (std::thread &producer : producers)
+        producer.join();
+    while (DebugSerial::drain(consumeLines))
+    {
+    }
+    *received = linesReceived;
+    *dropped = DebugSerial::stats().dropped - droppedBefore;
+    return linesOrdered;
+}
+
+int benchLog()
+{
+    int failures = 0;
+    char want[512];
+
+    printf("\n== Deferred logger ==\n");
+    drainAll();
+
+    // Deferred printf matches printf, conversions and length modifiers included
+    const char *name = "ModbusTask";
+    DebugSerial::printf("%u reads, %d us, %5.1f KB/s, %02X %x, %s, 100%%, %lu\n", 7u, -42, 12.345f, 0x0Bu, 255, name, (uint32_t)123456);
+    snprintf(want, sizeof(want), "%u reads, %d us, %5.1f KB/s, %02X %x, %s, 100%%, %lu\n", 7u, -42, 12.345, 0x0Bu, 255, name, 123456UL);
+    failures += expect("deferred printf", drainAll(), want);
+
+    // The string argument is copied: changing the buffer afterwards does not change the line
+    char buffer[16] = "before";
+    DebugSerial::printf_ln("value %s", buffer);
+    strcpy(buffer, "after");
+    failures += expect("string argument copied", drainAll(), "value before\r\n");
+
+    // Text longer than a record spans several, numbers go through Print
+    char longText[201];
+    for (int i = 0; i < 200; i++)
+        longText[i] = 'a' + i % 26;
+    longText[200] = '\0';
+    DebugSerial::println(longText);
+    DebugSerial::print("rc=");
+    DebugSerial::println(-3);
+    snprintf(want, sizeof(want), "%s\r\nrc=-3\r\n", longText);
+    failures += expect("long text and numbers", drainAll(), want);
+
+    // Hex dump, with the level prefix at the start of the line
+    const uint8_t frame[] = {0x01, 0x03, 0x02, 0x0A, 0xFF};
+    DebugSerial::hexdump<DEBUG_LEVEL_ERROR>("Frame: ", frame, sizeof(frame));
+    failures += expect("hex dump", drainAll(), "[E] Frame: 01 03 02 0A FF \r\n");
+    DEBUG_WARN("timeout (slave %u)\n", 3);
+    failures += expect("warning prefix", drainAll(), "[W] timeout (slave 3)\n");
+
+    // Levels above DEBUG_LOG_LEVEL queue nothing and do not evaluate their arguments
+    uint32_t loggedBefore = DebugSerial::stats().logged;
+    DEBUG_VERBOSE("crc %X\n", countedArgument());
+    DEBUG_HEXDUMP(DEBUG_LEVEL_VERBOSE, "Response: ", frame, sizeof(frame));
+    DEBUG_DEBUG("%u\n", countedArgument());
+    if (sideEffects || DebugSerial::stats().logged != loggedBefore || drainAll()[0])
+    {
+        printf("FAIL: compiled-out levels\n");
+        failures++;
+    }
+
+    // Overflow: the ring keeps the first DEBUG_LOG_RECORDS messages, the rest are counted
+    uint32_t droppedBefore = DebugSerial::stats().dropped;
+    for (uint32_t i = 0; i < DEBUG_LOG_RECORDS + 10; i++)
+        DebugSerial::printf("%u\n", i);
+    uint32_t dropped = DebugSerial::stats().dropped - droppedBefore;
+    drainAll();
+    unsigned first = 0, lines = 0;
+    for (const char *p = captured; *p; p = strchr(p, '\n') + 1)
+        lines++;
+    sscanf(captured, "%u", &first);
+    if (dropped != 10 || lines != DEBUG_LOG_RECORDS || first != 0 || DebugSerial::stats().highWater != DEBUG_LOG_RECORDS)
+    {
+        printf("FAIL: overflow, %u dropped, %u lines\n", dropped, lines);
+        failures++;
+    }
+
+    // A message that needs more records than are free is dropped whole
+    for (uint32_t i = 0; i < DEBUG_LOG_RECORDS - 2; i++)
+        DebugSerial::printf("%u\n", i);
+    DebugSerial::println(longText); // 5 records
+    if (DebugSerial::stats().dropped - droppedBefore != 11 || strstr(drainAll(), "abc"))
+    {
+        printf("FAIL: partial long text\n");
+        failures++;
+    }
+
+    uint32_t received = 0;
+    dropped = 0;
+    if (!producersInOrder(&received, &dropped) || received + dropped != PRODUCERS * PRODUCER_LINES)
+    {
+        printf("FAIL: %u producers, %u received + %u dropped of %u\n", PRODUCERS, received, dropped, PRODUCERS * PRODUCER_LINES);
+        failures++;
+    }
+    printf("%u threads + drain:       %6u of %u lines whole and in order, %u dropped\n", PRODUCERS, received, PRODUCERS * PRODUCER_LINES, dropped);
+
+    // What the logging task pays: a record against formatting the line, and the
+    // UART time the caller no longer waits for. Only the queueing is timed,
+    // the ring is drained between batches.
+    const uint32_t batches = 5000;
+    double queueNs = 0;
+    for (uint32_t b = 0; b < batches; b++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < DEBUG_LOG_RECORDS; i++)
+            DebugSerial::printf("Poll slave %u: runs %u, missed %u, jitter %u ms\n", 3u, 1200u, 0u, 12u);
+        queueNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        DebugSerial::drain(discard);
+    }
+    double logNs = queueNs / (batches * DEBUG_LOG_RECORDS);
+    printf("%-28s %5zu B %10.1f ns/frame %12.0f frames/s\n", "printf, deferred", sizeof(LogRecord), logNs, 1e9 / logNs);
+    char line[DEBUG_LOG_LINE];
+    int length = 0;
+    double formatNs = runBench("snprintf, same line", sizeof(line), 200000, [&]()
+                               {
+        length = snprintf(line, sizeof(line), "Poll slave %u: runs %u, missed %u, jitter %u ms\n", 3u, 1200u, 0u, 12u);
+        doNotOptimize(line); });
+    DebugSerial::drain(discard);
+    printf("caller pays %.0f ns to queue the line (%.0f ns to format it); writing its %d bytes holds the UART %.0f us at %u baud\n",
+           logNs, formatNs, length, length * 10e6 / UART_BAUD, UART_BAUD);
+    return failures;
+}
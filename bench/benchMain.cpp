@@ -0,0 +1,59 @@
+// Host benchmark entry point for the native environment.
+// Build and run with: pio run -e native -t exec
+#include <Arduino.h>
+#include <stdio.h>
+
+NativeSerial Serial;
+
+int benchModbusCodec();
+int benchCrc();
+int benchAscii();
+int benchRegisterMap();
+int benchReadPlanner();
+int benchJournal();
+int benchPayload();
+int benchBatch();
+int benchException();
+int benchQueue();
+int benchMqttLink();
+int benchOta();
+int benchInflate();
+int benchBackend();
+int benchLog();
+int benchMetrics();
+int benchProfiler();
+int benchPollConfig();
+int benchAggregate();
+int benchWrite();
+
+int main()
+{
+    int failures = 0;
+    failures += benchModbusCodec();
+    failures += benchCrc();
+    failures += benchAscii();
+    failures += benchRegisterMap();
+    failures += benchReadPlanner();
+    failures += benchJournal();
+    failures += benchPayload();
+    failures += benchBatch();
+    failures += benchException();
+    failures += benchQueue();
+    failures += benchMqttLink();
+    failures += benchOta();
+    failures += benchInflate();
+    failures += benchBackend();
+    failures += benchLog();
+    failures += benchMetrics();
+    failures += benchProfiler();
+    failures += benchPollConfig();
+    failures += benchAggregate();
+    failures += benchWrite();
+
+    if (failures)
+    {
+        printf("\n%d check(s) FAILED\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,192 @@
+// Metrics registry: histogram buckets and percentiles, Modbus outcome counting,
+// JSON and MessagePack forms, recording cost
+#include <Arduino.h>
+#include <thread>
+#include "metrics.h"
+#include "modbusHelper.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 1000000;
+static const uint32_t THREADED_ADDS = 500000;
+
+// Length of the MessagePack value at `data`, 0 if it is malformed or runs past `size`
+static size_t msgPackValueLength(const uint8_t *data, size_t size)
+{
+    if (!size)
+        return 0;
+    uint8_t type = data[0];
+    size_t header = 1, entries = 0;
+    if (type <= 0x7F || type >= 0xE0 || type == 0xC2 || type == 0xC3)
+        return 1;
+    if ((type & 0xF0) == 0x90)
+        entries = type & 0x0F;
+    else if (type == 0xDC && size >= 3)
+        entries = (data[1] << 8) | data[2], header = 3;
+    else if (type == 0xCC || type == 0xD0)
+        return size >= 2 ? 2 : 0;
+    else if (type == 0xCD || type == 0xD1)
+        return size >= 3 ? 3 : 0;
+    else if (type == 0xCE || type == 0xD2)
+        return size >= 5 ? 5 : 0;
+    else if (type == 0xCF)
+        return size >= 9 ? 9 : 0;
+    else
+        return 0;
+    size_t used = header;
+    for (size_t i = 0; i < entries; i++)
+    {
+        size_t length = msgPackValueLength(data + used, size - used);
+        if (!length)
+            return 0;
+        used += length;
+    }
+    return used;
+}
+
+static void rtuFrame(uint8_t *frame, size_t length)
+{
+    uint16_t crc = calculateCRC(frame, length - 2);
+    frame[length - 2] = crc & 0xFF;
+    frame[length - 1] = crc >> 8;
+}
+
+int benchMetrics()
+{
+    int failures = 0;
+    printf("\n== Metrics registry ==\n");
+
+    // Bucket boundaries: 0, then one bucket per power of two, the last one open-ended
+    struct
+    {
+        uint32_t value;
+        size_t bucket;
+    } boundaries[] = {{0, 0}, {1, 1}, {2, 2}, {3, 2}, {4, 3}, {1023, 10}, {1024, 11}, {(1UL << 18) - 1, 18}, {1UL << 18, 19}, {UINT32_MAX, 19}};
+    for (auto &boundary : boundaries)
+    {
+        size_t bucket = MetricHistogram::bucketOf(boundary.value);
+        if (bucket != boundary.bucket || boundary.value > MetricHistogram::bucketLimit(bucket) ||
+            (bucket && boundary.value <= MetricHistogram::bucketLimit(bucket - 1)))
+        {
+            printf("FAIL: bucket of %u is %zu, expected %zu\n", boundary.value, bucket, boundary.bucket);
+            failures++;
+        }
+    }
+
+    // 90 fast answers and 10 slow ones: the median is the fast bucket's bound,
+    // p99 is clipped to the largest value seen
+    static MetricsRegistry registry;
+    MetricHistogram &latency = registry.histogram(METRIC_PUBLISH_US);
+    for (int i = 0; i < 90; i++)
+        latency.record(1000);
+    for (int i = 0; i < 10; i++)
+        latency.record(100000);
+    if (latency.count() != 100 || latency.sum() != 90 * 1000 + 10 * 100000 || latency.max() != 100000 ||
+        latency.percentile(0.5f) != 1023 || latency.percentile(0.9f) != 1023 || latency.percentile(0.99f) != 100000 ||
+        latency.usedBuckets() != 18)
+    {
+        printf("FAIL: percentiles p50 %u p90 %u p99 %u\n", latency.percentile(0.5f), latency.percentile(0.9f), latency.percentile(0.99f));
+        failures++;
+    }
+
+    // Outcomes of real frames as the polling task classifies them
+    uint8_t good[] = {0x01, 0x03, 0x04, 0x09, 0xC4, 0x0A, 0x28, 0x00, 0x00};
+    uint8_t exception[] = {0x01, 0x83, 0x02, 0x00, 0x00};
+    uint8_t truncated[] = {0x01, 0x03, 0x08, 0x09, 0xC4, 0x00, 0x00};
+    rtuFrame(good, sizeof(good));
+    rtuFrame(exception, sizeof(exception));
+    rtuFrame(truncated, sizeof(truncated));
+    uint8_t corrupted[sizeof(good)];
+    memcpy(corrupted, good, sizeof(good));
+    corrupted[4] ^= 0x01;
+    struct
+    {
+        const uint8_t *frame;
+        size_t length;
+        ModbusError expected;
+    } outcomes[] = {{good, sizeof(good), MODBUS_OK},
+                    {corrupted, sizeof(corrupted), MODBUS_CRC_ERROR},
+                    {exception, sizeof(exception), MODBUS_EXCEPTION},
+                    {truncated, sizeof(truncated), MODBUS_LENGTH_ERROR},
+                    {good, 3, MODBUS_LENGTH_ERROR}};
+    for (auto &outcome : outcomes)
+    {
+        ModbusError error = MODBUS_NO_RESPONSE;
+        readModbusResponse(outcome.frame, outcome.length, 0, &error);
+        if (error != outcome.expected)
+        {
+            printf("FAIL: frame classified as %u, expected %u\n", error, outcome.expected);
+            failures++;
+        }
+        registry.recordTransaction(7, error, 12000, 5000);
+    }
+    registry.recordTransaction(7, MODBUS_NO_RESPONSE, 1000000, 6000);
+    registry.recordTransaction(9, MODBUS_OK, 8000, 6000);
+    SlaveMetrics *chamber = registry.slave(7);
+    if (!chamber || chamber->transactions.value() != 6 || chamber->crcErrors.value() != 1 || chamber->exceptions.value() != 1 ||
+        chamber->lengthErrors.value() != 2 || chamber->timeouts.value() != 1 || chamber->failuresInRow.value() != 5 ||
+        chamber->roundTripUs.count() != 5 || registry.slave(9) != chamber + 1)
+    {
+        printf("FAIL: slave counters\n");
+        failures++;
+    }
+
+    // Counters stay exact with two tasks adding
+    MetricCounter &publishes = registry.counter(METRIC_PUBLISHES);
+    std::thread other([&]()
+                      {
+        for (uint32_t i = 0; i < THREADED_ADDS; i++)
+            publishes.add(); });
+    for (uint32_t i = 0; i < THREADED_ADDS; i++)
+        publishes.add();
+    other.join();
+    if (publishes.value() != 2 * THREADED_ADDS)
+    {
+        printf("FAIL: threaded counter %u\n", publishes.value());
+        failures++;
+    }
+
+    // Both forms: JSON keys from the name tables, MessagePack well-formed end to end
+    registry.gauge(METRIC_FREE_HEAP).set(123456);
+    static char json[2048];
+    static uint8_t packed[1024];
+    size_t jsonLength = registry.writeJson(json, sizeof(json), 7000);
+    size_t packedLength = registry.pack(packed, sizeof(packed), 7000);
+    const char *expectedJson[] = {"{\"uptimeMs\":7000,\"publishes\":1000000,", "\"freeHeap\":123456",
+                                  "\"publishUs\":{\"count\":100,\"sum\":1090000,\"max\":100000,\"p50\":1023,\"p90\":1023,\"p99\":100000,",
+                                  "{\"slave\":7,\"transactions\":6,\"timeouts\":1,\"crcErrors\":1,\"lengthErrors\":2,\"exceptions\":1,\"failuresInRow\":5,\"lastOkAgeMs\":2000,",
+                                  "{\"slave\":9,", "]}}]}"};
+    for (const char *fragment : expectedJson)
+    {
+        if (!jsonLength || !strstr(json, fragment))
+        {
+            printf("FAIL: JSON lacks %s\n", fragment);
+            failures++;
+        }
+    }
+    if (!packedLength || msgPackValueLength(packed, packedLength) != packedLength || packed[0] != 0x96 || packed[1] != METRICS_FORMAT_VERSION)
+    {
+        printf("FAIL: MessagePack metrics malformed\n");
+        failures++;
+    }
+    if (registry.writeJson(json, 64, 7000) || registry.pack(packed, 16, 7000))
+    {
+        printf("FAIL: overflow not reported\n");
+        failures++;
+    }
+    printf("metrics message, 2 slaves: %zu B JSON, %zu B MessagePack\n", jsonLength, packedLength);
+
+    uint32_t value = 0;
+    runBench("counter add", sizeof(MetricCounter), ITERATIONS, [&]()
+             { publishes.add(); });
+    runBench("histogram record", sizeof(MetricHistogram), ITERATIONS, [&]()
+             {
+        latency.record(value);
+        value = value * 1664525u + 1013904223u; });
+    runBench("transaction record", sizeof(SlaveMetrics), ITERATIONS, [&]()
+             { registry.recordTransaction(9, MODBUS_OK, 8000, 6000); });
+    runBench("JSON, 2 slaves", jsonLength, ITERATIONS / 100, [&]()
+             { doNotOptimize(registry.writeJson(json, sizeof(json), 7000)); });
+    runBench("MessagePack, 2 slaves", packedLength, ITERATIONS / 100, [&]()
+             { doNotOptimize(registry.pack(packed, sizeof(packed), 7000)); });
+    return failures;
+}
@@ -0,0 +1,74 @@
+// Encode / CRC / decode throughput of the Modbus RTU codec in modbusHelper.cpp
+#include <Arduino.h>
+#include <math.h>
+#include "modbusHelper.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 200000;
+static const uint16_t REG_QUANTITIES[] = {10, 32, 64, 125}; // 125 is the FC 0x03 maximum
+
+// Build a valid FC 0x03 response for `regQuantity` registers, returns frame length
+static size_t buildReadResponse(uint8_t *frame, uint8_t slaveAddr, uint16_t regQuantity)
+{
+    frame[0] = slaveAddr;
+    frame[1] = 0x03;
+    frame[2] = (uint8_t)(regQuantity * 2);
+    for (uint16_t i = 0; i < regQuantity; i++)
+    {
+        uint16_t value = (uint16_t)(i * 100 + 34); // D1 = 0.34, D2 = 1.34, ...
+        frame[3 + i * 2] = (value >> 8) & 0xFF;
+        frame[4 + i * 2] = value & 0xFF;
+    }
+    size_t length = 3 + regQuantity * 2;
+    uint16_t crc = calculateCRC(frame, length);
+    frame[length] = crc & 0xFF;
+    frame[length + 1] = (crc >> 8) & 0xFF;
+    return length + 2;
+}
+
+int benchModbusCodec()
+{
+    int failures = 0;
+    uint8_t request[8];
+    uint8_t response[256];
+
+    printf("== Modbus RTU codec ==\n");
+
+    // Sanity check the decoder before timing it
+    size_t checkLength = buildReadResponse(response, 1, 10);
+    ChamberData check = readModbusResponse(response, checkLength);
+    if (fabsf(check.tempPV - 0.34f) > 0.001f || fabsf(check.humiSP - 5.34f) > 0.001f || check.nowSTS != 934)
+    {
+        printf("FAIL: readModbusResponse decoded unexpected values\n");
+        failures++;
+    }
+
+    uint16_t startAddr = 0;
+    runBench("encode request", sizeof(request), ITERATIONS, [&]()
+             {
+                 prepareModbusRequest(request, 1, 0x03, startAddr++, 10);
+                 doNotOptimize(request);
+             });
+
+    for (uint16_t regQuantity : REG_QUANTITIES)
+    {
+        size_t length = buildReadResponse(response, 1, regQuantity);
+        char name[32];
+
+        snprintf(name, sizeof(name), "crc %u regs", regQuantity);
+        runBench(name, length, ITERATIONS, [&]()
+                 {
+                     uint16_t crc = calculateCRC(response, length - 2);
+                     doNotOptimize(crc);
+                 });
+
+        snprintf(name, sizeof(name), "decode %u regs", regQuantity);
+        runBench(name, length, ITERATIONS, [&]()
+                 {
+                     ChamberData data = readModbusResponse(response, length);
+                     doNotOptimize(data);
+                 });
+    }
+
+    return failures;
+}
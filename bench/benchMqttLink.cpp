@@ -0,0 +1,113 @@
+// MQTT reconnect state machine: backoff growth, jitter and a fleet reconnecting after a broker restart
+#include <Arduino.h>
+#include "mqttLink.h"
+#include "benchHarness.h"
+
+static const uint32_t BASE_MS = 1000;
+static const uint32_t MAX_MS = 60000;
+static const uint32_t FLEET = 200;
+
+// Simulated broker: refuses connections until upAtMs
+struct FakeBroker
+{
+    uint32_t upAtMs;
+    bool accepts(uint32_t nowMs) const { return (int32_t)(nowMs - upAtMs) >= 0; }
+};
+
+int benchMqttLink()
+{
+    int failures = 0;
+    MqttLink link;
+
+    printf("\n== MQTT reconnect ==\n");
+
+    // No attempts while the network is down, connected links are left alone
+    link.begin(BASE_MS, MAX_MS, 1);
+    if (link.attemptDue(0, false, false) || link.state() != LINK_WAIT_NETWORK || link.attemptDue(5000, true, true))
+    {
+        printf("FAIL: network down / connected\n");
+        failures++;
+    }
+
+    // Waits double from the base up to the cap, each within [ceiling / 2, ceiling]
+    uint32_t now = 0;
+    while (!link.attemptDue(now, true, false))
+        now++;
+    uint32_t ceiling = BASE_MS;
+    for (int attempt = 0; attempt < 10; attempt++)
+    {
+        link.attemptResult(false, -2, now);
+        ceiling = ceiling * 2 > MAX_MS ? MAX_MS : ceiling * 2;
+        uint32_t wait = link.stats().backoffMs;
+        if (wait < ceiling / 2 || wait > ceiling || link.attemptDue(now + wait - 1, true, false) ||
+            !link.attemptDue(now + wait, true, false))
+        {
+            printf("FAIL: backoff after %d failures: %u ms, ceiling %u ms\n", attempt + 1, wait, ceiling);
+            failures++;
+            break;
+        }
+        now += wait;
+    }
+    if (link.stats().lastRc != -2 || link.stats().attempts != 10)
+    {
+        printf("FAIL: attempt counters\n");
+        failures++;
+    }
+
+    // Connect, then the broker drops us: one disconnect, time to connect measured from the drop
+    link.attemptResult(true, 0, now);
+    now += 10000;
+    link.attemptDue(now, true, false);
+    uint32_t dropped = now;
+    while (!link.attemptDue(now, true, false))
+        now++;
+    link.attemptResult(true, 0, now + 50);
+    if (link.state() != LINK_CONNECTED || link.stats().disconnects != 1 ||
+        link.stats().lastConnectMs != now + 50 - dropped)
+    {
+        printf("FAIL: reconnect after drop\n");
+        failures++;
+    }
+
+    // Fleet: the broker restarts at t = 0 and is back at t = 30 s. Count attempts per 100 ms
+    FakeBroker broker = {30000};
+    MqttLink fleet[FLEET];
+    uint32_t attemptsPerWindow[1200] = {0};
+    uint32_t connected = 0;
+    uint32_t worstConnectMs = 0;
+    for (uint32_t i = 0; i < FLEET; i++)
+        fleet[i].begin(BASE_MS, MAX_MS, 0x9E3779B9u * (i + 1));
+    for (uint32_t t = 0; t < 120000 && connected < FLEET; t += 10)
+    {
+        for (uint32_t i = 0; i < FLEET; i++)
+        {
+            if (fleet[i].state() == LINK_CONNECTED || !fleet[i].attemptDue(t, true, false))
+                continue;
+            attemptsPerWindow[t / 100]++;
+            bool ok = broker.accepts(t);
+            fleet[i].attemptResult(ok, ok ? 0 : -2, t);
+            if (ok)
+            {
+                connected++;
+                if (fleet[i].stats().lastConnectMs > worstConnectMs)
+                    worstConnectMs = fleet[i].stats().lastConnectMs;
+            }
+        }
+    }
+    uint32_t peak = 0;
+    uint32_t total = 0;
+    for (uint32_t window = 0; window < 1200; window++)
+    {
+        total += attemptsPerWindow[window];
+        if (attemptsPerWindow[window] > peak)
+            peak = attemptsPerWindow[window];
+    }
+    printf("%u clients, broker down 30 s: %u attempts, peak %u per 100 ms (fixed 5 s retry: %u), all connected after %u ms\n",
+           FLEET, total, peak, FLEET, worstConnectMs);
+    if (connected != FLEET || peak > FLEET / 4)
+    {
+        printf("FAIL: fleet reconnect\n");
+        failures++;
+    }
+    return failures;
+}
@@ -0,0 +1,191 @@
+// OTA download pipeline: SHA-256 vectors, resume after a drop, and network/flash overlap
+#include <Arduino.h>
+#include <thread>
+#include <vector>
+#include "otaPipeline.h"
+#include "benchHarness.h"
+
+static const uint32_t IMAGE_SIZE = 256 * 1024;
+static const uint32_t NETWORK_US_PER_KB = 1000; // ~1 MB/s link, 4 ms per buffer
+static const uint32_t FLASH_US_PER_KB = 750;    // Erase + write, 3 ms per sector
+
+static bool digestIs(const uint8_t *data, size_t len, const char *hex)
+{
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    Sha256 hash;
+    hash.begin();
+    hash.update(data, len);
+    hash.finish(digest);
+    return parseSha256Hex(hex, expected) && memcmp(digest, expected, sizeof(digest)) == 0;
+}
+
+static void sleepUs(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+// Download `image` through the pipeline, in reads of up to `readSize` bytes, the
+// connection dropping every `dropEvery` bytes and resuming from received().
+// Flash is a vector the writer appends to. Returns the elapsed ms.
+static double download(OtaPipeline &pipeline, const std::vector<uint8_t> &image, std::vector<uint8_t> &flash,
+                       size_t readSize, uint32_t dropEvery, bool simulateTiming, uint32_t *resumes)
+{
+    pipeline.begin();
+    flash.clear();
+    auto start = std::chrono::steady_clock::now();
+    std::thread writer([&]()
+                       {
+        while (!pipeline.failed() && !pipeline.drained())
+        {
+            bool wrote = pipeline.consume([&](const uint8_t *data, size_t len)
+                                          {
+                if (simulateTiming)
+                    sleepUs(len * FLASH_US_PER_KB / 1024);
+                flash.insert(flash.end(), data, data + len);
+                return true; });
+            if (!wrote)
+                sleepUs(20);
+        } });
+
+    *resumes = 0;
+    while (pipeline.received() < image.size())
+    {
+        // One connection: starts at received(), like a Range request
+        uint32_t offset = pipeline.received();
+        uint32_t end = dropEvery ? std::min<uint32_t>(offset + dropEvery, image.size()) : image.size();
+        uint32_t position = offset;
+        uint8_t *buffer = nullptr;
+        size_t filled = 0;
+        while (position < end)
+        {
+            if (!buffer && !(buffer = pipeline.acquire()))
+            {
+                sleepUs(20);
+                continue;
+            }
+            size_t count = std::min<size_t>(std::min<size_t>(readSize, OTA_BUFFER_SIZE - filled), end - position);
+            if (simulateTiming)
+                sleepUs(count * NETWORK_US_PER_KB / 1024);
+            memcpy(buffer + filled, image.data() + position, count);
+            filled += count;
+            position += count;
+            if (filled == OTA_BUFFER_SIZE)
+            {
+                pipeline.submit(buffer, filled);
+                buffer = nullptr;
+                filled = 0;
+            }
+        }
+        if (buffer && filled)
+            pipeline.submit(buffer, filled);
+        if (pipeline.received() < image.size())
+            (*resumes)++;
+    }
+    pipeline.close();
+    writer.join();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int benchOta()
+{
+    int failures = 0;
+
+    printf("\n== OTA pipeline ==\n");
+
+    // FIPS 180-4 test vectors
+    const char *abc = "abc";
+    const char *twoBlocks = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    if (!digestIs(nullptr, 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855") ||
+        !digestIs((const uint8_t *)abc, 3, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") ||
+        !digestIs((const uint8_t *)twoBlocks, strlen(twoBlocks), "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"))
+    {
+        printf("FAIL: SHA-256 test vectors\n");
+        failures++;
+    }
+    uint8_t parsed[SHA256_DIGEST_SIZE];
+    if (parseSha256Hex("ba7816bf", parsed) ||
+        parseSha256Hex("zz7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad", parsed))
+    {
+        printf("FAIL: malformed digest accepted\n");
+        failures++;
+    }
+
+    std::vector<uint8_t> image(IMAGE_SIZE + 123); // Last buffer partly filled
+    uint32_t rng = 12345;
+    for (uint8_t &byte : image)
+    {
+        rng = rng * 1103515245 + 12345;
+        byte = (uint8_t)(rng >> 16);
+    }
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    Sha256 hash;
+    hash.begin();
+    hash.update(image.data(), image.size());
+    hash.finish(expected);
+
+    static OtaPipeline pipeline;
+    std::vector<uint8_t> flash;
+    flash.reserve(image.size());
+    uint32_t resumes;
+
+    // Odd-sized reads, hashed chunk by chunk, land intact
+    download(pipeline, image, flash, 1460, 0, false, &resumes);
+    if (flash != image || !pipeline.verify(expected))
+    {
+        printf("FAIL: image or digest after download\n");
+        failures++;
+    }
+
+    // Connection drops every 50000 bytes, mid-buffer: resumed image is the same
+    download(pipeline, image, flash, 1460, 50000, false, &resumes);
+    if (flash != image || resumes != image.size() / 50000 || !pipeline.verify(expected))
+    {
+        printf("FAIL: resume after drops (%u resumes)\n", resumes);
+        failures++;
+    }
+
+    // A corrupted byte fails the digest
+    image[1000] ^= 1;
+    download(pipeline, image, flash, 1460, 0, false, &resumes);
+    if (pipeline.verify(expected))
+    {
+        printf("FAIL: corrupted image verified\n");
+        failures++;
+    }
+    image[1000] ^= 1;
+
+    // A failed flash write stops the reader
+    pipeline.begin();
+    uint8_t *buffer = pipeline.acquire();
+    pipeline.submit(buffer, OTA_BUFFER_SIZE);
+    pipeline.consume([](const uint8_t *, size_t)
+                     { return false; });
+    if (!pipeline.failed())
+    {
+        printf("FAIL: flash error not reported\n");
+        failures++;
+    }
+
+    // Network and flash overlapped, against reading and writing in turn
+    double serialMs = IMAGE_SIZE / 1024.0 * (NETWORK_US_PER_KB + FLASH_US_PER_KB) / 1000.0;
+    double pipelinedMs = download(pipeline, image, flash, OTA_BUFFER_SIZE, 0, true, &resumes);
+    const OtaPipelineStats &stats = pipeline.stats();
+    printf("%u KB image: %.0f KB/s pipelined (%.0f ms, max %u buffers queued), %.0f KB/s read-then-write\n",
+           IMAGE_SIZE / 1024, IMAGE_SIZE / 1024.0 / pipelinedMs * 1000.0, pipelinedMs, stats.maxInFlight,
+           IMAGE_SIZE / 1024.0 / serialMs * 1000.0);
+    if (flash != image || pipelinedMs > serialMs)
+    {
+        printf("FAIL: pipelined download slower than serial\n");
+        failures++;
+    }
+
+    runBench("sha256 4 KB", OTA_BUFFER_SIZE, 20000, [&]()
+             {
+        hash.begin();
+        hash.update(image.data(), OTA_BUFFER_SIZE);
+        hash.finish(parsed);
+        doNotOptimize(parsed); });
+
+    return failures;
+}
@@ -0,0 +1,97 @@
+// Sample payload encoding: MessagePack correctness, encode time and bytes against JSON
+#include <Arduino.h>
+#include "samplePack.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define BENCH_HAVE_ARDUINOJSON 1
+#endif
+
+static const uint32_t ITERATIONS = 200000;
+static const char BOARD_ID[] = "A1B2C3D4E5F6";
+
+// A full TEMI1500 sample as decoded from registers D1..D10
+static ChamberData fullSample()
+{
+    const uint8_t registers[20] = {0x09, 0x29, 0x09, 0xC4, 0x08, 0x98, 0x08, 0xFC, 0x17, 0x70,
+                                   0x17, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03};
+    ChamberData data;
+    memset(&data, 0, sizeof(data));
+    data.slaveAddr = 1;
+    decodeRegisters(registers, sizeof(registers), 0, &data);
+    return data;
+}
+
+#ifdef BENCH_HAVE_ARDUINOJSON
+// Same document as serializeSample() in mqttHelper.cpp
+static size_t jsonSample(const ChamberData &data, uint32_t timestamp, char *out, size_t outSize)
+{
+    JsonDocument doc;
+    doc["client"] = BOARD_ID;
+    doc["slave"] = data.slaveAddr;
+    doc["ts"] = timestamp;
+    visitChamberFields(data, [&](const RegisterField &field, auto value)
+                       { doc[field.key] = value; });
+    doc.shrinkToFit();
+    return serializeJson(doc, out, outSize);
+}
+#endif
+
+int benchPayload()
+{
+    int failures = 0;
+    uint8_t payload[256];
+    ChamberData data = fullSample();
+
+    printf("\n== Sample payload ==\n");
+
+    // Hand-checked encoding: index 7, slave 1, two fixed-point fields
+    ChamberData small;
+    memset(&small, 0, sizeof(small));
+    small.slaveAddr = 1;
+    small.tempPV = -12.5f; // D1 -> -1250
+    small.nowSTS = 3;      // D10
+    small.validMask = (1UL << 0) | (1UL << 6);
+    SampleMeta indexed = {BOARD_ID, 7, 0, false};
+    const uint8_t expected[] = {0x84, 0xA1, 'c', 0x07, 0xA1, 's', 0x01, 0x00, 0xD1, 0xFB, 0x1E, 0x09, 0x03};
+    size_t length = packSample(small, indexed, payload, sizeof(payload));
+    if (length != sizeof(expected) || memcmp(payload, expected, length) != 0)
+    {
+        printf("FAIL: MessagePack encoding\n");
+        failures++;
+    }
+
+    // Fixed-point values survive exactly: 23.45 -> 2345 (0xCD 0x09 0x29)
+    SampleMeta meta = {BOARD_ID, -1, 1700000000, false};
+    length = packSample(data, meta, payload, sizeof(payload));
+    const uint8_t tempPV[] = {0x00, 0xCD, 0x09, 0x29};
+    if (length == 0 || memmem(payload, length, tempPV, sizeof(tempPV)) == nullptr)
+    {
+        printf("FAIL: fixed-point field\n");
+        failures++;
+    }
+
+    // Too small a buffer is reported, never overrun
+    if (packSample(data, meta, payload, 10) != 0)
+    {
+        printf("FAIL: MessagePack overflow\n");
+        failures++;
+    }
+
+    SampleMeta byIndex = {BOARD_ID, 7, 1700000000, false};
+    runBench("msgpack, board ID", packSample(data, meta, payload, sizeof(payload)), ITERATIONS, [&]()
+             { doNotOptimize(packSample(data, meta, payload, sizeof(payload))); });
+    runBench("msgpack, device index", packSample(data, byIndex, payload, sizeof(payload)), ITERATIONS, [&]()
+             { doNotOptimize(packSample(data, byIndex, payload, sizeof(payload))); });
+
+#ifdef BENCH_HAVE_ARDUINOJSON
+    char json[256];
+    runBench("json (ArduinoJson)", jsonSample(data, 1700000000, json, sizeof(json)), ITERATIONS / 10, [&]()
+             { doNotOptimize(jsonSample(data, 1700000000, json, sizeof(json))); });
+#else
+    printf("json (ArduinoJson)           skipped, ArduinoJson not installed\n");
+#endif
+
+    return failures;
+}
@@ -0,0 +1,143 @@
+// Runtime poll config: text form, rejection of configs the bus cannot carry,
+// per-slave field plans and a simulated 100 ms schedule
+#include <Arduino.h>
+#include "pollConfig.h"
+#include "pollScheduler.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t BAUD = 115200;
+static const uint32_t TURNAROUND_US = 5000;
+static const uint16_t GAP_TOLERANCE = 4;
+
+static int expectRejected(const char *text, const char *reason)
+{
+    PollConfig config;
+    char error[128] = "";
+    if (parsePollConfig(text, &config, error, sizeof(error)) &&
+        checkPollConfig(config, GAP_TOLERANCE, BAUD, TURNAROUND_US, error, sizeof(error)))
+    {
+        printf("FAIL: accepted \"%s\"\n", text);
+        return 1;
+    }
+    if (!strstr(error, reason))
+    {
+        printf("FAIL: \"%s\" rejected with \"%s\", expected \"%s\"\n", text, error, reason);
+        return 1;
+    }
+    return 0;
+}
+
+// Fake clock: each transaction holds the bus for its planned time
+static uint32_t simulateSchedule(const PollConfig &config, uint32_t durationMs, uint32_t *missed)
+{
+    PollJob jobs[POLL_MAX_JOBS];
+    size_t count = planPollJobs(config.slaves, config.slaveCount, GAP_TOLERANCE, jobs, POLL_MAX_JOBS);
+    static PollScheduler scheduler;
+    scheduler.begin(jobs, count, 0);
+    uint32_t nowUs = 0, cycles = 0;
+    while (nowUs < durationMs * 1000)
+    {
+        uint32_t waitMs = 0;
+        int index = scheduler.nextDueJob(nowUs / 1000, &waitMs);
+        if (index < 0)
+        {
+            nowUs = (nowUs / 1000 + waitMs) * 1000;
+            continue;
+        }
+        scheduler.markStarted(index, nowUs / 1000);
+        nowUs += estimateReadMicros(scheduler.job(index).regQuantity, BAUD, TURNAROUND_US, scheduler.job(index).transport);
+        cycles += scheduler.job(index).lastInCycle;
+    }
+    *missed = 0;
+    for (size_t i = 0; i < count; i++)
+        *missed += scheduler.stats(i).missedDeadlines;
+    return cycles;
+}
+
+int benchPollConfig()
+{
+    int failures = 0;
+    printf("\n== Runtime poll config ==\n");
+
+    // Parse, units and defaults
+    PollConfig config;
+    char error[128] = "";
+    const char *text = "slave=1 period=500ms regs=tempPV,nowSTS; slave=2 fc=4 period=2s ascii\n slave=3 period=1min;";
+    if (!parsePollConfig(text, &config, error, sizeof(error)) || config.slaveCount != 3 ||
+        config.slaves[0].periodMs != 500 || config.slaves[0].registerMask != ((1UL << 0) | (1UL << 6)) ||
+        config.slaves[1].functionCode != 4 || config.slaves[1].periodMs != 2000 || config.slaves[1].transport != MODBUS_ASCII ||
+        config.slaves[2].periodMs != 60000 || config.slaves[2].functionCode != 3 || config.slaves[2].registerMask != 0)
+    {
+        printf("FAIL: parse \"%s\": %s\n", text, error);
+        failures++;
+    }
+
+    // The canonical form parses back to the same config
+    char canonical[POLL_CONFIG_TEXT_SIZE];
+    PollConfig again;
+    size_t length = formatPollConfig(config, canonical, sizeof(canonical));
+    const char *expected = "slave=1 fc=3 period=500ms regs=tempPV,nowSTS; slave=2 fc=4 period=2000ms ascii; slave=3 fc=3 period=60000ms";
+    if (!length || strcmp(canonical, expected) != 0 || !parsePollConfig(canonical, &again, error, sizeof(error)) ||
+        memcmp(again.slaves, config.slaves, sizeof(config.slaves)) != 0 || formatPollConfig(config, canonical, 32))
+    {
+        printf("FAIL: canonical form \"%s\"\n", canonical);
+        failures++;
+    }
+
+    // Each slave reads only its fields: tempPV and nowSTS are too far apart for one read
+    PollJob jobs[POLL_MAX_JOBS];
+    size_t jobCount = planPollJobs(config.slaves, config.slaveCount, GAP_TOLERANCE, jobs, POLL_MAX_JOBS);
+    if (jobCount != 4 || jobs[0].startAddr != 0 || jobs[0].regQuantity != 1 || jobs[0].lastInCycle ||
+        jobs[1].startAddr != 9 || !jobs[1].lastInCycle || jobs[2].regQuantity != 10 || jobs[3].slaveAddr != 3)
+    {
+        printf("FAIL: per-slave field plan, %zu jobs\n", jobCount);
+        failures++;
+    }
+
+    failures += expectRejected("", "no slaves");
+    failures += expectRejected("period=1s", "no slave=");
+    failures += expectRejected("slave=1 period=50ms", "bad value 'period=50ms'");
+    failures += expectRejected("slave=1 regs=tempPV,dewPoint", "bad value");
+    failures += expectRejected("slave=1; slave=1", "listed twice");
+    failures += expectRejected("slave=1 speed=fast", "unknown word 'speed=fast'");
+    failures += expectRejected("slave=248", "bad value");
+    failures += expectRejected("slave=1 fc=6", "bad value");
+    // 8 ASCII slaves every 100 ms would need more of the bus than the limit
+    failures += expectRejected("slave=1 period=100ms ascii; slave=2 period=100ms ascii; slave=3 period=100ms ascii; slave=4 period=100ms ascii;"
+                               "slave=5 period=100ms ascii; slave=6 period=100ms ascii; slave=7 period=100ms ascii; slave=8 period=100ms ascii",
+                               "of the bus, limit 80%");
+
+    // Qualification run: 4 slaves at 100 ms fit, and the schedule keeps every deadline
+    const char *fast = "slave=1 period=100ms; slave=2 period=100ms; slave=3 period=100ms; slave=4 period=100ms";
+    uint32_t missed = 0;
+    if (!parsePollConfig(fast, &config, error, sizeof(error)) ||
+        !checkPollConfig(config, GAP_TOLERANCE, BAUD, TURNAROUND_US, error, sizeof(error)))
+    {
+        printf("FAIL: 4 slaves at 100 ms rejected: %s\n", error);
+        failures++;
+    }
+    uint32_t load = pollBusLoad(config, GAP_TOLERANCE, BAUD, TURNAROUND_US);
+    uint32_t cycles = simulateSchedule(config, 10000, &missed);
+    if (cycles != 400 || missed != 0)
+    {
+        printf("FAIL: 100 ms schedule, %u cycles, %u missed\n", cycles, missed);
+        failures++;
+    }
+    printf("4 slaves every 100 ms:     bus load %u.%u%%, %u cycles in 10 s, %u missed deadlines\n", load / 10, load % 10, cycles, missed);
+    const uint32_t slowPeriods[] = {1000, 60000};
+    for (uint32_t periodMs : slowPeriods)
+    {
+        for (size_t i = 0; i < config.slaveCount; i++)
+            config.slaves[i].periodMs = periodMs;
+        load = pollBusLoad(config, GAP_TOLERANCE, BAUD, TURNAROUND_US);
+        printf("4 slaves every %5u ms:   bus load %u.%u%%\n", periodMs, load / 10, load % 10);
+    }
+
+    runBench("parse + check config", strlen(text), 100000, [&]()
+             {
+        bool ok = parsePollConfig(text, &config, error, sizeof(error)) &&
+                  checkPollConfig(config, GAP_TOLERANCE, BAUD, TURNAROUND_US, error, sizeof(error));
+        doNotOptimize(ok); });
+    return failures;
+}
@@ -0,0 +1,163 @@
+// Task profiler: sliding-window CPU per task and core from simulated run-time
+// counters, task churn, counter wrap, heap fragmentation, sampling cost
+#include <Arduino.h>
+#include "taskProfiler.h"
+#include "benchHarness.h"
+
+static const uint32_t SAMPLE_TICKS = 1000000; // Run-time clock per sample, 1 s in us
+
+// A simulated system: fixed tasks whose counters advance by a set share of each sample
+struct SimTask
+{
+    TaskSnapshot snapshot;
+    uint32_t permille; // Of one core, per sample
+};
+
+static void advance(SimTask *sim, size_t count, uint32_t *clock)
+{
+    *clock += SAMPLE_TICKS;
+    for (size_t i = 0; i < count; i++)
+        sim[i].snapshot.runTime += (uint32_t)((uint64_t)SAMPLE_TICKS * sim[i].permille / 1000);
+}
+
+static void sample(TaskProfiler &profiler, SimTask *sim, size_t count, uint32_t clock)
+{
+    TaskSnapshot snapshots[PROFILER_MAX_TASKS + 4];
+    for (size_t i = 0; i < count; i++)
+        snapshots[i] = sim[i].snapshot;
+    profiler.record(clock, snapshots, count, {100000, 25000});
+}
+
+static size_t slotNamed(const TaskProfiler &profiler, const char *name, size_t window)
+{
+    size_t slots[PROFILER_MAX_TASKS];
+    size_t found = profiler.busiest(window, slots, PROFILER_MAX_TASKS);
+    for (size_t i = 0; i < found; i++)
+        if (strcmp(profiler.taskName(slots[i]), name) == 0)
+            return slots[i];
+    return PROFILER_MAX_TASKS;
+}
+
+static int expectLoad(const char *what, int32_t got, int32_t want)
+{
+    if (got >= want - 1 && got <= want + 1) // Integer division of the share
+        return 0;
+    printf("FAIL: %s is %d permille, expected %d\n", what, got, want);
+    return 1;
+}
+
+int benchProfiler()
+{
+    int failures = 0;
+    printf("\n== Task profiler ==\n");
+
+    // Core 0: ModbusTask at 30 %, core 1: a burst in MqttLoop over the last 10 samples.
+    // The clock starts just below the wrap so every window crosses it.
+    static TaskProfiler profiler;
+    SimTask sim[] = {
+        {{1, "IDLE0", 0, 0, 0, 1000, true}, 700},
+        {{2, "IDLE1", 0, 1, 0, 1000, true}, 1000},
+        {{3, "ModbusTask", 0, 0, 2, 1800, false}, 300},
+        {{4, "MqttLoop", 0, 1, 1, 5000, false}, 0},
+        {{5, "Background", 0, -1, 1, 6000, false}, 0},
+    };
+    const size_t tasks = sizeof(sim) / sizeof(sim[0]);
+    uint32_t clock = UINT32_MAX - 30 * SAMPLE_TICKS;
+    for (size_t i = 0; i < tasks; i++)
+        sim[i].snapshot.runTime = UINT32_MAX - 20 * SAMPLE_TICKS;
+    if (profiler.taskLoad(0, 0) != -1)
+    {
+        printf("FAIL: load before any sample\n");
+        failures++;
+    }
+    sample(profiler, sim, tasks, clock);
+    for (int s = 0; s < 50; s++)
+    {
+        advance(sim, tasks, &clock);
+        sample(profiler, sim, tasks, clock);
+    }
+    sim[1].permille = 0, sim[3].permille = 1000;
+    for (int s = 0; s < 10; s++)
+    {
+        advance(sim, tasks, &clock);
+        sample(profiler, sim, tasks, clock);
+    }
+
+    size_t mqtt = slotNamed(profiler, "MqttLoop", 0);
+    size_t modbus = slotNamed(profiler, "ModbusTask", 0);
+    failures += expectLoad("MqttLoop over 1 s", profiler.taskLoad(mqtt, 0), 1000);
+    failures += expectLoad("MqttLoop over 10 s", profiler.taskLoad(mqtt, 1), 1000);
+    failures += expectLoad("MqttLoop over 60 s", profiler.taskLoad(mqtt, 2), 166);
+    failures += expectLoad("ModbusTask over 60 s", profiler.taskLoad(modbus, 2), 300);
+    failures += expectLoad("core 0 over 10 s", profiler.coreLoad(0, 1), 300);
+    failures += expectLoad("core 1 over 1 s", profiler.coreLoad(1, 0), 1000);
+    failures += expectLoad("core 1 over 60 s", profiler.coreLoad(1, 2), 166);
+    size_t top[2];
+    if (profiler.busiest(2, top, 2) != 2 || top[0] != modbus || top[1] != mqtt)
+    {
+        printf("FAIL: busiest tasks over 60 s\n");
+        failures++;
+    }
+
+    // A task created mid-window counts from zero; a deleted task's slot is
+    // reused without its history
+    SimTask churn[tasks + 1];
+    memcpy(churn, sim, sizeof(sim));
+    churn[4] = {{6, "OTAWriter", 0, -1, 3, 2000, false}, 500}; // Background deleted, OTAWriter new
+    for (int s = 0; s < 4; s++)
+    {
+        advance(churn, tasks, &clock);
+        sample(profiler, churn, tasks, clock);
+    }
+    size_t writer = slotNamed(profiler, "OTAWriter", 0);
+    failures += expectLoad("new task over 1 s", profiler.taskLoad(writer, 0), 500);
+    failures += expectLoad("new task over 10 s", profiler.taskLoad(writer, 1), 200);
+    if (slotNamed(profiler, "Background", 0) != PROFILER_MAX_TASKS)
+    {
+        printf("FAIL: deleted task still listed\n");
+        failures++;
+    }
+
+    // More tasks than slots: the rest are counted, tracked ones keep working
+    SimTask crowd[PROFILER_MAX_TASKS + 3];
+    for (size_t i = 0; i < PROFILER_MAX_TASKS + 3; i++)
+        crowd[i] = i < tasks ? churn[i] : SimTask{{(uint32_t)(100 + i), "worker", 0, -1, 1, 512, false}, 10};
+    advance(crowd, PROFILER_MAX_TASKS + 3, &clock);
+    sample(profiler, crowd, PROFILER_MAX_TASKS + 3, clock);
+    if (profiler.stats().untracked != 3 || profiler.fragmentation() != 750 || profiler.stats().minLargestBlock != 25000)
+    {
+        printf("FAIL: untracked %u, fragmentation %u\n", profiler.stats().untracked, profiler.fragmentation());
+        failures++;
+    }
+
+    profiler.recordCost(42);
+    static char json[4096];
+    size_t length = profiler.writeJson(json, sizeof(json));
+    const char *expectedJson[] = {"\"windowsMs\":[1000,10000,60000]", "\"cores\":[[",
+                                  "{\"name\":\"ModbusTask\",\"core\":0,\"priority\":2,\"stackFree\":1800,\"cpu\":[30.0,",
+                                  "\"heap\":{\"free\":100000,\"largestBlock\":25000,\"minLargestBlock\":25000,\"fragmentation\":75.0,",
+                                  "\"untracked\":3,\"costUs\":{\"last\":42,\"max\":42}}"};
+    for (const char *fragment : expectedJson)
+    {
+        if (!length || !strstr(json, fragment))
+        {
+            printf("FAIL: profile JSON lacks %s\n", fragment);
+            failures++;
+        }
+    }
+    if (profiler.writeJson(json, 128))
+    {
+        printf("FAIL: overflow not reported\n");
+        failures++;
+    }
+    printf("profile report, %u tasks: %zu B JSON\n", PROFILER_MAX_TASKS, length);
+
+    // What the profiler task pays per sample once the task list is read, and for a report
+    runBench("sample, full task list", sizeof(TaskProfiler), 100000, [&]()
+             {
+        advance(crowd, PROFILER_MAX_TASKS, &clock);
+        sample(profiler, crowd, PROFILER_MAX_TASKS, clock); });
+    runBench("profile report", length, 10000, [&]()
+             { doNotOptimize(profiler.writeJson(json, sizeof(json))); });
+    return failures;
+}
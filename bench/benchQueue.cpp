@@ -0,0 +1,120 @@
+// SPSC sample queue: ordering and overflow handling, on one thread and across two
+#include <Arduino.h>
+#include <thread>
+#include "sampleQueue.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 1000000;
+static const uint32_t THREADED_SAMPLES = 100000;
+
+static TimedSample stamped(uint32_t timestamp)
+{
+    TimedSample sample;
+    memset(&sample, 0, sizeof(sample));
+    sample.timestamp = timestamp;
+    return sample;
+}
+
+// Producer and consumer on two threads: every popped sample must be newer than the last
+static bool threadedOrder(bool dropOldest, uint32_t *received)
+{
+    static SpscQueue<TimedSample, 32> queue;
+    TimedSample sample;
+    while (queue.pop(&sample))
+    {
+    }
+
+    bool ordered = true;
+    std::thread consumer([&]()
+                         {
+        uint32_t last = 0;
+        TimedSample popped;
+        while (last != THREADED_SAMPLES)
+        {
+            if (!queue.pop(&popped))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(20)); // Let the producer run on a single-core host
+                continue;
+            }
+            if (popped.timestamp <= last)
+                ordered = false;
+            last = popped.timestamp;
+            (*received)++;
+        } });
+    for (uint32_t i = 1; i <= THREADED_SAMPLES; i++)
+    {
+        while (!queue.push(stamped(i)))
+        {
+            if (dropOldest)
+                queue.dropOldest();
+            else
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+        }
+    }
+    consumer.join();
+    return ordered;
+}
+
+int benchQueue()
+{
+    int failures = 0;
+    SpscQueue<TimedSample, 4> queue;
+    TimedSample sample;
+
+    printf("\n== Sample queue ==\n");
+
+    // FIFO up to capacity, then full
+    for (uint32_t i = 1; i <= 4; i++)
+        queue.push(stamped(i));
+    if (queue.push(stamped(5)) || queue.size() != 4 || !queue.pop(&sample) || sample.timestamp != 1)
+    {
+        printf("FAIL: FIFO / full\n");
+        failures++;
+    }
+
+    // Drop oldest: 2 goes, 5 takes its place at the back
+    queue.push(stamped(5));
+    if (!queue.dropOldest() || !queue.push(stamped(6)))
+    {
+        printf("FAIL: drop oldest\n");
+        failures++;
+    }
+    uint32_t expected[] = {3, 4, 5, 6};
+    for (uint32_t timestamp : expected)
+    {
+        if (!queue.pop(&sample) || sample.timestamp != timestamp)
+        {
+            printf("FAIL: order after drop oldest\n");
+            failures++;
+            break;
+        }
+    }
+    if (queue.pop(&sample) || queue.dropOldest())
+    {
+        printf("FAIL: empty queue\n");
+        failures++;
+    }
+
+    runBench("push+pop (same thread)", sizeof(TimedSample), ITERATIONS, [&]()
+             {
+        queue.push(sample);
+        queue.pop(&sample);
+        doNotOptimize(sample); });
+
+    // Two threads, the consumer sees samples in order with and without drop-oldest
+    uint32_t received = 0;
+    if (!threadedOrder(false, &received) || received != THREADED_SAMPLES)
+    {
+        printf("FAIL: threaded, lossless\n");
+        failures++;
+    }
+    printf("2 threads, lossless:     %6u of %u received in order\n", received, THREADED_SAMPLES);
+    received = 0;
+    if (!threadedOrder(true, &received))
+    {
+        printf("FAIL: threaded, drop oldest\n");
+        failures++;
+    }
+    printf("2 threads, drop oldest:  %6u of %u received in order\n", received, THREADED_SAMPLES);
+    return failures;
+}
@@ -0,0 +1,102 @@
+// Read plan optimizer: correctness and bus time saved by the plan (cost model)
+#include <Arduino.h>
+#include "readPlanner.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t BAUD = 115200;
+static const uint32_t TURNAROUND_US = 5000;
+
+static bool sameRanges(const ReadRange *ranges, size_t count, const ReadRange *expected, size_t expectedCount)
+{
+    if (count != expectedCount)
+        return false;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (ranges[i].startAddr != expected[i].startAddr || ranges[i].regQuantity != expected[i].regQuantity)
+            return false;
+    }
+    return true;
+}
+
+// One row of the cost report: the plan against one read per register and against exact runs (no gap tolerance)
+static void reportPlan(const char *name, const uint16_t *registers, size_t count, uint16_t gapTolerance)
+{
+    ReadRange ranges[256];
+    size_t planned = planReads(registers, count, gapTolerance, ranges, 256);
+    size_t exact = planReads(registers, count, 0, ranges + 128, 128);
+    uint32_t planUs = estimatePlanMicros(ranges, planned, BAUD, TURNAROUND_US);
+    uint32_t exactUs = estimatePlanMicros(ranges + 128, exact, BAUD, TURNAROUND_US);
+    uint32_t perRegisterUs = count * estimateReadMicros(1, BAUD, TURNAROUND_US);
+    printf("%-22s %4zu regs gap %2u: %3zu reads %7u us | exact runs %3zu reads %7u us | per register %7u us\n",
+           name, count, gapTolerance, planned, planUs, exact, exactUs, perRegisterUs);
+}
+
+int benchReadPlanner()
+{
+    int failures = 0;
+    ReadRange ranges[64];
+
+    printf("\n== Read planner ==\n");
+
+    // D1..D6 and D10: one read with tolerance 3, two without
+    const uint16_t chamber[] = {9, 0, 1, 2, 3, 4, 5, 5};
+    const ReadRange merged[] = {{0, 10}};
+    const ReadRange split[] = {{0, 6}, {9, 1}};
+    if (!sameRanges(ranges, planReads(chamber, 8, 3, ranges, 64), merged, 1) ||
+        !sameRanges(ranges, planReads(chamber, 8, 2, ranges, 64), split, 2))
+    {
+        printf("FAIL: gap tolerance\n");
+        failures++;
+    }
+
+    // 200 contiguous registers split at the 125 limit
+    uint16_t wide[200];
+    for (uint16_t i = 0; i < 200; i++)
+        wide[i] = 1000 + i;
+    const ReadRange wideExpected[] = {{1000, 125}, {1125, 75}};
+    if (!sameRanges(ranges, planReads(wide, 200, 10, ranges, 64), wideExpected, 2))
+    {
+        printf("FAIL: 125 register limit\n");
+        failures++;
+    }
+
+    // Too many ranges for the output is reported, not truncated
+    const uint16_t sparse[] = {0, 100, 200};
+    if (planReads(sparse, 3, 0, ranges, 2) != 0)
+    {
+        printf("FAIL: output overflow not reported\n");
+        failures++;
+    }
+
+    uint16_t mapRegisters[CHAMBER_REGISTER_COUNT];
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+        mapRegisters[i] = CHAMBER_REGISTER_MAP[i].reg;
+
+    // A larger controller: PV/SP blocks every 20 registers plus scattered alarms
+    uint16_t large[120];
+    size_t largeCount = 0;
+    for (uint16_t block = 0; block < 10; block++)
+    {
+        for (uint16_t r = 0; r < 8; r++)
+            large[largeCount++] = block * 20 + r;
+        large[largeCount++] = block * 20 + 15;
+    }
+    for (uint16_t alarm = 0; alarm < 10; alarm++)
+        large[largeCount++] = 300 + alarm * 7;
+
+    printf("Bus time per cycle at %u baud, %u us slave turnaround:\n", BAUD, TURNAROUND_US);
+    reportPlan("CHAMBER_REGISTER_MAP", mapRegisters, CHAMBER_REGISTER_COUNT, 4);
+    reportPlan("large controller", large, largeCount, 0);
+    reportPlan("large controller", large, largeCount, 4);
+    reportPlan("large controller", large, largeCount, 8);
+    reportPlan("large controller", large, largeCount, 16);
+
+    runBench("plan large controller", largeCount * 2, 100000, [&]()
+             {
+                 size_t n = planReads(large, largeCount, 8, ranges, 64);
+                 doNotOptimize(n);
+             });
+
+    return failures;
+}
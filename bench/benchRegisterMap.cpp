@@ -0,0 +1,93 @@
+// Table-driven register decoder (registerMap.h) against the previous handwritten mapping
+#include <Arduino.h>
+#include "modbusHelper.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t ITERATIONS = 2000000;
+
+// The mapping readModbusResponse used before CHAMBER_REGISTER_MAP, kept as the baseline
+static ChamberData decodeHandwritten(const uint8_t *dataBytes, size_t byteCount)
+{
+    ChamberData chamberData;
+    memset(&chamberData, 0, sizeof(chamberData));
+    chamberData.tempPV = unsignedToSignedFloat((dataBytes[0] << 8) | dataBytes[1]);
+    chamberData.tempSP = unsignedToSignedFloat((dataBytes[2] << 8) | dataBytes[3]);
+    chamberData.wetPV = unsignedToSignedFloat((dataBytes[4] << 8) | dataBytes[5]);
+    chamberData.wetSP = unsignedToSignedFloat((dataBytes[6] << 8) | dataBytes[7]);
+    chamberData.humiPV = unsignedToSignedFloat((dataBytes[8] << 8) | dataBytes[9]);
+    chamberData.humiSP = unsignedToSignedFloat((dataBytes[10] << 8) | dataBytes[11]);
+    if (byteCount >= 20)
+    {
+        chamberData.nowSTS = (dataBytes[18] << 8) | dataBytes[19];
+    }
+    return chamberData;
+}
+
+int benchRegisterMap()
+{
+    int failures = 0;
+    uint8_t data[20];
+
+    printf("\n== Register map decoder ==\n");
+
+    for (size_t i = 0; i < sizeof(data); i += 2)
+    {
+        int16_t value = (int16_t)(i * 250 - 1234); // Includes negative values
+        data[i] = (uint8_t)((uint16_t)value >> 8);
+        data[i + 1] = (uint8_t)value;
+    }
+
+    ChamberData expected = decodeHandwritten(data, sizeof(data));
+    ChamberData decoded;
+    memset(&decoded, 0, sizeof(decoded));
+    size_t count = decodeRegisters(data, sizeof(data), 0, &decoded);
+    if (count != CHAMBER_REGISTER_COUNT || decoded.tempPV != expected.tempPV || decoded.humiSP != expected.humiSP ||
+        decoded.wetPV != expected.wetPV || decoded.nowSTS != expected.nowSTS)
+    {
+        printf("FAIL: table decoder differs from the handwritten mapping\n");
+        failures++;
+    }
+
+    // Six registers returned: D10 must not be read past the end
+    memset(&decoded, 0, sizeof(decoded));
+    decodeRegisters(data, 12, 0, &decoded);
+    if (decoded.nowSTS != 0 || (decoded.validMask & (1UL << (CHAMBER_REGISTER_COUNT - 1))))
+    {
+        printf("FAIL: table decoder read past the returned registers\n");
+        failures++;
+    }
+
+    // A block starting at D10 only fills nowSTS
+    memset(&decoded, 0, sizeof(decoded));
+    if (decodeRegisters(data + 18, 2, 9, &decoded) != 1 || decoded.nowSTS != expected.nowSTS)
+    {
+        printf("FAIL: table decoder with a non-zero start address\n");
+        failures++;
+    }
+
+    // The serializer walks the same table and skips fields that were not decoded
+    size_t fields = 0;
+    visitChamberFields(decoded, [&](const RegisterField &, auto)
+                       { fields++; });
+    if (fields != 1)
+    {
+        printf("FAIL: serializer visited fields that were not decoded\n");
+        failures++;
+    }
+
+    runBench("decode handwritten", sizeof(data), ITERATIONS, [&]()
+             {
+                 ChamberData d = decodeHandwritten(data, sizeof(data));
+                 doNotOptimize(d);
+             });
+    runBench("decode register map", sizeof(data), ITERATIONS, [&]()
+             {
+                 ChamberData d;
+                 memset(&d, 0, sizeof(d));
+                 decodeRegisters(data, sizeof(data), 0, &d);
+                 doNotOptimize(d);
+             });
+
+    return failures;
+}
@@ -0,0 +1,267 @@
+// Modbus writes: FC 06/16 frames against the spec examples, echo and read back
+// checks, the SET parser, the write queue and the wait a write sees on a busy bus
+#include <Arduino.h>
+#include "modbusWrite.h"
+#include "pollConfig.h"
+#include "pollScheduler.h"
+#include "registerMap.h"
+#include "benchHarness.h"
+
+static const uint32_t BAUD = 115200;
+static const uint32_t TURNAROUND_US = 5000;
+static const uint32_t SIMULATED_MS = 60000;
+
+static size_t fieldIndex(const char *key)
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (strcmp(CHAMBER_REGISTER_MAP[i].key, key) == 0)
+            return i;
+    }
+    return CHAMBER_REGISTER_COUNT;
+}
+
+static int expectRejected(const char *text, const char *reason)
+{
+    WriteCommand command;
+    char error[96] = "";
+    if (parseWriteCommand(text, &command, error, sizeof(error)))
+    {
+        printf("FAIL: accepted SET \"%s\"\n", text);
+        return 1;
+    }
+    if (!strstr(error, reason))
+    {
+        printf("FAIL: SET \"%s\" rejected with \"%s\", expected \"%s\"\n", text, error, reason);
+        return 1;
+    }
+    return 0;
+}
+
+// Bus time of each poll transaction on a fake clock, as the Modbus task would run them
+struct BusInterval
+{
+    uint32_t startUs, endUs;
+    uint8_t slaveAddr;
+};
+
+static size_t simulateBus(const PollConfig &config, BusInterval *intervals, size_t maxIntervals)
+{
+    PollJob jobs[POLL_MAX_JOBS];
+    size_t count = planPollJobs(config.slaves, config.slaveCount, 4, jobs, POLL_MAX_JOBS);
+    static PollScheduler scheduler;
+    scheduler.begin(jobs, count, 0);
+    uint32_t nowUs = 0;
+    size_t used = 0;
+    while (nowUs < SIMULATED_MS * 1000 && used < maxIntervals)
+    {
+        uint32_t waitMs = 0;
+        int index = scheduler.nextDueJob(nowUs / 1000, &waitMs);
+        if (index < 0)
+        {
+            nowUs = (nowUs / 1000 + waitMs) * 1000;
+            continue;
+        }
+        scheduler.markStarted(index, nowUs / 1000);
+        const PollJob &job = scheduler.job(index);
+        uint32_t busUs = estimateReadMicros(job.regQuantity, BAUD, TURNAROUND_US, job.transport);
+        intervals[used++] = {nowUs, nowUs + busUs, job.slaveAddr};
+        nowUs += busUs;
+    }
+    return used;
+}
+
+int benchWrite()
+{
+    int failures = 0;
+    printf("\n== Modbus writes ==\n");
+
+    // Frames of the Modbus application protocol spec examples
+    uint8_t request[WRITE_REQUEST_SIZE];
+    const uint16_t single[] = {0x0003};
+    const uint8_t expectSingle[] = {0x01, 0x06, 0x00, 0x01, 0x00, 0x03, 0x98, 0x0B};
+    size_t length = prepareModbusWriteRequest(request, 1, 0x06, 1, single, 1);
+    if (length != sizeof(expectSingle) || memcmp(request, expectSingle, length) != 0)
+    {
+        printf("FAIL: Write Single Register frame\n");
+        failures++;
+    }
+    const uint16_t multiple[] = {0x000A, 0x0102};
+    const uint8_t expectMultiple[] = {0x01, 0x10, 0x00, 0x01, 0x00, 0x02, 0x04, 0x00, 0x0A, 0x01, 0x02, 0x92, 0x30};
+    length = prepareModbusWriteRequest(request, 1, 0x10, 1, multiple, 2);
+    if (length != sizeof(expectMultiple) || memcmp(request, expectMultiple, length) != 0)
+    {
+        printf("FAIL: Write Multiple Registers frame\n");
+        failures++;
+    }
+
+    // Acknowledged by the echo of address and quantity; exceptions and other answers are not
+    const uint8_t echo[] = {0x01, 0x10, 0x00, 0x01, 0x00, 0x02};
+    const uint8_t refused[] = {0x01, 0x90, 0x02};
+    const uint8_t other[] = {0x01, 0x10, 0x00, 0x01, 0x00, 0x01};
+    if (checkModbusWriteResponse(echo, sizeof(echo), request) != MODBUS_OK ||
+        checkModbusWriteResponse(refused, sizeof(refused), request) != MODBUS_EXCEPTION ||
+        checkModbusWriteResponse(other, sizeof(other), request) != MODBUS_LENGTH_ERROR ||
+        checkModbusWriteResponse(echo, 3, request) != MODBUS_LENGTH_ERROR)
+    {
+        printf("FAIL: write response check\n");
+        failures++;
+    }
+
+    // SET text: fields in register order, values scaled like the register map
+    WriteCommand command;
+    char error[96] = "";
+    size_t tempSP = fieldIndex("tempSP"), humiSP = fieldIndex("humiSP");
+    if (!parseWriteCommand("1 humiSP=60 tempSP=-20.5 id=42", &command, error, sizeof(error)) ||
+        command.slaveAddr != 1 || command.id != 42 || command.count != 2 || command.forceMultiple ||
+        command.fields[0] != tempSP || command.values[0] != (uint16_t)-2050 ||
+        command.fields[1] != humiSP || command.values[1] != 6000)
+    {
+        printf("FAIL: parse SET: %s\n", error);
+        failures++;
+    }
+    // Set points are not adjacent: one Write Single Register each, unless fc=16
+    uint16_t startAddr = 0, quantity = 0;
+    writeReadRange(command, &startAddr, &quantity);
+    if (writeRunLength(command, 0) != 1 || writeRunFunction(command, 1) != 0x06 || startAddr != 1 || quantity != 5)
+    {
+        printf("FAIL: runs of tempSP + humiSP\n");
+        failures++;
+    }
+    WriteCommand forced;
+    if (!parseWriteCommand("3 tempSP=25 fc=16", &forced, error, sizeof(error)) || writeRunFunction(forced, 1) != 0x10)
+    {
+        printf("FAIL: fc=16\n");
+        failures++;
+    }
+    // Adjacent registers share one transaction (the run logic only looks at addresses)
+    WriteCommand adjacent = {};
+    adjacent.count = 3;
+    adjacent.fields[0] = (uint8_t)fieldIndex("tempPV"), adjacent.fields[1] = (uint8_t)tempSP, adjacent.fields[2] = (uint8_t)humiSP;
+    if (writeRunLength(adjacent, 0) != 2 || writeRunFunction(adjacent, 2) != 0x10 || writeRunLength(adjacent, 2) != 1)
+    {
+        printf("FAIL: adjacent registers\n");
+        failures++;
+    }
+
+    failures += expectRejected("1 tempPV=20", "tempPV is not writable");
+    failures += expectRejected("1 humiSP=120", "outside 0..100");
+    failures += expectRejected("1 tempSP=warm", "bad value");
+    failures += expectRejected("1 dewPoint=3", "unknown field 'dewPoint'");
+    failures += expectRejected("0 tempSP=25", "slave address");
+    failures += expectRejected("1", "no fields");
+    failures += expectRejected("1 tempSP=25 tempSP=26", "given twice");
+    failures += expectRejected("1 tempSP=25 fc=3", "fc is 6 or 16");
+    failures += expectRejected("1 tempSP", "expected <field>=<value>");
+
+    // Read back of registers 1..5: what was written, then a controller that clamped humiSP
+    uint8_t readBack[3 + 10] = {0x01, 0x03, 10};
+    const uint16_t registers[] = {(uint16_t)-2050, 0, 0, 0, 6000};
+    for (size_t i = 0; i < 5; i++)
+        readBack[3 + i * 2] = registers[i] >> 8, readBack[4 + i * 2] = registers[i] & 0xFF;
+    WriteAck ack = {};
+    ack.command = command;
+    ack.result = checkWriteReadBack(command, readBack, sizeof(readBack), ack.readBack);
+    ack.waitMs = 3, ack.busUs = 41000, ack.latencyMs = 45;
+    char json[WRITE_ACK_SIZE];
+    length = writeAckJson(ack, json, sizeof(json));
+    const char *expected = "{\"id\":42,\"slave\":1,\"result\":\"ok\",\"written\":{\"tempSP\":-20.50,\"humiSP\":60.00},"
+                           "\"readBack\":{\"tempSP\":-20.50,\"humiSP\":60.00},\"waitMs\":3,\"busUs\":41000,\"latencyMs\":45}";
+    if (ack.result != WRITE_OK || !length || strcmp(json, expected) != 0)
+    {
+        printf("FAIL: ack %s\n", json);
+        failures++;
+    }
+    readBack[11] = 5990 >> 8, readBack[12] = 5990 & 0xFF;
+    ack.result = checkWriteReadBack(command, readBack, sizeof(readBack), ack.readBack);
+    writeAckJson(ack, json, sizeof(json));
+    if (ack.result != WRITE_MISMATCH || !strstr(json, "\"result\":\"mismatch\"") || !strstr(json, "\"readBack\":{\"tempSP\":-20.50,\"humiSP\":59.90}") ||
+        checkWriteReadBack(command, readBack, 9, ack.readBack) != WRITE_BAD_FRAME)
+    {
+        printf("FAIL: read back mismatch %s\n", json);
+        failures++;
+    }
+    ack.result = writeResultOf(MODBUS_EXCEPTION);
+    ack.exceptionCode = 3;
+    writeAckJson(ack, json, sizeof(json));
+    if (!strstr(json, "\"result\":\"exception\"") || !strstr(json, "\"exception\":3") || strstr(json, "readBack") ||
+        writeResultOf(MODBUS_CRC_ERROR) != WRITE_BAD_FRAME || writeAckJson(ack, json, 32))
+    {
+        printf("FAIL: exception ack %s\n", json);
+        failures++;
+    }
+
+    // Queue: first in, first out; a newer write of the same fields takes the older one's place
+    static WriteQueue queue;
+    WriteCommand first = command, second = forced, newer = command, superseded, taken;
+    newer.id = 43;
+    newer.values[0] = 2500;
+    if (queue.push(first, &superseded) != WRITE_OK || queue.push(second, &superseded) != WRITE_OK ||
+        queue.push(newer, &superseded) != WRITE_SUPERSEDED || superseded.id != 42 || queue.size() != 2 ||
+        !queue.pop(&taken) || taken.id != 43 || taken.values[0] != 2500 || !queue.pop(&taken) || taken.slaveAddr != 3 ||
+        queue.pop(&taken))
+    {
+        printf("FAIL: write queue order\n");
+        failures++;
+    }
+    for (uint8_t slave = 1; slave <= WRITE_QUEUE_SIZE; slave++)
+    {
+        WriteCommand queued = command;
+        queued.slaveAddr = slave;
+        queue.push(queued, &superseded);
+    }
+    if (queue.push(forced, &superseded) != WRITE_QUEUE_FULL || queue.stats().rejected != 1 ||
+        queue.stats().superseded != 1 || queue.stats().highWater != WRITE_QUEUE_SIZE)
+    {
+        printf("FAIL: full write queue\n");
+        failures++;
+    }
+
+    // Wait for the bus: ahead of the next poll a write waits for the transaction in progress at
+    // most, where riding along with the slave's next poll would wait up to its period
+    PollConfig config;
+    parsePollConfig("slave=1 period=1s; slave=2 period=1s; slave=3 period=1s; slave=4 period=1s", &config, error, sizeof(error));
+    static BusInterval intervals[1024];
+    size_t used = simulateBus(config, intervals, 1024);
+    uint32_t longestUs = 0, maxWaitUs = 0, maxPollWaitUs = 0;
+    uint64_t totalWaitUs = 0;
+    for (size_t i = 0; i < used; i++)
+        longestUs = intervals[i].endUs - intervals[i].startUs > longestUs ? intervals[i].endUs - intervals[i].startUs : longestUs;
+    uint32_t seed = 7;
+    const uint32_t arrivals = 2000;
+    for (uint32_t a = 0; a < arrivals; a++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        uint32_t atUs = seed % ((SIMULATED_MS - 2000) * 1000);
+        uint32_t waitUs = 0, pollWaitUs = 0;
+        for (size_t i = 0; i < used; i++)
+        {
+            if (intervals[i].startUs <= atUs && atUs < intervals[i].endUs)
+                waitUs = intervals[i].endUs - atUs;
+            if (intervals[i].startUs >= atUs && intervals[i].slaveAddr == 1)
+            {
+                pollWaitUs = intervals[i].startUs - atUs;
+                break;
+            }
+        }
+        totalWaitUs += waitUs;
+        maxWaitUs = waitUs > maxWaitUs ? waitUs : maxWaitUs;
+        maxPollWaitUs = pollWaitUs > maxPollWaitUs ? pollWaitUs : maxPollWaitUs;
+    }
+    if (maxWaitUs > longestUs)
+    {
+        printf("FAIL: a write waited %u us, longer than one transaction (%u us)\n", maxWaitUs, longestUs);
+        failures++;
+    }
+    printf("4 slaves every 1 s, %u writes: wait for the bus max %.1f ms, mean %.2f ms (one read is %.1f ms); "
+           "with the next poll max %.0f ms\n", arrivals, maxWaitUs / 1000.0, totalWaitUs / 1000.0 / arrivals,
+           longestUs / 1000.0, maxPollWaitUs / 1000.0);
+
+    runBench("parse SET", 32, 200000, [&]()
+             { doNotOptimize(parseWriteCommand("1 tempSP=25.5 humiSP=60 id=7", &command, error, sizeof(error))); });
+    runBench("write frame + ack", length, 200000, [&]()
+             {
+        doNotOptimize(prepareModbusWriteRequest(request, 1, 0x10, 1, multiple, 2));
+        doNotOptimize(writeAckJson(ack, json, sizeof(json))); });
+    return failures;
+}
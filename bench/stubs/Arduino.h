@@ -0,0 +1,105 @@
+// Minimal Arduino stand-in for the native (host) environment.
+// Only what the host-built modules use is provided; Serial output is discarded
+// so the benchmarks measure the codec and not the console.
+#ifndef NATIVE_ARDUINO_STUB_H
+#define NATIVE_ARDUINO_STUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+#define DEC 10
+#define HEX 16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// Base of DebugSerial's line formatter; the device core's Print has many more overloads
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+
+    size_t write(const uint8_t *data, size_t length)
+    {
+        size_t n = 0;
+        while (length--)
+            n += write(*data++);
+        return n;
+    }
+
+    size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value, int base = DEC) { return print((long)value, base); }
+    size_t print(unsigned value, int base = DEC) { return print((unsigned long)value, base); }
+
+    size_t print(long value, int base = DEC)
+    {
+        if (base == DEC)
+            return printFormatted("%ld", value);
+        return print((unsigned long)value, base);
+    }
+
+    size_t print(unsigned long value, int base = DEC)
+    {
+        return printFormatted(base == HEX ? "%lX" : "%lu", value);
+    }
+
+    size_t print(double value, int digits = 2)
+    {
+        char text[32];
+        snprintf(text, sizeof(text), "%.*f", digits, value);
+        return print(text);
+    }
+
+private:
+    template <typename T>
+    size_t printFormatted(const char *format, T value)
+    {
+        char text[24];
+        snprintf(text, sizeof(text), format, value);
+        return print(text);
+    }
+};
+
+class NativeSerial
+{
+public:
+    void begin(unsigned long) {}
+
+    template <typename T>
+    size_t print(const T &, int = DEC) { return 0; }
+
+    template <typename T>
+    size_t println(const T &, int = DEC) { return 0; }
+
+    size_t println() { return 0; }
+};
+
+extern NativeSerial Serial;
+
+inline unsigned long millis()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)duration_cast<milliseconds>(steady_clock::now() - start).count();
+}
+
+inline unsigned long micros()
+{
+    using namespace std::chrono;
+    static const steady_clock::time_point start = steady_clock::now();
+    return (unsigned long)duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+inline void delay(unsigned long ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+#endif
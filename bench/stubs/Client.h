@@ -0,0 +1,21 @@
+// Arduino network client interface, the subset the host-built modules use.
+// On the device WiFiClient implements it; the benchmarks use a socket client.
+#ifndef NATIVE_CLIENT_STUB_H
+#define NATIVE_CLIENT_STUB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+class Client
+{
+public:
+    virtual ~Client() {}
+    virtual int connect(const char *host, uint16_t port) = 0;
+    virtual size_t write(const uint8_t *buf, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read(uint8_t *buf, size_t size) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+};
+
+#endif
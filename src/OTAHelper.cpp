@@ -1,37 +1,69 @@
-#include <HTTPClient.h>
 #include <Update.h>
 #include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <new>
 #include "OTAHelper.h"
 #include "debugSerial.h"
+#include "resourceGuard.h"
+#include "otaPipeline.h"
+#include "infoHelper.h"
+#include "metrics.h"
 
-#define BUFFERSIZE 4000
+#define OTA_MAX_ATTEMPTS 6       // Connections per update, the first plus Range resumes
+#define OTA_RETRY_DELAY 2000     // ms before resuming, times the attempt number
+#define OTA_STALL_TIMEOUT 15000  // ms without data before the connection is dropped and resumed
+#define OTA_WRITER_PRIORITY 1
+#define OTA_DIGEST_HEADER "X-Firmware-SHA256" // Digest of the image as flashed, compressed or not
+#define OTA_SIZE_HEADER "X-Firmware-Size"     // Image size of a compressed download, optional
+#define FIRMWARE_QUERY "/firmware?filePrefix=" APPUPDNAME "&screenSize=" APPSCREENSIZE "&version=" APPVERSION
+#ifndef OTA_REQUIRE_SHA256
+#define OTA_REQUIRE_SHA256 0 // 1 = refuse images sent without a digest, once the update server sends it
+#endif
 
 String vNewVersion = "N";
 
-int _totalLength;
-int _currentLength = 0; // current size of written firmware
-
-String _firmwareQuery = String(APPAPI) + "/firmware?filePrefix=" + String(APPUPDNAME) + "&screenSize=" + String(APPSCREENSIZE) + "&version=" + String(APPVERSION);
+OtaStats _otaStats = {};
+extern MetricsRegistry metrics;
+volatile bool _otaWriterRunning = false; // Cleared by the writer task as it exits
+char _firmwareETag[64] = "";                // Of the last check response, sent back as If-None-Match
 
 String OTACheck(boolean forceUpdate)
 {
-    HTTPClient client;
-    String queryURL = _firmwareQuery + "&update=N";
-    DebugSerial::println("Will connect " + queryURL);
-    client.begin(queryURL.c_str());
-    client.addHeader("X-Secret-Key", String(APPAPIKEY));
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &backend = backendClient();
+    DebugSerial::println("Will connect " APPAPI FIRMWARE_QUERY "&update=N");
+    char conditional[96] = "";
+    if (_firmwareETag[0])
+    {
+        snprintf(conditional, sizeof(conditional), "If-None-Match: %s\r\n", _firmwareETag);
+    }
+    static const char *const headers[] = {"ETag"};
+    backend.collectHeaders(headers, 1);
     JsonDocument doc;
 
-    int httpResponseCode = client.GET();
+    int httpResponseCode = backend.request("GET", FIRMWARE_QUERY "&update=N", nullptr, conditional);
+    _otaStats.checks++;
 
-    if (httpResponseCode > 0)
+    if (httpResponseCode == 304)
+    {
+        // Same answer as last time, without a body to download and parse
+        _otaStats.notModified++;
+        DebugSerial::println("Firmware check: not modified");
+        backend.end();
+    }
+    else if (httpResponseCode > 0)
     {
         DebugSerial::print("HTTP Response code: ");
         DebugSerial::println(httpResponseCode);
-        String payload = client.getString();
+        const char *payload = backend.body();
         DebugSerial::println(payload);
-        client.end();
-        DeserializationError error = deserializeJson(doc, payload);
+        JsonDocument filter;
+        filter["hasnewversion"] = true;
+        DeserializationError error = deserializeJson(doc, payload, DeserializationOption::Filter(filter));
+        const char *etag = httpResponseCode == 200 ? backend.header("ETag") : "";
+        bool cacheable = strlen(etag) < sizeof(_firmwareETag);
+        backend.end();
 
         if (error)
         {
@@ -41,10 +73,11 @@ String OTACheck(boolean forceUpdate)
         }
 
         vNewVersion = doc["hasnewversion"].as<String>();
+        strcpy(_firmwareETag, cacheable ? etag : "");
     }
     else
     {
-        client.end();
+        backend.end();
     }
 
     if (vNewVersion == "Y" && forceUpdate)
@@ -55,80 +88,236 @@ String OTACheck(boolean forceUpdate)
     return vNewVersion;
 }
 
+// Flash side of the pipeline: hashes and writes chunks as the download task submits them
+static void otaWriterTask(void *param)
+{
+    OtaPipeline *pipeline = (OtaPipeline *)param;
+    while (!pipeline->failed() && !pipeline->drained())
+    {
+        bool wrote = pipeline->consume([](const uint8_t *data, size_t len)
+                                       {
+            ResourceLock flashLock(RESOURCE_FLASH); // Per chunk, so journal writes interleave with the download
+            return Update.write((uint8_t *)data, len) == len; });
+        if (!wrote)
+        {
+            vTaskDelay(1); // Waiting for the network
+        }
+    }
+    _otaWriterRunning = false; // The pipeline is not touched after this
+    vTaskDelete(NULL);
+}
+
+// "bytes <first>-<last>/<total>": true if the server resumed at `offset`
+static bool rangeStartsAt(const char *contentRange, uint32_t offset)
+{
+    const char *space = strchr(contentRange, ' ');
+    return space && strchr(space, '-') && strtoul(space + 1, nullptr, 10) == offset;
+}
+
+// Read one response body into the pipeline until the image is complete, the
+// connection drops or stalls. Returns the bytes still missing.
+static uint32_t downloadBody(BackendClient &backend, OtaPipeline &pipeline, uint32_t totalLength)
+{
+    uint8_t *buffer = nullptr;
+    size_t filled = 0;
+    uint32_t lastDataMs = millis();
+    while (pipeline.received() + filled < totalLength && !pipeline.failed())
+    {
+        if (!buffer && !(buffer = pipeline.acquire()))
+        {
+            vTaskDelay(1); // Every buffer is waiting for flash
+            continue;
+        }
+        size_t room = OTA_BUFFER_SIZE - filled;
+        uint32_t missing = totalLength - pipeline.received() - filled;
+        int count = backend.readBody(buffer + filled, min(room, (size_t)missing));
+        if (count < 0 || (!count && millis() - lastDataMs > OTA_STALL_TIMEOUT))
+            break;
+        if (!count)
+        {
+            vTaskDelay(1); // Nothing received yet, let lower-priority tasks run too
+            continue;
+        }
+        filled += count;
+        lastDataMs = millis();
+        // Hand over full buffers, and the last one
+        if (filled == OTA_BUFFER_SIZE || pipeline.received() + filled == totalLength)
+        {
+            pipeline.submit(buffer, filled);
+            buffer = nullptr;
+            filled = 0;
+        }
+    }
+    // What arrived before a drop is still good, the resume starts after it
+    if (buffer && filled)
+        pipeline.submit(buffer, filled);
+    return totalLength - pipeline.received();
+}
+
 void OTAUpdate()
 {
-    // Connect to external web server
-    HTTPClient client;
-    String fwVersionURL = _firmwareQuery + "&update=Y";
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &backend = backendClient();
     DebugSerial::println("Checking if new firmware is available.");
-    DebugSerial::println("Will connect " + fwVersionURL);
-
-    client.begin(fwVersionURL.c_str());
-    client.addHeader("X-Secret-Key", String(APPAPIKEY));
+    DebugSerial::println("Will connect " APPAPI FIRMWARE_QUERY "&update=Y");
 
-    int loopNumber = 0;
+    OtaPipeline *pipeline = new (std::nothrow) OtaPipeline(); // ~12 KB of buffers, only while updating
+    if (!pipeline)
+    {
+        DebugSerial::println("Not enough memory for the firmware download.");
+        return;
+    }
+    pipeline->begin();
+    InflateStream *inflater = nullptr; // Set if the server sent a compressed image
+    TaskHandle_t writerTask = nullptr;
+    uint32_t totalLength = 0;
+    uint32_t imageSize = 0;
+    uint8_t expected[SHA256_DIGEST_SIZE];
+    bool hasDigest = false;
+    uint32_t startMs = millis();
+    static const char *const headers[] = {OTA_DIGEST_HEADER, OTA_SIZE_HEADER, "Content-Range", "Content-Encoding"};
+    backend.collectHeaders(headers, 4);
+    _otaStats.attempts++;
 
-    // Get file, just to check if each reachable
-    int resp = client.GET();
-    DebugSerial::print("Response: ");
-    DebugSerial::println(resp);
-    // If file is reachable, start downloading
-    if (resp == 200)
+    for (uint8_t attempt = 0; attempt < OTA_MAX_ATTEMPTS && !pipeline->failed(); attempt++)
     {
-        _totalLength = client.getSize();
-        // transfer to local variable
-        int len = _totalLength;
-        // this is required to start firmware update process
-        Update.begin(UPDATE_SIZE_UNKNOWN);
-        DebugSerial::printf("FW Size: %u\n", _totalLength);
-        // create buffer for read
-        uint8_t buff[BUFFERSIZE] = {0};
-        // get tcp stream
-        WiFiClient *stream = client.getStreamPtr();
-        // read all data from server
-        DebugSerial::println("Updating firmware...");
-        while (client.connected() && (len > 0 || len == -1))
+        if (attempt)
+        {
+            DebugSerial::printf("\nDownload interrupted at %u of %u bytes, resuming\n", pipeline->received(), totalLength);
+            vTaskDelay(pdMS_TO_TICKS(OTA_RETRY_DELAY * attempt));
+            _otaStats.resumes++;
+        }
+        // Servers without compressed images ignore Accept-Encoding
+        char extraHeaders[64] = "Accept-Encoding: deflate\r\n";
+        uint32_t offset = pipeline->received();
+        if (offset)
         {
+            snprintf(extraHeaders + strlen(extraHeaders), sizeof(extraHeaders) - strlen(extraHeaders), "Range: bytes=%u-\r\n", offset);
+        }
+        int resp = backend.request("GET", FIRMWARE_QUERY "&update=Y", nullptr, extraHeaders);
+        DebugSerial::print("Response: ");
+        DebugSerial::println(resp);
 
-            if (loopNumber % 180 == 0)
+        const char *encoding = backend.header("Content-Encoding");
+        bool compressed = strcmp(encoding, "deflate") == 0;
+        if (!offset && resp == 200)
+        {
+            totalLength = backend.contentLength();
+            imageSize = totalLength;
+            if (compressed)
             {
-                DebugSerial::print(".");
+                // Inflated on the writer task into a window of at most 2^INFLATE_MAX_WINDOW_BITS bytes
+                inflater = new (std::nothrow) InflateStream();
+                const char *size = backend.header(OTA_SIZE_HEADER);
+                imageSize = size[0] ? strtoul(size, nullptr, 10) : UPDATE_SIZE_UNKNOWN;
             }
-            loopNumber++;
-
-            // get available data size
-            size_t size = stream->available();
-            if (size)
+            else if (encoding[0])
+            {
+                DebugSerial::printf("Unsupported firmware encoding %s\n", encoding);
+                backend.end();
+                break;
+            }
+            hasDigest = parseSha256Hex(backend.header(OTA_DIGEST_HEADER), expected);
+            if (totalLength == 0 || totalLength == (uint32_t)-1 || (OTA_REQUIRE_SHA256 && !hasDigest))
+            {
+                DebugSerial::println("Firmware response needs a Content-Length and an " OTA_DIGEST_HEADER " header.");
+                backend.end();
+                break;
+            }
+            if (!hasDigest)
+            {
+                DEBUG_WARN("No " OTA_DIGEST_HEADER " header, the image is installed unverified\n");
+            }
+            if ((compressed && !inflater) || !Update.begin(imageSize))
             {
-                // read up to 128 byte
-                int c = stream->readBytes(buff, ((size > sizeof(buff)) ? sizeof(buff) : size));
-                // pass to function
-                updateFirmware(buff, c);
-                if (len > 0)
-                {
-                    len -= c;
-                }
-                DebugSerial::printf("Downloading Stream: %d \n", _currentLength);
+                DebugSerial::printf("Cannot start the update: %s\n", inflater || !compressed ? Update.errorString() : "no memory");
+                backend.end();
+                break;
             }
-            // delay(1);
+            pipeline->begin(inflater);
+            _otaWriterRunning = true;
+            if (xTaskCreate(otaWriterTask, "OTAWriter", 4096, pipeline, OTA_WRITER_PRIORITY, &writerTask) != pdPASS)
+            {
+                _otaWriterRunning = false;
+                writerTask = nullptr;
+                Update.abort();
+                backend.end();
+                break;
+            }
+            DebugSerial::printf("FW Size: %u%s\n", totalLength, compressed ? " (deflate)" : "");
+            DebugSerial::println("Updating firmware...");
+        }
+        else if (!(offset && resp == 206 && rangeStartsAt(backend.header("Content-Range"), offset) && compressed == (inflater != nullptr)))
+        {
+            // A server that ignores Range answers 200 with the whole file: the written part cannot be rewound
+            DebugSerial::println("Cannot download firmware file.");
+            backend.end();
+            if (offset)
+                continue;
+            break;
         }
+
+        uint32_t missing = downloadBody(backend, *pipeline, totalLength);
+        backend.end(); // Closes the connection if the body was cut short
+        if (!missing)
+            break;
     }
-    else
+
+    bool complete = totalLength && pipeline->received() == totalLength;
+    if (writerTask)
     {
-        DebugSerial::println("Cannot download firmware file.");
+        if (!complete)
+            pipeline->fail();
+        pipeline->close();
+        while (_otaWriterRunning)
+        {
+            vTaskDelay(1); // Writer is flushing the last chunks
+        }
     }
-    client.end();
-}
-
-void updateFirmware(uint8_t *data, size_t len)
-{
-    Update.write(data, len);
-    _currentLength += len;
+    complete = complete && pipeline->imageComplete();
+    bool verified = complete && !pipeline->failed() && (!hasDigest || pipeline->verify(expected));
+    uint32_t elapsedMs = millis() - startMs;
+    const OtaPipelineStats &stats = pipeline->stats();
+    _otaStats.lastBytes = pipeline->written();
+    _otaStats.lastImageBytes = pipeline->imageSize();
+    _otaStats.lastMs = elapsedMs;
+    _otaStats.lastKBps = elapsedMs ? (float)pipeline->written() / elapsedMs * 1000.0f / 1024.0f : 0;
+    metrics.counter(METRIC_OTA_BYTES).add(pipeline->written());
+    metrics.gauge(METRIC_OTA_BYTES_PER_SEC).set(elapsedMs ? (int32_t)((uint64_t)pipeline->written() * 1000 / elapsedMs) : 0);
+    DebugSerial::printf("\nDownloaded %u bytes (%u image bytes) in %u ms, %.1f KB/s, %u chunks, %u reader stalls\n",
+                        pipeline->written(), pipeline->imageSize(), elapsedMs, _otaStats.lastKBps, stats.chunks, stats.readerStalls);
+    delete pipeline;
+    delete inflater;
 
-    if (_currentLength != _totalLength)
+    if (!writerTask)
+    {
+        _otaStats.failures++;
+        metrics.counter(METRIC_OTA_FAILURES).add();
+        return;
+    }
+    if (!verified)
+    {
+        Update.abort();
+        _otaStats.failures++;
+        metrics.counter(METRIC_OTA_FAILURES).add();
+        DebugSerial::println(complete ? "Firmware digest mismatch, update discarded." : "Download incomplete, update discarded.");
         return;
-    Update.end(true);
-    DebugSerial::printf("\nUpdate Success, Total Size: %u\nRebooting...\n", _currentLength);
+    }
+    ResourceLock flashLock(RESOURCE_FLASH);
+    if (!Update.end(imageSize == UPDATE_SIZE_UNKNOWN)) // Unknown size: the end of the stream is the end of the image
+    {
+        _otaStats.failures++;
+        metrics.counter(METRIC_OTA_FAILURES).add();
+        DebugSerial::printf("Update.end failed: %s\n", Update.errorString());
+        return;
+    }
+    DebugSerial::printf("Update Success, Total Size: %u\nRebooting...\n", _otaStats.lastImageBytes);
     // Restart ESP32 to see changes
+    DebugSerial::flush();
     ESP.restart();
-}
\ No newline at end of file
+}
+
+const OtaStats &otaStats()
+{
+    return _otaStats;
+}
@@ -1,6 +1,18 @@
+
 #include <Arduino.h>
 
+typedef struct {
+    uint32_t checks;      // Update checks sent
+    uint32_t notModified; // Checks answered 304 against the cached ETag
+    uint32_t attempts;  // Updates started
+    uint32_t resumes;   // Range requests after a dropped or stalled connection
+    uint32_t failures;  // Updates discarded (incomplete, digest mismatch, flash error)
+    uint32_t lastBytes; // Last download, as transferred
+    uint32_t lastImageBytes; // Same, after decompression
+    uint32_t lastMs;
+    float lastKBps;
+} OtaStats;
+
 String OTACheck(boolean forceUpdate);
-void updateFirmware(uint8_t *data, size_t len);
 void OTAUpdate();
-void updateFirmware(uint8_t *data, size_t len);
\ No newline at end of file
+const OtaStats &otaStats();
@@ -0,0 +1,342 @@
+#include <Arduino.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "backendClient.h"
+
+bool BackendClient::begin(Client &transport, const char *baseUrl, const char *apiKey)
+{
+    client = &transport;
+    key = apiKey;
+    const char *start;
+    if (strncmp(baseUrl, "http://", 7) == 0)
+    {
+        start = baseUrl + 7;
+        port = defaultPort = 80;
+    }
+    else if (strncmp(baseUrl, "https://", 8) == 0)
+    {
+        start = baseUrl + 8; // The caller passes a TLS transport
+        port = defaultPort = 443;
+    }
+    else
+    {
+        return false;
+    }
+    const char *slash = strchr(start, '/');
+    size_t hostLength = slash ? (size_t)(slash - start) : strlen(start);
+    const char *colon = (const char *)memchr(start, ':', hostLength);
+    if (colon)
+    {
+        port = (uint16_t)atoi(colon + 1);
+        hostLength = colon - start;
+    }
+    if (!hostLength || hostLength >= sizeof(host) || (slash && strlen(slash) >= sizeof(basePath)))
+        return false;
+    memcpy(host, start, hostLength);
+    host[hostLength] = '\0';
+    strcpy(basePath, slash ? slash : "");
+    return true;
+}
+
+void BackendClient::collectHeaders(const char *const *names, size_t count)
+{
+    headerNames = names;
+    headerCount = count < BACKEND_MAX_HEADERS ? count : BACKEND_MAX_HEADERS;
+}
+
+const char *BackendClient::header(const char *name) const
+{
+    for (size_t i = 0; i < headerCount; i++)
+    {
+        if (headerOffsets[i] >= 0 && strcasecmp(headerNames[i], name) == 0)
+            return headerValues + headerOffsets[i];
+    }
+    return "";
+}
+
+bool BackendClient::connect()
+{
+    rxPos = rxLen = 0;
+    if (!client->connect(host, port))
+        return false;
+    backendStats.connects++;
+    return true;
+}
+
+void BackendClient::close()
+{
+    client->stop();
+    rxPos = rxLen = 0;
+    keepAlive = false;
+}
+
+bool BackendClient::send(size_t length)
+{
+    return client->write((const uint8_t *)requestBuffer, length) == length;
+}
+
+// Refill the read-ahead buffer; with `wait`, until data arrives, the peer closes or the timeout
+bool BackendClient::fill(bool wait)
+{
+    uint32_t start = millis();
+    while (true)
+    {
+        int available = client->available();
+        if (available > 0)
+        {
+            int count = client->read(rx, (size_t)available < sizeof(rx) ? (size_t)available : sizeof(rx));
+            if (count > 0)
+            {
+                rxPos = 0;
+                rxLen = count;
+                received += count;
+                return true;
+            }
+        }
+        if (!wait || !client->connected())
+            return false;
+        if (millis() - start > BACKEND_TIMEOUT)
+        {
+            timedOut = true;
+            return false;
+        }
+        delay(1);
+    }
+}
+
+// One CRLF-terminated line without the terminator, truncated to fit
+bool BackendClient::readLine(char *line, size_t size)
+{
+    size_t length = 0;
+    while (true)
+    {
+        if (rxPos == rxLen && !fill(true))
+            return false;
+        char c = (char)rx[rxPos++];
+        if (c == '\n')
+        {
+            if (length && line[length - 1] == '\r')
+                length--;
+            line[length] = '\0';
+            return true;
+        }
+        if (length < size - 1)
+            line[length++] = c;
+    }
+}
+
+int BackendClient::readStatus()
+{
+    char line[64];
+    if (!readLine(line, sizeof(line)) || strncmp(line, "HTTP/1.", 7) != 0 || !line[7] || line[8] != ' ')
+        return -1;
+    keepAlive = line[7] == '1'; // HTTP/1.0 closes unless asked otherwise
+    return atoi(line + 9);
+}
+
+bool BackendClient::readHeaders()
+{
+    char line[192];
+    size_t used = 0;
+    for (size_t i = 0; i < BACKEND_MAX_HEADERS; i++)
+        headerOffsets[i] = -1;
+    bodyLength = -1;
+    chunked = false;
+    while (true)
+    {
+        if (!readLine(line, sizeof(line)))
+            return false;
+        if (!line[0])
+            return true;
+        char *value = strchr(line, ':');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        while (*value == ' ' || *value == '\t')
+            value++;
+        if (strcasecmp(line, "Content-Length") == 0)
+            bodyLength = atol(value);
+        else if (strcasecmp(line, "Transfer-Encoding") == 0 && strstr(value, "chunked"))
+            chunked = true;
+        else if (strcasecmp(line, "Connection") == 0)
+            keepAlive = strcasecmp(value, "close") != 0 && (keepAlive || strcasecmp(value, "keep-alive") == 0);
+        for (size_t i = 0; i < headerCount; i++)
+        {
+            size_t length = strlen(value) + 1;
+            if (strcasecmp(line, headerNames[i]) == 0 && used + length <= sizeof(headerValues))
+            {
+                memcpy(headerValues + used, value, length);
+                headerOffsets[i] = (int16_t)used;
+                used += length;
+            }
+        }
+    }
+}
+
+int BackendClient::request(const char *method, const char *path, const char *body, const char *extraHeaders)
+{
+    end(); // In case the caller left the last exchange open
+    backendStats.requests++;
+    size_t size = sizeof(requestBuffer);
+    char portSuffix[7] = ""; // RFC 7230 5.4: host:port unless the scheme's default
+    if (port != defaultPort)
+        snprintf(portSuffix, sizeof(portSuffix), ":%u", (unsigned)port);
+    int length = snprintf(requestBuffer, size, "%s %s%s HTTP/1.1\r\nHost: %s%s\r\nX-Secret-Key: %s\r\n%s",
+                          method, basePath, path, host, portSuffix, key, extraHeaders ? extraHeaders : "");
+    if (length > 0 && (size_t)length < size)
+    {
+        length += body ? snprintf(requestBuffer + length, size - length,
+                                  "Content-Type: application/json\r\nContent-Length: %u\r\n\r\n%s",
+                                  (unsigned)strlen(body), body)
+                       : snprintf(requestBuffer + length, size - length, "\r\n");
+    }
+    if (length <= 0 || (size_t)length >= size)
+    {
+        backendStats.failures++;
+        return -1;
+    }
+
+    uint32_t start = millis();
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        bool reused = client->connected();
+        if (!reused && !connect())
+            break;
+        received = 0;
+        timedOut = false;
+        bool sent = send(length);
+        int status = sent ? readStatus() : -1;
+        if (status > 0 && readHeaders())
+        {
+            bool bodyless = status < 200 || status == 204 || status == 304 || strcmp(method, "HEAD") == 0;
+            if (bodyless)
+                bodyLength = 0;
+            else if (chunked)
+                bodyLength = -1;
+            else if (bodyLength < 0)
+                keepAlive = false; // Body ends when the server closes
+            bodyRemaining = bodyLength > 0 ? bodyLength : 0;
+            bodyDone = bodyLength == 0;
+            bodyFailed = false;
+            chunkStarted = false;
+            backendStats.lastMs = millis() - start;
+            if (backendStats.lastMs > backendStats.maxMs)
+                backendStats.maxMs = backendStats.lastMs;
+            return status;
+        }
+        close();
+        // A kept-alive connection may have been closed by the server while idle: one more try on a new
+        // one, but only if the server cannot have acted on it. A slow answer (timeout) or a partial one
+        // is never resent, and a POST or PUT that was written may have arrived before the close.
+        bool idempotent = strcmp(method, "GET") == 0 || strcmp(method, "HEAD") == 0;
+        bool closedUnanswered = !received && !timedOut; // EOF before the first byte
+        if (!reused || (sent && !(idempotent && closedUnanswered)))
+            break;
+        backendStats.retries++;
+    }
+    backendStats.failures++;
+    return -1;
+}
+
+// Chunked body: read the next chunk size line (and the CRLF ending the previous chunk)
+bool BackendClient::nextChunk()
+{
+    char line[32];
+    if (chunkStarted && !readLine(line, sizeof(line)))
+        return false;
+    if (!readLine(line, sizeof(line)))
+        return false;
+    chunkStarted = true;
+    bodyRemaining = strtoul(line, nullptr, 16);
+    if (!bodyRemaining)
+    {
+        // Last chunk, skip any trailers
+        do
+        {
+            if (!readLine(line, sizeof(line)))
+                return false;
+        } while (line[0]);
+        bodyDone = true;
+    }
+    return true;
+}
+
+int BackendClient::readBody(uint8_t *buffer, size_t len)
+{
+    if (bodyDone)
+        return -1;
+    if (chunked && !bodyRemaining)
+    {
+        if (!nextChunk())
+        {
+            bodyDone = bodyFailed = true;
+            return -1;
+        }
+        if (bodyDone)
+            return -1;
+    }
+    bool untilClose = !chunked && bodyLength < 0;
+    size_t want = !untilClose && len > bodyRemaining ? bodyRemaining : len;
+    int count;
+    if (rxPos < rxLen)
+    {
+        count = (int)(want < rxLen - rxPos ? want : rxLen - rxPos);
+        memcpy(buffer, rx + rxPos, count);
+        rxPos += count;
+    }
+    else
+    {
+        int available = client->available();
+        if (available <= 0)
+        {
+            if (client->connected())
+                return 0;
+            bodyDone = true;
+            bodyFailed = !untilClose;
+            return -1;
+        }
+        count = client->read(buffer, want < (size_t)available ? want : (size_t)available);
+        if (count <= 0)
+            return 0;
+    }
+    if (!untilClose)
+    {
+        bodyRemaining -= count;
+        if (!bodyRemaining && !chunked)
+            bodyDone = true;
+    }
+    return count;
+}
+
+const char *BackendClient::body()
+{
+    size_t length = 0;
+    uint32_t lastData = millis();
+    while (length < sizeof(bodyBuffer) - 1)
+    {
+        int count = readBody((uint8_t *)bodyBuffer + length, sizeof(bodyBuffer) - 1 - length);
+        if (count < 0)
+            break;
+        if (count == 0)
+        {
+            if (millis() - lastData > BACKEND_TIMEOUT)
+                break;
+            delay(1);
+            continue;
+        }
+        length += count;
+        lastData = millis();
+    }
+    bodyBuffer[length] = '\0';
+    return bodyBuffer;
+}
+
+void BackendClient::end()
+{
+    if (!client)
+        return;
+    if (!bodyDone || bodyFailed || !keepAlive)
+        close();
+    bodyDone = true;
+}
@@ -0,0 +1,95 @@
+#ifndef BACKEND_CLIENT_H
+#define BACKEND_CLIENT_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <Client.h>
+
+#define BACKEND_REQUEST_SIZE 512 // Request line, headers and JSON body
+#define BACKEND_BODY_SIZE 512    // Buffered response bodies (JSON answers), larger ones are streamed with readBody()
+#define BACKEND_HEADER_SIZE 256  // Values of the collected response headers
+#define BACKEND_MAX_HEADERS 6
+#define BACKEND_TIMEOUT 5000     // ms without progress before a request fails
+
+typedef struct {
+    uint32_t requests;
+    uint32_t connects; // TCP handshakes, the other requests reused the connection
+    uint32_t retries;  // Requests resent after the server had closed an idle connection before answering
+    uint32_t failures; // Requests that got no response
+    uint32_t lastMs;   // Request sent to headers received
+    uint32_t maxMs;
+} BackendStats;
+
+// One keep-alive HTTP/1.1 connection to the backend (APPAPI), shared by
+// registration, update checks and OTA downloads under the HTTP resource lock.
+// Requests are formatted into a fixed buffer and responses parsed in place,
+// so a call allocates nothing.
+class BackendClient {
+public:
+    // baseUrl: http://host[:port][/path], the path is prepended to every request
+    bool begin(Client &transport, const char *baseUrl, const char *apiKey);
+
+    // Response headers to keep for header(), set before request()
+    void collectHeaders(const char *const *names, size_t count);
+
+    // Send a request and read the status line and headers. Returns the HTTP
+    // status, or -1 if no response arrived. `path` is relative to the base
+    // URL, `extraHeaders` is zero or more "Name: value\r\n" lines. If a reused
+    // connection turns out closed, a GET or HEAD is resent once on a new one,
+    // other methods only if the request could not be written.
+    int request(const char *method, const char *path, const char *body = nullptr, const char *extraHeaders = nullptr);
+
+    const char *header(const char *name) const; // "" if absent or not collected
+    int32_t contentLength() const { return bodyLength; } // -1 if chunked or unknown
+
+    // Whole body in the internal buffer, NUL-terminated, truncated to BACKEND_BODY_SIZE - 1 bytes
+    const char *body();
+    // Stream the body: bytes read, 0 if none arrived yet, -1 once it is complete or the connection dropped
+    int readBody(uint8_t *buffer, size_t len);
+    bool bodyComplete() const { return bodyDone && !bodyFailed; }
+    // End the exchange: the connection is kept if the body was read to the end
+    void end();
+
+    const BackendStats &stats() const { return backendStats; }
+
+private:
+    bool connect();
+    bool send(size_t length);
+    int readStatus();
+    bool readHeaders();
+    bool fill(bool wait);
+    bool readLine(char *line, size_t size);
+    bool nextChunk();
+    void close();
+
+    Client *client = nullptr;
+    const char *key = "";
+    char host[64] = "";
+    char basePath[64] = "";
+    uint16_t port = 80;
+    uint16_t defaultPort = 80; // Of the scheme; any other port goes in the Host header
+
+    char requestBuffer[BACKEND_REQUEST_SIZE];
+    char bodyBuffer[BACKEND_BODY_SIZE];
+    uint8_t rx[256]; // Read-ahead for the status line, headers and chunk sizes
+    size_t rxPos = 0;
+    size_t rxLen = 0;
+    uint32_t received = 0; // Bytes of the current response so far
+    bool timedOut = false; // The last fill() gave up on a silent, still open connection
+
+    const char *const *headerNames = nullptr;
+    size_t headerCount = 0;
+    char headerValues[BACKEND_HEADER_SIZE];
+    int16_t headerOffsets[BACKEND_MAX_HEADERS];
+
+    int32_t bodyLength = -1;
+    uint32_t bodyRemaining = 0; // Of the body, or of the current chunk
+    bool chunked = false;
+    bool chunkStarted = false; // A chunk was read, its CRLF precedes the next size line
+    bool bodyDone = true;
+    bool bodyFailed = false;
+    bool keepAlive = false;
+    BackendStats backendStats = {};
+};
+
+#endif
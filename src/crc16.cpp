@@ -0,0 +1,87 @@
+#include "crc16.h"
+
+namespace
+{
+    struct Crc16Tables
+    {
+        uint16_t t[4][256];
+    };
+
+    // t[0] is the classic byte table, t[k][n] is t[0] advanced by k more zero bytes
+    constexpr Crc16Tables makeCrc16Tables()
+    {
+        Crc16Tables tables{};
+        for (int n = 0; n < 256; n++)
+        {
+            uint16_t crc = (uint16_t)n;
+            for (int j = 0; j < 8; j++)
+            {
+                crc = (crc & 0x0001) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+            }
+            tables.t[0][n] = crc;
+        }
+        for (int k = 1; k < 4; k++)
+        {
+            for (int n = 0; n < 256; n++)
+            {
+                uint16_t prev = tables.t[k - 1][n];
+                tables.t[k][n] = (uint16_t)((prev >> 8) ^ tables.t[0][prev & 0xFF]);
+            }
+        }
+        return tables;
+    }
+
+    // Generated at compile time, lives in flash (.rodata)
+    constexpr Crc16Tables CRC16_TABLES = makeCrc16Tables();
+
+    static_assert(CRC16_TABLES.t[0][1] == 0xC0C1, "CRC16 table generation is broken");
+    static_assert(CRC16_TABLES.t[0][255] == 0x4040, "CRC16 table generation is broken");
+}
+
+// Reference implementation, kept for cross-checking and for builds that cannot spare the tables
+uint16_t crc16Bitwise(const uint8_t *data, size_t length, uint16_t crc)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++)
+        {
+            if (crc & 0x0001)
+            {
+                crc >>= 1;
+                crc ^= 0xA001;
+            }
+            else
+            {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+uint16_t crc16Table(const uint8_t *data, size_t length, uint16_t crc)
+{
+    const uint16_t *table = CRC16_TABLES.t[0];
+    for (size_t i = 0; i < length; i++)
+    {
+        crc = (crc >> 8) ^ table[(crc ^ data[i]) & 0xFF];
+    }
+    return crc;
+}
+
+uint16_t crc16Slice4(const uint8_t *data, size_t length, uint16_t crc)
+{
+    // Bytes are combined one at a time, so the input needs no alignment
+    while (length >= 4)
+    {
+        uint16_t x = crc ^ (uint16_t)(data[0] | (data[1] << 8));
+        crc = CRC16_TABLES.t[3][x & 0xFF] ^
+              CRC16_TABLES.t[2][x >> 8] ^
+              CRC16_TABLES.t[1][data[2]] ^
+              CRC16_TABLES.t[0][data[3]];
+        data += 4;
+        length -= 4;
+    }
+    return crc16Table(data, length, crc);
+}
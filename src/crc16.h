@@ -0,0 +1,32 @@
+#ifndef CRC16_H
+#define CRC16_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// CRC-16/Modbus engines (poly 0xA001 reflected, init 0xFFFF)
+#define CRC16_IMPL_BITWISE 0 // 8 shifts per byte, no tables
+#define CRC16_IMPL_TABLE 1   // one 256-entry table lookup per byte (512 B rodata)
+#define CRC16_IMPL_SLICE4 2  // four bytes per step over four tables (2 KB rodata)
+
+// Select the engine used by calculateCRC() with -DCRC16_IMPL=<n>
+#ifndef CRC16_IMPL
+#define CRC16_IMPL CRC16_IMPL_TABLE
+#endif
+
+uint16_t crc16Bitwise(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+uint16_t crc16Table(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+uint16_t crc16Slice4(const uint8_t *data, size_t length, uint16_t crc = 0xFFFF);
+
+inline uint16_t crc16Modbus(const uint8_t *data, size_t length)
+{
+#if CRC16_IMPL == CRC16_IMPL_BITWISE
+    return crc16Bitwise(data, length);
+#elif CRC16_IMPL == CRC16_IMPL_SLICE4
+    return crc16Slice4(data, length);
+#else
+    return crc16Table(data, length);
+#endif
+}
+
+#endif
@@ -1,7 +1,22 @@
-#include "DebugSerial.h"
+#include "debugSerial.h"
+#include <stdio.h>
+#ifndef NATIVE_BUILD
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+#define DEBUG_LOG_TASK_PRIORITY 0 // Same as idle: the UART gets whatever time is left
+#define DEBUG_LOG_DRAIN_MS 10     // Poll interval of the drain task while the ring is empty
 
 // Define the static member in the implementation file
 bool DebugSerial::debugEnabled = true;
+LogRing<DEBUG_LOG_RECORDS> DebugSerial::ring;
+
+static std::atomic<uint32_t> _logged{0};
+static std::atomic<uint32_t> _dropped{0};
+static std::atomic<uint32_t> _highWater{0};
+static std::atomic_flag _draining = ATOMIC_FLAG_INIT;
+static bool _lineStart = true; // Drain side: the next record starts a line
 
 // Set debug mode
 void DebugSerial::setDebug(bool debug) {
@@ -13,26 +28,225 @@ bool DebugSerial::getDebug() {
   return debugEnabled;
 }
 
-// Implement printf with debug flag
-void DebugSerial::printf(const char* format, ...) {
-  if (debugEnabled) {
-    char buffer[256];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    Serial.print(buffer);
-    va_end(args);
+bool DebugSerial::claim(size_t count, size_t *first) {
+  if (!ring.claim(count, first)) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  _logged.fetch_add(1, std::memory_order_relaxed);
+  uint32_t queued = (uint32_t)ring.size();
+  uint32_t highWater = _highWater.load(std::memory_order_relaxed);
+  while (queued > highWater && !_highWater.compare_exchange_weak(highWater, queued, std::memory_order_relaxed)) {
+  }
+  return true;
+}
+
+uint32_t DebugSerial::copyString(LogRecord &record, const char *string) {
+  if (!string || record.length >= DEBUG_LOG_DATA - 1) {
+    return DEBUG_LOG_DATA - 1; // Shared terminator: prints as empty
+  }
+  uint32_t offset = record.length;
+  size_t room = DEBUG_LOG_DATA - 1 - offset;
+  size_t length = strnlen(string, room);
+  memcpy(record.data + offset, string, length);
+  record.data[offset + length] = '\0';
+  record.length = (uint8_t)(offset + length + 1);
+  return offset;
+}
+
+// `label` and `data` go into consecutive records claimed together
+void DebugSerial::push(uint8_t level, const char *label, const void *data, size_t length, LogKind kind, bool newline) {
+  size_t labelLength = label ? strlen(label) : 0;
+  size_t labelRecords = (labelLength + DEBUG_LOG_DATA - 1) / DEBUG_LOG_DATA;
+  size_t dataRecords = length ? (length + DEBUG_LOG_DATA - 1) / DEBUG_LOG_DATA : 1;
+  size_t pos;
+  if (!claim(labelRecords + dataRecords, &pos)) {
+    return;
+  }
+  for (size_t i = 0; i < labelRecords + dataRecords; i++, pos++) {
+    bool isLabel = i < labelRecords;
+    const char *source = isLabel ? label : (const char *)data;
+    size_t offset = (isLabel ? i : i - labelRecords) * DEBUG_LOG_DATA;
+    size_t total = isLabel ? labelLength : length;
+    size_t chunk = total - offset < DEBUG_LOG_DATA ? total - offset : DEBUG_LOG_DATA;
+
+    LogRecord &record = ring.record(pos);
+    record.format = nullptr;
+    record.level = level;
+    record.kind = isLabel ? LOG_TEXT : kind;
+    record.argCount = 0;
+    record.length = (uint8_t)chunk;
+    record.newline = newline && i == labelRecords + dataRecords - 1;
+    memcpy(record.data, source + offset, chunk);
+    ring.publish(pos);
+  }
+}
+
+// One conversion of a deferred printf. The length modifier is dropped: the
+// argument was widened to 32 bits (or a float) when it was captured.
+static int formatArg(char *out, size_t size, const char *spec, size_t specLength, char conversion, const LogRecord &record, uint8_t index) {
+  char format[16];
+  memcpy(format, spec, specLength);
+  const LogArg &arg = record.args[index];
+  switch (record.types[index]) {
+    case LOG_ARG_INT:
+    case LOG_ARG_UINT:
+      if (!strchr("diouxXc", conversion)) {
+        conversion = record.types[index] == LOG_ARG_INT ? 'd' : 'u';
+      }
+      break;
+    case LOG_ARG_FLOAT:
+      if (!strchr("fFeEgGaA", conversion)) {
+        conversion = 'g';
+      }
+      break;
+    case LOG_ARG_STRING:
+      conversion = 's';
+      break;
+    default:
+      conversion = 'p';
+      break;
+  }
+  format[specLength] = conversion;
+  format[specLength + 1] = '\0';
+  switch (record.types[index]) {
+    case LOG_ARG_INT:
+      return snprintf(out, size, format, (int)arg.i);
+    case LOG_ARG_UINT:
+      return snprintf(out, size, format, (unsigned)arg.u);
+    case LOG_ARG_FLOAT:
+      return snprintf(out, size, format, (double)arg.f);
+    case LOG_ARG_STRING:
+      return snprintf(out, size, format, record.data + arg.u);
+    default:
+      return snprintf(out, size, format, arg.p);
+  }
+}
+
+static size_t formatDeferred(const LogRecord &record, char *out, size_t size) {
+  size_t used = 0;
+  uint8_t index = 0;
+  const char *p = record.format;
+  while (*p && used + 1 < size) {
+    if (*p != '%') {
+      out[used++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[used++] = '%';
+      p += 2;
+      continue;
+    }
+    // Flags, width and precision are kept; '*' is not supported
+    const char *spec = p++;
+    while (*p && strchr("-+ #0123456789.", *p) && p - spec < 12) {
+      p++;
+    }
+    size_t specLength = p - spec;
+    while (*p && strchr("hlLjzt", *p)) {
+      p++;
+    }
+    if (!*p) {
+      break;
+    }
+    char conversion = *p++;
+    if (index >= record.argCount) {
+      continue; // More conversions than arguments
+    }
+    int written = formatArg(out + used, size - used, spec, specLength, conversion, record, index++);
+    if (written > 0) {
+      used += (size_t)written < size - used ? (size_t)written : size - used - 1;
+    }
   }
+  out[used] = '\0';
+  return used;
 }
 
-// Implement printf with newline
-void DebugSerial::printf_ln(const char* format, ...) {
-  if (debugEnabled) {
-    char buffer[256];
-    va_list args;
-    va_start(args, format);
-    vsnprintf(buffer, sizeof(buffer), format, args);
-    Serial.println(buffer);
-    va_end(args);
+// Text of one record, without its line end
+static size_t formatRecord(const LogRecord &record, char *out, size_t size) {
+  static const char digits[] = "0123456789ABCDEF";
+  size_t used = 0;
+  switch (record.kind) {
+    case LOG_FORMAT:
+      return formatDeferred(record, out, size);
+    case LOG_TEXT:
+      used = record.length < size - 1 ? record.length : size - 1;
+      memcpy(out, record.data, used);
+      break;
+    case LOG_HEX:
+      for (size_t i = 0; i < record.length && used + 3 < size; i++) {
+        out[used++] = digits[(uint8_t)record.data[i] >> 4];
+        out[used++] = digits[(uint8_t)record.data[i] & 0x0F];
+        out[used++] = ' ';
+      }
+      break;
   }
-}
\ No newline at end of file
+  out[used] = '\0';
+  return used;
+}
+
+size_t DebugSerial::drain(LogWriter write, size_t maxRecords) {
+  static const char prefixes[][5] = {"", "[E] ", "[W] ", "", "[D] ", "[V] "};
+  if (_draining.test_and_set(std::memory_order_acquire)) {
+    return 0;
+  }
+  char line[DEBUG_LOG_LINE + 8];
+  size_t drained = 0;
+  const LogRecord *record;
+  while (drained < maxRecords && (record = ring.peek())) {
+    size_t length = 0;
+    if (_lineStart && record->level < sizeof(prefixes) / sizeof(prefixes[0])) {
+      length = strlen(prefixes[record->level]);
+      memcpy(line, prefixes[record->level], length);
+    }
+    length += formatRecord(*record, line + length, DEBUG_LOG_LINE);
+    if (record->newline) {
+      line[length++] = '\r';
+      line[length++] = '\n';
+    }
+    _lineStart = length && line[length - 1] == '\n';
+    ring.release(); // The slot is free again before the UART write
+    write(line, length);
+    drained++;
+  }
+  _draining.clear(std::memory_order_release);
+  return drained;
+}
+
+LogStats DebugSerial::stats() {
+  LogStats stats;
+  stats.logged = _logged.load(std::memory_order_relaxed);
+  stats.dropped = _dropped.load(std::memory_order_relaxed);
+  stats.highWater = _highWater.load(std::memory_order_relaxed);
+  return stats;
+}
+
+#ifndef NATIVE_BUILD
+static void writeSerial(const char *text, size_t length) {
+  Serial.write((const uint8_t *)text, length);
+}
+
+// Lowest priority: Serial.write blocks while the UART buffer is full, which
+// now only delays this task and never the one that logged
+static void logDrainTask(void *pvParameters) {
+  while (1) {
+    if (!DebugSerial::drain(writeSerial)) {
+      vTaskDelay(pdMS_TO_TICKS(DEBUG_LOG_DRAIN_MS));
+    }
+  }
+}
+
+void DebugSerial::begin() {
+  xTaskCreate(logDrainTask, "LogDrain", 3072, NULL, DEBUG_LOG_TASK_PRIORITY, NULL);
+}
+
+void DebugSerial::flush() {
+  uint32_t start = millis();
+  while (ring.size() && millis() - start < 500) {
+    if (!drain(writeSerial)) {
+      delay(1); // The drain task holds the ring, or a record is still being written
+    }
+  }
+  Serial.flush();
+}
+#endif
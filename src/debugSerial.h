@@ -3,54 +3,222 @@
 
 #include <Arduino.h>
 #include <stdarg.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include <utility>
+#include "logRing.h"
 
+#define DEBUG_LEVEL_NONE 0
+#define DEBUG_LEVEL_ERROR 1
+#define DEBUG_LEVEL_WARN 2
+#define DEBUG_LEVEL_INFO 3    // print, println and printf
+#define DEBUG_LEVEL_DEBUG 4
+#define DEBUG_LEVEL_VERBOSE 5 // Modbus frame dumps
+
+// Messages above this level are compiled out, select with -DDEBUG_LOG_LEVEL=<n>
+#ifndef DEBUG_LOG_LEVEL
+#define DEBUG_LOG_LEVEL DEBUG_LEVEL_INFO
+#endif
+
+#define DEBUG_LOG_LINE 256 // Longest formatted printf, and print() of a non-string value
+
+// Leveled logging. Arguments are not evaluated when the level is compiled out.
+#define DEBUG_LOG(level, format, ...)                                  \
+  do {                                                                 \
+    if (level <= DEBUG_LOG_LEVEL)                                      \
+      DebugSerial::log<level>(false, format, ##__VA_ARGS__);           \
+  } while (0)
+#define DEBUG_ERROR(format, ...) DEBUG_LOG(DEBUG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#define DEBUG_WARN(format, ...) DEBUG_LOG(DEBUG_LEVEL_WARN, format, ##__VA_ARGS__)
+#define DEBUG_INFO(format, ...) DEBUG_LOG(DEBUG_LEVEL_INFO, format, ##__VA_ARGS__)
+#define DEBUG_DEBUG(format, ...) DEBUG_LOG(DEBUG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#define DEBUG_VERBOSE(format, ...) DEBUG_LOG(DEBUG_LEVEL_VERBOSE, format, ##__VA_ARGS__)
+#define DEBUG_HEXDUMP(level, label, data, length)                      \
+  do {                                                                 \
+    if (level <= DEBUG_LOG_LEVEL)                                      \
+      DebugSerial::hexdump<level>(label, data, length);                \
+  } while (0)
+
+typedef struct {
+  uint32_t logged;    // Messages queued
+  uint32_t dropped;   // Messages that found the ring full
+  uint32_t highWater; // Most records queued at once
+} LogStats;
+
+// Receives formatted output on the draining task
+typedef void (*LogWriter)(const char *text, size_t length);
+
+// Logging never writes to the UART on the calling task. A message becomes a
+// record in a lock-free ring: printf keeps the format pointer and copies the
+// arguments, print copies the text, and a low-priority task formats and writes
+// the records. When the ring is full the message is dropped and counted.
 class DebugSerial {
 public:
+  // Start the task that drains the ring to Serial, after Serial.begin()
+  static void begin();
+
+  // Write everything queued on the calling task, e.g. before a restart
+  static void flush();
+
   // Enable/Disable debug mode
   static void setDebug(bool debug);
-  
+
   // Get current debug state
   static bool getDebug();
 
-  // Printf-style debug printing
-  static void printf(const char* format, ...);
-  static void printf_ln(const char* format, ...);
+  // Printf-style debug printing, formatted later: the format must be a literal
+  template <typename... Args>
+  static void printf(const char* format, Args... args) {
+    log<DEBUG_LEVEL_INFO>(false, format, args...);
+  }
+
+  template <typename... Args>
+  static void printf_ln(const char* format, Args... args) {
+    log<DEBUG_LEVEL_INFO>(true, format, args...);
+  }
 
   // Standard print methods with type support
   template <typename T>
-  static void print(T message) {
-    if (debugEnabled) {
-      Serial.print(message);
-    }
+  static void print(const T &message) {
+    text<DEBUG_LEVEL_INFO>(message, false);
   }
 
   template <typename T>
-  static void println(T message) {
-    if (debugEnabled) {
-      Serial.println(message);
-    }
+  static void println(const T &message) {
+    text<DEBUG_LEVEL_INFO>(message, true);
   }
 
   // Overloaded print methods for multiple parameters
   template <typename T1, typename T2>
-  static void print(T1 message1, T2 message2) {
-    if (debugEnabled) {
-      Serial.print(message1);
-      Serial.print(message2);
-    }
+  static void print(const T1 &message1, const T2 &message2) {
+    text<DEBUG_LEVEL_INFO>(message1, false);
+    text<DEBUG_LEVEL_INFO>(message2, false);
   }
 
   template <typename T1, typename T2>
-  static void println(T1 message1, T2 message2) {
-    if (debugEnabled) {
-      Serial.print(message1);
-      Serial.println(message2);
+  static void println(const T1 &message1, const T2 &message2) {
+    text<DEBUG_LEVEL_INFO>(message1, false);
+    text<DEBUG_LEVEL_INFO>(message2, true);
+  }
+
+  // Queue a printf record: up to DEBUG_LOG_ARGS integer, float, string or
+  // pointer arguments; strings are copied, 64-bit integers are not supported
+  template <uint8_t Level, typename... Args>
+  static void log(bool newline, const char* format, Args... args) {
+    if constexpr (Level <= DEBUG_LOG_LEVEL) {
+      static_assert(sizeof...(Args) <= DEBUG_LOG_ARGS, "Too many arguments for one log record");
+      size_t pos;
+      if (!debugEnabled || !claim(1, &pos)) {
+        return;
+      }
+      LogRecord &record = ring.record(pos);
+      record.format = format;
+      record.level = Level;
+      record.kind = LOG_FORMAT;
+      record.argCount = 0;
+      record.length = 0;
+      record.newline = newline;
+      record.data[DEBUG_LOG_DATA - 1] = '\0'; // Strings that do not fit point here
+      (captureArg(record, args), ...);
+      ring.publish(pos);
     }
   }
 
+  // Queue `label` followed by `data` as hex bytes, formatted on the draining task
+  template <uint8_t Level>
+  static void hexdump(const char *label, const uint8_t *data, size_t length) {
+    if constexpr (Level <= DEBUG_LOG_LEVEL) {
+      if (debugEnabled) {
+        push(Level, label, data, length, LOG_HEX, true);
+      }
+    }
+  }
+
+  // Consumer side: format queued records and pass them to `write`, up to
+  // `maxRecords`. Returns the records written, 0 if another task is draining.
+  static size_t drain(LogWriter write, size_t maxRecords = (size_t)-1);
+
+  static LogStats stats();
+
 private:
+  template <typename T, typename = void>
+  struct HasCStr : std::false_type {};
+  template <typename T>
+  struct HasCStr<T, decltype(std::declval<const T &>().c_str(), void())> : std::true_type {};
+
+  // Print target for values without a string form: numbers, IPAddress, tm...
+  class LogLine : public Print {
+  public:
+    size_t write(uint8_t c) override {
+      if (used + 1 >= sizeof(text)) {
+        return 0;
+      }
+      text[used++] = (char)c;
+      return 1;
+    }
+    using Print::write;
+    char text[DEBUG_LOG_LINE];
+    size_t used = 0;
+  };
+
+  template <uint8_t Level, typename T>
+  static void text(const T &message, bool newline) {
+    if constexpr (Level <= DEBUG_LOG_LEVEL) {
+      if (!debugEnabled) {
+        return;
+      }
+      if constexpr (std::is_convertible<const T &, const char *>::value) {
+        const char *string = message;
+        push(Level, nullptr, string, strlen(string), LOG_TEXT, newline);
+      } else if constexpr (HasCStr<T>::value) {
+        const char *string = message.c_str();
+        push(Level, nullptr, string, strlen(string), LOG_TEXT, newline);
+      } else {
+        LogLine line;
+        line.print(message);
+        push(Level, nullptr, line.text, line.used, LOG_TEXT, newline);
+      }
+    }
+  }
+
+  template <typename T>
+  static void captureArg(LogRecord &record, const T &value) {
+    uint8_t index = record.argCount++;
+    LogArg &arg = record.args[index];
+    if constexpr (std::is_floating_point<T>::value) {
+      record.types[index] = LOG_ARG_FLOAT;
+      arg.f = (float)value;
+    } else if constexpr (std::is_enum<T>::value) {
+      record.types[index] = LOG_ARG_INT;
+      arg.i = (int32_t)value;
+    } else if constexpr (std::is_integral<T>::value) {
+      static_assert(sizeof(T) <= 4, "64-bit integers cannot be logged deferred, format them first");
+      record.types[index] = std::is_signed<T>::value ? LOG_ARG_INT : LOG_ARG_UINT;
+      if (std::is_signed<T>::value) {
+        arg.i = (int32_t)value;
+      } else {
+        arg.u = (uint32_t)value;
+      }
+    } else if constexpr (std::is_convertible<const T &, const char *>::value) {
+      record.types[index] = LOG_ARG_STRING;
+      arg.u = copyString(record, value);
+    } else {
+      static_assert(std::is_pointer<T>::value, "Unsupported log argument type");
+      record.types[index] = LOG_ARG_POINTER;
+      arg.p = (const void *)value;
+    }
+  }
+
+  // Copy into the record's data, truncated to what is left. Returns its offset.
+  static uint32_t copyString(LogRecord &record, const char *string);
+
+  static bool claim(size_t count, size_t *first);
+  static void push(uint8_t level, const char *label, const void *data, size_t length, LogKind kind, bool newline);
+
   // Static debug flag
   static bool debugEnabled;
+  static LogRing<DEBUG_LOG_RECORDS> ring;
 };
 
-#endif // DEBUG_SERIAL_H
\ No newline at end of file
+#endif // DEBUG_SERIAL_H
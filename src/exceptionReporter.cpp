@@ -0,0 +1,98 @@
+#include "exceptionReporter.h"
+#include "registerMap.h"
+#include <math.h>
+#include <string.h>
+
+void ExceptionReporter::begin(uint32_t heartbeatMs)
+{
+    heartbeat = heartbeatMs;
+    memset(images, 0, sizeof(images));
+    memset(&reporterStats, 0, sizeof(reporterStats));
+}
+
+ExceptionReporter::SlaveImage *ExceptionReporter::imageFor(uint8_t slaveAddr)
+{
+    SlaveImage *unused = nullptr;
+    for (size_t i = 0; i < EXCEPTION_MAX_SLAVES; i++)
+    {
+        if (images[i].used && images[i].published.slaveAddr == slaveAddr)
+        {
+            return &images[i];
+        }
+        if (!images[i].used && unused == nullptr)
+        {
+            unused = &images[i];
+        }
+    }
+    return unused;
+}
+
+static bool outsideDeadband(const FieldDeadband &deadband, float value, float last)
+{
+    float change = fabsf(value - last);
+    if (deadband.kind == DEADBAND_PERCENT)
+    {
+        return change > fabsf(last) * deadband.band / 100.0f;
+    }
+    return change > deadband.band;
+}
+
+bool ExceptionReporter::filter(ChamberData &data, uint32_t nowMs)
+{
+    reporterStats.samples++;
+    SlaveImage *image = imageFor(data.slaveAddr);
+    if (image == nullptr)
+    {
+        return data.validMask != 0; // More slaves than images: publish unfiltered
+    }
+
+    bool snapshot = !image->used || nowMs - image->lastSnapshotMs >= heartbeat;
+    if (snapshot && data.validMask != 0) // A timed-out poll does not count as the snapshot
+    {
+        image->used = true;
+        image->lastSnapshotMs = nowMs;
+        reporterStats.snapshots++;
+    }
+
+    const ChamberData &current = data;
+    const ChamberData &last = image->published;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        uint32_t bit = 1UL << i;
+        if (!(data.validMask & bit))
+        {
+            continue;
+        }
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        bool changed = snapshot || !(image->published.validMask & bit);
+        if (!changed)
+        {
+            if (field.kind == FIELD_FLOAT)
+                changed = outsideDeadband(registerDeadband(i), registerFloat(current, field), registerFloat(last, field));
+            else
+                changed = registerUint16(current, field) != registerUint16(last, field);
+        }
+
+        if (!changed)
+        {
+            data.validMask &= ~bit;
+            reporterStats.fieldsSuppressed++;
+            continue;
+        }
+        // Deadbands are measured from the last published value, so slow drift is still reported
+        if (field.kind == FIELD_FLOAT)
+            *registerFloat(image->published, field) = registerFloat(current, field);
+        else
+            *registerUint16(image->published, field) = registerUint16(current, field);
+        image->published.validMask |= bit;
+        reporterStats.fieldsSent++;
+    }
+    image->published.slaveAddr = data.slaveAddr;
+
+    if (data.validMask == 0)
+    {
+        reporterStats.samplesSuppressed++;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#ifndef EXCEPTION_REPORTER_H
+#define EXCEPTION_REPORTER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+#include "pollScheduler.h"
+
+#define EXCEPTION_MAX_SLAVES POLL_MAX_JOBS
+
+typedef struct {
+    uint32_t samples;           // Samples filtered
+    uint32_t snapshots;         // Samples sent in full because the heartbeat was due
+    uint32_t fieldsSent;        // Fields left in the published samples
+    uint32_t fieldsSuppressed;  // Fields dropped as within their deadband
+    uint32_t samplesSuppressed; // Samples with nothing left to publish
+} ExceptionStats;
+
+// Report-by-exception filter over ChamberData. Keeps, per slave, the image of
+// what was last published and clears the validMask bit of every field that has
+// not moved past its CHAMBER_DEADBANDS entry, so the serializer leaves it out.
+// Every heartbeatMs a slave's sample goes out in full for consumers to resync.
+class ExceptionReporter {
+public:
+    void begin(uint32_t heartbeatMs);
+
+    // Reduce `data` to its changed fields in place. Returns false if none is left.
+    bool filter(ChamberData &data, uint32_t nowMs);
+
+    const ExceptionStats &stats() const { return reporterStats; }
+
+private:
+    typedef struct {
+        ChamberData published;  // Last published value of each field (validMask: ever published)
+        uint32_t lastSnapshotMs;
+        bool used;
+    } SlaveImage;
+
+    SlaveImage *imageFor(uint8_t slaveAddr);
+
+    SlaveImage images[EXCEPTION_MAX_SLAVES];
+    uint32_t heartbeat = 0;
+    ExceptionStats reporterStats = {};
+};
+
+#endif
@@ -0,0 +1,366 @@
+#include <stdlib.h>
+#include "inflateStream.h"
+
+namespace
+{
+    const uint16_t LENGTH_BASE[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                      35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    const uint8_t LENGTH_EXTRA[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                      3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    const uint16_t DISTANCE_BASE[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                        6145, 8193, 12289, 16385, 24577};
+    const uint8_t DISTANCE_EXTRA[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    const uint8_t CODE_LENGTH_ORDER[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+}
+
+void InflateStream::begin()
+{
+    end();
+    mode = MODE_HEADER;
+    bitBuffer = 0;
+    bitCount = 0;
+    outputBytes = 0;
+    adlerA = 1;
+    adlerB = 0;
+    lastBlock = false;
+}
+
+void InflateStream::end()
+{
+    free(window);
+    window = nullptr;
+}
+
+bool InflateStream::bits(uint8_t count, uint32_t *value)
+{
+    if (bitCount < count)
+    {
+        shortRead = true;
+        return false;
+    }
+    *value = (uint32_t)(bitBuffer & ((1ULL << count) - 1));
+    bitBuffer >>= count;
+    bitCount -= count;
+    return true;
+}
+
+// Canonical Huffman decode one bit at a time (codes are stored bit-reversed)
+int InflateStream::decode(const Huffman &table)
+{
+    int code = 0;
+    int first = 0;
+    int index = 0;
+    for (int len = 1; len < 16; len++)
+    {
+        if (!bitCount)
+        {
+            shortRead = true;
+            return -1;
+        }
+        code |= (int)(bitBuffer & 1);
+        bitBuffer >>= 1;
+        bitCount--;
+        int count = table.count[len];
+        if (code - count < first)
+            return table.symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+// False if the lengths over-subscribe the code; incomplete codes are accepted
+bool InflateStream::build(Huffman &table, const uint8_t *lengths, size_t count)
+{
+    uint16_t offsets[16];
+    for (int len = 0; len < 16; len++)
+        table.count[len] = 0;
+    for (size_t symbol = 0; symbol < count; symbol++)
+        table.count[lengths[symbol]]++;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++)
+    {
+        left = (left << 1) - table.count[len];
+        if (left < 0)
+            return false;
+    }
+    offsets[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offsets[len + 1] = offsets[len] + table.count[len];
+    for (size_t symbol = 0; symbol < count; symbol++)
+    {
+        if (lengths[symbol])
+            table.symbol[offsets[lengths[symbol]]++] = (uint16_t)symbol;
+    }
+    return true;
+}
+
+void InflateStream::put(uint8_t byte)
+{
+    window[windowPos++] = byte;
+    outputBytes++;
+    if (windowPos > windowMask)
+    {
+        flush();
+        windowPos = 0;
+        flushPos = 0;
+    }
+}
+
+// Hand the bytes produced since the last flush to the sink
+bool InflateStream::flush()
+{
+    const uint8_t *data = window + flushPos;
+    size_t len = windowPos - flushPos;
+    if (!len)
+        return true;
+    flushPos = windowPos;
+    for (size_t done = 0; done < len;)
+    {
+        size_t run = len - done < 5552 ? len - done : 5552; // Longest run before the sums can overflow
+        for (size_t i = 0; i < run; i++)
+        {
+            adlerA += data[done + i];
+            adlerB += adlerA;
+        }
+        adlerA %= 65521;
+        adlerB %= 65521;
+        done += run;
+    }
+    if (!sink(sinkContext, data, len))
+        sinkFailed = true;
+    return !sinkFailed;
+}
+
+// One unit of decoding: a header, a code length or a literal/match. Reads all
+// of its bits before writing anything, so a short read can be rolled back.
+bool InflateStream::step()
+{
+    uint32_t value;
+    switch (mode)
+    {
+    case MODE_HEADER:
+    {
+        if (!bits(16, &value))
+            return false;
+        uint8_t cmf = value & 0xFF;
+        uint8_t flg = value >> 8;
+        uint8_t windowBits = (cmf >> 4) + 8;
+        if ((cmf & 0x0F) != 8 || ((cmf << 8) | flg) % 31 || (flg & 0x20) || windowBits > INFLATE_MAX_WINDOW_BITS)
+            return false;
+        window = (uint8_t *)malloc(1UL << windowBits);
+        if (!window)
+            return false;
+        windowMask = (1UL << windowBits) - 1;
+        windowPos = 0;
+        flushPos = 0;
+        mode = MODE_BLOCK;
+        return true;
+    }
+    case MODE_BLOCK:
+        if (!bits(3, &value))
+            return false;
+        lastBlock = value & 1;
+        switch (value >> 1)
+        {
+        case 0:
+            mode = MODE_STORED_LENGTH;
+            return true;
+        case 1:
+        {
+            for (int i = 0; i < 288; i++)
+                lengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+            for (int i = 0; i < 30; i++)
+                lengths[288 + i] = 5;
+            build(literalCode, lengths, 288);
+            build(distanceCode, lengths + 288, 30);
+            mode = MODE_CODES;
+            return true;
+        }
+        case 2:
+            mode = MODE_TABLE_SIZES;
+            return true;
+        default:
+            return false;
+        }
+    case MODE_STORED_LENGTH:
+        if (!bits(bitCount & 7, &value) || !bits(32, &value))
+            return false;
+        if ((value & 0xFFFF) != (~value >> 16))
+            return false;
+        storedRemaining = value & 0xFFFF;
+        mode = storedRemaining ? MODE_STORED : lastBlock ? MODE_TRAILER : MODE_BLOCK;
+        return true;
+    case MODE_STORED:
+        // Byte-aligned: copy straight from the bit buffer, committing as it goes
+        if (bitCount < 8)
+        {
+            shortRead = true;
+            return false;
+        }
+        while (storedRemaining && bitCount >= 8)
+        {
+            put((uint8_t)bitBuffer);
+            bitBuffer >>= 8;
+            bitCount -= 8;
+            storedRemaining--;
+        }
+        if (!storedRemaining)
+            mode = lastBlock ? MODE_TRAILER : MODE_BLOCK;
+        return true;
+    case MODE_TABLE_SIZES:
+        if (!bits(14, &value))
+            return false;
+        literalCount = (value & 31) + 257;
+        distanceCount = ((value >> 5) & 31) + 1;
+        codeLengthCount = (value >> 10) + 4;
+        if (literalCount > 286 || distanceCount > 30)
+            return false;
+        for (int i = 0; i < 19; i++)
+            lengths[i] = 0;
+        lengthIndex = 0;
+        mode = MODE_CODE_LENGTH_CODES;
+        return true;
+    case MODE_CODE_LENGTH_CODES:
+        if (!bits(3, &value))
+            return false;
+        lengths[CODE_LENGTH_ORDER[lengthIndex++]] = value;
+        if (lengthIndex == codeLengthCount)
+        {
+            // The code length code is kept in literalCode until the real one is built
+            if (!build(literalCode, lengths, 19))
+                return false;
+            lengthIndex = 0;
+            mode = MODE_CODE_LENGTHS;
+        }
+        return true;
+    case MODE_CODE_LENGTHS:
+    {
+        int symbol = decode(literalCode);
+        if (symbol < 0)
+            return false;
+        uint8_t length = 0;
+        uint32_t repeat = 1;
+        if (symbol < 16)
+        {
+            length = symbol;
+        }
+        else if (symbol == 16)
+        {
+            if (!lengthIndex || !bits(2, &value))
+                return false;
+            length = lengths[lengthIndex - 1];
+            repeat = 3 + value;
+        }
+        else if (!bits(symbol == 17 ? 3 : 7, &value))
+        {
+            return false;
+        }
+        else
+        {
+            repeat = symbol == 17 ? 3 + value : 11 + value;
+        }
+        if (lengthIndex + repeat > (uint32_t)(literalCount + distanceCount))
+            return false;
+        while (repeat--)
+            lengths[lengthIndex++] = length;
+        if (lengthIndex == literalCount + distanceCount)
+        {
+            if (!lengths[256] || !build(literalCode, lengths, literalCount) ||
+                !build(distanceCode, lengths + literalCount, distanceCount))
+                return false;
+            mode = MODE_CODES;
+        }
+        return true;
+    }
+    case MODE_CODES:
+    {
+        int symbol = decode(literalCode);
+        if (symbol < 0)
+            return false;
+        if (symbol < 256)
+        {
+            put((uint8_t)symbol);
+            return true;
+        }
+        if (symbol == 256)
+        {
+            mode = lastBlock ? MODE_TRAILER : MODE_BLOCK;
+            return true;
+        }
+        symbol -= 257;
+        uint32_t extra;
+        if (symbol >= 29 || !bits(LENGTH_EXTRA[symbol], &extra))
+            return false;
+        uint32_t length = LENGTH_BASE[symbol] + extra;
+        int distanceSymbol = decode(distanceCode);
+        if (distanceSymbol < 0 || distanceSymbol >= 30 || !bits(DISTANCE_EXTRA[distanceSymbol], &extra))
+            return false;
+        uint32_t distance = DISTANCE_BASE[distanceSymbol] + extra;
+        if (distance > outputBytes || distance > windowMask + 1)
+            return false;
+        while (length--)
+            put(window[(windowPos - distance) & windowMask]);
+        return true;
+    }
+    case MODE_TRAILER:
+    {
+        if (!bits(bitCount & 7, &value) || !bits(32, &value))
+            return false;
+        // Stored big-endian, read least significant byte first
+        uint32_t adler = (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+        if (!flush() || adler != ((adlerB << 16) | adlerA))
+            return false;
+        mode = MODE_DONE;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+InflateResult InflateStream::feed(const uint8_t *data, size_t len, InflateSink out, void *context)
+{
+    if (mode == MODE_DONE || mode == MODE_ERROR)
+        return mode == MODE_DONE ? INFLATE_DONE : INFLATE_ERROR;
+    input = data;
+    inputEnd = data + len;
+    sink = out;
+    sinkContext = context;
+    sinkFailed = false;
+    while (mode != MODE_DONE && !sinkFailed)
+    {
+        // Top up to at least 57 bits while input lasts; the longest step needs 48
+        while (bitCount <= 56 && input < inputEnd)
+        {
+            bitBuffer |= (uint64_t)*input++ << bitCount;
+            bitCount += 8;
+        }
+        uint64_t savedBuffer = bitBuffer;
+        uint8_t savedCount = bitCount;
+        shortRead = false;
+        if (step())
+            continue;
+        if (!shortRead)
+        {
+            mode = MODE_ERROR;
+            return INFLATE_ERROR;
+        }
+        // Chunk ended mid-step: undo the bits taken and wait for the next one
+        bitBuffer = savedBuffer;
+        bitCount = savedCount;
+        break;
+    }
+    if (window && !flush())
+        sinkFailed = true;
+    if (sinkFailed)
+    {
+        mode = MODE_ERROR;
+        return INFLATE_ERROR;
+    }
+    return mode == MODE_DONE ? INFLATE_DONE : INFLATE_MORE;
+}
@@ -0,0 +1,95 @@
+#ifndef INFLATE_STREAM_H
+#define INFLATE_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef INFLATE_MAX_WINDOW_BITS
+#define INFLATE_MAX_WINDOW_BITS 15 // Largest history accepted, 2^15 = 32 KB; compress with a smaller window to use less heap
+#endif
+
+enum InflateResult : uint8_t {
+    INFLATE_MORE,  // Input consumed, stream not finished
+    INFLATE_DONE,  // Stream finished and its Adler-32 matched
+    INFLATE_ERROR  // Corrupt stream, window too large, or the sink failed
+};
+
+// Receives decompressed bytes, in pieces of up to the window size
+typedef bool (*InflateSink)(void *context, const uint8_t *data, size_t len);
+
+// Streaming zlib (RFC 1950/1951) decoder: input arrives in arbitrary chunks,
+// output is written through the window to the sink as it is produced. The
+// window is sized from the stream header (2^8 to 2^INFLATE_MAX_WINDOW_BITS
+// bytes) and is the only large allocation. Each decoding step reads all of
+// its bits before producing anything and is rolled back if the chunk ends
+// mid-step, so no partial state has to be kept between chunks. Preferred to
+// the ROM's tinfl for heap: about 1.6 KB of state against tinfl's 11 KB of
+// tables, and a window of 4 KB for a wbits=12 image.
+class InflateStream {
+public:
+    ~InflateStream() { end(); }
+    void begin();
+    void end(); // Frees the window
+
+    InflateResult feed(const uint8_t *data, size_t len, InflateSink sink, void *context);
+    bool done() const { return mode == MODE_DONE; }
+    uint32_t windowSize() const { return window ? windowMask + 1 : 0; }
+    uint32_t produced() const { return outputBytes; }
+
+private:
+    struct Huffman {
+        uint16_t count[16];   // Codes per length
+        uint16_t symbol[288]; // Symbols ordered by code
+    };
+
+    enum Mode : uint8_t {
+        MODE_HEADER,
+        MODE_BLOCK,
+        MODE_STORED_LENGTH,
+        MODE_STORED,
+        MODE_TABLE_SIZES,
+        MODE_CODE_LENGTH_CODES,
+        MODE_CODE_LENGTHS,
+        MODE_CODES,
+        MODE_TRAILER,
+        MODE_DONE,
+        MODE_ERROR
+    };
+
+    bool step();
+    bool bits(uint8_t count, uint32_t *value);
+    int decode(const Huffman &table);
+    static bool build(Huffman &table, const uint8_t *lengths, size_t count);
+    void put(uint8_t byte);
+    bool flush();
+
+    Mode mode = MODE_HEADER;
+    uint64_t bitBuffer = 0;
+    uint8_t bitCount = 0;
+    bool shortRead = false; // A step ran out of bits, roll it back
+    const uint8_t *input = nullptr;
+    const uint8_t *inputEnd = nullptr;
+
+    uint8_t *window = nullptr;
+    uint32_t windowMask = 0;
+    uint32_t windowPos = 0;
+    uint32_t flushPos = 0;
+    uint32_t outputBytes = 0;
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    InflateSink sink = nullptr;
+    void *sinkContext = nullptr;
+    bool sinkFailed = false;
+
+    bool lastBlock = false;
+    uint32_t storedRemaining = 0;
+    uint16_t literalCount = 0; // HLIT + 257
+    uint16_t distanceCount = 0; // HDIST + 1
+    uint8_t codeLengthCount = 0; // HCLEN + 4
+    uint16_t lengthIndex = 0;
+    uint8_t lengths[288 + 32];
+    Huffman literalCode;
+    Huffman distanceCode;
+};
+
+#endif
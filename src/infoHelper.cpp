@@ -1,31 +1,89 @@
-#include <HTTPClient.h>
+#include <WiFiClient.h>
+#include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
 #include "infoHelper.h"
 #include "debugSerial.h"
+#include "resourceGuard.h"
+#include "pollConfig.h"
 
 extern char boardID[23];
+bool submitPollConfig(const char *text, PollConfigSource source, char *error, size_t errorSize);
+
+// One connection to APPAPI for every backend call, kept open between them
+WiFiClient backendSocket;
+WiFiClientSecure backendTlsSocket;
+BackendClient backend;
+bool backendReady = false;
+
+BackendClient &backendClient()
+{
+    if (!backendReady)
+    {
+        bool tls = strncmp(APPAPI, "https://", 8) == 0;
+        if (tls)
+        {
+            backendTlsSocket.setInsecure(); // No CA configured, as HTTPClient did with a bare URL
+        }
+        backendReady = backend.begin(tls ? (Client &)backendTlsSocket : (Client &)backendSocket, APPAPI, APPAPIKEY);
+    }
+    return backend;
+}
+
+// Create the device record or bring its firmware version up to date in one
+// round trip. Servers without /register get the check-then-create/update sequence.
+void registerDevice()
+{
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &client = backendClient();
+    char path[64];
+    char body[160];
+    snprintf(path, sizeof(path), "/register?u_id=%s", boardID);
+    snprintf(body, sizeof(body), "{\"u_id\":\"%s\",\"device_type\":\"%s\",\"firm_ver\":\"%s\"}", boardID, APPDEVTYPE, APPVERSION);
+    DebugSerial::printf("Will connect %s%s\n", APPAPI, path);
+
+    int httpResponseCode = client.request("POST", path, body);
+    const char *response = client.body();
+    client.end();
+
+    if (httpResponseCode >= 200 && httpResponseCode < 300)
+    {
+        DebugSerial::println("Device registered");
+    }
+    else if (httpResponseCode == 404 || httpResponseCode == 405)
+    {
+        DebugSerial::println("No /register endpoint, checking the device record");
+        checkDeviceExist();
+    }
+    else
+    {
+        DebugSerial::print("HTTP Response code: ");
+        DebugSerial::println(httpResponseCode);
+        DebugSerial::println(response);
+    }
+}
 
 void checkDeviceExist()
 {
-    HTTPClient client;
-    JsonDocument doc;
-    String queryURL = String(APPAPI) + "/checkexist?u_id=" + String(boardID);
-    DebugSerial::println("Will connect " + queryURL);
-    client.begin(queryURL.c_str());
-    client.addHeader("X-Secret-Key", String(APPAPIKEY));
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &client = backendClient();
+    char path[64];
+    snprintf(path, sizeof(path), "/checkexist?u_id=%s", boardID);
+    DebugSerial::printf("Will connect %s%s\n", APPAPI, path);
 
-    int httpResponseCode = client.GET();
+    int httpResponseCode = client.request("GET", path);
 
     if(httpResponseCode == 204) //code no content => info not exist
     {
+        client.end();
         DebugSerial::println("code no content => info not exist");
         signInfo();
     }
     else if(httpResponseCode == 200){ //info exist, check firm_ver
         DebugSerial::println("info exist, check firm_ver on db");
         JsonDocument doc;
-        deserializeJson(doc, client.getString());
-        if(String(APPVERSION) != doc["firm_ver"]){
+        deserializeJson(doc, client.body());
+        client.end();
+        if(strcmp(APPVERSION, doc["firm_ver"] | "") != 0){
             DebugSerial::println("Updating version in database");
             updateFirmver();
         }
@@ -34,36 +92,28 @@ void checkDeviceExist()
     else{
         DebugSerial::print("HTTP Response code: ");
         DebugSerial::println(httpResponseCode);
-        String payload = client.getString();
-        DebugSerial::println("Response " + payload);
-        
+        DebugSerial::print("Response ");
+        DebugSerial::println(client.body());
+        client.end();
     }
-    client.end();
 }
 
 void signInfo()
 {
-    HTTPClient client;
-    String queryURL = String(APPAPI) + "/data?u_id=" + String(boardID);
-    DebugSerial::println("Will connect " + queryURL);
-    client.begin(queryURL.c_str());
-    client.addHeader("Content-Type", "application/json");
-    client.addHeader("X-Secret-Key", String(APPAPIKEY));
-    JsonDocument doc;
-    doc["u_id"] = String(boardID);
-    doc["device_type"] = String(APPDEVTYPE);
-    doc["firm_ver"] = String(APPVERSION);
-
-    String httpRequestData;
-    serializeJson(doc, httpRequestData);
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &client = backendClient();
+    char path[64];
+    char httpRequestData[160];
+    snprintf(path, sizeof(path), "/data?u_id=%s", boardID);
+    snprintf(httpRequestData, sizeof(httpRequestData), "{\"u_id\":\"%s\",\"device_type\":\"%s\",\"firm_ver\":\"%s\"}", boardID, APPDEVTYPE, APPVERSION);
+    DebugSerial::printf("Will connect %s%s\n", APPAPI, path);
     DebugSerial::print(httpRequestData);
-    int httpResponseCode = client.POST(httpRequestData);
+    int httpResponseCode = client.request("POST", path, httpRequestData);
 
     if (httpResponseCode > 0)
     {
-        String response = client.getString();
         DebugSerial::println(httpResponseCode);
-        DebugSerial::println(response);
+        DebugSerial::println(client.body());
     }
     else
     {
@@ -76,25 +126,19 @@ void signInfo()
 
 void updateFirmver()
 {
-    HTTPClient client;
-    String queryURL = String(APPAPI) + "/firmware?u_id=" + String(boardID);
-    DebugSerial::println("Will connect " + queryURL);
-    client.begin(queryURL.c_str());
-    client.addHeader("X-Secret-Key", String(APPAPIKEY));
-    client.addHeader("Content-Type", "application/json");
-    JsonDocument doc;
-    doc["firm_ver"] = String(APPVERSION);
-
-    String httpRequestData;
-    serializeJson(doc, httpRequestData);
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &client = backendClient();
+    char path[64];
+    snprintf(path, sizeof(path), "/firmware?u_id=%s", boardID);
+    DebugSerial::printf("Will connect %s%s\n", APPAPI, path);
+    const char *httpRequestData = "{\"firm_ver\":\"" APPVERSION "\"}";
     DebugSerial::print(httpRequestData);
-    int httpResponseCode = client.PUT(httpRequestData);
+    int httpResponseCode = client.request("PUT", path, httpRequestData);
 
     if (httpResponseCode > 0)
     {
-        String response = client.getString();
         DebugSerial::println(httpResponseCode);
-        DebugSerial::println(response);
+        DebugSerial::println(client.body());
     }
     else
     {
@@ -103,4 +147,42 @@ void updateFirmver()
     }
 
     client.end();
-}
\ No newline at end of file
+}
+
+// Poll config kept in the backend database. The server answers
+// GET /pollconfig?u_id=<id> with the text form (see pollConfig.h), or 204/404
+// when the device has none, which keeps the saved or built-in one.
+void fetchPollConfig()
+{
+    ResourceLock httpLock(RESOURCE_HTTP);
+    BackendClient &client = backendClient();
+    char path[64];
+    snprintf(path, sizeof(path), "/pollconfig?u_id=%s", boardID);
+    DebugSerial::printf("Will connect %s%s\n", APPAPI, path);
+
+    int httpResponseCode = client.request("GET", path);
+    const char *response = client.body();
+    client.end();
+
+    if (httpResponseCode == 200)
+    {
+        char error[96];
+        if (submitPollConfig(response, POLL_CONFIG_BACKEND, error, sizeof(error)))
+        {
+            DebugSerial::println("Poll config from backend applied");
+        }
+        else
+        {
+            DEBUG_WARN("Poll config from backend rejected: %s\n", error);
+        }
+    }
+    else if (httpResponseCode == 204 || httpResponseCode == 404)
+    {
+        DebugSerial::println("No poll config in backend, keeping the current one");
+    }
+    else
+    {
+        DebugSerial::print("HTTP Response code: ");
+        DebugSerial::println(httpResponseCode);
+    }
+}
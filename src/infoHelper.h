@@ -1,3 +1,8 @@
+#include "backendClient.h"
+
+BackendClient &backendClient();
+void registerDevice();
 void checkDeviceExist();
 void signInfo();
-void updateFirmver();
\ No newline at end of file
+void updateFirmver();
+void fetchPollConfig();
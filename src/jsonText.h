@@ -0,0 +1,42 @@
+#ifndef JSON_TEXT_H
+#define JSON_TEXT_H
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stddef.h>
+
+// Appends printf-formatted JSON to a fixed buffer, remembers if anything did not fit
+class JsonText
+{
+public:
+    JsonText(char *out, size_t size) : buffer(out), capacity(size) {}
+
+    void append(const char *format, ...)
+    {
+        if (overflow)
+            return;
+        va_list args;
+        va_start(args, format);
+        int written = vsnprintf(buffer + used, capacity - used, format, args);
+        va_end(args);
+        if (written < 0 || (size_t)written >= capacity - used)
+        {
+            overflow = true;
+            return;
+        }
+        used += written;
+    }
+
+    size_t length() const
+    {
+        return overflow ? 0 : used;
+    }
+
+private:
+    char *buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool overflow = false;
+};
+
+#endif
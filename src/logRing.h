@@ -0,0 +1,139 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+#ifndef DEBUG_LOG_RECORDS
+#define DEBUG_LOG_RECORDS 32 // Ring slots, a power of two (~100 bytes each)
+#endif
+#define DEBUG_LOG_ARGS 8  // Arguments of one deferred printf
+#define DEBUG_LOG_DATA 48 // Bytes per record: %s copies, text or frame bytes
+
+enum LogKind : uint8_t {
+    LOG_FORMAT, // format + captured arguments, formatted by the drain task
+    LOG_TEXT,   // Preformatted text, long text spans consecutive records
+    LOG_HEX     // Raw bytes, printed as a hex dump
+};
+
+enum LogArgType : uint8_t {
+    LOG_ARG_INT,
+    LOG_ARG_UINT,
+    LOG_ARG_FLOAT,
+    LOG_ARG_STRING, // Offset of the copy in LogRecord::data
+    LOG_ARG_POINTER
+};
+
+typedef union {
+    int32_t i;
+    uint32_t u;
+    float f;
+    const void *p;
+} LogArg;
+
+typedef struct {
+    const char *format; // LOG_FORMAT only, a string literal: it is read after the call returns
+    uint8_t level;
+    LogKind kind;
+    uint8_t argCount;
+    uint8_t length; // Bytes used in data
+    bool newline;   // Ends the line after this record
+    uint8_t types[DEBUG_LOG_ARGS];
+    LogArg args[DEBUG_LOG_ARGS];
+    char data[DEBUG_LOG_DATA];
+} LogRecord;
+
+// Bounded multi-producer/single-consumer ring of log records. Each slot carries
+// a sequence number: a producer reserves slots with a CAS on head, fills them in
+// place and publishes each by advancing its sequence; the consumer takes
+// published slots in order and hands them back for the next lap.
+template <size_t N>
+class LogRing {
+    static_assert(N && (N & (N - 1)) == 0, "LogRing size must be a power of two");
+
+public:
+    LogRing()
+    {
+        for (size_t i = 0; i < N; i++)
+        {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Producer side, any task: reserve `count` consecutive records so a long
+    // message is not interleaved with others. False if they do not all fit.
+    bool claim(size_t count, size_t *first)
+    {
+        if (!count || count > N)
+        {
+            return false;
+        }
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            intptr_t lag = 0;
+            for (size_t i = 0; i < count && !lag; i++)
+            {
+                lag = (intptr_t)(slots[(pos + i) & (N - 1)].sequence.load(std::memory_order_acquire) - (pos + i));
+            }
+            if (lag < 0)
+            {
+                return false; // Not yet taken by the consumer: full
+            }
+            if (lag > 0)
+            {
+                pos = head.load(std::memory_order_relaxed); // Another producer got there first
+            }
+            else if (head.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed))
+            {
+                *first = pos;
+                return true;
+            }
+        }
+    }
+
+    LogRecord &record(size_t pos)
+    {
+        return slots[pos & (N - 1)].record;
+    }
+
+    // Producer side, after filling record(pos)
+    void publish(size_t pos)
+    {
+        slots[pos & (N - 1)].sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // Consumer side: the oldest record if it is published, else nullptr
+    const LogRecord *peek() const
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        const Slot &slot = slots[pos & (N - 1)];
+        return slot.sequence.load(std::memory_order_acquire) == pos + 1 ? &slot.record : nullptr;
+    }
+
+    // Consumer side, hand the record returned by peek() back to the producers
+    void release()
+    {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        slots[pos & (N - 1)].sequence.store(pos + N, std::memory_order_release);
+        tail.store(pos + 1, std::memory_order_relaxed);
+    }
+
+    // Records reserved and not yet released, approximate while producers run
+    size_t size() const
+    {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+    Slot slots[N];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
+
+#endif
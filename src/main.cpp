@@ -2,172 +2,849 @@
 
 #define BAUD_RATE 115200    // Define RS-485 baud rate
 #define MODBUS_TIMEOUT 1000 // Timeout for Modbus response in milliseconds
+#define MODBUS_TURNAROUND_US 5000 // Typical slave processing time, for the read plan cost model
+#define READ_GAP_TOLERANCE 4 // Read up to 4 unused registers rather than start another transaction
 #define MAX_DATA_LENGTH 51  // Adjust based on your expected maximum message length
 #define WDT_TIMEOUT 300     // 5 minutes
+#define MODBUS_TASK_PRIORITY 2     // Above loop() and background work, acquisition preempts both
+#define BACKGROUND_TASK_PRIORITY 1 // OTA, NTP and registration
+#define BACKGROUND_RETRY_MS 10000  // Retry a background job this soon when Wi-Fi is down
+#define POLL_CONFIG_NAMESPACE "poll" // NVS namespace of the runtime poll config
+#define POLL_CONFIG_KEY "config"
+#define PROFILER_TASK_PRIORITY 1   // As the stack monitor it replaces
+#define PROFILER_REPORT_MS 60000   // Summary on the debug serial
+#ifndef PROFILE_PAYLOAD_SIZE
+#define PROFILE_PAYLOAD_SIZE 3072 // PROFILE report, about 100 bytes per task
+#endif
 
 // EQSP32 instance
 EQSP32 eqsp32;
 char boardID[23];
 
-// Semaphore for thread-safe access to shared resources
-SemaphoreHandle_t xSemaphore = NULL;
 // Global task handles to track all tasks
 TaskStackUsage stackUsageData;
 TaskHandle_t modbusTaskHandle = NULL;
-TaskHandle_t checkFirmwareTaskHandle = NULL;
-TaskHandle_t syncNTPTaskHandle = NULL;
+TaskHandle_t backgroundTaskHandle = NULL;
+TaskHandle_t profilerTaskHandle = NULL;
 
-// Function to send Modbus RTU request
-void modbusRequest(uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, uint16_t regQuantity)
+// Network housekeeping, run one job at a time on the background task
+typedef struct {
+    const char *name;
+    void (*run)();
+    uint32_t periodMs;       // 0 runs once at startup, then only on request
+    uint32_t nextMs;
+    bool scheduled;          // nextMs is valid
+    volatile bool requested; // Run as soon as possible (MQTT command)
+    bool (*skip)();          // Periodic run not needed while this returns true, nullptr if always
+} BackgroundJob;
+
+BackgroundJob backgroundJobs[BACKGROUND_JOB_COUNT] = {
+    {"register", registerDevice, 0, 0, true, false, nullptr},
+    {"pollconfig", fetchPollConfig, 0, 0, true, false, nullptr},                  // At startup and on POLL FETCH
+    {"ntp", syncNTP, 600000, 0, true, false, nullptr},                            // Every 10 minutes
+    {"ota", []() { OTACheck(true); }, 300000, 0, true, false, firmwareAnnounced}, // Every 5 minutes, unless announcements arrive over MQTT
+};
+
+// Receive ring for the RS-485 bus, kept off the Modbus task stack
+ModbusRxRing modbusRxRing;
+
+// Bus, MQTT and OTA health, published on the metrics topic and in STATUS
+MetricsRegistry metrics;
+
+// CPU per task and heap fragmentation, sampled by the profiler task
+TaskProfiler taskProfiler;
+static char profileText[PROFILE_PAYLOAD_SIZE];
+static std::atomic<size_t> profileLength{0};
+static volatile bool profileRequested = false;
+
+// Send one RTU frame, CRC included
+void sendModbusFrame(const uint8_t *frame, size_t length)
 {
-    // Prepare the request message
-    uint8_t request[8];
-    prepareModbusRequest(request, slaveAddr, functionCode, startAddr, regQuantity);
+    // Drop any stale bytes so the response starts at the echo
+    while (eqsp32.Serial.available())
+    {
+        eqsp32.Serial.read();
+    }
     // Send the request
     eqsp32.configSerial(RS485_TX, BAUD_RATE); // Enable transmitter
-    eqsp32.Serial.write(request, 8);          // Write the request to UART
+    eqsp32.Serial.write(frame, length);       // Write the request to UART
     eqsp32.Serial.flush();                    // Ensure message sent
     eqsp32.configSerial(RS485_RX, BAUD_RATE); // Disable transmitter
 }
 
-bool waitForModbusResponse(uint8_t *response, size_t *responseLength, uint32_t timeout)
+// Function to send Modbus RTU request, the 8 sent bytes are left in `request`
+void modbusRequest(uint8_t *request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, uint16_t regQuantity)
+{
+    prepareModbusRequest(request, slaveAddr, functionCode, startAddr, regQuantity);
+    sendModbusFrame(request, 8);
+}
+
+// Send `length` message bytes (no CRC) as one ASCII frame
+void sendModbusAsciiFrame(const uint8_t *message, size_t length)
+{
+    char frame[1 + 2 * (WRITE_REQUEST_SIZE - 1) + 2]; // ':' + message and LRC as hex pairs + CR LF
+    size_t frameLength = encodeModbusAsciiFrame(message, length, frame, sizeof(frame));
+    while (eqsp32.Serial.available())
+    {
+        eqsp32.Serial.read();
+    }
+    // ASCII slaves use 7 data bits; the next RTU request switches the port back
+    eqsp32.configSerial(RS485_TX, BAUD_RATE, SERIAL_7E1);
+    eqsp32.Serial.write((const uint8_t *)frame, frameLength);
+    eqsp32.Serial.flush();
+    eqsp32.configSerial(RS485_RX, BAUD_RATE, SERIAL_7E1);
+}
+
+// Function to send Modbus ASCII request, the 6 message bytes (no CRC) are left in `request`
+void modbusAsciiRequest(uint8_t *request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, uint16_t regQuantity)
+{
+    prepareModbusRequest(request, slaveAddr, functionCode, startAddr, regQuantity);
+    sendModbusAsciiFrame(request, 6);
+}
+
+// Task blocked in waitForModbusResponse, woken by the UART receive event
+static volatile TaskHandle_t modbusRxWaiter = NULL;
+
+void onModbusRx()
+{
+    TaskHandle_t waiter = modbusRxWaiter;
+    if (waiter != NULL)
+    {
+        xTaskNotifyGive(waiter);
+    }
+}
+
+// Hook the UART receive event when the port offers one (HardwareSerial::onReceive).
+// Without it waitForModbusResponse still sleeps between checks, one tick at a time.
+template <typename Port>
+auto attachModbusRxEvent(Port &port, int) -> decltype(port.onReceive(onModbusRx), bool())
+{
+    port.onReceive(onModbusRx);
+    return true;
+}
+
+template <typename Port>
+bool attachModbusRxEvent(Port &, long)
+{
+    return false;
+}
+
+// Receive one response frame into modbusRxRing and return a view of it without
+// the transceiver echo. The frame ends when the length announced by its header
+// has arrived; the 3.5 character silence that ends every RTU frame only ends
+// frames whose length the header does not give.
+bool waitForModbusResponse(const uint8_t *request, size_t requestLength, ModbusFrameView *frame, uint32_t timeout)
 {
-    memset(response, 0, 256); // Clear the response buffer
+    uint8_t *rx = modbusRxRing.beginFrame();
     uint32_t startTime = millis();
+    uint32_t silenceUs = modbusSilenceMicros(BAUD_RATE);
+    TickType_t silenceTicks = pdMS_TO_TICKS(silenceUs / 1000 + 1);
+    uint32_t lastByteUs = micros();
+    size_t received = 0;
+    int echoLength = -1; // Unknown until the first bytes are compared with the request
+    size_t expected = 0;
+    bool complete = false;
 
-    while (millis() - startTime < timeout)
+    modbusRxWaiter = xTaskGetCurrentTaskHandle();
+    while (!complete && millis() - startTime < timeout)
     {
-        if (eqsp32.Serial.available())
+        // Drain what the UART driver has buffered
+        while (received < MODBUS_RX_MAX_FRAME && eqsp32.Serial.available())
         {
-            // Read the entire response into the buffer
-            *responseLength = eqsp32.Serial.readBytes(response, 256);
+            rx[received++] = eqsp32.Serial.read();
+            lastByteUs = micros();
+        }
+
+        if (echoLength < 0 && received > 0)
+        {
+            echoLength = modbusEchoLength(rx, received, request, requestLength);
+        }
 
-            // Check if the response is at least as long as the request (8 bytes)
-            if (*responseLength > 8)
+        if (echoLength >= 0 && received > (size_t)echoLength)
+        {
+            if (expected == 0)
             {
-                // Remove the first 8 bytes (echo of the request)
-                memmove(response, response + 8, *responseLength - 8);
-                *responseLength -= 8;
-                return true; // Response received
+                expected = modbusResponseLength(rx + echoLength, received - echoLength);
+            }
+            // Once the header gives the length, only that length (or the timeout) ends the
+            // frame: bytes are drained in UART FIFO chunks, so long reads show gaps longer
+            // than the silence while the FIFO fills
+            if (expected != 0)
+            {
+                complete = received >= echoLength + expected || received == MODBUS_RX_MAX_FRAME;
             }
+            else
+            {
+                complete = micros() - lastByteUs >= silenceUs || received == MODBUS_RX_MAX_FRAME;
+            }
+        }
+
+        if (!complete)
+        {
+            // Block until the UART reports data, or until the silence interval has passed
+            ulTaskNotifyTake(pdTRUE, silenceTicks > 0 ? silenceTicks : 1);
         }
     }
-    return false; // Timeout
+    modbusRxWaiter = NULL;
+
+    if (!complete)
+    {
+        modbusRxRing.endFrame(0);
+        return false; // Timeout
+    }
+
+    // Hand out the response in place, after the echo
+    ModbusFrameView whole = modbusRxRing.endFrame(received);
+    frame->data = whole.data + echoLength;
+    frame->length = whole.length - echoLength;
+    return true; // Response received
 }
 
-// Task to handle Modbus communication
-void modbusTask(void *pvParameters)
+// Receive one Modbus ASCII response. Characters are decoded as they arrive,
+// straight into modbusRxRing; the view holds address, function and data (LRC checked and dropped).
+// On timeout *error tells if a frame arrived with a bad LRC.
+bool waitForModbusAsciiResponse(const uint8_t *message, size_t messageLength, ModbusFrameView *frame, uint32_t timeout, ModbusError *error)
 {
-    while (1)
+    uint8_t *rx = modbusRxRing.beginFrame();
+    ModbusAsciiDecoder decoder;
+    decoder.reset(rx, MODBUS_RX_MAX_FRAME);
+    uint32_t startTime = millis();
+    *error = MODBUS_NO_RESPONSE;
+
+    modbusRxWaiter = xTaskGetCurrentTaskHandle();
+    while (millis() - startTime < timeout)
     {
-        if (xSemaphoreTake(xSemaphore, portMAX_DELAY) == pdTRUE)
-        {
-            // Example: Read Holding Registers from D1 to D10 (Register Address 0 to 9)
-            uint8_t slaveAddr = 1;       // Slave address
-            uint8_t functionCode = 0x03; // Function code for Read Holding Registers
-            uint16_t startAddr = 0;      // Start address of the holding register (D1 = 0, D2 = 1, ..., D10 = 9)
-            uint16_t regQuantity = 10;   // Number of registers to read (D1 to D10)
-
-            // Send Modbus request
-            modbusRequest(slaveAddr, functionCode, startAddr, regQuantity);
-            uint8_t response[256];
-            size_t responseLength = 0;
-            ChamberData chamberData;
-            memset(&chamberData, 0, sizeof(chamberData)); // Initialize all fields to 0
-            if (waitForModbusResponse(response, &responseLength, MODBUS_TIMEOUT))
+        while (eqsp32.Serial.available())
+        {
+            ModbusAsciiDecoder::Status status = decoder.feed((char)eqsp32.Serial.read());
+            if (status == ModbusAsciiDecoder::COMPLETE)
             {
-                // Process the response
-                chamberData = readModbusResponse(response, responseLength);
-                for (size_t i = 0; i < responseLength; i++)
+                // The transceiver echo is a complete frame of our own request, skip it
+                if (decoder.length() == messageLength && memcmp(rx, message, messageLength) == 0)
                 {
-                    Serial.print(response[i], HEX);
-                    Serial.print(" ");
+                    continue;
                 }
+                modbusRxWaiter = NULL;
+                *frame = modbusRxRing.endFrame(decoder.length());
+                return true; // Response received
             }
-            else
+            if (status == ModbusAsciiDecoder::FRAME_ERROR && decoder.lrcFailed())
             {
-                DebugSerial::println("Modbus response timeout");
+                DEBUG_ERROR("LRC validation failed\n");
+                *error = MODBUS_CRC_ERROR;
             }
-            sendDataMQTT(chamberData);
+        }
+        // Block until the UART reports more characters
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+    }
+    modbusRxWaiter = NULL;
+    modbusRxRing.endFrame(0);
+    return false; // Timeout
+}
 
-            xSemaphoreGive(xSemaphore); // Release the semaphore
+// Chambers daisy-chained on the RS-485 bus. Their reads are planned from
+// CHAMBER_REGISTER_MAP, e.g. D1 to D10 (Register Address 0 to 9) in one request.
+const PollSlave pollSlaves[] = {
+    // slave, function, period (ms)[, MODBUS_ASCII for legacy 7-bit slaves[, field mask]]
+    // Replaced at runtime by POLL commands or the backend, see pollConfig.h
+    {1, 0x03, 60000},
+};
+PollScheduler pollScheduler;
+
+// Poll config the Modbus task picks up between transactions, newest wins
+static QueueHandle_t pollConfigQueue = NULL;
+// Config being polled in text form, for POLL and STATUS
+static SemaphoreHandle_t pollConfigMutex = NULL;
+static char pollConfigText[POLL_CONFIG_TEXT_SIZE];
+static PollConfigSource pollConfigSource = POLL_CONFIG_DEFAULT;
+static uint32_t pollConfigLoad = 0; // Permille of the bus
+
+// How late polls started against their deadlines, over every poll config since boot.
+// This is what blocked acquisition: the transaction or write ahead of it on the bus,
+// or the task not getting the CPU. Written by the Modbus task only.
+static std::atomic<uint32_t> acquisitionLateMs{0};
+static std::atomic<uint32_t> acquisitionMaxLateMs{0};
+
+static void noteAcquisitionLate(uint32_t lateMs)
+{
+    acquisitionLateMs.fetch_add(lateMs, std::memory_order_relaxed);
+    if (lateMs > acquisitionMaxLateMs.load(std::memory_order_relaxed))
+    {
+        acquisitionMaxLateMs.store(lateMs, std::memory_order_relaxed);
+    }
+}
+
+uint32_t acquisitionBlockedMs(uint32_t *maxMs)
+{
+    *maxMs = acquisitionMaxLateMs.load(std::memory_order_relaxed);
+    return acquisitionLateMs.load(std::memory_order_relaxed);
+}
+
+// SET commands waiting for the bus, served by the Modbus task ahead of the next poll
+static WriteQueue writeQueue;
+static SemaphoreHandle_t writeQueueMutex = NULL;
+static uint32_t nextWriteId = 1;
+
+// Data of each slave's current cycle, merged across its reads
+ChamberData cycleData[POLL_MAX_JOBS];
+
+ChamberData &cycleDataFor(uint8_t slaveAddr)
+{
+    for (size_t i = 0; i < POLL_MAX_JOBS - 1; i++)
+    {
+        if (cycleData[i].slaveAddr == slaveAddr || cycleData[i].slaveAddr == 0)
+        {
+            cycleData[i].slaveAddr = slaveAddr;
+            return cycleData[i];
         }
-        vTaskDelay(pdMS_TO_TICKS(60000)); // TODO: use the reference lib and read config from database
     }
+    return cycleData[POLL_MAX_JOBS - 1];
 }
 
-// Task to check for firmware updates
-void checkFirmwareTask(void *pvParameters)
+static PollConfig defaultPollConfig()
 {
-    while (1)
+    PollConfig config = {};
+    config.slaveCount = sizeof(pollSlaves) / sizeof(pollSlaves[0]);
+    memcpy(config.slaves, pollSlaves, sizeof(pollSlaves));
+    config.source = POLL_CONFIG_DEFAULT;
+    return config;
+}
+
+// Remember what is being polled, for POLL and STATUS
+static void notePollConfig(const PollConfig &config)
+{
+    xSemaphoreTake(pollConfigMutex, portMAX_DELAY);
+    if (!formatPollConfig(config, pollConfigText, sizeof(pollConfigText)))
+    {
+        pollConfigText[0] = '\0';
+    }
+    pollConfigSource = config.source;
+    pollConfigLoad = pollBusLoad(config, READ_GAP_TOLERANCE, BAUD_RATE, MODBUS_TURNAROUND_US);
+    xSemaphoreGive(pollConfigMutex);
+}
+
+// The config saved in NVS by the last POLL command or backend fetch, else pollSlaves.
+// Runs in setup(), off the Modbus task's stack: NVS, the text form and the parser are its deepest path.
+static PollConfig loadPollConfig()
+{
+    PollConfig config = defaultPollConfig();
+    Preferences preferences;
+    if (preferences.begin(POLL_CONFIG_NAMESPACE, true))
     {
-        if (xSemaphoreTake(xSemaphore, portMAX_DELAY) == pdTRUE)
+        char text[POLL_CONFIG_TEXT_SIZE];
+        char error[96];
+        if (preferences.getString(POLL_CONFIG_KEY, text, sizeof(text)) > 0)
         {
-            if (eqsp32.getWiFiStatus() == EQ_WF_CONNECTED && WiFi.localIP().toString() != "0.0.0.0")
+            PollConfig saved;
+            if (parsePollConfig(text, &saved, error, sizeof(error)) &&
+                checkPollConfig(saved, READ_GAP_TOLERANCE, BAUD_RATE, MODBUS_TURNAROUND_US, error, sizeof(error)))
             {
-                DebugSerial::println("Checking for firmware updates...");
-                OTACheck(true); // Call OTAHelper function to check for updates
+                config = saved;
+                config.source = POLL_CONFIG_NVS;
             }
-            xSemaphoreGive(xSemaphore); // Release the semaphore
+            else
+            {
+                DEBUG_WARN("Saved poll config ignored: %s\n", error);
+            }
+        }
+        preferences.end();
+    }
+    return config;
+}
+
+// Validate, save and hand a new config to the Modbus task, which switches to it
+// before its next transaction. Runs on the MQTT loop or the background task.
+bool submitPollConfig(const char *text, PollConfigSource source, char *error, size_t errorSize)
+{
+    PollConfig config;
+    if (!parsePollConfig(text, &config, error, errorSize) ||
+        !checkPollConfig(config, READ_GAP_TOLERANCE, BAUD_RATE, MODBUS_TURNAROUND_US, error, errorSize))
+    {
+        return false;
+    }
+    config.source = source;
+    char canonical[POLL_CONFIG_TEXT_SIZE];
+    if (!formatPollConfig(config, canonical, sizeof(canonical)))
+    {
+        snprintf(error, errorSize, "does not fit %u characters", POLL_CONFIG_TEXT_SIZE);
+        return false;
+    }
+    xSemaphoreTake(pollConfigMutex, portMAX_DELAY);
+    bool unchanged = strcmp(canonical, pollConfigText) == 0;
+    xSemaphoreGive(pollConfigMutex);
+    if (unchanged)
+    {
+        return true; // Same plan, e.g. the backend fetch at boot: no flash write, no scheduler restart
+    }
+    {
+        ResourceLock flashLock(RESOURCE_FLASH);
+        Preferences preferences;
+        if (!preferences.begin(POLL_CONFIG_NAMESPACE, false) || !preferences.putString(POLL_CONFIG_KEY, canonical))
+        {
+            DEBUG_WARN("Poll config not saved, it applies until reboot\n");
         }
-        vTaskDelay(pdMS_TO_TICKS(300000)); // Delay for 300 seconds (5 minutes)
+        preferences.end();
     }
+    notePollConfig(config);
+    xQueueOverwrite(pollConfigQueue, &config);
+    xTaskNotifyGive(modbusTaskHandle);
+    return true;
 }
 
-// Task to check for firmware updates
-void syncNTPTask(void *pvParameters)
+// Back to pollSlaves, also after a reboot
+void resetPollConfig()
+{
+    {
+        ResourceLock flashLock(RESOURCE_FLASH);
+        Preferences preferences;
+        if (preferences.begin(POLL_CONFIG_NAMESPACE, false))
+        {
+            preferences.remove(POLL_CONFIG_KEY);
+            preferences.end();
+        }
+    }
+    PollConfig config = defaultPollConfig();
+    notePollConfig(config);
+    xQueueOverwrite(pollConfigQueue, &config);
+    xTaskNotifyGive(modbusTaskHandle);
+}
+
+// JSON object: the config in text form, where it came from and its planned bus load
+size_t describePollConfig(char *out, size_t size)
+{
+    xSemaphoreTake(pollConfigMutex, portMAX_DELAY);
+    int length = snprintf(out, size, "{\"config\":\"%s\",\"source\":\"%s\",\"busLoadPct\":%u.%u,\"minPeriodMs\":%u}",
+                          pollConfigText, pollConfigSourceName(pollConfigSource),
+                          (unsigned)(pollConfigLoad / 10), (unsigned)(pollConfigLoad % 10), POLL_MIN_PERIOD_MS);
+    xSemaphoreGive(pollConfigMutex);
+    return length > 0 && (size_t)length < size ? length : 0;
+}
+
+// Plan the reads for every slave and hand them to the scheduler. Partial
+// cycles of the previous plan are dropped.
+void setupPollJobs(const PollConfig &config)
+{
+    static PollJob jobs[POLL_MAX_JOBS]; // Modbus task only; the scheduler keeps its own copy
+    size_t slaveCount = config.slaveCount;
+    size_t jobCount = planPollJobs(config.slaves, slaveCount, READ_GAP_TOLERANCE, jobs, POLL_MAX_JOBS);
+    if (jobCount == 0)
+    {
+        DebugSerial::println("Error: poll plan does not fit POLL_MAX_JOBS");
+    }
+    pollScheduler.begin(jobs, jobCount, millis());
+    memset(cycleData, 0, sizeof(cycleData));
+    for (size_t i = 0; i < slaveCount; i++)
+    {
+        metrics.slave(config.slaves[i].slaveAddr); // Reported in config order
+    }
+
+    // Report what the plan costs on the bus against one read per register
+    uint32_t planUs = 0;
+    for (size_t i = 0; i < jobCount; i++)
+    {
+        planUs += estimateReadMicros(jobs[i].regQuantity, BAUD_RATE, MODBUS_TURNAROUND_US, jobs[i].transport);
+    }
+    uint32_t perRegisterUs = slaveCount * CHAMBER_REGISTER_COUNT * estimateReadMicros(1, BAUD_RATE, MODBUS_TURNAROUND_US);
+    DebugSerial::printf("Read plan (%s config): %u reads for %u slaves, ~%u us of bus time per cycle (%u us saved), bus load %u permille\n",
+                        pollConfigSourceName(config.source), jobCount, slaveCount, planUs, perRegisterUs > planUs ? perRegisterUs - planUs : 0,
+                        pollBusLoad(config, READ_GAP_TOLERANCE, BAUD_RATE, MODBUS_TURNAROUND_US));
+}
+
+// Run one read transaction on the bus and decode it for the job's slave
+ChamberData pollSlave(const PollJob &job)
+{
+    uint8_t request[8];
+    ModbusFrameView response;
+    ChamberData chamberData;
+    memset(&chamberData, 0, sizeof(chamberData)); // Initialize all fields to 0
+    bool received;
+    ModbusError result = MODBUS_NO_RESPONSE;
+    uint32_t startUs = micros();
+
+    // Send Modbus request
+    if (job.transport == MODBUS_ASCII)
+    {
+        modbusAsciiRequest(request, job.slaveAddr, job.functionCode, job.startAddr, job.regQuantity);
+        received = waitForModbusAsciiResponse(request, 6, &response, MODBUS_TIMEOUT, &result);
+    }
+    else
+    {
+        modbusRequest(request, job.slaveAddr, job.functionCode, job.startAddr, job.regQuantity);
+        received = waitForModbusResponse(request, sizeof(request), &response, MODBUS_TIMEOUT);
+    }
+    uint32_t roundTripUs = micros() - startUs;
+
+    if (received)
+    {
+        // Process the response
+        chamberData = job.transport == MODBUS_ASCII ? decodeChamberData(response.data, response.length, job.startAddr, &result)
+                                                    : readModbusResponse(response.data, response.length, job.startAddr, &result);
+        DEBUG_HEXDUMP(DEBUG_LEVEL_VERBOSE, "Response: ", response.data, response.length);
+    }
+    else if (result == MODBUS_NO_RESPONSE)
+    {
+        DEBUG_WARN("Modbus response timeout (slave %u)\n", job.slaveAddr);
+    }
+    metrics.recordTransaction(job.slaveAddr, result, roundTripUs, millis());
+    chamberData.slaveAddr = job.slaveAddr;
+    return chamberData;
+}
+
+// Queue a SET command for the Modbus task, which runs it before its next poll.
+// Runs on the MQTT loop. Assigns the id if the command has none.
+WriteResult submitWrite(WriteCommand &command, WriteCommand *superseded)
+{
+    xSemaphoreTake(writeQueueMutex, portMAX_DELAY);
+    if (command.id == 0)
+    {
+        command.id = nextWriteId++;
+    }
+    command.queuedMs = millis();
+    WriteResult result = writeQueue.push(command, superseded);
+    xSemaphoreGive(writeQueueMutex);
+    if (result != WRITE_QUEUE_FULL)
+    {
+        xTaskNotifyGive(modbusTaskHandle); // Wakes it if it sleeps until the next deadline
+    }
+    return result;
+}
+
+WriteQueueStats writeQueueStats(size_t *pending)
+{
+    xSemaphoreTake(writeQueueMutex, portMAX_DELAY);
+    WriteQueueStats stats = writeQueue.stats();
+    *pending = writeQueue.size();
+    xSemaphoreGive(writeQueueMutex);
+    return stats;
+}
+
+static bool takeWrite(WriteCommand *command)
+{
+    xSemaphoreTake(writeQueueMutex, portMAX_DELAY);
+    bool taken = writeQueue.pop(command);
+    xSemaphoreGive(writeQueueMutex);
+    return taken;
+}
+
+// One write or read back transaction. The view holds address, function and
+// data, CRC or LRC checked and dropped. Counted in the slave's metrics.
+static ModbusError exchangeModbusFrame(ModbusTransport transport, const uint8_t *request, size_t length, ModbusFrameView *response)
+{
+    ModbusError result = MODBUS_NO_RESPONSE;
+    uint32_t startUs = micros();
+    bool received;
+    if (transport == MODBUS_ASCII)
+    {
+        sendModbusAsciiFrame(request, length - 2);
+        received = waitForModbusAsciiResponse(request, length - 2, response, MODBUS_TIMEOUT, &result);
+    }
+    else
+    {
+        sendModbusFrame(request, length);
+        received = waitForModbusResponse(request, length, response, MODBUS_TIMEOUT);
+        if (received && !validateModbusCRC(response->data, response->length))
+        {
+            result = MODBUS_CRC_ERROR;
+            received = false;
+        }
+        else if (received)
+        {
+            response->length -= 2;
+        }
+    }
+    if (received)
+    {
+        if (request[1] != 0x03)
+        {
+            result = checkModbusWriteResponse(response->data, response->length, request);
+        }
+        else
+        {
+            result = response->length < 3 ? MODBUS_LENGTH_ERROR : response->data[1] & 0x80 ? MODBUS_EXCEPTION : MODBUS_OK;
+        }
+    }
+    else if (result == MODBUS_NO_RESPONSE)
+    {
+        DEBUG_WARN("Modbus write timeout (slave %u)\n", request[0]);
+    }
+    metrics.recordTransaction(request[0], result, micros() - startUs, millis());
+    return result;
+}
+
+static ModbusTransport transportOf(const PollConfig &config, uint8_t slaveAddr)
+{
+    for (size_t i = 0; i < config.slaveCount; i++)
+    {
+        if (config.slaves[i].slaveAddr == slaveAddr)
+        {
+            return config.slaves[i].transport;
+        }
+    }
+    return MODBUS_RTU;
+}
+
+// Write a SET command, one transaction per run of contiguous registers, then
+// read the registers back and hand the ack to the MQTT loop
+static void runWrite(const WriteCommand &command, ModbusTransport transport)
+{
+    WriteAck ack = {};
+    ack.command = command;
+    ack.waitMs = millis() - command.queuedMs;
+    uint32_t startUs = micros();
+    ModbusFrameView response = {};
+    ModbusError error = MODBUS_OK;
+    {
+        ResourceLock busLock(RESOURCE_RS485);
+        for (size_t first = 0; first < command.count && error == MODBUS_OK;)
+        {
+            size_t run = writeRunLength(command, first);
+            uint8_t request[WRITE_REQUEST_SIZE];
+            size_t length = prepareModbusWriteRequest(request, command.slaveAddr, writeRunFunction(command, run),
+                                                      CHAMBER_REGISTER_MAP[command.fields[first]].reg, &command.values[first], run);
+            error = exchangeModbusFrame(transport, request, length, &response);
+            first += run;
+        }
+        if (error == MODBUS_OK)
+        {
+            uint8_t request[8];
+            uint16_t startAddr, quantity;
+            writeReadRange(command, &startAddr, &quantity);
+            prepareModbusRequest(request, command.slaveAddr, 0x03, startAddr, quantity);
+            error = exchangeModbusFrame(transport, request, sizeof(request), &response);
+        }
+    }
+    ack.busUs = micros() - startUs;
+    ack.result = error == MODBUS_OK ? checkWriteReadBack(command, response.data, response.length, ack.readBack) : writeResultOf(error);
+    if (error == MODBUS_EXCEPTION)
+    {
+        ack.exceptionCode = response.data[2];
+    }
+    ack.latencyMs = millis() - command.queuedMs;
+    metrics.counter(ack.result == WRITE_OK ? METRIC_WRITES : METRIC_WRITE_FAILURES).add();
+    metrics.histogram(METRIC_WRITE_LATENCY_MS).record(ack.latencyMs);
+    queueWriteAck(ack); // Published by the MQTT loop
+}
+
+// Task to handle Modbus communication
+void modbusTask(void *pvParameters)
+{
+    PollConfig config = {};
+    xQueueReceive(pollConfigQueue, &config, portMAX_DELAY); // Loaded by setup()
+    setupPollJobs(config);
+    while (1)
+    {
+        // A new config applies between transactions, never in the middle of one
+        if (xQueueReceive(pollConfigQueue, &config, 0) == pdTRUE)
+        {
+            setupPollJobs(config);
+        }
+        // Writes go ahead of the next poll, so a SET waits for one transaction at most
+        WriteCommand command;
+        if (takeWrite(&command))
+        {
+            runWrite(command, transportOf(config, command.slaveAddr));
+            continue;
+        }
+        uint32_t waitMs = 0;
+        int jobIndex = pollScheduler.nextDueJob(millis(), &waitMs);
+        if (jobIndex < 0)
+        {
+            // Sleep until the earliest deadline, a new config or a write; due jobs run back-to-back to keep the bus busy
+            TickType_t waitTicks = pdMS_TO_TICKS(waitMs > 1000 ? 1000 : waitMs);
+            ulTaskNotifyTake(pdTRUE, waitTicks > 0 ? waitTicks : 1);
+            continue;
+        }
+
+        const PollJob &job = pollScheduler.job(jobIndex);
+        pollScheduler.markStarted(jobIndex, millis());
+        noteAcquisitionLate(pollScheduler.stats(jobIndex).lastJitterMs);
+        ChamberData &chamberData = cycleDataFor(job.slaveAddr);
+        {
+            ResourceLock busLock(RESOURCE_RS485);
+            mergeChamberFields(chamberData, pollSlave(job));
+        }
+        if (job.lastInCycle)
+        {
+            queueSample(chamberData); // Published by the MQTT loop, never blocks polling
+            memset(&chamberData, 0, sizeof(chamberData));
+            chamberData.slaveAddr = job.slaveAddr;
+        }
+    }
+}
+
+// Ask the background task to run a job now, e.g. from an MQTT command
+void requestBackgroundJob(BackgroundJobId id)
+{
+    backgroundJobs[id].requested = true;
+    if (backgroundTaskHandle != NULL)
+    {
+        xTaskNotifyGive(backgroundTaskHandle);
+    }
+}
+
+// Low-priority task for OTA, NTP and registration. Each job only takes the
+// resources it uses (HTTP, flash), so a long OTA download never stops polling.
+void backgroundTask(void *pvParameters)
 {
     while (1)
     {
-        if (xSemaphoreTake(xSemaphore, portMAX_DELAY) == pdTRUE)
+        uint32_t waitMs = 60000;
+        for (size_t i = 0; i < BACKGROUND_JOB_COUNT; i++)
         {
-            if (eqsp32.getWiFiStatus() == EQ_WF_CONNECTED && WiFi.localIP().toString() != "0.0.0.0")
+            BackgroundJob &job = backgroundJobs[i];
+            uint32_t now = millis();
+            bool periodic = job.scheduled && (int32_t)(now - job.nextMs) >= 0;
+            if (periodic && !job.requested && job.skip && job.skip())
             {
-                syncNTP();
+                job.nextMs = now + job.periodMs;
+                periodic = false;
             }
-            xSemaphoreGive(xSemaphore); // Release the semaphore
+            bool due = job.requested || periodic;
+            if (!due)
+            {
+                if (job.scheduled && job.nextMs - now < waitMs)
+                {
+                    waitMs = job.nextMs - now;
+                }
+                continue;
+            }
+
+            if (eqsp32.getWiFiStatus() != EQ_WF_CONNECTED || WiFi.localIP().toString() == "0.0.0.0")
+            {
+                job.nextMs = now + BACKGROUND_RETRY_MS;
+                job.scheduled = true;
+                waitMs = waitMs < BACKGROUND_RETRY_MS ? waitMs : BACKGROUND_RETRY_MS;
+                continue;
+            }
+
+            DebugSerial::printf("Background job: %s\n", job.name);
+            job.requested = false;
+            job.run();
+            job.scheduled = job.periodMs != 0;
+            job.nextMs = millis() + job.periodMs;
         }
-        vTaskDelay(pdMS_TO_TICKS(600000)); // Delay for 10 minutes
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs)); // Woken early by requestBackgroundJob
     }
 }
 
-void stackMonitorTask(void *pvParameters) //DO NOT USE xSemaphore here, it will cause deadlock
+// Hands a report to the MQTT loop: written by the profiler task while the
+// length is 0, published and released by the MQTT loop once it is not
+void requestProfile()
 {
-    while (1)
+    profileRequested = true;
+    if (profilerTaskHandle != NULL)
     {
+        xTaskNotifyGive(profilerTaskHandle);
+    }
+}
+
+size_t profileReport(const char **report)
+{
+    *report = profileText;
+    return profileLength.load(std::memory_order_acquire);
+}
 
-        DebugSerial::println("--- TASK STACK USAGE REPORT ---");
+void releaseProfileReport()
+{
+    profileLength.store(0, std::memory_order_release);
+}
 
-        // Collect stack usage data
-        if (modbusTaskHandle != NULL)
+// Samples every task each PROFILER_SAMPLE_MS and logs a summary every minute.
+// A PROFILE request only wakes it to write the report: samples stay evenly spaced.
+void profilerTask(void *pvParameters)
+{
+    uint32_t nextSampleMs = millis();
+    uint32_t lastReportMs = millis();
+    while (1)
+    {
+        if ((int32_t)(millis() - nextSampleMs) >= 0)
         {
-            stackUsageData.modbusTaskStack = uxTaskGetStackHighWaterMark(modbusTaskHandle);
-            DebugSerial::printf("Modbus Task: %u bytes\n", stackUsageData.modbusTaskStack);
+            sampleTaskProfiler(taskProfiler);
+            nextSampleMs += PROFILER_SAMPLE_MS;
+            if ((int32_t)(millis() - nextSampleMs) >= 0)
+            {
+                nextSampleMs = millis() + PROFILER_SAMPLE_MS; // Fell behind, do not catch up in a burst
+            }
         }
 
-        if (checkFirmwareTaskHandle != NULL)
+        if (profileRequested && profileLength.load(std::memory_order_acquire) == 0)
         {
-            stackUsageData.firmwareTaskStack = uxTaskGetStackHighWaterMark(checkFirmwareTaskHandle);
-            DebugSerial::printf("Firmware Task: %u bytes\n", stackUsageData.firmwareTaskStack);
+            profileRequested = false;
+            size_t length = taskProfiler.writeJson(profileText, sizeof(profileText));
+            if (length)
+            {
+                profileLength.store(length, std::memory_order_release);
+            }
+            else
+            {
+                DebugSerial::println("Profile report does not fit PROFILE_PAYLOAD_SIZE");
+            }
         }
 
-        if (syncNTPTaskHandle != NULL)
+        if (millis() - lastReportMs >= PROFILER_REPORT_MS)
         {
-            stackUsageData.ntpTaskStack = uxTaskGetStackHighWaterMark(syncNTPTaskHandle);
-            DebugSerial::printf("NTP Task: %u bytes\n", stackUsageData.ntpTaskStack);
+            lastReportMs = millis();
+            logTaskReport();
         }
 
-        // Overall system memory info
-        DebugSerial::printf("Free Heap: %u bytes\n", ESP.getFreeHeap());
+        int32_t waitMs = (int32_t)(nextSampleMs - millis());
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs > 0 ? waitMs : 0)); // Woken early by requestProfile
+    }
+}
+
+void logTaskReport()
+{
+    DebugSerial::println("--- TASK STACK USAGE REPORT ---");
 
-        vTaskDelay(pdMS_TO_TICKS(60000)); // Check every minute
+    // Collect stack usage data
+    if (modbusTaskHandle != NULL)
+    {
+        stackUsageData.modbusTaskStack = uxTaskGetStackHighWaterMark(modbusTaskHandle);
+        DebugSerial::printf("Modbus Task: %u bytes\n", stackUsageData.modbusTaskStack);
     }
+
+    if (backgroundTaskHandle != NULL)
+    {
+        stackUsageData.backgroundTaskStack = uxTaskGetStackHighWaterMark(backgroundTaskHandle);
+        DebugSerial::printf("Background Task: %u bytes\n", stackUsageData.backgroundTaskStack);
+    }
+
+    // CPU over the last minute, busiest tasks first
+    const size_t window = PROFILER_WINDOW_COUNT - 1;
+    DebugSerial::printf("CPU core 0: %d, core 1: %d permille\n", taskProfiler.coreLoad(0, window), taskProfiler.coreLoad(1, window));
+    size_t busiest[3];
+    size_t count = taskProfiler.busiest(window, busiest, 3);
+    for (size_t i = 0; i < count; i++)
+    {
+        DebugSerial::printf("  %s: %d permille\n", taskProfiler.taskName(busiest[i]), taskProfiler.taskLoad(busiest[i], window));
+    }
+    const ProfilerStats &profiler = taskProfiler.stats();
+    DebugSerial::printf("Profiler sample: %u us, max %u us\n", profiler.lastCostUs, profiler.maxCostUs);
+
+    // Time polls started after their deadlines
+    uint32_t maxLateMs;
+    uint32_t lateMs = acquisitionBlockedMs(&maxLateMs);
+    DebugSerial::printf("Acquisition blocked: %u ms total, %u ms max\n", lateMs, maxLateMs);
+
+    // Poll timing per job
+    for (size_t i = 0; i < pollScheduler.jobCount(); i++)
+    {
+        const PollJobStats &stats = pollScheduler.stats(i);
+        DebugSerial::printf("Poll slave %u: runs %u, missed %u, jitter last %u ms max %u ms\n",
+                            pollScheduler.job(i).slaveAddr, stats.runs, stats.missedDeadlines,
+                            stats.lastJitterMs, stats.maxJitterMs);
+    }
+
+    // Overall system memory info
+    DebugSerial::printf("Free Heap: %u bytes, largest block %u bytes, fragmentation %u permille\n",
+                        ESP.getFreeHeap(), heap_caps_get_largest_free_block(MALLOC_CAP_8BIT), taskProfiler.fragmentation());
 }
 
 void setup()
 {
     // Initialize Serial Monitor for debugging
     Serial.begin(115200);
+    DebugSerial::begin(); // Log output is written by a low-priority task from here on
     snprintf(boardID, 23, "%llX", ESP.getEfuseMac()); // Get unique ESP MAC
 
     // Initialize EQSP32
@@ -184,6 +861,10 @@ void setup()
     // Configure UART for RS-485
     eqsp32.configSerial(RS485_TX, BAUD_RATE);
     eqsp32.configSerial(RS485_RX, BAUD_RATE);
+    if (!attachModbusRxEvent(eqsp32.Serial, 0))
+    {
+        DebugSerial::println("RS-485 port has no receive event, polling per tick");
+    }
 
     startWatchDog(); // Start watch dog, if cannot connect to the wifi, esp will restart after 60 secs
     // setup_wifi(); //Handled by EQSP32
@@ -195,22 +876,25 @@ void setup()
 
     printWifiInfo();
 
-    // Create a semaphore
-    xSemaphore = xSemaphoreCreateBinary();
-    if (xSemaphore != NULL)
-    {
-        xSemaphoreGive(xSemaphore); // Give the semaphore to start with
-    }
+    // One guard per shared resource (RS-485, HTTP, flash)
+    setupResourceGuards();
+
+    // Journal must be ready before the Modbus task produces samples
+    setupJournal();
+
+    // Poll config handoff, read by the Modbus task from its start
+    pollConfigQueue = xQueueCreate(1, sizeof(PollConfig));
+    pollConfigMutex = xSemaphoreCreateMutex();
+    writeQueueMutex = xSemaphoreCreateMutex();
+    PollConfig bootConfig = loadPollConfig();
+    notePollConfig(bootConfig);
+    xQueueOverwrite(pollConfigQueue, &bootConfig);
 
     // Create tasks
-    xTaskCreate(modbusTask, "ModbusTask", 4096, NULL, 1, &modbusTaskHandle);
-    xTaskCreate(checkFirmwareTask, "CheckFirmwareTask", 8192, NULL, 1, &checkFirmwareTaskHandle);
-    xTaskCreate(syncNTPTask, "syncNTPTask", 4096, NULL, 1, &syncNTPTaskHandle);
-    xTaskCreate(stackMonitorTask, "StackMonitorTask", 4096, NULL, 1, NULL);
-
-    delay(500);
-    checkDeviceExist();
-    delay(500);
+    xTaskCreate(modbusTask, "ModbusTask", 4096, NULL, MODBUS_TASK_PRIORITY, &modbusTaskHandle);
+    xTaskCreate(backgroundTask, "BackgroundTask", 8192, NULL, BACKGROUND_TASK_PRIORITY, &backgroundTaskHandle); // Registration runs first
+    xTaskCreate(profilerTask, "ProfilerTask", 4096, NULL, PROFILER_TASK_PRIORITY, &profilerTaskHandle);
+
     setup_mqtt();
 }
 
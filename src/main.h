@@ -5,12 +5,24 @@
 #include <freertos/task.h>
 #include <freertos/semphr.h>
 #include <esp_task_wdt.h>
+#include <esp_heap_caps.h>
+#include <Preferences.h>
 #include "OTAHelper.h"
 #include "mqttHelper.h"
 #include "infoHelper.h"
 #include "debugSerial.h"
 #include "timeHelper.h"
 #include "modbusHelper.h"
+#include "pollScheduler.h"
+#include "modbusRxRing.h"
+#include "modbusAscii.h"
+#include "readPlanner.h"
+#include "registerMap.h"
+#include "resourceGuard.h"
+#include "metrics.h"
+#include "taskProfiler.h"
+#include "pollConfig.h"
+#include "modbusWrite.h"
 
 void startWatchDog();
 void stopWatchDog();
@@ -20,8 +32,34 @@ void WiFiStationDisconnected(WiFiEvent_t event, WiFiEventInfo_t info);
 void printWifiInfo();
 void checkFirmware();
 
+enum BackgroundJobId {
+    JOB_REGISTER,
+    JOB_POLL_CONFIG,
+    JOB_NTP,
+    JOB_OTA,
+    BACKGROUND_JOB_COUNT
+};
+void requestBackgroundJob(BackgroundJobId id);
+
+// Runtime poll config (POLL command, backend), applied by the Modbus task
+bool submitPollConfig(const char *text, PollConfigSource source, char *error, size_t errorSize);
+void resetPollConfig();
+size_t describePollConfig(char *out, size_t size); // JSON object, 0 if `out` is too small
+
+// Sum and worst of how late polls started against their deadlines
+uint32_t acquisitionBlockedMs(uint32_t *maxMs);
+
+// SET commands, written by the Modbus task ahead of the next poll
+WriteResult submitWrite(WriteCommand &command, WriteCommand *superseded);
+WriteQueueStats writeQueueStats(size_t *pending);
+
+// On-demand CPU profile (PROFILE command), written by the profiler task
+void requestProfile();
+size_t profileReport(const char **report); // Length of the report ready to publish, 0 if none
+void releaseProfileReport();
+void logTaskReport();
+
 struct TaskStackUsage {
     uint32_t modbusTaskStack;
-    uint32_t firmwareTaskStack;
-    uint32_t ntpTaskStack;
+    uint32_t backgroundTaskStack;
 };
\ No newline at end of file
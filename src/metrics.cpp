@@ -0,0 +1,220 @@
+#include <string.h>
+#include "metrics.h"
+#include "msgPack.h"
+#include "jsonText.h"
+
+static const char *const COUNTER_NAMES[METRIC_COUNTER_COUNT] = {"publishes", "publishFailures", "mqttReconnects", "otaBytes", "otaFailures", "writes", "writeFailures"};
+static const char *const GAUGE_NAMES[METRIC_GAUGE_COUNT] = {"freeHeap", "minFreeHeap", "otaBytesPerSec"};
+static const char *const HISTOGRAM_NAMES[METRIC_HISTOGRAM_COUNT] = {"publishUs", "writeLatencyMs"};
+
+size_t MetricHistogram::bucketOf(uint32_t value)
+{
+    size_t bits = value ? 32 - __builtin_clz(value) : 0;
+    return bits < METRIC_BUCKETS - 1 ? bits : METRIC_BUCKETS - 1;
+}
+
+uint32_t MetricHistogram::bucketLimit(size_t index)
+{
+    if (index >= METRIC_BUCKETS - 1)
+        return UINT32_MAX;
+    return index ? (1UL << index) - 1 : 0;
+}
+
+void MetricHistogram::record(uint32_t value)
+{
+    buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+    total.fetch_add(1, std::memory_order_relaxed);
+    sumValue.fetch_add(value, std::memory_order_relaxed);
+    uint32_t highest = maxValue.load(std::memory_order_relaxed);
+    while (value > highest && !maxValue.compare_exchange_weak(highest, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+uint32_t MetricHistogram::percentile(float p) const
+{
+    uint32_t values = count();
+    if (!values)
+        return 0;
+    uint32_t rank = (uint32_t)(p * values + 0.999f); // Values at or below the answer
+    if (rank < 1)
+        rank = 1;
+    uint32_t seen = 0;
+    for (size_t i = 0; i < METRIC_BUCKETS; i++)
+    {
+        seen += bucket(i);
+        if (seen >= rank)
+            return bucketLimit(i) < max() ? bucketLimit(i) : max();
+    }
+    return max(); // Recorded while reading
+}
+
+size_t MetricHistogram::usedBuckets() const
+{
+    size_t used = METRIC_BUCKETS;
+    while (used && !bucket(used - 1))
+        used--;
+    return used;
+}
+
+SlaveMetrics *MetricsRegistry::slave(uint8_t address)
+{
+    for (size_t i = 0; i < METRICS_MAX_SLAVES; i++)
+    {
+        uint8_t slot = slaves[i].address.load(std::memory_order_acquire);
+        if (slot == address)
+            return &slaves[i];
+        if (slot == 0)
+        {
+            slaves[i].address.store(address, std::memory_order_release);
+            return &slaves[i];
+        }
+    }
+    return nullptr;
+}
+
+void MetricsRegistry::recordTransaction(uint8_t address, ModbusError result, uint32_t roundTripUs, uint32_t nowMs)
+{
+    SlaveMetrics *metrics = slave(address);
+    if (!metrics)
+        return;
+    metrics->transactions.add();
+    if (result != MODBUS_NO_RESPONSE)
+        metrics->roundTripUs.record(roundTripUs); // Rejected answers still tell how slow the slave is
+    switch (result)
+    {
+    case MODBUS_OK:
+        metrics->failuresInRow.set(0);
+        metrics->lastOkMs.store(nowMs ? nowMs : 1, std::memory_order_relaxed);
+        return;
+    case MODBUS_NO_RESPONSE:
+        metrics->timeouts.add();
+        break;
+    case MODBUS_CRC_ERROR:
+        metrics->crcErrors.add();
+        break;
+    case MODBUS_LENGTH_ERROR:
+        metrics->lengthErrors.add();
+        break;
+    case MODBUS_EXCEPTION:
+        metrics->exceptions.add();
+        break;
+    }
+    metrics->failuresInRow.set(metrics->failuresInRow.value() + 1);
+}
+
+const char *MetricsRegistry::counterName(MetricCounterId id)
+{
+    return COUNTER_NAMES[id];
+}
+
+const char *MetricsRegistry::gaugeName(MetricGaugeId id)
+{
+    return GAUGE_NAMES[id];
+}
+
+const char *MetricsRegistry::histogramName(MetricHistogramId id)
+{
+    return HISTOGRAM_NAMES[id];
+}
+
+namespace
+{
+    void histogramJson(JsonText &json, const MetricHistogram &histogram)
+    {
+        json.append("{\"count\":%u,\"sum\":%llu,\"max\":%u,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"buckets\":[",
+                    (unsigned)histogram.count(), (unsigned long long)histogram.sum(), (unsigned)histogram.max(),
+                    (unsigned)histogram.percentile(0.5f), (unsigned)histogram.percentile(0.9f), (unsigned)histogram.percentile(0.99f));
+        for (size_t i = 0; i < histogram.usedBuckets(); i++)
+            json.append(i ? ",%u" : "%u", (unsigned)histogram.bucket(i));
+        json.append("]}");
+    }
+
+    void histogramPack(MsgPackWriter &writer, const MetricHistogram &histogram)
+    {
+        size_t used = histogram.usedBuckets();
+        writer.arrayHeader(4);
+        writer.uint(histogram.count());
+        writer.uint64(histogram.sum());
+        writer.uint(histogram.max());
+        writer.arrayHeader(used);
+        for (size_t i = 0; i < used; i++)
+            writer.uint(histogram.bucket(i));
+    }
+
+    // ms since the last good read, -1 if there was none
+    int32_t lastOkAge(const SlaveMetrics &slave, uint32_t nowMs)
+    {
+        uint32_t lastOkMs = slave.lastOkMs.load(std::memory_order_relaxed);
+        return lastOkMs ? (int32_t)(nowMs - lastOkMs) : -1;
+    }
+}
+
+size_t MetricsRegistry::writeJson(char *out, size_t size, uint32_t nowMs) const
+{
+    JsonText json(out, size);
+    json.append("{\"uptimeMs\":%u", (unsigned)nowMs);
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++)
+        json.append(",\"%s\":%u", COUNTER_NAMES[i], (unsigned)counters[i].value());
+    for (size_t i = 0; i < METRIC_GAUGE_COUNT; i++)
+        json.append(",\"%s\":%d", GAUGE_NAMES[i], (int)gauges[i].value());
+    for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+    {
+        json.append(",\"%s\":", HISTOGRAM_NAMES[i]);
+        histogramJson(json, histograms[i]);
+    }
+    json.append(",\"slaves\":[");
+    for (size_t i = 0; i < METRICS_MAX_SLAVES; i++)
+    {
+        const SlaveMetrics &slave = slaves[i];
+        uint8_t address = slave.address.load(std::memory_order_acquire);
+        if (!address)
+            break;
+        json.append("%s{\"slave\":%u,\"transactions\":%u,\"timeouts\":%u,\"crcErrors\":%u,\"lengthErrors\":%u,"
+                    "\"exceptions\":%u,\"failuresInRow\":%d,\"lastOkAgeMs\":%d,\"roundTripUs\":",
+                    i ? "," : "", address, (unsigned)slave.transactions.value(), (unsigned)slave.timeouts.value(),
+                    (unsigned)slave.crcErrors.value(), (unsigned)slave.lengthErrors.value(), (unsigned)slave.exceptions.value(),
+                    (int)slave.failuresInRow.value(), (int)lastOkAge(slave, nowMs));
+        histogramJson(json, slave.roundTripUs);
+        json.append("}");
+    }
+    json.append("]}");
+    return json.length();
+}
+
+size_t MetricsRegistry::pack(uint8_t *out, size_t size, uint32_t nowMs) const
+{
+    size_t slaveCount = 0;
+    while (slaveCount < METRICS_MAX_SLAVES && slaves[slaveCount].address.load(std::memory_order_acquire))
+        slaveCount++;
+
+    MsgPackWriter writer(out, size);
+    writer.arrayHeader(6);
+    writer.uint(METRICS_FORMAT_VERSION);
+    writer.uint(nowMs);
+    writer.arrayHeader(METRIC_COUNTER_COUNT);
+    for (size_t i = 0; i < METRIC_COUNTER_COUNT; i++)
+        writer.uint(counters[i].value());
+    writer.arrayHeader(METRIC_GAUGE_COUNT);
+    for (size_t i = 0; i < METRIC_GAUGE_COUNT; i++)
+        writer.integer(gauges[i].value());
+    writer.arrayHeader(METRIC_HISTOGRAM_COUNT);
+    for (size_t i = 0; i < METRIC_HISTOGRAM_COUNT; i++)
+        histogramPack(writer, histograms[i]);
+    writer.arrayHeader(slaveCount);
+    for (size_t i = 0; i < slaveCount; i++)
+    {
+        const SlaveMetrics &slave = slaves[i];
+        writer.arrayHeader(9);
+        writer.uint(slave.address.load(std::memory_order_relaxed));
+        writer.uint(slave.transactions.value());
+        writer.uint(slave.timeouts.value());
+        writer.uint(slave.crcErrors.value());
+        writer.uint(slave.lengthErrors.value());
+        writer.uint(slave.exceptions.value());
+        writer.integer(slave.failuresInRow.value());
+        writer.integer(lastOkAge(slave, nowMs));
+        histogramPack(writer, slave.roundTripUs);
+    }
+    return writer.length();
+}
@@ -0,0 +1,137 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "modbusHelper.h"
+
+#define METRIC_BUCKETS 20 // 0, then [2^(i-1), 2^i) per bucket; the last takes everything from 2^18 up
+#ifndef METRICS_MAX_SLAVES
+#define METRICS_MAX_SLAVES 8 // Chambers tracked on the bus, later ones are not counted
+#endif
+#define METRICS_FORMAT_VERSION 2 // First element of the packed form; 2 added the write counters and latency
+
+// Event count, incremented from any task
+class MetricCounter {
+public:
+    void add(uint32_t n = 1) { count.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t value() const { return count.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint32_t> count{0};
+};
+
+// Last value set
+class MetricGauge {
+public:
+    void set(int32_t value) { current.store(value, std::memory_order_relaxed); }
+    int32_t value() const { return current.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int32_t> current{0};
+};
+
+// Log-scale histogram with fixed buckets: recording a value is a bit scan and
+// a few relaxed atomic adds. Percentiles are bucket upper bounds, so they are
+// at most 2x the true value.
+class MetricHistogram {
+public:
+    void record(uint32_t value);
+
+    uint32_t count() const { return total.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return sumValue.load(std::memory_order_relaxed); }
+    uint32_t max() const { return maxValue.load(std::memory_order_relaxed); }
+    uint32_t bucket(size_t index) const { return buckets[index].load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding fraction `p` of the values (0.5 = median), at most max()
+    uint32_t percentile(float p) const;
+
+    // Buckets up to the last non-empty one
+    size_t usedBuckets() const;
+
+    static size_t bucketOf(uint32_t value);
+    static uint32_t bucketLimit(size_t index); // Largest value counted in the bucket
+
+private:
+    std::atomic<uint32_t> buckets[METRIC_BUCKETS] = {};
+    std::atomic<uint32_t> total{0};
+    std::atomic<uint64_t> sumValue{0};
+    std::atomic<uint32_t> maxValue{0};
+};
+
+enum MetricCounterId : uint8_t {
+    METRIC_PUBLISHES,        // Data messages the broker took
+    METRIC_PUBLISH_FAILURES, // Data messages that went to the journal instead
+    METRIC_MQTT_RECONNECTS,  // Connects after the first
+    METRIC_OTA_BYTES,        // Firmware bytes downloaded
+    METRIC_OTA_FAILURES,     // Updates discarded
+    METRIC_WRITES,           // SET commands written and read back unchanged
+    METRIC_WRITE_FAILURES,   // SET commands that failed on the bus or read back different
+    METRIC_COUNTER_COUNT
+};
+
+enum MetricGaugeId : uint8_t {
+    METRIC_FREE_HEAP,
+    METRIC_MIN_FREE_HEAP,
+    METRIC_OTA_BYTES_PER_SEC, // Of the last firmware download
+    METRIC_GAUGE_COUNT
+};
+
+enum MetricHistogramId : uint8_t {
+    METRIC_PUBLISH_US,       // Time mqttClient.publish() takes for a data message
+    METRIC_WRITE_LATENCY_MS, // SET command queued until read back
+    METRIC_HISTOGRAM_COUNT
+};
+
+// Health of one chamber: slow (round trip), flaky (errors) or offline
+// (failures in a row, time since the last good read)
+typedef struct {
+    std::atomic<uint8_t> address; // 0 while the slot is free, set once by the polling task
+    MetricCounter transactions;
+    MetricCounter timeouts;
+    MetricCounter crcErrors;
+    MetricCounter lengthErrors;
+    MetricCounter exceptions;
+    MetricGauge failuresInRow;
+    std::atomic<uint32_t> lastOkMs; // millis() of the last good response, 0 if none yet
+    MetricHistogram roundTripUs;    // From sending the request to the end of the response
+} SlaveMetrics;
+
+// Every metric the firmware keeps, fixed at compile time: there is nothing to
+// allocate or look up by name when a value is recorded
+class MetricsRegistry {
+public:
+    MetricCounter &counter(MetricCounterId id) { return counters[id]; }
+    MetricGauge &gauge(MetricGaugeId id) { return gauges[id]; }
+    MetricHistogram &histogram(MetricHistogramId id) { return histograms[id]; }
+
+    // Metrics of a slave, a slot is taken on first use. nullptr once all are taken.
+    SlaveMetrics *slave(uint8_t address);
+
+    // One Modbus transaction of `address`; the round trip only counts for answers
+    void recordTransaction(uint8_t address, ModbusError result, uint32_t roundTripUs, uint32_t nowMs);
+
+    // JSON object, keys as in the *Name() tables. Returns the length, 0 if `out` is too small.
+    size_t writeJson(char *out, size_t size, uint32_t nowMs) const;
+
+    // MessagePack array, positional in enum order:
+    //   [METRICS_FORMAT_VERSION, uptime ms, [counters], [gauges], [histograms],
+    //    [[address, transactions, timeouts, crcErrors, lengthErrors, exceptions,
+    //      failuresInRow, ms since the last good read (-1 if none), roundTripUs], ...]]
+    // with each histogram as [count, sum, max, [buckets up to the last non-empty]].
+    // Returns the length, 0 if `out` is too small.
+    size_t pack(uint8_t *out, size_t size, uint32_t nowMs) const;
+
+    static const char *counterName(MetricCounterId id);
+    static const char *gaugeName(MetricGaugeId id);
+    static const char *histogramName(MetricHistogramId id);
+
+private:
+    MetricCounter counters[METRIC_COUNTER_COUNT];
+    MetricGauge gauges[METRIC_GAUGE_COUNT];
+    MetricHistogram histograms[METRIC_HISTOGRAM_COUNT];
+    SlaveMetrics slaves[METRICS_MAX_SLAVES] = {};
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "modbusAscii.h"
+
+static const char HEX_DIGITS[] = "0123456789ABCDEF";
+
+// Two's complement of the 8-bit sum of the message bytes
+uint8_t calculateLRC(const uint8_t *data, size_t length)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        sum += data[i];
+    }
+    return (uint8_t)(-sum);
+}
+
+size_t encodeModbusAsciiFrame(const uint8_t *message, size_t length, char *out, size_t outSize)
+{
+    size_t needed = 1 + 2 * (length + 1) + 2;
+    if (outSize < needed)
+    {
+        return 0;
+    }
+
+    size_t pos = 0;
+    out[pos++] = ':';
+    for (size_t i = 0; i < length; i++)
+    {
+        out[pos++] = HEX_DIGITS[message[i] >> 4];
+        out[pos++] = HEX_DIGITS[message[i] & 0x0F];
+    }
+    uint8_t lrc = calculateLRC(message, length);
+    out[pos++] = HEX_DIGITS[lrc >> 4];
+    out[pos++] = HEX_DIGITS[lrc & 0x0F];
+    out[pos++] = '\r';
+    out[pos++] = '\n';
+    return pos;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return -1;
+}
+
+void ModbusAsciiDecoder::reset(uint8_t *buffer, size_t bufferCapacity)
+{
+    out = buffer;
+    capacity = bufferCapacity;
+    decoded = 0;
+    sum = 0;
+    state = WAIT_START;
+    lrcError = false;
+}
+
+ModbusAsciiDecoder::Status ModbusAsciiDecoder::feed(char c)
+{
+    c &= 0x7F; // 7-bit characters
+    if (c == ':')
+    {
+        // A start character always begins a new frame, even mid-frame
+        decoded = 0;
+        sum = 0;
+        lrcError = false;
+        state = HIGH_NIBBLE;
+        return IN_PROGRESS;
+    }
+
+    switch (state)
+    {
+    case WAIT_START:
+        return IN_PROGRESS;
+
+    case HIGH_NIBBLE:
+    {
+        if (c == '\r')
+        {
+            state = WAIT_LF;
+            return IN_PROGRESS;
+        }
+        int value = hexValue(c);
+        if (value < 0)
+            break;
+        highNibble = (uint8_t)value;
+        state = LOW_NIBBLE;
+        return IN_PROGRESS;
+    }
+
+    case LOW_NIBBLE:
+    {
+        int value = hexValue(c);
+        if (value < 0 || decoded >= capacity)
+            break;
+        uint8_t byte = (uint8_t)((highNibble << 4) | value);
+        out[decoded++] = byte;
+        sum += byte; // Running sum, the LRC byte brings it to zero
+        state = HIGH_NIBBLE;
+        return IN_PROGRESS;
+    }
+
+    case WAIT_LF:
+        if (c != '\n')
+            break;
+        state = WAIT_START;
+        if (decoded < 2 || sum != 0)
+        {
+            lrcError = decoded >= 2;
+            return FRAME_ERROR;
+        }
+        return COMPLETE;
+    }
+
+    state = WAIT_START;
+    return FRAME_ERROR;
+}
@@ -0,0 +1,44 @@
+#ifndef MODBUS_ASCII_H
+#define MODBUS_ASCII_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Modbus ASCII framing: ':' + hex pairs of address/function/data + LRC hex + CR LF,
+// sent with 7 data bits (SERIAL_7E1)
+#define MODBUS_ASCII_MAX_FRAME 513 // ':' + 2 * (255 + LRC) + CR LF
+
+uint8_t calculateLRC(const uint8_t *data, size_t length);
+
+// Encode `length` message bytes (no CRC) as an ASCII frame, returns the character count or 0 if `out` is too small
+size_t encodeModbusAsciiFrame(const uint8_t *message, size_t length, char *out, size_t outSize);
+
+// Decodes an ASCII frame one character at a time, straight into a caller's binary buffer
+class ModbusAsciiDecoder {
+public:
+    enum Status {
+        IN_PROGRESS, // Waiting for more characters
+        COMPLETE,    // Frame ended with CR LF and its LRC matched
+        FRAME_ERROR  // Bad hex digit, overflow or LRC mismatch; waiting for the next ':'
+    };
+
+    void reset(uint8_t *out, size_t capacity);
+    Status feed(char c);
+
+    // Message bytes of the completed frame (address, function, data; LRC dropped)
+    size_t length() const { return decoded > 0 ? decoded - 1 : 0; }
+    bool lrcFailed() const { return lrcError; }
+
+private:
+    enum State { WAIT_START, HIGH_NIBBLE, LOW_NIBBLE, WAIT_LF };
+
+    uint8_t *out = nullptr;
+    size_t capacity = 0;
+    size_t decoded = 0;
+    uint8_t sum = 0;
+    uint8_t highNibble = 0;
+    State state = WAIT_START;
+    bool lrcError = false;
+};
+
+#endif
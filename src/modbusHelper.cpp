@@ -1,50 +1,23 @@
 #include <modbusHelper.h>
 #include <string.h>
 #include "debugSerial.h"
+#include "crc16.h"
+#include "registerMap.h"
 
-// Function to calculate CRC for Modbus RTU
+// Function to calculate CRC for Modbus RTU, engine selected by CRC16_IMPL (see crc16.h)
 uint16_t calculateCRC(const uint8_t *data, size_t length)
 {
-    uint16_t crc = 0xFFFF;
-    for (size_t i = 0; i < length; i++)
-    {
-        crc ^= data[i];
-        for (int j = 0; j < 8; j++)
-        {
-            if (crc & 0x0001)
-            {
-                crc >>= 1;
-                crc ^= 0xA001;
-            }
-            else
-            {
-                crc >>= 1;
-            }
-        }
-    }
-    return crc;
+    return crc16Modbus(data, length);
 }
 
-void printCRCDebug(uint8_t* response, size_t responseLength) {
-    // Print the entire response
-    Serial.print("Full Response: ");
-    for (size_t i = 0; i < responseLength; i++) {
-        Serial.print(response[i], HEX);
-        Serial.print(" ");
-    }
-    Serial.println();
-
-    // Calculate and print CRC of different message slices
-    uint16_t fullMessageCRC = calculateCRC(response, responseLength - 2);
-    uint16_t receivedCRC = (response[responseLength - 1] << 8) | response[responseLength - 2];
-
-    Serial.print("Calculated CRC: ");
-    Serial.println(fullMessageCRC, HEX);
-    Serial.print("Received CRC: ");
-    Serial.println(receivedCRC, HEX);
+// Compiled out unless DEBUG_LOG_LEVEL includes DEBUG_LEVEL_VERBOSE, CRC included
+void printCRCDebug(const uint8_t* response, size_t responseLength) {
+    DEBUG_HEXDUMP(DEBUG_LEVEL_VERBOSE, "Full Response: ", response, responseLength);
+    DEBUG_VERBOSE("Calculated CRC: %X\r\nReceived CRC: %X\r\n", calculateCRC(response, responseLength - 2),
+                  (unsigned)((response[responseLength - 1] << 8) | response[responseLength - 2]));
 }
 
-bool validateModbusCRC(uint8_t* response, size_t responseLength) {
+bool validateModbusCRC(const uint8_t* response, size_t responseLength) {
     // Ensure enough bytes for CRC
     if (responseLength < 4) return false;
 
@@ -67,6 +40,44 @@ float unsignedToSignedFloat(uint16_t value)
     return static_cast<float>(signedValue) / 100.0;
 }
 
+// Length of the transceiver echo of `request` at the start of `rx`: requestLength when
+// the request was echoed, 0 when it was not, -1 while too few bytes arrived to tell
+int modbusEchoLength(const uint8_t* rx, size_t received, const uint8_t* request, size_t requestLength) {
+    size_t compared = received < requestLength ? received : requestLength;
+    if (memcmp(rx, request, compared) != 0) return 0;
+    return compared == requestLength ? (int)requestLength : -1;
+}
+
+// Total RTU frame length announced by the first bytes of a response, 0 while not yet known
+size_t modbusResponseLength(const uint8_t* frame, size_t received) {
+    if (received < 2) return 0;
+
+    uint8_t functionCode = frame[1];
+    if (functionCode & 0x80) return 5; // Exception: address, function, exception code, CRC
+
+    switch (functionCode) {
+        case 0x01: // Read Coils
+        case 0x02: // Read Discrete Inputs
+        case 0x03: // Read Holding Registers
+        case 0x04: // Read Input Registers
+            if (received < 3) return 0;
+            return 5 + frame[2]; // address, function, byte count, data, CRC
+        case 0x05: // Write Single Coil
+        case 0x06: // Write Single Register
+        case 0x0F: // Write Multiple Coils
+        case 0x10: // Write Multiple Registers
+            return 8; // Echo of address/value or start/quantity, CRC
+        default:
+            return 0; // Unknown, rely on the inter-frame silence
+    }
+}
+
+// Modbus RTU inter-frame silence (3.5 characters of 11 bits), fixed at 1750 us above 19200 baud
+uint32_t modbusSilenceMicros(uint32_t baudRate) {
+    if (baudRate > 19200) return 1750;
+    return (uint32_t)(38500000UL / baudRate);
+}
+
 // Function to prepare the Modbus RTU request
 void prepareModbusRequest(uint8_t* request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, uint16_t regQuantity) {
     // Prepare the request message
@@ -83,40 +94,97 @@ void prepareModbusRequest(uint8_t* request, uint8_t slaveAddr, uint8_t functionC
     request[7] = (crc >> 8) & 0xFF; // High byte of CRC
 }
 
-// Function to read and parse Modbus response
-ChamberData readModbusResponse(uint8_t* response, size_t responseLength) {
+// Write Single Register (0x06, count 1) or Write Multiple Registers (0x10) RTU request.
+// Returns the frame length with CRC; the message without CRC (length - 2) is what ASCII sends.
+size_t prepareModbusWriteRequest(uint8_t* request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, const uint16_t* values, uint16_t count) {
+    size_t length;
+    request[0] = slaveAddr;
+    request[1] = functionCode;
+    request[2] = (startAddr >> 8) & 0xFF;
+    request[3] = startAddr & 0xFF;
+    if (functionCode == 0x06) {
+        request[4] = (values[0] >> 8) & 0xFF; // Register value
+        request[5] = values[0] & 0xFF;
+        length = 6;
+    } else {
+        request[4] = (count >> 8) & 0xFF;     // Register count
+        request[5] = count & 0xFF;
+        request[6] = (uint8_t)(count * 2);    // Byte count
+        for (uint16_t i = 0; i < count; i++) {
+            request[7 + i * 2] = (values[i] >> 8) & 0xFF;
+            request[8 + i * 2] = values[i] & 0xFF;
+        }
+        length = 7 + count * 2;
+    }
+
+    uint16_t crc = calculateCRC(request, length);
+    request[length] = crc & 0xFF;
+    request[length + 1] = (crc >> 8) & 0xFF;
+    return length + 2;
+}
+
+// Check a write response (slave address, function code, data; no CRC/LRC). A slave
+// acknowledges 0x06 and 0x10 by echoing address and value or quantity; an answer
+// that does not echo the request counts as a length error.
+ModbusError checkModbusWriteResponse(const uint8_t* response, size_t responseLength, const uint8_t* request) {
+    if (responseLength >= 3 && response[0] == request[0] && response[1] == (request[1] | 0x80)) {
+        DEBUG_WARN("Modbus exception %u from slave %u\n", response[2], response[0]);
+        return MODBUS_EXCEPTION;
+    }
+    if (responseLength < 6 || memcmp(response, request, 6) != 0) {
+        DebugSerial::println("Error: Write response does not echo the request.");
+        return MODBUS_LENGTH_ERROR;
+    }
+    return MODBUS_OK;
+}
+
+// Function to read and parse Modbus RTU response
+ChamberData readModbusResponse(const uint8_t* response, size_t responseLength, uint16_t startAddr, ModbusError* error) {
     ChamberData chamberData;
     memset(&chamberData, 0, sizeof(chamberData)); // Initialize all fields to 0
     
     // Validate CRC
     if (responseLength < 5) { // Minimum response length for function code 0x03 is 5 bytes (slave address, function code, byte count, CRC)
         DebugSerial::println("Error: Response is too short.");
+        if (error) *error = MODBUS_LENGTH_ERROR;
         return chamberData;
     }
 
     if (!validateModbusCRC(response, responseLength)) {
         DebugSerial::println("Error: CRC validation failed");
+        if (error) *error = MODBUS_CRC_ERROR;
+        return chamberData;
+    }
+
+    return decodeChamberData(response, responseLength - 2, startAddr, error);
+}
+
+// Map a checked read response (slave address, function code, byte count, data; no CRC/LRC)
+// of registers from `startAddr` to ChamberData through CHAMBER_REGISTER_MAP
+ChamberData decodeChamberData(const uint8_t* response, size_t responseLength, uint16_t startAddr, ModbusError* error) {
+    ChamberData chamberData;
+    memset(&chamberData, 0, sizeof(chamberData)); // Initialize all fields to 0
+
+    if (responseLength < 3) {
+        if (error) *error = MODBUS_LENGTH_ERROR;
+        return chamberData;
+    }
+    if (response[1] & 0x80) { // Exception: address, function | 0x80, exception code
+        DEBUG_WARN("Modbus exception %u from slave %u\n", response[2], response[0]);
+        if (error) *error = MODBUS_EXCEPTION;
         return chamberData;
     }
 
     // Extract register values
     uint8_t dataBytesLength = response[2]; // Byte count (third byte in response)
-    if (responseLength < 5 + dataBytesLength) {
+    if (responseLength < 3 + (size_t)dataBytesLength) {
         DebugSerial::println("Error: Response length does not match the byte count.");
+        if (error) *error = MODBUS_LENGTH_ERROR;
         return chamberData;
     }
 
-    uint8_t dataBytes[dataBytesLength];
-    memcpy(dataBytes, &response[3], dataBytesLength); // Copy data bytes (skip slave address, function code, byte count, and CRC)
-
-    // Map data to ChamberData struct
-    chamberData.tempPV = unsignedToSignedFloat((dataBytes[0] << 8) | dataBytes[1]); // D1
-    chamberData.tempSP = unsignedToSignedFloat((dataBytes[2] << 8) | dataBytes[3]); // D2
-    chamberData.wetPV = unsignedToSignedFloat((dataBytes[4] << 8) | dataBytes[5]);  // D3
-    chamberData.wetSP = unsignedToSignedFloat((dataBytes[6] << 8) | dataBytes[7]);  // D4
-    chamberData.humiPV = unsignedToSignedFloat((dataBytes[8] << 8) | dataBytes[9]); // D5
-    chamberData.humiSP = unsignedToSignedFloat((dataBytes[10] << 8) | dataBytes[11]);// D6
-    chamberData.nowSTS = (dataBytes[18] << 8) | dataBytes[19];                             // D10
-
+    // Data bytes in place (skip slave address, function code and byte count)
+    decodeRegisters(&response[3], dataBytesLength, startAddr, &chamberData);
+    if (error) *error = MODBUS_OK;
     return chamberData;
 }
\ No newline at end of file
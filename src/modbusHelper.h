@@ -6,6 +6,7 @@
 
 // Define the ChamberData struct
 typedef struct {
+    uint8_t slaveAddr; // Modbus slave address of the chamber the data came from
     float tempPV;   // Temperature Process Value (D1)
     float tempSP;   // Temperature Set Point (D2)
     float wetPV;    // Wetness Process Value (D3)
@@ -13,11 +14,40 @@ typedef struct {
     float humiPV;   // Humidity Process Value (D5)
     float humiSP;   // Humidity Set Point (D6)
     uint16_t nowSTS; // Current Status (D10)
+    uint32_t validMask; // Bit i set when CHAMBER_REGISTER_MAP[i] was decoded (see registerMap.h)
 } ChamberData;
 
+// Serial framing spoken by a slave
+enum ModbusTransport : uint8_t {
+    MODBUS_RTU = 0,  // Binary, CRC16, 8N1
+    MODBUS_ASCII = 1 // ':' + hex, LRC, CR LF, 7E1
+};
+
+// Outcome of one transaction, counted per slave (see metrics.h)
+enum ModbusError : uint8_t {
+    MODBUS_OK = 0,
+    MODBUS_NO_RESPONSE,  // No complete response in time
+    MODBUS_CRC_ERROR,    // CRC (RTU) or LRC (ASCII) mismatch
+    MODBUS_LENGTH_ERROR, // Shorter than its header or byte count says
+    MODBUS_EXCEPTION     // The slave answered with an exception code
+};
+
+// Received frame referenced in place, no copy
+typedef struct {
+    const uint8_t* data;
+    size_t length;
+} ModbusFrameView;
+
 void prepareModbusRequest(uint8_t* request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, uint16_t regQuantity);
 uint16_t calculateCRC(const uint8_t *data, size_t length);
 float unsignedToSignedFloat(uint16_t value);
-ChamberData readModbusResponse(uint8_t* response, size_t responseLength);
+size_t modbusResponseLength(const uint8_t* frame, size_t received);
+uint32_t modbusSilenceMicros(uint32_t baudRate);
+bool validateModbusCRC(const uint8_t* response, size_t responseLength);
+ChamberData readModbusResponse(const uint8_t* response, size_t responseLength, uint16_t startAddr = 0, ModbusError* error = nullptr);
+ChamberData decodeChamberData(const uint8_t* response, size_t responseLength, uint16_t startAddr = 0, ModbusError* error = nullptr);
+size_t prepareModbusWriteRequest(uint8_t* request, uint8_t slaveAddr, uint8_t functionCode, uint16_t startAddr, const uint16_t* values, uint16_t count);
+ModbusError checkModbusWriteResponse(const uint8_t* response, size_t responseLength, const uint8_t* request);
+int modbusEchoLength(const uint8_t* rx, size_t received, const uint8_t* request, size_t requestLength);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,22 @@
+#include "modbusRxRing.h"
+
+uint8_t *ModbusRxRing::beginFrame()
+{
+    if (head + MODBUS_RX_MAX_FRAME > sizeof(buffer))
+    {
+        head = 0; // Wrap early so the frame never straddles the end
+    }
+    frameStart = head;
+    return buffer + frameStart;
+}
+
+ModbusFrameView ModbusRxRing::endFrame(size_t length)
+{
+    if (length > MODBUS_RX_MAX_FRAME)
+    {
+        length = MODBUS_RX_MAX_FRAME;
+    }
+    head = frameStart + length;
+    ModbusFrameView view = {buffer + frameStart, length};
+    return view;
+}
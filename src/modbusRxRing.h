@@ -0,0 +1,29 @@
+#ifndef MODBUS_RX_RING_H
+#define MODBUS_RX_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+
+#define MODBUS_RX_RING_SIZE 1024
+#define MODBUS_RX_MAX_FRAME 264 // 256-byte RTU ADU plus an 8-byte request echo
+
+// Receive ring for the RS-485 bus. Each frame is written contiguously (the ring
+// wraps before a frame rather than inside it) so the decoder gets a plain
+// pointer + length view. A view stays valid until the ring comes round to it
+// again, a few frames later.
+class ModbusRxRing {
+public:
+    // Start receiving a frame, returns room for MODBUS_RX_MAX_FRAME bytes
+    uint8_t *beginFrame();
+
+    // Close the frame of `length` bytes started by beginFrame()
+    ModbusFrameView endFrame(size_t length);
+
+private:
+    uint8_t buffer[MODBUS_RX_RING_SIZE];
+    size_t head = 0;
+    size_t frameStart = 0;
+};
+
+#endif
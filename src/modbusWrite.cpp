@@ -0,0 +1,292 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "modbusWrite.h"
+#include "jsonText.h"
+
+static const char *const RESULT_NAMES[] = {"ok", "noResponse", "badFrame", "exception", "mismatch", "superseded", "queueFull"};
+
+const char *writeResultName(WriteResult result)
+{
+    return result < sizeof(RESULT_NAMES) / sizeof(RESULT_NAMES[0]) ? RESULT_NAMES[result] : "unknown";
+}
+
+WriteResult writeResultOf(ModbusError error)
+{
+    switch (error)
+    {
+    case MODBUS_OK:
+        return WRITE_OK;
+    case MODBUS_NO_RESPONSE:
+        return WRITE_NO_RESPONSE;
+    case MODBUS_EXCEPTION:
+        return WRITE_EXCEPTION;
+    default:
+        return WRITE_BAD_FRAME;
+    }
+}
+
+static bool signedScale(RegisterScale scale)
+{
+    return scale == REG_SIGNED_DIV100 || scale == REG_SIGNED_DIV10;
+}
+
+// Field units to the register value, the scaling of registerMap.h backwards
+static bool fieldToRaw(const RegisterField &field, float value, uint16_t *raw)
+{
+    long scaled = lroundf(value * registerDivisor(field.scale));
+    if (signedScale(field.scale) ? scaled < INT16_MIN || scaled > INT16_MAX : scaled < 0 || scaled > UINT16_MAX)
+        return false;
+    *raw = (uint16_t)scaled;
+    return true;
+}
+
+static float rawToField(const RegisterField &field, uint16_t raw)
+{
+    float value = signedScale(field.scale) ? (float)(int16_t)raw : (float)raw;
+    return value / registerDivisor(field.scale);
+}
+
+// One "key=value" word after the slave address
+static bool parseWord(const char *word, size_t length, WriteCommand *command, char *error, size_t errorSize)
+{
+    const char *equals = (const char *)memchr(word, '=', length);
+    if (!equals || equals == word || equals + 1 == word + length)
+    {
+        snprintf(error, errorSize, "expected <field>=<value>, got '%.*s'", (int)length, word);
+        return false;
+    }
+    size_t keyLength = equals - word;
+    char value[24];
+    size_t valueLength = length - keyLength - 1;
+    if (valueLength >= sizeof(value))
+    {
+        snprintf(error, errorSize, "bad value '%.*s'", (int)length, word);
+        return false;
+    }
+    memcpy(value, equals + 1, valueLength);
+    value[valueLength] = '\0';
+    char *end;
+
+    if (keyLength == 2 && memcmp(word, "fc", 2) == 0)
+    {
+        unsigned long functionCode = strtoul(value, &end, 10);
+        if (*end || (functionCode != 6 && functionCode != 16))
+        {
+            snprintf(error, errorSize, "bad value '%.*s', fc is 6 or 16", (int)length, word);
+            return false;
+        }
+        command->forceMultiple = functionCode == 16;
+        return true;
+    }
+    if (keyLength == 2 && memcmp(word, "id", 2) == 0)
+    {
+        command->id = strtoul(value, &end, 10);
+        if (*end || value[0] == '-')
+        {
+            snprintf(error, errorSize, "bad value '%.*s'", (int)length, word);
+            return false;
+        }
+        return true;
+    }
+
+    size_t index = 0;
+    while (index < CHAMBER_REGISTER_COUNT &&
+           (strlen(CHAMBER_REGISTER_MAP[index].key) != keyLength || memcmp(CHAMBER_REGISTER_MAP[index].key, word, keyLength) != 0))
+        index++;
+    if (index == CHAMBER_REGISTER_COUNT)
+    {
+        snprintf(error, errorSize, "unknown field '%.*s'", (int)keyLength, word);
+        return false;
+    }
+    const FieldLimits *limits = registerWriteLimits(index);
+    if (!limits)
+    {
+        snprintf(error, errorSize, "%s is not writable", CHAMBER_REGISTER_MAP[index].key);
+        return false;
+    }
+    float number = strtof(value, &end);
+    uint16_t raw;
+    if (*end || end == value)
+    {
+        snprintf(error, errorSize, "bad value '%.*s'", (int)length, word);
+        return false;
+    }
+    if (!(number >= limits->min && number <= limits->max) || !fieldToRaw(CHAMBER_REGISTER_MAP[index], number, &raw))
+    {
+        snprintf(error, errorSize, "%s=%s outside %g..%g", CHAMBER_REGISTER_MAP[index].key, value, limits->min, limits->max);
+        return false;
+    }
+    if (command->count == WRITE_MAX_FIELDS)
+    {
+        snprintf(error, errorSize, "more than %u fields", WRITE_MAX_FIELDS);
+        return false;
+    }
+    // Keep the fields in register order, so contiguous ones share a transaction
+    size_t at = command->count;
+    uint16_t reg = CHAMBER_REGISTER_MAP[index].reg;
+    for (size_t i = 0; i < command->count; i++)
+    {
+        if (command->fields[i] == index)
+        {
+            snprintf(error, errorSize, "%s given twice", CHAMBER_REGISTER_MAP[index].key);
+            return false;
+        }
+    }
+    while (at > 0 && CHAMBER_REGISTER_MAP[command->fields[at - 1]].reg > reg)
+    {
+        command->fields[at] = command->fields[at - 1];
+        command->values[at] = command->values[at - 1];
+        at--;
+    }
+    command->fields[at] = (uint8_t)index;
+    command->values[at] = raw;
+    command->count++;
+    return true;
+}
+
+bool parseWriteCommand(const char *text, WriteCommand *command, char *error, size_t errorSize)
+{
+    WriteCommand parsed = {};
+    const char *p = text;
+    while (*p == ' ')
+        p++;
+    char *end;
+    unsigned long slaveAddr = strtoul(p, &end, 10);
+    if (end == p || (*end && *end != ' ') || slaveAddr < 1 || slaveAddr > 247)
+    {
+        snprintf(error, errorSize, "expected a slave address 1..247 first");
+        return false;
+    }
+    parsed.slaveAddr = (uint8_t)slaveAddr;
+    p = end;
+    while (*p)
+    {
+        while (*p == ' ')
+            p++;
+        size_t wordLength = strcspn(p, " ");
+        if (wordLength && !parseWord(p, wordLength, &parsed, error, errorSize))
+            return false;
+        p += wordLength;
+    }
+    if (!parsed.count)
+    {
+        snprintf(error, errorSize, "no fields to write");
+        return false;
+    }
+    *command = parsed;
+    return true;
+}
+
+size_t writeRunLength(const WriteCommand &command, size_t first)
+{
+    size_t length = 1;
+    while (first + length < command.count &&
+           CHAMBER_REGISTER_MAP[command.fields[first + length]].reg == CHAMBER_REGISTER_MAP[command.fields[first]].reg + length)
+        length++;
+    return length;
+}
+
+uint8_t writeRunFunction(const WriteCommand &command, size_t runLength)
+{
+    return runLength == 1 && !command.forceMultiple ? 0x06 : 0x10;
+}
+
+void writeReadRange(const WriteCommand &command, uint16_t *startAddr, uint16_t *quantity)
+{
+    *startAddr = CHAMBER_REGISTER_MAP[command.fields[0]].reg;
+    *quantity = CHAMBER_REGISTER_MAP[command.fields[command.count - 1]].reg - *startAddr + 1;
+}
+
+WriteResult checkWriteReadBack(const WriteCommand &command, const uint8_t *response, size_t responseLength,
+                               uint16_t *readBack)
+{
+    uint16_t startAddr, quantity;
+    writeReadRange(command, &startAddr, &quantity);
+    if (responseLength < 3 || response[2] < quantity * 2 || responseLength < 3 + (size_t)quantity * 2)
+        return WRITE_BAD_FRAME;
+    WriteResult result = WRITE_OK;
+    for (size_t i = 0; i < command.count; i++)
+    {
+        const uint8_t *bytes = response + 3 + (CHAMBER_REGISTER_MAP[command.fields[i]].reg - startAddr) * 2;
+        readBack[i] = (uint16_t)((bytes[0] << 8) | bytes[1]);
+        if (readBack[i] != command.values[i])
+            result = WRITE_MISMATCH;
+    }
+    return result;
+}
+
+// {"<field>":<value>,...} in field units, as many decimals as the register resolves
+static void appendFields(JsonText &json, const WriteCommand &command, const uint16_t *values)
+{
+    for (size_t i = 0; i < command.count; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[command.fields[i]];
+        int32_t divisor = registerDivisor(field.scale);
+        int decimals = divisor >= 100 ? 2 : divisor >= 10 ? 1 : 0;
+        json.append("%s\"%s\":%.*f", i ? "," : "{", field.key, decimals, (double)rawToField(field, values[i]));
+    }
+    json.append("}");
+}
+
+size_t writeAckJson(const WriteAck &ack, char *out, size_t size)
+{
+    JsonText json(out, size);
+    json.append("{\"id\":%lu,\"slave\":%u,\"result\":\"%s\",\"written\":", (unsigned long)ack.command.id,
+                (unsigned)ack.command.slaveAddr, writeResultName(ack.result));
+    appendFields(json, ack.command, ack.command.values);
+    if (ack.result == WRITE_OK || ack.result == WRITE_MISMATCH)
+    {
+        json.append(",\"readBack\":");
+        appendFields(json, ack.command, ack.readBack);
+    }
+    if (ack.result == WRITE_EXCEPTION)
+    {
+        json.append(",\"exception\":%u", (unsigned)ack.exceptionCode);
+    }
+    if (ack.result != WRITE_SUPERSEDED && ack.result != WRITE_QUEUE_FULL)
+    {
+        json.append(",\"waitMs\":%lu,\"busUs\":%lu,\"latencyMs\":%lu", (unsigned long)ack.waitMs,
+                    (unsigned long)ack.busUs, (unsigned long)ack.latencyMs);
+    }
+    json.append("}");
+    return json.length();
+}
+
+WriteResult WriteQueue::push(const WriteCommand &command, WriteCommand *superseded)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        WriteCommand &queued = pending[(head + i) % WRITE_QUEUE_SIZE];
+        if (queued.slaveAddr == command.slaveAddr && queued.count == command.count &&
+            queued.forceMultiple == command.forceMultiple && memcmp(queued.fields, command.fields, command.count) == 0)
+        {
+            *superseded = queued;
+            queued = command;
+            queueStats.superseded++;
+            return WRITE_SUPERSEDED;
+        }
+    }
+    if (count == WRITE_QUEUE_SIZE)
+    {
+        queueStats.rejected++;
+        return WRITE_QUEUE_FULL;
+    }
+    pending[(head + count) % WRITE_QUEUE_SIZE] = command;
+    count++;
+    queueStats.queued++;
+    if (count > queueStats.highWater)
+        queueStats.highWater = count;
+    return WRITE_OK;
+}
+
+bool WriteQueue::pop(WriteCommand *command)
+{
+    if (!count)
+        return false;
+    *command = pending[head];
+    head = (head + 1) % WRITE_QUEUE_SIZE;
+    count--;
+    return true;
+}
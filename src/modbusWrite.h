@@ -0,0 +1,100 @@
+#ifndef MODBUS_WRITE_H
+#define MODBUS_WRITE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+#include "registerMap.h"
+
+#define WRITE_MAX_FIELDS 8                              // Fields one SET may change
+#define WRITE_QUEUE_SIZE 8                              // Writes waiting for the bus
+#define WRITE_REQUEST_SIZE (9 + 2 * WRITE_MAX_FIELDS)   // 0x10 frame: header, byte count, values, CRC
+#define WRITE_ACK_SIZE 512                              // One ack, every field written
+
+enum WriteResult : uint8_t {
+    WRITE_OK,          // Written and read back unchanged
+    WRITE_NO_RESPONSE, // No answer to the write or the read back
+    WRITE_BAD_FRAME,   // CRC/LRC error, malformed answer or no echo of the request
+    WRITE_EXCEPTION,   // The slave refused it, see exceptionCode
+    WRITE_MISMATCH,    // Written, but the read back differs (clamped or ignored by the controller)
+    WRITE_SUPERSEDED,  // Replaced in the queue by a newer write of the same fields
+    WRITE_QUEUE_FULL   // Not queued
+};
+
+// One SET command: fields of one slave, in register order
+typedef struct {
+    uint32_t id;        // From id=<n>, else assigned when queued
+    uint8_t slaveAddr;
+    bool forceMultiple; // fc=16: Write Multiple Registers even for a single register
+    uint8_t count;
+    uint8_t fields[WRITE_MAX_FIELDS];  // CHAMBER_REGISTER_MAP indexes
+    uint16_t values[WRITE_MAX_FIELDS]; // Raw register values
+    uint32_t queuedMs;
+} WriteCommand;
+
+// Outcome of a command, published on <command topic>/<board ID>/write
+typedef struct {
+    WriteCommand command;
+    WriteResult result;
+    uint8_t exceptionCode;
+    uint16_t readBack[WRITE_MAX_FIELDS];
+    uint32_t waitMs;    // From queued to the write going on the bus
+    uint32_t busUs;     // Write and read back transactions
+    uint32_t latencyMs; // From queued to verified
+} WriteAck;
+
+// Text form: "<slave> <field>=<value> [<field>=<value>...] [fc=16] [id=<n>]",
+// e.g. "1 tempSP=25.5 humiSP=60". Fields are CHAMBER_WRITABLE members, values
+// in field units within their limits. Returns false with a reason in `error`.
+bool parseWriteCommand(const char *text, WriteCommand *command, char *error, size_t errorSize);
+
+// Registers from fields[first] that are contiguous, so one transaction writes them
+size_t writeRunLength(const WriteCommand &command, size_t first);
+
+// Function code of a run: 0x06 for a single register, unless forceMultiple
+uint8_t writeRunFunction(const WriteCommand &command, size_t runLength);
+
+// Register range one read back covers
+void writeReadRange(const WriteCommand &command, uint16_t *startAddr, uint16_t *quantity);
+
+// Compare a checked read response (address, function, byte count, data; no CRC/LRC)
+// of the read back range with what was written, filling `readBack`
+WriteResult checkWriteReadBack(const WriteCommand &command, const uint8_t *response, size_t responseLength,
+                               uint16_t *readBack);
+
+// JSON ack: id, slave, result, written field values and, once verified, read
+// back values and latencies. Returns the length, 0 if `out` is too small.
+size_t writeAckJson(const WriteAck &ack, char *out, size_t size);
+
+// Outcome of a write whose transaction ended with `error`
+WriteResult writeResultOf(ModbusError error);
+
+const char *writeResultName(WriteResult result);
+
+typedef struct {
+    uint32_t queued;
+    uint32_t superseded; // Replaced by a newer write before reaching the bus
+    uint32_t rejected;   // Queue full
+    uint32_t highWater;
+} WriteQueueStats;
+
+// Writes waiting for the bus, served before any poll. First in, first out,
+// except that a write of the same fields of the same slave replaces the one
+// still waiting, in its place: only the newest set point goes on the bus.
+class WriteQueue {
+public:
+    // Returns WRITE_OK, WRITE_SUPERSEDED with the replaced command in `superseded`, or WRITE_QUEUE_FULL
+    WriteResult push(const WriteCommand &command, WriteCommand *superseded);
+    bool pop(WriteCommand *command);
+
+    size_t size() const { return count; }
+    const WriteQueueStats &stats() const { return queueStats; }
+
+private:
+    WriteCommand pending[WRITE_QUEUE_SIZE];
+    size_t head = 0;
+    size_t count = 0;
+    WriteQueueStats queueStats = {};
+};
+
+#endif
@@ -1,11 +1,65 @@
 #include <PubSubClient.h>
 #include <ArduinoJson.h>
+#include <LittleFS.h>
+#include <time.h>
 #include "main.h"
+#include "registerMap.h"
+#include "sampleJournal.h"
+#include "samplePack.h"
+#include "sampleBatch.h"
+#include "exceptionReporter.h"
+#include "sampleAggregator.h"
+#include "sampleQueue.h"
+#include "mqttLink.h"
 
 #define MQTT_MAX_PACKET_SIZE 1024 // NOTE: Have to edit the PubSubClient.h file, it rewrites the sketch
+#define JOURNAL_PATH "/littlefs/journal" // Directory of segment files and the replay cursor
+#define JOURNAL_SLOTS 4096            // ~200 KB of samples held while the broker is unreachable
+#define JOURNAL_REPLAY_BATCH 5        // Samples replayed per batch once reconnected
+#define JOURNAL_REPLAY_INTERVAL 1000  // ms between batches, so live samples keep flowing
+#define SAMPLE_PAYLOAD_SIZE 256
+#ifndef BATCH_MAX_SAMPLES
+#define BATCH_MAX_SAMPLES 1  // Samples per data message, 1 publishes every sample on its own
+#endif
+#ifndef BATCH_MAX_AGE
+#define BATCH_MAX_AGE 10000  // ms the oldest sample may wait for its batch
+#endif
+#ifndef REPORT_BY_EXCEPTION
+#define REPORT_BY_EXCEPTION 0 // 1 = publish only fields that moved past their deadband (CHAMBER_DEADBANDS)
+#endif
+#ifndef EXCEPTION_HEARTBEAT
+#define EXCEPTION_HEARTBEAT 300000 // ms between full samples in report-by-exception mode
+#endif
+#ifndef AGGREGATE_WINDOW
+#define AGGREGATE_WINDOW 0 // ms per summary window on <data topic>/summary, 0 = publish every raw sample
+#endif
+#ifndef AGGREGATE_RAW
+#define AGGREGATE_RAW 0 // 1 = publish the raw samples as well as the summaries, for debugging
+#endif
+#define MQTT_BACKOFF_BASE 1000  // ms, first reconnect wait; doubles per failed attempt
+#define MQTT_BACKOFF_MAX 60000  // ms, longest reconnect wait
+#define MQTT_SOCKET_TIMEOUT 5   // s, bounds each connect attempt
+#define SAMPLE_QUEUE_SIZE 32 // Samples buffered between the Modbus task and the MQTT loop (power of two)
+#define WRITE_ACK_QUEUE_SIZE 8 // SET acks waiting for the MQTT loop (power of two)
+#define BATCH_MAX_BYTES (MQTT_MAX_PACKET_SIZE - 7) // Fixed header and topic length, the topic itself is taken off at setup
+#ifndef APPPMQTTFWTOPIC
+#define APPPMQTTFWTOPIC "/firmware" // Retained firmware announcements, <topic>/<APPUPDNAME> holds the current version
+#endif
+#ifndef APPPMQTTMETRICSTOPIC
+#define APPPMQTTMETRICSTOPIC "/metrics" // Periodic metrics, <topic>/<board ID>[/mp]
+#endif
+#ifndef METRICS_INTERVAL
+#define METRICS_INTERVAL 60000 // ms between metrics messages, 0 = only in STATUS
+#endif
+#define METRICS_PAYLOAD_SIZE 2048
+#ifndef APPDEVINDEX
+#define APPDEVINDEX -1 // Numeric device index sent instead of the board ID in binary payloads, -1 if not assigned
+#endif
 extern EQSP32 eqsp32;
 
 extern TaskStackUsage stackUsageData;
+extern PollScheduler pollScheduler;
+extern MetricsRegistry metrics;
 
 // Update these with values suitable for your network.
 const char *ssid = APPSSID;
@@ -22,20 +76,66 @@ int value = 0;
 
 extern char boardID[23];
 String cmdTopic = String(APPPMQTTCMDTOPIC);
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+String dataTopic = String(APPPMQTTDATATOPIC) + PAYLOAD_MSGPACK_TOPIC_SUFFIX;
+#else
 String dataTopic = String(APPPMQTTDATATOPIC);
+#endif
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+String summaryTopic = String(APPPMQTTDATATOPIC) + "/summary" + PAYLOAD_MSGPACK_TOPIC_SUFFIX;
+#else
+String summaryTopic = String(APPPMQTTDATATOPIC) + "/summary";
+#endif
 String statusTopic = String(APPPMQTTSTSTOPIC);
+String firmwareTopic = String(APPPMQTTFWTOPIC) + "/" + APPUPDNAME;
+volatile bool firmwareAnnouncementSeen = false; // On the current connection
+unsigned long lastMetrics = 0;
+char metricsPayload[METRICS_PAYLOAD_SIZE]; // MQTT loop only: metrics messages and STATUS
 
-void reconnect()
+// Samples that could not be published, replayed after reconnect
+SampleJournal sampleJournal;
+unsigned long lastReplay = 0;
+SampleBatch replayBatch;
+
+// Acquired samples handed from the Modbus task to the MQTT loop, which owns mqttClient
+SpscQueue<TimedSample, SAMPLE_QUEUE_SIZE> sampleQueue;
+QueueStats queueStats;
+
+// Outcomes of SET commands, handed from the Modbus task to the MQTT loop
+SpscQueue<WriteAck, WRITE_ACK_QUEUE_SIZE> writeAckQueue;
+
+// Samples of the pending data message, journaled if its publish fails
+SampleBatch sampleBatch;
+TimedSample batchedSamples[BATCH_MAX_SAMPLES];
+
+// Last published image of each slave, for report-by-exception
+ExceptionReporter exceptionReporter;
+
+// Windowed summaries of fast polls; the AGGREGATE command changes the window at runtime
+SampleAggregator sampleAggregator;
+bool aggregateRaw = AGGREGATE_RAW;
+
+// Aggregation state, in STATUS and the AGGREGATE reply
+void addAggregateStatus(JsonObject aggregate)
 {
-  startWatchDog();
-  // Ensure WiFi is connected
-  while (!eqsp32.getWiFiStatus() == EQ_WF_CONNECTED && WiFi.localIP().toString() == "0.0.0.0")
-  {
-    DebugSerial::print(".");
-    delay(500);
-  }
+  const AggregateStats &stats = sampleAggregator.stats();
+  aggregate["windowMs"] = sampleAggregator.window();
+  aggregate["raw"] = aggregateRaw || !sampleAggregator.window();
+  aggregate["open"] = sampleAggregator.openWindows();
+  aggregate["samples"] = stats.samples;
+  aggregate["summaries"] = stats.summaries;
+  aggregate["noSlot"] = stats.noSlot;
+  aggregate["late"] = stats.late;
+}
 
-  // Prepare will message
+// Connection state machine and the will/birth payloads, built once rather than per attempt
+MqttLink mqttLink;
+String willMessage;
+String birthMessage;
+String birthIP; // IP the birth message was built for
+
+void buildWillMessage()
+{
   JsonDocument willJsonDoc;
   willJsonDoc["status"] = "disconnected";
   willJsonDoc["client"] = boardID;
@@ -44,56 +144,83 @@ void reconnect()
   willJsonDoc["appUpdName"] = APPUPDNAME;
   willJsonDoc["appDevType"] = APPDEVTYPE;
 
-  String willMessageStr;
+  willMessage = "";
   willJsonDoc.shrinkToFit();
-  serializeJson(willJsonDoc, willMessageStr);
-  const char *willMessage = willMessageStr.c_str();
+  serializeJson(willJsonDoc, willMessage);
+}
 
-  // Loop until we're reconnected to the MQTT broker
-  while (!mqttClient.connected())
+// Connection acknowledgment, rebuilt only when the IP address changed
+const String &connectedMessage()
+{
+  String ip = WiFi.localIP().toString();
+  if (birthMessage.length() == 0 || ip != birthIP)
   {
-    DebugSerial::print("Attempting MQTT connection...");
+    JsonDocument connectJsonDoc;
+    connectJsonDoc["status"] = "connected";
+    connectJsonDoc["client"] = boardID;
+    connectJsonDoc["ip"] = ip;
+    connectJsonDoc["appVersion"] = APPVERSION;
+    connectJsonDoc["appScreenSize"] = APPSCREENSIZE;
+    connectJsonDoc["appUpdName"] = APPUPDNAME;
+    connectJsonDoc["appDevType"] = APPDEVTYPE;
 
-    // Attempt to connect with all parameters
-    if (mqttClient.connect(boardID,           // Client ID
-                           mqtt_user,         // Username
-                           mqtt_pass,         // Password
-                           statusTopic.c_str(), // Will Topic
-                           2,                 // Will QoS
-                           true,              // Will Retain
-                           willMessage,       // Will Message
-                           true))             // Clean Session
-    {
-      DebugSerial::println("MQTT Connected!");
+    birthMessage = "";
+    connectJsonDoc.shrinkToFit();
+    serializeJson(connectJsonDoc, birthMessage);
+    birthIP = ip;
+  }
+  return birthMessage;
+}
 
-      // Send connection acknowledgment
-      JsonDocument connectJsonDoc;
-      connectJsonDoc["status"] = "connected";
-      connectJsonDoc["client"] = boardID;
-      connectJsonDoc["ip"] = WiFi.localIP().toString();
-      connectJsonDoc["appVersion"] = APPVERSION;
-      connectJsonDoc["appScreenSize"] = APPSCREENSIZE;
-      connectJsonDoc["appUpdName"] = APPUPDNAME;
-      connectJsonDoc["appDevType"] = APPDEVTYPE;
+bool networkUp()
+{
+  return eqsp32.getWiFiStatus() == EQ_WF_CONNECTED && WiFi.localIP().toString() != "0.0.0.0";
+}
 
-      char dataToSend[256];
-      connectJsonDoc.shrinkToFit();
-      serializeJson(connectJsonDoc, dataToSend, sizeof(dataToSend));
+// One step of the connection state machine: at most one connect attempt, never waits
+void maintainMqttConnection()
+{
+  if (!mqttLink.attemptDue(millis(), networkUp(), mqttClient.connected()))
+  {
+    return;
+  }
 
-      mqttClient.publish(statusTopic.c_str(), dataToSend, true);
+  DebugSerial::print("Attempting MQTT connection...");
+  // Attempt to connect with all parameters
+  bool connected = mqttClient.connect(boardID,              // Client ID
+                                      mqtt_user,            // Username
+                                      mqtt_pass,            // Password
+                                      statusTopic.c_str(),  // Will Topic
+                                      2,                    // Will QoS
+                                      true,                 // Will Retain
+                                      willMessage.c_str(),  // Will Message
+                                      true);                // Clean Session
+  mqttLink.attemptResult(connected, mqttClient.state(), millis());
+  if (!connected)
+  {
+    DebugSerial::printf("failed, rc=%d, retrying in %u ms\n", mqttClient.state(), mqttLink.stats().backoffMs);
+    return;
+  }
 
-      // Subscribe to command topics
-      mqttClient.subscribe(cmdTopic.c_str());
-      mqttClient.subscribe((cmdTopic + "/" + boardID).c_str());
-    }
-    else
-    {
-      DebugSerial::print("failed, rc=");
-      DebugSerial::print(mqttClient.state());
-      DebugSerial::println(" retrying in 5 seconds");
-      delay(5000);
-    }
+  DebugSerial::printf("MQTT Connected! (%u ms after the link went down)\n", mqttLink.stats().lastConnectMs);
+  if (mqttLink.stats().connects > 1)
+  {
+    metrics.counter(METRIC_MQTT_RECONNECTS).add();
   }
+  mqttClient.publish(statusTopic.c_str(), connectedMessage().c_str(), true);
+
+  // Subscribe to command topics
+  mqttClient.subscribe(cmdTopic.c_str());
+  mqttClient.subscribe((cmdTopic + "/" + boardID).c_str());
+  // The retained announcement, if any, arrives right after subscribing
+  firmwareAnnouncementSeen = false;
+  mqttClient.subscribe(firmwareTopic.c_str(), 1);
+}
+
+// Announcements replace polling while they can reach us
+bool firmwareAnnounced()
+{
+  return firmwareAnnouncementSeen && mqttLink.state() == LINK_CONNECTED;
 }
 
 void callback(char *topic, byte *payload, unsigned int length)
@@ -107,21 +234,63 @@ void callback(char *topic, byte *payload, unsigned int length)
 
   DebugSerial::println("Incoming: " + String(topic) + " - " + payloadStr);
 
+  // Firmware announcement: the current version for APPUPDNAME, an empty payload withdraws it
+  if (String(topic) == firmwareTopic)
+  {
+    firmwareAnnouncementSeen = payloadStr.length() > 0;
+    if (firmwareAnnouncementSeen && payloadStr != APPVERSION)
+    {
+      requestBackgroundJob(JOB_OTA);
+    }
+    return;
+  }
+
   // Check if the message is for this specific board or a global command
   if (String(topic) == cmdTopic || String(topic) == (cmdTopic + "/" + boardID))
   {
     // Check if the message is "RESTART"
     if (payloadStr == "RESTART")
     {
+      DebugSerial::flush();
       ESP.restart();
     }
+    // Long network jobs run on the background task so the MQTT loop keeps going
     if (payloadStr == "UPDATE")
     {
-      OTACheck(true);
+      requestBackgroundJob(JOB_OTA);
     }
     if (payloadStr == "SYNCNTP")
     {
-      syncNTP();
+      requestBackgroundJob(JOB_NTP);
+    }
+    // "POLL" reports the poll config, "POLL <config>" replaces it, "POLL DEFAULT"
+    // restores the built-in one and "POLL FETCH" reloads it from the backend
+    if (payloadStr == "POLL" || payloadStr.startsWith("POLL "))
+    {
+      handlePollCommand(payloadStr.c_str() + 4);
+    }
+    // "AGGREGATE" reports the summary window, "AGGREGATE <ms> [RAW]" changes it, 0 = raw samples only
+    if (payloadStr == "AGGREGATE" || payloadStr.startsWith("AGGREGATE "))
+    {
+      handleAggregateCommand(payloadStr.c_str() + 9);
+    }
+    // "SET <slave> <field>=<value> ..." writes set points ahead of the next poll, acked on .../write.
+    // Only on this board's own topic: on the shared one it would write every chamber in the fleet.
+    if (payloadStr.startsWith("SET "))
+    {
+      if (String(topic) == cmdTopic)
+      {
+        rejectSetCommand("SET is only accepted on the board topic");
+      }
+      else
+      {
+        handleSetCommand(payloadStr.c_str() + 4);
+      }
+    }
+    // Written by the profiler task, published from mqttLoop once ready
+    if (payloadStr == "PROFILE")
+    {
+      requestProfile();
     }
     if (payloadStr == "STATUS")
     {
@@ -137,16 +306,134 @@ void callback(char *topic, byte *payload, unsigned int length)
       // Add stack usage data
       JsonObject stackUsage = statusJsonDoc["stackUsage"].to<JsonObject>();
       stackUsage["modbusTask"] = stackUsageData.modbusTaskStack;
-      stackUsage["firmwareTask"] = stackUsageData.firmwareTaskStack;
-      stackUsage["ntpTask"] = stackUsageData.ntpTaskStack;
+      stackUsage["backgroundTask"] = stackUsageData.backgroundTaskStack;
       statusJsonDoc["freeHeap"] = ESP.getFreeHeap();
+      // Add time spent waiting for each shared resource
+      JsonObject resources = statusJsonDoc["resources"].to<JsonObject>();
+      for (uint8_t i = 0; i < RESOURCE_COUNT; i++)
+      {
+        ResourceWaitStats wait = resourceWaitStats((SharedResource)i);
+        JsonObject resource = resources[resourceName((SharedResource)i)].to<JsonObject>();
+        resource["locks"] = wait.locks;
+        resource["contended"] = wait.contended;
+        resource["waitMs"] = wait.totalWaitMs;
+        resource["maxWaitMs"] = wait.maxWaitMs;
+      }
+      // Add how late polls started against their deadlines
+      uint32_t acquisitionMaxLateMs;
+      statusJsonDoc["acquisitionBlockedMs"] = acquisitionBlockedMs(&acquisitionMaxLateMs);
+      statusJsonDoc["acquisitionMaxLateMs"] = acquisitionMaxLateMs;
+      // Add data message batching counters
+      const BatchStats &batch = sampleBatch.stats();
+      JsonObject publish = statusJsonDoc["publish"].to<JsonObject>();
+      publish["messages"] = batch.messages;
+      publish["samples"] = batch.samples;
+      publish["samplesPerMessage"] = batch.messages ? (float)batch.samples / batch.messages : 0;
+      publish["maxSamplesPerMessage"] = batch.maxSamplesPerMessage;
+      publish["flushCount"] = batch.flushes[FLUSH_COUNT];
+      publish["flushAge"] = batch.flushes[FLUSH_AGE];
+      publish["flushBytes"] = batch.flushes[FLUSH_BYTES];
+      // Add connection counters
+      const MqttLinkStats &link = mqttLink.stats();
+      JsonObject mqtt = statusJsonDoc["mqtt"].to<JsonObject>();
+      mqtt["attempts"] = link.attempts;
+      mqtt["connects"] = link.connects;
+      mqtt["disconnects"] = link.disconnects;
+      mqtt["lastRc"] = link.lastRc;
+      mqtt["lastConnectMs"] = link.lastConnectMs;
+      mqtt["maxConnectMs"] = link.maxConnectMs;
+      // Add firmware download counters
+      const OtaStats &ota = otaStats();
+      JsonObject otaStatus = statusJsonDoc["ota"].to<JsonObject>();
+      otaStatus["checks"] = ota.checks;
+      otaStatus["notModified"] = ota.notModified;
+      otaStatus["announced"] = firmwareAnnounced();
+      otaStatus["attempts"] = ota.attempts;
+      otaStatus["resumes"] = ota.resumes;
+      otaStatus["failures"] = ota.failures;
+      otaStatus["lastBytes"] = ota.lastBytes;
+      otaStatus["lastImageBytes"] = ota.lastImageBytes;
+      otaStatus["lastMs"] = ota.lastMs;
+      otaStatus["lastKBps"] = ota.lastKBps;
+      // Add backend HTTP connection counters
+      const BackendStats &http = backendClient().stats();
+      JsonObject backend = statusJsonDoc["backend"].to<JsonObject>();
+      backend["requests"] = http.requests;
+      backend["connects"] = http.connects;
+      backend["retries"] = http.retries;
+      backend["failures"] = http.failures;
+      backend["lastMs"] = http.lastMs;
+      backend["maxMs"] = http.maxMs;
+      // Add the metrics registry, as on the metrics topic
+      updateMetricGauges();
+      size_t metricsLength = metrics.writeJson(metricsPayload, sizeof(metricsPayload), millis());
+      if (metricsLength)
+      {
+        statusJsonDoc["metrics"] = serialized(metricsPayload, metricsLength);
+      }
+      // Add log ring counters
+      LogStats logStats = DebugSerial::stats();
+      JsonObject logStatus = statusJsonDoc["log"].to<JsonObject>();
+      logStatus["logged"] = logStats.logged;
+      logStatus["dropped"] = logStats.dropped;
+      logStatus["highWater"] = logStats.highWater;
+      // Add acquisition queue counters
+      JsonObject queue = statusJsonDoc["queue"].to<JsonObject>();
+      queue["size"] = sampleQueue.size();
+      queue["highWater"] = queueStats.highWater;
+      queue["pushed"] = queueStats.pushed;
+      queue["overflows"] = queueStats.overflows;
+      queue["droppedOldest"] = queueStats.droppedOldest;
+      queue["droppedNewest"] = queueStats.droppedNewest;
+      queue["spilled"] = queueStats.spilled;
+#if REPORT_BY_EXCEPTION
+      const ExceptionStats &exception = exceptionReporter.stats();
+      JsonObject rbe = statusJsonDoc["exception"].to<JsonObject>();
+      rbe["samples"] = exception.samples;
+      rbe["snapshots"] = exception.snapshots;
+      rbe["fieldsSent"] = exception.fieldsSent;
+      rbe["fieldsSuppressed"] = exception.fieldsSuppressed;
+      rbe["samplesSuppressed"] = exception.samplesSuppressed;
+#endif
+      addAggregateStatus(statusJsonDoc["aggregate"].to<JsonObject>());
+      // Add SET command queue counters
+      size_t writesPending = 0;
+      WriteQueueStats writeStats = writeQueueStats(&writesPending);
+      JsonObject writes = statusJsonDoc["writes"].to<JsonObject>();
+      writes["pending"] = writesPending;
+      writes["queued"] = writeStats.queued;
+      writes["superseded"] = writeStats.superseded;
+      writes["rejected"] = writeStats.rejected;
+      writes["highWater"] = writeStats.highWater;
+      // Add poll scheduler timing per job
+      JsonArray poll = statusJsonDoc["poll"].to<JsonArray>();
+      for (size_t i = 0; i < pollScheduler.jobCount(); i++)
+      {
+        const PollJobStats &stats = pollScheduler.stats(i);
+        JsonObject job = poll.add<JsonObject>();
+        job["slave"] = pollScheduler.job(i).slaveAddr;
+        job["runs"] = stats.runs;
+        job["missed"] = stats.missedDeadlines;
+        job["jitterMs"] = stats.lastJitterMs;
+        job["maxJitterMs"] = stats.maxJitterMs;
+        job["avgJitterMs"] = stats.runs ? (uint32_t)(stats.totalJitterMs / stats.runs) : 0;
+        job["periodMs"] = pollScheduler.job(i).periodMs;
+      }
+      // Add the poll config in text form, as POLL reports it
+      char pollConfigJson[POLL_CONFIG_TEXT_SIZE + 128];
+      size_t pollConfigLength = describePollConfig(pollConfigJson, sizeof(pollConfigJson));
+      if (pollConfigLength)
+      {
+        statusJsonDoc["pollConfig"] = serialized(pollConfigJson, pollConfigLength);
+      }
 
-      char dataToSend[512];
-      statusJsonDoc.shrinkToFit();
-      serializeJson(statusJsonDoc, dataToSend);
+      String status;
+      serializeJson(statusJsonDoc, status);
 
-      // Publish the data
-      bool publishResult = mqttClient.publish((cmdTopic + "/" + boardID).c_str(), dataToSend);
+      // Publish the data, streamed since the status is larger than the MQTT packet buffer
+      String statusTopic = cmdTopic + "/" + boardID;
+      bool publishResult = mqttClient.beginPublish(statusTopic.c_str(), status.length(), false) &&
+                           mqttClient.print(status) == status.length() && mqttClient.endPublish();
   
       if (!publishResult) {
         DebugSerial::println("MQTT Publish Failed!");
@@ -155,45 +442,572 @@ void callback(char *topic, byte *payload, unsigned int length)
       }
 
       // Print the data to debug serial
-      DebugSerial::println(dataToSend);
+      DebugSerial::println(status);
     }
   }
 }
 
+void updateMetricGauges()
+{
+  metrics.gauge(METRIC_FREE_HEAP).set(ESP.getFreeHeap());
+  metrics.gauge(METRIC_MIN_FREE_HEAP).set(ESP.getMinFreeHeap());
+}
+
+// Periodic metrics message, in the configured PAYLOAD_ENCODING
+void publishMetrics()
+{
+  if (METRICS_INTERVAL == 0 || millis() - lastMetrics < METRICS_INTERVAL)
+  {
+    return;
+  }
+  lastMetrics = millis();
+  updateMetricGauges();
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+  size_t length = metrics.pack((uint8_t *)metricsPayload, sizeof(metricsPayload), millis());
+  String topic = String(APPPMQTTMETRICSTOPIC) + "/" + boardID + PAYLOAD_MSGPACK_TOPIC_SUFFIX;
+#else
+  size_t length = metrics.writeJson(metricsPayload, sizeof(metricsPayload), millis());
+  String topic = String(APPPMQTTMETRICSTOPIC) + "/" + boardID;
+#endif
+  // Streamed, the message can be larger than the MQTT packet buffer
+  if (!length || !mqttClient.beginPublish(topic.c_str(), length, false) ||
+      mqttClient.write((const uint8_t *)metricsPayload, length) != length || !mqttClient.endPublish())
+  {
+    DebugSerial::println("Metrics publish failed");
+  }
+}
+
+// Answer on <command topic>/<board ID>/poll with the config now polled, or why it was rejected
+void handlePollCommand(const char *argument)
+{
+  while (*argument == ' ')
+  {
+    argument++;
+  }
+  char reply[POLL_CONFIG_TEXT_SIZE + 128];
+  char error[96] = "";
+  bool accepted = true;
+  if (strcmp(argument, "FETCH") == 0)
+  {
+    requestBackgroundJob(JOB_POLL_CONFIG);
+  }
+  else if (strcmp(argument, "DEFAULT") == 0)
+  {
+    resetPollConfig();
+  }
+  else if (*argument)
+  {
+    accepted = submitPollConfig(argument, POLL_CONFIG_MQTT, error, sizeof(error));
+  }
+
+  size_t length;
+  if (accepted)
+  {
+    length = describePollConfig(reply, sizeof(reply));
+  }
+  else
+  {
+    for (char *c = error; *c; c++)
+    {
+      *c = *c == '"' || *c == '\\' ? '\'' : *c; // The reason quotes the offending word
+    }
+    length = snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}", error);
+    DEBUG_WARN("POLL rejected: %s\n", error);
+  }
+  String topic = cmdTopic + "/" + boardID + "/poll";
+  if (!length || !mqttClient.publish(topic.c_str(), (const uint8_t *)reply, length, false))
+  {
+    DebugSerial::println("Poll config reply failed");
+  }
+}
+
+// Answer on <command topic>/<board ID>/aggregate with the window now used, or why it was rejected
+void handleAggregateCommand(const char *argument)
+{
+  while (*argument == ' ')
+  {
+    argument++;
+  }
+  JsonDocument reply;
+  bool accepted = true;
+  if (*argument)
+  {
+    char *end;
+    unsigned long windowMs = strtoul(argument, &end, 10);
+    bool raw = strcmp(end, " RAW") == 0;
+    accepted = end != argument && (*end == '\0' || raw) &&
+               (windowMs == 0 || (windowMs >= AGGREGATE_MIN_WINDOW && windowMs <= AGGREGATE_MAX_WINDOW));
+    if (accepted)
+    {
+      // What the open windows hold so far goes out before the new length applies
+      SampleSummary summary;
+      while (sampleAggregator.flush(&summary))
+      {
+        publishSummary(summary);
+      }
+      sampleAggregator.begin(windowMs);
+      aggregateRaw = raw;
+    }
+  }
+  if (accepted)
+  {
+    addAggregateStatus(reply.to<JsonObject>());
+  }
+  else
+  {
+    reply["error"] = "expected AGGREGATE <0 or " + String(AGGREGATE_MIN_WINDOW) + ".." + String(AGGREGATE_MAX_WINDOW) + " ms> [RAW]";
+    DEBUG_WARN("AGGREGATE rejected: %s\n", argument);
+  }
+  String payload;
+  serializeJson(reply, payload);
+  String topic = cmdTopic + "/" + boardID + "/aggregate";
+  if (!mqttClient.publish(topic.c_str(), payload.c_str()))
+  {
+    DebugSerial::println("Aggregate reply failed");
+  }
+}
+
+// Outcome of a SET command on <command topic>/<board ID>/write
+void publishWriteAck(const WriteAck &ack)
+{
+  char payload[WRITE_ACK_SIZE];
+  size_t length = writeAckJson(ack, payload, sizeof(payload));
+  String topic = cmdTopic + "/" + boardID + "/write";
+  if (!length || !mqttClient.publish(topic.c_str(), (const uint8_t *)payload, length, false))
+  {
+    DEBUG_WARN("Write ack %u (%s) not published\n", (unsigned)ack.command.id, writeResultName(ack.result));
+  }
+}
+
+// Called on the Modbus task once a write is verified or failed
+void queueWriteAck(const WriteAck &ack)
+{
+  if (!writeAckQueue.push(ack))
+  {
+    DEBUG_WARN("Write ack queue full, ack %u dropped\n", (unsigned)ack.command.id);
+  }
+}
+
+void publishWriteAcks()
+{
+  WriteAck ack;
+  while (writeAckQueue.pop(&ack))
+  {
+    publishWriteAck(ack);
+  }
+}
+
+// Answer a SET that was not queued on <command topic>/<board ID>/write
+void rejectSetCommand(const char *reason)
+{
+  char reply[160];
+  int length = snprintf(reply, sizeof(reply), "{\"error\":\"%s\"}", reason);
+  DEBUG_WARN("SET rejected: %s\n", reason);
+  String topic = cmdTopic + "/" + boardID + "/write";
+  mqttClient.publish(topic.c_str(), (const uint8_t *)reply, length, false);
+}
+
+// Queue a SET for the Modbus task. A rejected command, a full queue or a write
+// replaced by this one is answered at once; the rest once read back.
+void handleSetCommand(const char *argument)
+{
+  WriteCommand command;
+  char error[96] = "";
+  if (!parseWriteCommand(argument, &command, error, sizeof(error)))
+  {
+    for (char *c = error; *c; c++)
+    {
+      *c = *c == '"' || *c == '\\' ? '\'' : *c; // The reason quotes the offending word
+    }
+    rejectSetCommand(error);
+    return;
+  }
+  WriteAck ack = {};
+  WriteResult result = submitWrite(command, &ack.command);
+  if (result == WRITE_QUEUE_FULL)
+  {
+    ack.command = command;
+  }
+  if (result != WRITE_OK)
+  {
+    ack.result = result;
+    publishWriteAck(ack);
+  }
+}
+
+// CPU profile requested with PROFILE, on <command topic>/<board ID>/profile
+void publishProfile()
+{
+  const char *report;
+  size_t length = profileReport(&report);
+  if (!length)
+  {
+    return;
+  }
+  String topic = cmdTopic + "/" + boardID + "/profile";
+  if (!mqttClient.beginPublish(topic.c_str(), length, false) ||
+      mqttClient.write((const uint8_t *)report, length) != length || !mqttClient.endPublish())
+  {
+    DebugSerial::println("Profile publish failed");
+  }
+  releaseProfileReport();
+}
+
 void setup_mqtt()
 {
   mqttClient.setServer(mqtt_server, 1883);
   mqttClient.setCallback(callback);
   mqttClient.setKeepAlive(60);
+  mqttClient.setBufferSize(MQTT_MAX_PACKET_SIZE);
+  mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
+  buildWillMessage();
+  mqttLink.begin(MQTT_BACKOFF_BASE, MQTT_BACKOFF_MAX, esp_random()); // Seeded per device for jitter
+
+  BatchFraming framing = PAYLOAD_ENCODING == PAYLOAD_MSGPACK ? BATCH_MSGPACK_ARRAY : BATCH_JSON_ARRAY;
+  BatchPolicy policy = {BATCH_MAX_SAMPLES, BATCH_MAX_AGE, BATCH_MAX_BYTES - dataTopic.length()};
+  sampleBatch.begin(policy, framing);
+  policy.maxSamples = BATCH_MAX_SAMPLES < JOURNAL_REPLAY_BATCH ? BATCH_MAX_SAMPLES : JOURNAL_REPLAY_BATCH;
+  replayBatch.begin(policy, framing);
+  exceptionReporter.begin(EXCEPTION_HEARTBEAT);
+  sampleAggregator.begin(AGGREGATE_WINDOW);
 }
 
 void mqttLoop()
 {
-  if (!mqttClient.connected())
+  maintainMqttConnection();
+
+  esp_task_wdt_reset();
+  if (mqttClient.connected())
+  {
+    mqttClient.loop();
+  }
+  // Samples keep flowing while offline: they go to the journal instead of the broker
+  drainSampleQueue();
+  flushExpiredBatch();
+  flushExpiredSummaries();
+  if (mqttClient.connected())
   {
-    reconnect();
+    publishWriteAcks();
+    replayJournal();
+    publishMetrics();
+    publishProfile();
   }
+}
 
-  esp_task_wdt_reset();
-  mqttClient.loop();
+void setupJournal()
+{
+  if (!LittleFS.begin(true)) // Format on first use
+  {
+    DebugSerial::println("LittleFS mount failed, samples will not be journaled");
+    return;
+  }
+  LittleFS.remove("/journal.bin"); // Single-file journal of earlier firmware
+  if (sampleJournal.begin(JOURNAL_PATH, JOURNAL_SLOTS))
+  {
+    DebugSerial::printf("Sample journal: %u samples pending replay\n", sampleJournal.pending());
+  }
 }
 
-void sendDataMQTT(const ChamberData &data)
+// Current Unix time, 0 until NTP has synced
+uint32_t sampleTimestamp()
 {
+  time_t now = time(nullptr);
+  return now > 1600000000 ? (uint32_t)now : 0;
+}
+
+// Encode one sample in the configured PAYLOAD_ENCODING, returns its length (0 if it did not fit)
+size_t serializeSample(const ChamberData &data, uint32_t timestamp, bool replay, uint8_t *out, size_t outSize)
+{
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+  SampleMeta meta = {boardID, APPDEVINDEX, timestamp, replay};
+  return packSample(data, meta, out, outSize);
+#else
   JsonDocument dataJsonDoc;
   dataJsonDoc["client"] = boardID;
-  dataJsonDoc["tempPV"] = data.tempPV;
-  dataJsonDoc["tempSP"] = data.tempSP;
-  dataJsonDoc["wetPV"] = data.wetPV;
-  dataJsonDoc["wetSP"] = data.wetSP;
-  dataJsonDoc["humiPV"] = data.humiPV;
-  dataJsonDoc["humiSP"] = data.humiSP;
-  dataJsonDoc["nowSTS"] = data.nowSTS;
-
-  char dataToSend[256];
+  dataJsonDoc["slave"] = data.slaveAddr;
+  if (timestamp)
+  {
+    dataJsonDoc["ts"] = timestamp;
+  }
+  if (replay)
+  {
+    dataJsonDoc["replay"] = true;
+  }
+  // Every decoded field of CHAMBER_REGISTER_MAP, keyed by its ChamberData member name
+  visitChamberFields(data, [&](const RegisterField &field, auto value)
+                     { dataJsonDoc[field.key] = value; });
+
   dataJsonDoc.shrinkToFit();
-  serializeJson(dataJsonDoc, dataToSend, sizeof(dataToSend));
+  return serializeJson(dataJsonDoc, (char *)out, outSize);
+#endif
+}
+
+void printSample(const uint8_t *payload, size_t length)
+{
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+  DebugSerial::printf("MessagePack sample, %u bytes\n", (unsigned)length);
+#else
+  DebugSerial::println((const char *)payload);
+#endif
+}
+
+void journalSample(const ChamberData &data, uint32_t timestamp)
+{
+  // Keep the sample for replay instead of dropping it
+  ResourceLock flashLock(RESOURCE_FLASH);
+  if (!sampleJournal.append(data, timestamp))
+  {
+    DebugSerial::println("MQTT offline and journal unavailable, sample dropped");
+  }
+}
 
-  mqttClient.publish(dataTopic.c_str(), dataToSend);
-  DebugSerial::println(dataToSend);
+// Publish the pending data message; its samples go to the journal if the broker does not take it
+void flushBatch(BatchFlushReason reason)
+{
+  size_t length;
+  const uint8_t *payload = sampleBatch.message(&length);
+  if (length == 0)
+  {
+    return;
+  }
+  if (mqttClient.connected() && timedPublish(dataTopic.c_str(), payload, length))
+  {
+    if (sampleBatch.samples() > 1)
+    {
+      DebugSerial::printf("Published %u samples in %u bytes\n", (unsigned)sampleBatch.samples(), (unsigned)length);
+    }
+    sampleBatch.sent(reason);
+    return;
+  }
+  metrics.counter(METRIC_PUBLISH_FAILURES).add();
+  for (size_t i = 0; i < sampleBatch.samples(); i++)
+  {
+    journalSample(batchedSamples[i].data, batchedSamples[i].timestamp);
+  }
+  sampleBatch.clear();
+}
+
+// Publish a data message, timing it for the publish latency histogram
+bool timedPublish(const char *topic, const uint8_t *payload, size_t length)
+{
+  uint32_t startUs = micros();
+  bool published = mqttClient.publish(topic, payload, length);
+  metrics.histogram(METRIC_PUBLISH_US).record(micros() - startUs);
+  if (published)
+  {
+    metrics.counter(METRIC_PUBLISHES).add();
+  }
+  return published;
+}
+
+void flushExpiredBatch()
+{
+  if (sampleBatch.expired(millis()))
+  {
+    flushBatch(FLUSH_AGE);
+  }
+}
+
+void publishSample(const TimedSample &sample)
+{
+  uint8_t dataToSend[SAMPLE_PAYLOAD_SIZE];
+  size_t length = serializeSample(sample.data, sample.timestamp, false, dataToSend, sizeof(dataToSend));
+  if (length == 0)
+  {
+    DebugSerial::println("Sample does not fit SAMPLE_PAYLOAD_SIZE, dropped");
+    return;
+  }
+  printSample(dataToSend, length);
+
+  if (!sampleBatch.add(dataToSend, length, millis()))
+  {
+    // Pending message is as large as it can get, send it and start the next one
+    flushBatch(FLUSH_BYTES);
+    if (!sampleBatch.add(dataToSend, length, millis()))
+    {
+      journalSample(sample.data, sample.timestamp); // Larger than a data message on its own
+      return;
+    }
+  }
+  batchedSamples[sampleBatch.samples() - 1] = sample;
+
+  if (sampleBatch.full() || !mqttClient.connected())
+  {
+    flushBatch(FLUSH_COUNT); // Offline this goes straight to the journal
+  }
+}
+
+// One closed window on the summary topic. Offline, or if the broker refuses it,
+// the window means go to the journal as an ordinary sample: the trend survives
+// the outage, the spread does not.
+void publishSummary(const SampleSummary &summary)
+{
+  uint8_t payload[SUMMARY_PAYLOAD_SIZE];
+#if PAYLOAD_ENCODING == PAYLOAD_MSGPACK
+  SampleMeta meta = {boardID, APPDEVINDEX, summary.timestamp, false};
+  size_t length = packSummary(summary, meta, payload, sizeof(payload));
+#else
+  size_t length = writeSummaryJson(summary, boardID, (char *)payload, sizeof(payload));
+#endif
+  if (length == 0)
+  {
+    DebugSerial::println("Summary does not fit SUMMARY_PAYLOAD_SIZE, journaling its means");
+  }
+  else
+  {
+    printSample(payload, length);
+    if (mqttClient.connected() && timedPublish(summaryTopic.c_str(), payload, length))
+    {
+      return;
+    }
+    metrics.counter(METRIC_PUBLISH_FAILURES).add();
+  }
+  ChamberData means;
+  summaryMeans(summary, &means);
+  if (means.validMask)
+  {
+    journalSample(means, summary.timestamp);
+  }
+}
+
+// Windows of slaves that stopped answering close on time rather than on their next sample
+void flushExpiredSummaries()
+{
+  SampleSummary summary;
+  while (sampleAggregator.expired(millis(), &summary))
+  {
+    publishSummary(summary);
+  }
+}
+
+void sendDataMQTT(const TimedSample &sample)
+{
+  if (sampleAggregator.window())
+  {
+    SampleSummary summary;
+    AggregateOutcome outcome = sampleAggregator.add(sample, &summary); // Windowed by capture time, not drain time
+    if (outcome == AGGREGATE_CLOSED)
+    {
+      publishSummary(summary);
+    }
+    if (outcome != AGGREGATE_NO_SLOT && !aggregateRaw)
+    {
+      return; // Published with its window
+    }
+  }
+#if REPORT_BY_EXCEPTION
+  TimedSample changed = sample;
+  if (!exceptionReporter.filter(changed.data, millis()))
+  {
+    return; // Nothing moved past its deadband
+  }
+  publishSample(changed);
+#else
+  publishSample(sample);
+#endif
+}
+
+// Called on the Modbus task: stamp the sample and hand it over without touching the network
+void queueSample(const ChamberData &data)
+{
+  TimedSample sample = {data, sampleTimestamp(), millis()};
+  if (!sampleQueue.push(sample))
+  {
+    queueStats.overflows++;
+#if SAMPLE_QUEUE_POLICY == QUEUE_DROP_OLDEST
+    if (sampleQueue.dropOldest())
+    {
+      queueStats.droppedOldest++;
+    }
+    if (!sampleQueue.push(sample))
+    {
+      queueStats.droppedNewest++;
+      return;
+    }
+#else
+    queueStats.droppedNewest++;
+    return;
+#endif
+  }
+  queueStats.pushed++;
+  size_t queued = sampleQueue.size();
+  if (queued > queueStats.highWater)
+  {
+    queueStats.highWater = queued;
+  }
+}
+
+// Called on the MQTT loop, the only task that uses mqttClient
+void drainSampleQueue()
+{
+  TimedSample sample;
+#if SAMPLE_QUEUE_POLICY == QUEUE_SPILL
+  // A loop that fell behind journals the backlog for replay, so the queue has
+  // room again; flash is only touched here, never on the Modbus task
+  while (sampleQueue.size() > SAMPLE_QUEUE_SIZE / 2 && sampleQueue.pop(&sample))
+  {
+    journalSample(sample.data, sample.timestamp);
+    queueStats.spilled++;
+  }
+#endif
+  for (size_t i = 0; i < SAMPLE_QUEUE_SIZE && sampleQueue.pop(&sample); i++)
+  {
+    sendDataMQTT(sample);
+  }
+}
+
+// Publish a small batch of journaled samples, rate-limited so live samples are not starved
+void replayJournal()
+{
+  if (!sampleJournal.isOpen() || millis() - lastReplay < JOURNAL_REPLAY_INTERVAL)
+  {
+    return;
+  }
+  lastReplay = millis();
+
+  JournalRecord records[JOURNAL_REPLAY_BATCH];
+  size_t count;
+  {
+    ResourceLock flashLock(RESOURCE_FLASH);
+    count = sampleJournal.peek(records, JOURNAL_REPLAY_BATCH);
+  }
+  uint32_t delivered = 0;
+  size_t next = 0;
+  // Same message layout as live samples: up to BATCH_MAX_SAMPLES per message
+  while (next < count)
+  {
+    size_t taken = next;
+    while (taken < count && !replayBatch.full())
+    {
+      uint8_t dataToSend[SAMPLE_PAYLOAD_SIZE];
+      size_t length = serializeSample(records[taken].data, records[taken].timestamp, true, dataToSend, sizeof(dataToSend));
+      if (!replayBatch.add(dataToSend, length, millis()))
+      {
+        break;
+      }
+      taken++;
+    }
+    if (taken == next)
+    {
+      delivered = records[next++].seq; // Can never be sent, skip it
+      continue;
+    }
+
+    size_t length;
+    const uint8_t *payload = replayBatch.message(&length);
+    if (!timedPublish(dataTopic.c_str(), payload, length))
+    {
+      replayBatch.clear();
+      break; // Retry from here on the next batch
+    }
+    replayBatch.sent(FLUSH_COUNT);
+    delivered = records[taken - 1].seq;
+    next = taken;
+  }
+  if (delivered)
+  {
+    ResourceLock flashLock(RESOURCE_FLASH);
+    sampleJournal.ack(delivered);
+    DebugSerial::printf("Replayed journal up to #%u, %u pending, %u dropped\n", delivered, sampleJournal.pending(), sampleJournal.dropped());
+  }
 }
\ No newline at end of file
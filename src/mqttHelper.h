@@ -1,10 +1,31 @@
 #include <modbusHelper.h>
+#include "sampleQueue.h"
+#include "sampleAggregator.h"
+#include "modbusWrite.h"
 
 void setup_mqtt();
-void reconnect();
+void maintainMqttConnection();
+bool firmwareAnnounced();
 void setup_wifi();
 void mqttLoop();
 void setWill();
 void sendConnectionAck();
-void sendDataMQTT(const ChamberData& chamberData);
+void sendDataMQTT(const TimedSample& sample);
+void queueSample(const ChamberData& chamberData);
+void drainSampleQueue();
+void setupJournal();
+void replayJournal();
+void flushExpiredBatch();
+void flushExpiredSummaries();
+void publishSummary(const SampleSummary &summary);
+bool timedPublish(const char *topic, const uint8_t *payload, size_t length);
+void updateMetricGauges();
+void publishMetrics();
+void publishProfile();
+void handlePollCommand(const char *argument);
+void handleAggregateCommand(const char *argument);
+void handleSetCommand(const char *argument);
+void rejectSetCommand(const char *reason);
+void queueWriteAck(const WriteAck &ack);
+void publishWriteAcks();
 void printMemoryUsage();
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "mqttLink.h"
+
+void MqttLink::begin(uint32_t baseMs, uint32_t maxMs, uint32_t seed)
+{
+    base = baseMs ? baseMs : 1;
+    max = maxMs > base ? maxMs : base;
+    rng = seed ? seed : 1;
+    linkState = LINK_WAIT_NETWORK;
+    linkStats = {};
+    failures = 0;
+    nextAttemptMs = 0;
+    outageStartMs = 0;
+}
+
+// xorshift32, enough to decorrelate devices seeded differently
+uint32_t MqttLink::random()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+uint32_t MqttLink::nextBackoff()
+{
+    uint32_t ceiling = base;
+    for (uint32_t i = 0; i < failures && ceiling < max; i++)
+    {
+        ceiling = ceiling > max / 2 ? max : ceiling * 2;
+    }
+    uint32_t half = ceiling / 2;
+    return ceiling - half + random() % (half + 1);
+}
+
+void MqttLink::lost(uint32_t nowMs)
+{
+    if (linkState == LINK_CONNECTED)
+    {
+        linkStats.disconnects++;
+    }
+    outageStartMs = nowMs;
+    failures = 0;
+    // First attempt after a random share of the base wait, so a fleet does not retry together
+    linkStats.backoffMs = random() % (base + 1);
+    nextAttemptMs = nowMs + linkStats.backoffMs;
+}
+
+bool MqttLink::attemptDue(uint32_t nowMs, bool networkUp, bool clientConnected)
+{
+    if (clientConnected)
+    {
+        return false; // attemptResult() moved us to LINK_CONNECTED
+    }
+    if (!networkUp)
+    {
+        if (linkState != LINK_WAIT_NETWORK)
+        {
+            lost(nowMs);
+            linkState = LINK_WAIT_NETWORK;
+        }
+        return false;
+    }
+    if (linkState != LINK_BACKOFF)
+    {
+        // Network back, or the broker dropped us
+        uint32_t outageStart = linkState == LINK_WAIT_NETWORK && outageStartMs ? outageStartMs : nowMs;
+        lost(nowMs);
+        outageStartMs = outageStart;
+        linkState = LINK_BACKOFF;
+    }
+    return (int32_t)(nowMs - nextAttemptMs) >= 0;
+}
+
+void MqttLink::attemptResult(bool connected, int rc, uint32_t nowMs)
+{
+    linkStats.attempts++;
+    if (connected)
+    {
+        linkState = LINK_CONNECTED;
+        linkStats.connects++;
+        linkStats.lastConnectMs = nowMs - outageStartMs;
+        if (linkStats.lastConnectMs > linkStats.maxConnectMs)
+        {
+            linkStats.maxConnectMs = linkStats.lastConnectMs;
+        }
+        linkStats.backoffMs = 0;
+        failures = 0;
+        return;
+    }
+    linkStats.lastRc = rc;
+    failures++;
+    linkStats.backoffMs = nextBackoff();
+    nextAttemptMs = nowMs + linkStats.backoffMs;
+}
@@ -0,0 +1,53 @@
+#ifndef MQTT_LINK_H
+#define MQTT_LINK_H
+
+#include <stdint.h>
+
+enum MqttLinkState : uint8_t {
+    LINK_WAIT_NETWORK, // Wi-Fi down, no attempts
+    LINK_BACKOFF,      // Waiting for the next attempt
+    LINK_CONNECTED
+};
+
+typedef struct {
+    uint32_t attempts;      // connect() calls
+    uint32_t connects;      // Successful connections
+    uint32_t disconnects;   // Connections lost after being up
+    int lastRc;             // Client state after the last failed attempt
+    uint32_t lastConnectMs; // Outage start to connected, last time
+    uint32_t maxConnectMs;
+    uint32_t backoffMs;     // Wait before the next attempt
+} MqttLinkStats;
+
+// Non-blocking reconnect logic, driven from the MQTT loop. The caller asks
+// attemptDue() on every pass, makes one connect attempt when it says so and
+// reports the result. Waits grow exponentially from baseMs up to maxMs with
+// "equal jitter" (half fixed, half random), so a fleet that lost the broker
+// at the same moment spreads its reconnects instead of retrying in lockstep.
+class MqttLink {
+public:
+    void begin(uint32_t baseMs, uint32_t maxMs, uint32_t seed);
+
+    // True if a connect attempt should be made now
+    bool attemptDue(uint32_t nowMs, bool networkUp, bool clientConnected);
+    void attemptResult(bool connected, int rc, uint32_t nowMs);
+
+    MqttLinkState state() const { return linkState; }
+    const MqttLinkStats &stats() const { return linkStats; }
+
+private:
+    void lost(uint32_t nowMs);
+    uint32_t nextBackoff();
+    uint32_t random();
+
+    MqttLinkState linkState = LINK_WAIT_NETWORK;
+    MqttLinkStats linkStats = {};
+    uint32_t base = 1000;
+    uint32_t max = 60000;
+    uint32_t failures = 0;     // Failed attempts since the link went down
+    uint32_t nextAttemptMs = 0;
+    uint32_t outageStartMs = 0;
+    uint32_t rng = 1;
+};
+
+#endif
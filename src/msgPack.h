@@ -0,0 +1,170 @@
+#ifndef MSG_PACK_H
+#define MSG_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Bounds-checked MessagePack writer, each value in its shortest form
+class MsgPackWriter
+{
+public:
+    MsgPackWriter(uint8_t *out, size_t size) : buffer(out), capacity(size) {}
+
+    void mapHeader(size_t entries)
+    {
+        if (entries <= 15)
+        {
+            byte(0x80 | entries);
+        }
+        else
+        {
+            byte(0xDE);
+            be16((uint16_t)entries);
+        }
+    }
+
+    void uint(uint32_t value)
+    {
+        if (value <= 0x7F)
+        {
+            byte(value);
+        }
+        else if (value <= 0xFF)
+        {
+            byte(0xCC);
+            byte(value);
+        }
+        else if (value <= 0xFFFF)
+        {
+            byte(0xCD);
+            be16((uint16_t)value);
+        }
+        else
+        {
+            byte(0xCE);
+            be16((uint16_t)(value >> 16));
+            be16((uint16_t)value);
+        }
+    }
+
+    void integer(int32_t value)
+    {
+        if (value >= 0)
+        {
+            uint((uint32_t)value);
+        }
+        else if (value >= -32)
+        {
+            byte((uint8_t)value); // Negative fixint
+        }
+        else if (value >= -128)
+        {
+            byte(0xD0);
+            byte((uint8_t)value);
+        }
+        else if (value >= -32768)
+        {
+            byte(0xD1);
+            be16((uint16_t)value);
+        }
+        else
+        {
+            byte(0xD2);
+            be16((uint16_t)((uint32_t)value >> 16));
+            be16((uint16_t)value);
+        }
+    }
+
+    void str(const char *value)
+    {
+        size_t length = strlen(value);
+        if (length <= 31)
+        {
+            byte(0xA0 | length);
+        }
+        else
+        {
+            byte(0xD9);
+            byte(length);
+        }
+        for (size_t i = 0; i < length; i++)
+        {
+            byte(value[i]);
+        }
+    }
+
+    // 64-bit only where the value needs it
+    void uint64(uint64_t value)
+    {
+        if (value <= 0xFFFFFFFFULL)
+        {
+            uint((uint32_t)value);
+            return;
+        }
+        byte(0xCF);
+        be16((uint16_t)(value >> 48));
+        be16((uint16_t)(value >> 32));
+        be16((uint16_t)(value >> 16));
+        be16((uint16_t)value);
+    }
+
+    void arrayHeader(size_t entries)
+    {
+        if (entries <= 15)
+        {
+            byte(0x90 | entries);
+        }
+        else
+        {
+            byte(0xDC);
+            be16((uint16_t)entries);
+        }
+    }
+
+    void boolean(bool value)
+    {
+        byte(value ? 0xC3 : 0xC2);
+    }
+
+    void float32(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        byte(0xCA);
+        be16((uint16_t)(bits >> 16));
+        be16((uint16_t)bits);
+    }
+
+    // 0 if anything did not fit
+    size_t length() const
+    {
+        return overflow ? 0 : used;
+    }
+
+private:
+    void byte(uint32_t value)
+    {
+        if (used < capacity)
+        {
+            buffer[used++] = (uint8_t)value;
+        }
+        else
+        {
+            overflow = true;
+        }
+    }
+
+    void be16(uint16_t value)
+    {
+        byte(value >> 8);
+        byte(value & 0xFF);
+    }
+
+    uint8_t *buffer;
+    size_t capacity;
+    size_t used = 0;
+    bool overflow = false;
+};
+
+#endif
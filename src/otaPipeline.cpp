@@ -0,0 +1,56 @@
+#include <string.h>
+#include "otaPipeline.h"
+
+void OtaPipeline::begin(InflateStream *decompressor)
+{
+    uint8_t index;
+    OtaChunk chunk;
+    while (free.pop(&index))
+    {
+    }
+    while (filled.pop(&chunk))
+    {
+    }
+    for (uint8_t i = 0; i < OTA_BUFFER_COUNT; i++)
+    {
+        free.push(i);
+    }
+    hash.begin();
+    inflater = decompressor;
+    if (inflater)
+        inflater->begin();
+    imageBytes = 0;
+    receivedBytes = 0;
+    writtenBytes.store(0, std::memory_order_relaxed);
+    closed.store(false, std::memory_order_relaxed);
+    failure.store(false, std::memory_order_relaxed);
+    pipelineStats = {};
+}
+
+uint8_t *OtaPipeline::acquire()
+{
+    uint8_t index;
+    if (!free.pop(&index))
+    {
+        pipelineStats.readerStalls++;
+        return nullptr;
+    }
+    return buffers[index];
+}
+
+void OtaPipeline::submit(uint8_t *buffer, size_t length)
+{
+    OtaChunk chunk = {(uint8_t)((buffer - buffers[0]) / OTA_BUFFER_SIZE), (uint16_t)length};
+    filled.push(chunk); // Never full: there are fewer buffers than queue slots
+    receivedBytes += length;
+    uint32_t inFlight = filled.size();
+    if (inFlight > pipelineStats.maxInFlight)
+        pipelineStats.maxInFlight = inFlight;
+}
+
+bool OtaPipeline::verify(const uint8_t expected[SHA256_DIGEST_SIZE])
+{
+    uint8_t digest[SHA256_DIGEST_SIZE];
+    hash.finish(digest);
+    return memcmp(digest, expected, SHA256_DIGEST_SIZE) == 0;
+}
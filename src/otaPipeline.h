@@ -0,0 +1,100 @@
+#ifndef OTA_PIPELINE_H
+#define OTA_PIPELINE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "sampleQueue.h"
+#include "sha256.h"
+#include "inflateStream.h"
+
+#ifndef OTA_BUFFER_COUNT
+#define OTA_BUFFER_COUNT 3 // Rotating download buffers: one filling, the rest queued for or being written to flash
+#endif
+#define OTA_BUFFER_SIZE 4096 // One flash sector per buffer
+
+static_assert(OTA_BUFFER_COUNT >= 2 && OTA_BUFFER_COUNT <= 4, "OTA_BUFFER_COUNT must be 2 to 4");
+
+typedef struct {
+    uint8_t buffer;
+    uint16_t length;
+} OtaChunk;
+
+typedef struct {
+    uint32_t chunks;        // Buffers written to flash
+    uint32_t readerStalls;  // Times the network side found every buffer in flight
+    uint32_t maxInFlight;   // Most buffers queued for flash at once
+} OtaPipelineStats;
+
+// Buffers handed between the download (network) task and the flash writer
+// task. The reader fills a free buffer and submits it, the writer hashes it,
+// writes it and hands it back, so reading the next chunk overlaps with the
+// flash erase/write of the previous one. Both hand-offs are SPSC queues of
+// buffer indices; neither side ever blocks the other. A compressed download
+// is inflated on the writer side; the digest covers the image as written.
+class OtaPipeline {
+public:
+    void begin(InflateStream *decompressor = nullptr);
+
+    // Reader side: a free buffer of OTA_BUFFER_SIZE bytes, nullptr if all are in flight
+    uint8_t *acquire();
+    void submit(uint8_t *buffer, size_t length);
+    // No more chunks will be submitted
+    void close() { closed.store(true, std::memory_order_release); }
+    uint32_t received() const { return receivedBytes; }
+
+    // Writer side: decompress if needed, hash and write(data, length) the oldest
+    // submitted chunk. False if none was waiting. A failed write fails the whole pipeline.
+    template <typename Writer>
+    bool consume(Writer write)
+    {
+        OtaChunk chunk;
+        if (!filled.pop(&chunk))
+            return false;
+        const uint8_t *data = buffers[chunk.buffer];
+        auto image = [&](const uint8_t *bytes, size_t length)
+        {
+            hash.update(bytes, length);
+            imageBytes += length;
+            return write(bytes, length);
+        };
+        bool written = inflater ? inflater->feed(data, chunk.length, [](void *context, const uint8_t *bytes, size_t length)
+                                                 { return (*static_cast<decltype(image) *>(context))(bytes, length); },
+                                                 &image) != INFLATE_ERROR
+                                : image(data, chunk.length);
+        if (!written)
+            fail();
+        writtenBytes.fetch_add(chunk.length, std::memory_order_release);
+        pipelineStats.chunks++;
+        free.push(chunk.buffer);
+        return true;
+    }
+
+    // Closed and every submitted chunk written
+    bool drained() const { return closed.load(std::memory_order_acquire) && filled.size() == 0; }
+    void fail() { failure.store(true, std::memory_order_release); }
+    bool failed() const { return failure.load(std::memory_order_acquire); }
+    uint32_t written() const { return writtenBytes.load(std::memory_order_acquire); }
+    // Once drained: every image byte arrived (for a compressed download, the stream ended)
+    bool imageComplete() const { return !inflater || inflater->done(); }
+    uint32_t imageSize() const { return imageBytes; }
+
+    // Once drained: does the image hash to `expected`?
+    bool verify(const uint8_t expected[SHA256_DIGEST_SIZE]);
+    const OtaPipelineStats &stats() const { return pipelineStats; }
+
+private:
+    uint8_t buffers[OTA_BUFFER_COUNT][OTA_BUFFER_SIZE];
+    SpscQueue<uint8_t, 4> free;     // Writer -> reader
+    SpscQueue<OtaChunk, 4> filled;  // Reader -> writer
+    Sha256 hash;
+    InflateStream *inflater = nullptr;
+    uint32_t imageBytes = 0; // Written by the writer side, read once drained
+    uint32_t receivedBytes = 0;
+    std::atomic<uint32_t> writtenBytes{0};
+    std::atomic<bool> closed{false};
+    std::atomic<bool> failure{false};
+    OtaPipelineStats pipelineStats = {};
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pollConfig.h"
+#include "registerMap.h"
+
+static const char *const SOURCE_NAMES[] = {"default", "nvs", "mqtt", "backend"};
+
+const char *pollConfigSourceName(PollConfigSource source)
+{
+    return source < sizeof(SOURCE_NAMES) / sizeof(SOURCE_NAMES[0]) ? SOURCE_NAMES[source] : "unknown";
+}
+
+// Unsigned decimal of exactly `length` characters
+static bool parseNumber(const char *text, size_t length, uint32_t max, uint32_t *value)
+{
+    uint64_t number = 0;
+    if (length == 0 || length > 10)
+        return false;
+    for (size_t i = 0; i < length; i++)
+    {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+        number = number * 10 + (text[i] - '0');
+    }
+    if (number > max)
+        return false;
+    *value = (uint32_t)number;
+    return true;
+}
+
+static bool parsePeriod(const char *text, size_t length, uint32_t *periodMs)
+{
+    static const struct
+    {
+        const char *suffix;
+        uint32_t scale;
+    } units[] = {{"min", 60000}, {"ms", 1}, {"s", 1000}};
+    uint32_t scale = 1;
+    for (const auto &unit : units)
+    {
+        size_t suffixLength = strlen(unit.suffix);
+        if (length > suffixLength && memcmp(text + length - suffixLength, unit.suffix, suffixLength) == 0)
+        {
+            scale = unit.scale;
+            length -= suffixLength;
+            break;
+        }
+    }
+    uint32_t count;
+    if (!parseNumber(text, length, POLL_MAX_PERIOD_MS / scale, &count))
+        return false;
+    *periodMs = count * scale;
+    return true;
+}
+
+static bool parseRegisters(const char *text, size_t length, uint32_t *mask)
+{
+    if (length == 3 && memcmp(text, "all", 3) == 0)
+    {
+        *mask = 0;
+        return true;
+    }
+    *mask = 0;
+    while (length)
+    {
+        const char *comma = (const char *)memchr(text, ',', length);
+        size_t nameLength = comma ? (size_t)(comma - text) : length;
+        size_t field = 0;
+        while (field < CHAMBER_REGISTER_COUNT &&
+               (strlen(CHAMBER_REGISTER_MAP[field].key) != nameLength || memcmp(CHAMBER_REGISTER_MAP[field].key, text, nameLength) != 0))
+            field++;
+        if (field == CHAMBER_REGISTER_COUNT)
+            return false;
+        *mask |= 1UL << field;
+        length -= comma ? nameLength + 1 : nameLength;
+        text += comma ? nameLength + 1 : nameLength;
+    }
+    return *mask != 0;
+}
+
+// One "key=value" or flag word of an entry
+static bool parseWord(const char *word, size_t length, PollSlave *slave, bool *hasAddress, char *error, size_t errorSize)
+{
+    const char *equals = (const char *)memchr(word, '=', length);
+    size_t keyLength = equals ? (size_t)(equals - word) : length;
+    const char *value = equals ? equals + 1 : word + length;
+    size_t valueLength = equals ? length - keyLength - 1 : 0;
+    uint32_t number = 0;
+    bool ok;
+    if (!equals && keyLength == 5 && memcmp(word, "ascii", 5) == 0)
+        slave->transport = MODBUS_ASCII, ok = true;
+    else if (!equals && keyLength == 3 && memcmp(word, "rtu", 3) == 0)
+        slave->transport = MODBUS_RTU, ok = true;
+    else if (keyLength == 5 && memcmp(word, "slave", 5) == 0)
+    {
+        ok = parseNumber(value, valueLength, 247, &number) && number >= 1;
+        slave->slaveAddr = (uint8_t)number;
+        *hasAddress = ok;
+    }
+    else if (keyLength == 2 && memcmp(word, "fc", 2) == 0)
+    {
+        ok = parseNumber(value, valueLength, 4, &number) && number >= 3;
+        slave->functionCode = (uint8_t)number;
+    }
+    else if (keyLength == 6 && memcmp(word, "period", 6) == 0)
+        ok = parsePeriod(value, valueLength, &slave->periodMs) && slave->periodMs >= POLL_MIN_PERIOD_MS;
+    else if (keyLength == 4 && memcmp(word, "regs", 4) == 0)
+        ok = parseRegisters(value, valueLength, &slave->registerMask);
+    else
+    {
+        snprintf(error, errorSize, "unknown word '%.*s'", (int)length, word);
+        return false;
+    }
+    if (!ok)
+        snprintf(error, errorSize, "bad value '%.*s'", (int)length, word);
+    return ok;
+}
+
+bool parsePollConfig(const char *text, PollConfig *config, char *error, size_t errorSize)
+{
+    PollConfig parsed = {};
+    const char *p = text;
+    if (strnlen(text, POLL_CONFIG_TEXT_SIZE) == POLL_CONFIG_TEXT_SIZE)
+    {
+        snprintf(error, errorSize, "longer than %u characters", POLL_CONFIG_TEXT_SIZE - 1);
+        return false;
+    }
+    while (*p)
+    {
+        size_t entryLength = strcspn(p, ";\n");
+        PollSlave slave = {0, 0x03, POLL_DEFAULT_PERIOD_MS, MODBUS_RTU, 0};
+        bool hasAddress = false, empty = true;
+        const char *end = p + entryLength;
+        while (p < end)
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+                p++;
+            size_t wordLength = 0;
+            while (p + wordLength < end && p[wordLength] != ' ' && p[wordLength] != '\t' && p[wordLength] != '\r')
+                wordLength++;
+            if (!wordLength)
+                continue;
+            empty = false;
+            char reason[64];
+            if (!parseWord(p, wordLength, &slave, &hasAddress, reason, sizeof(reason)))
+            {
+                snprintf(error, errorSize, "slave entry %u: %s", parsed.slaveCount + 1, reason);
+                return false;
+            }
+            p += wordLength;
+        }
+        p = *end ? end + 1 : end;
+        if (empty)
+            continue; // Blank entry, e.g. a trailing ';'
+        if (!hasAddress)
+        {
+            snprintf(error, errorSize, "slave entry %u: no slave=", parsed.slaveCount + 1);
+            return false;
+        }
+        for (size_t i = 0; i < parsed.slaveCount; i++)
+        {
+            if (parsed.slaves[i].slaveAddr == slave.slaveAddr)
+            {
+                snprintf(error, errorSize, "slave %u listed twice", slave.slaveAddr);
+                return false;
+            }
+        }
+        if (parsed.slaveCount == POLL_CONFIG_MAX_SLAVES)
+        {
+            snprintf(error, errorSize, "more than %u slaves", POLL_CONFIG_MAX_SLAVES);
+            return false;
+        }
+        parsed.slaves[parsed.slaveCount++] = slave;
+    }
+    if (!parsed.slaveCount)
+    {
+        snprintf(error, errorSize, "no slaves");
+        return false;
+    }
+    *config = parsed;
+    return true;
+}
+
+size_t formatPollConfig(const PollConfig &config, char *out, size_t size)
+{
+    size_t used = 0;
+    for (size_t s = 0; s < config.slaveCount; s++)
+    {
+        const PollSlave &slave = config.slaves[s];
+        int written = snprintf(out + used, size - used, "%sslave=%u fc=%u period=%lums", s ? "; " : "",
+                               slave.slaveAddr, slave.functionCode, (unsigned long)slave.periodMs);
+        if (written < 0 || (size_t)written >= size - used)
+            return 0;
+        used += written;
+        uint32_t all = CHAMBER_REGISTER_ALL;
+        for (size_t i = 0; slave.registerMask && (slave.registerMask & all) != all && i < CHAMBER_REGISTER_COUNT; i++)
+        {
+            if (!(slave.registerMask & (1UL << i)))
+                continue;
+            bool first = (slave.registerMask & ((1UL << i) - 1)) == 0;
+            written = snprintf(out + used, size - used, "%s%s", first ? " regs=" : ",", CHAMBER_REGISTER_MAP[i].key);
+            if (written < 0 || (size_t)written >= size - used)
+                return 0;
+            used += written;
+        }
+        if (slave.transport == MODBUS_ASCII)
+        {
+            written = snprintf(out + used, size - used, " ascii");
+            if (written < 0 || (size_t)written >= size - used)
+                return 0;
+            used += written;
+        }
+    }
+    return used;
+}
+
+uint32_t pollBusLoad(const PollConfig &config, uint16_t gapTolerance, uint32_t baudRate, uint32_t turnaroundUs)
+{
+    uint64_t load = 0;
+    for (size_t s = 0; s < config.slaveCount; s++)
+    {
+        const PollSlave &slave = config.slaves[s];
+        ReadRange ranges[CHAMBER_REGISTER_COUNT];
+        size_t count = planFieldReads(slave.registerMask, gapTolerance, ranges, CHAMBER_REGISTER_COUNT);
+        uint32_t cycleUs = estimatePlanMicros(ranges, count, baudRate, turnaroundUs, slave.transport);
+        load += (uint64_t)cycleUs * 1000 / ((uint64_t)slave.periodMs * 1000); // Bus time per period, permille
+    }
+    return load > UINT32_MAX ? UINT32_MAX : (uint32_t)load;
+}
+
+bool checkPollConfig(const PollConfig &config, uint16_t gapTolerance, uint32_t baudRate, uint32_t turnaroundUs,
+                     char *error, size_t errorSize)
+{
+    PollJob jobs[POLL_MAX_JOBS];
+    if (!planPollJobs(config.slaves, config.slaveCount, gapTolerance, jobs, POLL_MAX_JOBS))
+    {
+        snprintf(error, errorSize, "more than %u reads per cycle", POLL_MAX_JOBS);
+        return false;
+    }
+    uint32_t load = pollBusLoad(config, gapTolerance, baudRate, turnaroundUs);
+    if (load > POLL_MAX_BUS_LOAD)
+    {
+        snprintf(error, errorSize, "needs %u.%u%% of the bus, limit %u%%: lengthen the periods or read fewer fields",
+                 (unsigned)(load / 10), (unsigned)(load % 10), POLL_MAX_BUS_LOAD / 10);
+        return false;
+    }
+    return true;
+}
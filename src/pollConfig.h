@@ -0,0 +1,52 @@
+#ifndef POLL_CONFIG_H
+#define POLL_CONFIG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "readPlanner.h"
+
+#define POLL_CONFIG_MAX_SLAVES 8
+#define POLL_CONFIG_TEXT_SIZE 512 // Text form, as received, stored in NVS and reported
+#ifndef POLL_MIN_PERIOD_MS
+#define POLL_MIN_PERIOD_MS 100 // Fastest poll period accepted
+#endif
+#define POLL_MAX_PERIOD_MS 86400000UL
+#ifndef POLL_MAX_BUS_LOAD
+#define POLL_MAX_BUS_LOAD 800 // Permille of bus time the polls may plan for, the rest absorbs retries and timeouts
+#endif
+#define POLL_DEFAULT_PERIOD_MS 60000 // When an entry gives no period
+
+enum PollConfigSource : uint8_t {
+    POLL_CONFIG_DEFAULT, // pollSlaves compiled into the firmware
+    POLL_CONFIG_NVS,     // Restored at boot
+    POLL_CONFIG_MQTT,    // POLL command
+    POLL_CONFIG_BACKEND  // GET <APPAPI>/pollconfig
+};
+
+// Slaves, periods and fields to poll, replaceable at runtime
+typedef struct {
+    PollSlave slaves[POLL_CONFIG_MAX_SLAVES];
+    uint8_t slaveCount;
+    PollConfigSource source;
+} PollConfig;
+
+// Text form: one entry per slave, separated by ';' or newlines, each a list of
+// key=value words:
+//   slave=<1..247> [period=<n>[ms|s|min]] [fc=3|4] [regs=all|<field>,<field>...] [ascii]
+// e.g. "slave=1 period=500ms regs=tempPV,humiPV; slave=2 period=1min ascii".
+// Fields are CHAMBER_REGISTER_MAP keys. Returns false with a reason in `error`.
+bool parsePollConfig(const char *text, PollConfig *config, char *error, size_t errorSize);
+
+// Canonical text form, accepted by parsePollConfig. Returns the length, 0 if `out` is too small.
+size_t formatPollConfig(const PollConfig &config, char *out, size_t size);
+
+// Permille of the bus the planned reads take, from the read plan cost model
+uint32_t pollBusLoad(const PollConfig &config, uint16_t gapTolerance, uint32_t baudRate, uint32_t turnaroundUs);
+
+// Reject a config the bus cannot carry: over POLL_MAX_BUS_LOAD, or more reads than POLL_MAX_JOBS
+bool checkPollConfig(const PollConfig &config, uint16_t gapTolerance, uint32_t baudRate, uint32_t turnaroundUs,
+                     char *error, size_t errorSize);
+
+const char *pollConfigSourceName(PollConfigSource source);
+
+#endif
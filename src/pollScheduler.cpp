@@ -0,0 +1,79 @@
+#include "pollScheduler.h"
+#include <string.h>
+
+// Signed difference so the comparisons survive millis() wrap-around
+static inline int32_t timeDiff(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b);
+}
+
+bool PollScheduler::begin(const PollJob *newJobs, size_t newCount, uint32_t nowMs)
+{
+    if (newCount > POLL_MAX_JOBS)
+    {
+        return false;
+    }
+    memcpy(jobs, newJobs, newCount * sizeof(PollJob));
+    memset(jobStats, 0, sizeof(jobStats));
+    for (size_t i = 0; i < newCount; i++)
+    {
+        if (jobs[i].periodMs == 0)
+        {
+            jobs[i].periodMs = 1;
+        }
+        deadlines[i] = nowMs;
+    }
+    count = newCount;
+    return true;
+}
+
+int PollScheduler::nextDueJob(uint32_t nowMs, uint32_t *waitMs)
+{
+    int earliest = -1;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (earliest < 0 || timeDiff(deadlines[i], deadlines[earliest]) < 0)
+        {
+            earliest = (int)i;
+        }
+    }
+    if (earliest < 0)
+    {
+        *waitMs = UINT32_MAX;
+        return -1;
+    }
+
+    int32_t untilDue = timeDiff(deadlines[earliest], nowMs);
+    if (untilDue > 0)
+    {
+        *waitMs = (uint32_t)untilDue;
+        return -1;
+    }
+    *waitMs = 0;
+    return earliest;
+}
+
+void PollScheduler::markStarted(int index, uint32_t startMs)
+{
+    PollJobStats &s = jobStats[index];
+    uint32_t period = jobs[index].periodMs;
+    uint32_t jitter = (uint32_t)timeDiff(startMs, deadlines[index]);
+
+    s.runs++;
+    s.lastJitterMs = jitter;
+    s.totalJitterMs += jitter;
+    if (jitter > s.maxJitterMs)
+    {
+        s.maxJitterMs = jitter;
+    }
+
+    // Fixed rate: next deadline is one period after this one. If we are already
+    // past it, count the skipped periods instead of firing a catch-up burst.
+    deadlines[index] += period;
+    if (timeDiff(startMs, deadlines[index]) >= 0)
+    {
+        uint32_t behind = (uint32_t)timeDiff(startMs, deadlines[index]) / period + 1;
+        s.missedDeadlines += behind;
+        deadlines[index] += behind * period;
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef POLL_SCHEDULER_H
+#define POLL_SCHEDULER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+
+#define POLL_MAX_JOBS 16 // One RS-485 bus rarely carries more than 8 chambers
+
+// One periodic Modbus read on the bus
+typedef struct {
+    uint8_t slaveAddr;    // Slave address of the chamber controller
+    uint8_t functionCode; // 0x03 Read Holding Registers / 0x04 Read Input Registers
+    uint16_t startAddr;   // First register (D1 = 0)
+    uint16_t regQuantity; // Number of registers to read
+    uint32_t periodMs;    // Fixed poll period
+    ModbusTransport transport; // MODBUS_RTU unless the slave only speaks ASCII
+    bool lastInCycle;     // Last read of this slave's cycle, publish its merged data afterwards
+} PollJob;
+
+// Timing counters kept per job
+typedef struct {
+    uint32_t runs;            // Transactions started
+    uint32_t missedDeadlines; // Periods skipped because the job started a full period late
+    uint32_t lastJitterMs;    // Start time minus deadline of the last run
+    uint32_t maxJitterMs;     // Worst start jitter seen
+    uint64_t totalJitterMs;   // Sum of jitter, for the mean
+} PollJobStats;
+
+// Fixed-rate, earliest-deadline-first scheduler for the jobs on one bus.
+// Deadlines advance by the period from the previous deadline, never from the
+// end of the work, so the period does not drift with transaction time.
+class PollScheduler {
+public:
+    // Replace the job table; every job is due immediately
+    bool begin(const PollJob *jobs, size_t count, uint32_t nowMs);
+
+    // Index of the most overdue job, or -1 with *waitMs set to the time until the next deadline
+    int nextDueJob(uint32_t nowMs, uint32_t *waitMs);
+
+    // Record the start of a job's transaction and advance its deadline
+    void markStarted(int index, uint32_t startMs);
+
+    size_t jobCount() const { return count; }
+    const PollJob &job(size_t index) const { return jobs[index]; }
+    const PollJobStats &stats(size_t index) const { return jobStats[index]; }
+
+private:
+    PollJob jobs[POLL_MAX_JOBS];
+    PollJobStats jobStats[POLL_MAX_JOBS];
+    uint32_t deadlines[POLL_MAX_JOBS];
+    size_t count = 0;
+};
+
+#endif
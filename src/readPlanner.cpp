@@ -0,0 +1,114 @@
+#include "readPlanner.h"
+#include "registerMap.h"
+#include <algorithm>
+
+size_t planReads(const uint16_t *registers, size_t count, uint16_t gapTolerance, ReadRange *out, size_t maxRanges,
+                 uint16_t maxQuantity)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    uint16_t sorted[MODBUS_MAX_READ_REGISTERS * 2];
+    if (count > sizeof(sorted) / sizeof(sorted[0]))
+    {
+        return 0;
+    }
+    std::copy(registers, registers + count, sorted);
+    std::sort(sorted, sorted + count);
+
+    // Greedy left to right is optimal here: extend the open read while the next
+    // register is within the gap tolerance and the read stays under maxQuantity
+    size_t ranges = 0;
+    uint16_t start = sorted[0];
+    uint16_t last = sorted[0];
+    for (size_t i = 1; i <= count; i++)
+    {
+        if (i < count)
+        {
+            uint16_t reg = sorted[i];
+            uint32_t gap = (uint32_t)reg - last - (reg == last ? 0 : 1);
+            if (gap <= gapTolerance && (uint32_t)reg - start + 1 <= maxQuantity)
+            {
+                last = reg;
+                continue;
+            }
+        }
+        if (ranges == maxRanges)
+        {
+            return 0;
+        }
+        out[ranges].startAddr = start;
+        out[ranges].regQuantity = (uint16_t)(last - start + 1);
+        ranges++;
+        if (i < count)
+        {
+            start = last = sorted[i];
+        }
+    }
+    return ranges;
+}
+
+uint32_t estimateReadMicros(uint16_t regQuantity, uint32_t baudRate, uint32_t turnaroundUs, ModbusTransport transport)
+{
+    if (transport == MODBUS_ASCII)
+    {
+        // Two hex characters per byte, LRC instead of CRC, ':' and CR LF around each frame, 7E1
+        uint32_t characters = (1 + 2 * 7 + 2) + (1 + 2 * (4 + 2 * (uint32_t)regQuantity) + 2);
+        return (uint32_t)((uint64_t)characters * 10 * 1000000 / baudRate) + turnaroundUs;
+    }
+    uint32_t characters = 8 + 5 + 2 * (uint32_t)regQuantity; // Request + response (address, function, count, data, CRC)
+    uint32_t wireUs = (uint32_t)((uint64_t)characters * 10 * 1000000 / baudRate);
+    return wireUs + 2 * modbusSilenceMicros(baudRate) + turnaroundUs;
+}
+
+uint32_t estimatePlanMicros(const ReadRange *ranges, size_t count, uint32_t baudRate, uint32_t turnaroundUs, ModbusTransport transport)
+{
+    uint32_t total = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        total += estimateReadMicros(ranges[i].regQuantity, baudRate, turnaroundUs, transport);
+    }
+    return total;
+}
+
+size_t planFieldReads(uint32_t registerMask, uint16_t gapTolerance, ReadRange *out, size_t maxRanges)
+{
+    uint16_t registers[CHAMBER_REGISTER_COUNT];
+    size_t count = 0;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (registerMask == 0 || (registerMask & (1UL << i)))
+        {
+            registers[count++] = CHAMBER_REGISTER_MAP[i].reg;
+        }
+    }
+    return planReads(registers, count, gapTolerance, out, maxRanges);
+}
+
+size_t planPollJobs(const PollSlave *slaves, size_t slaveCount, uint16_t gapTolerance, PollJob *jobs, size_t maxJobs)
+{
+    size_t jobCount = 0;
+    for (size_t s = 0; s < slaveCount; s++)
+    {
+        ReadRange ranges[CHAMBER_REGISTER_COUNT];
+        size_t rangeCount = planFieldReads(slaves[s].registerMask, gapTolerance, ranges, CHAMBER_REGISTER_COUNT);
+        for (size_t r = 0; r < rangeCount; r++)
+        {
+            if (jobCount == maxJobs)
+            {
+                return 0;
+            }
+            PollJob &job = jobs[jobCount++];
+            job.slaveAddr = slaves[s].slaveAddr;
+            job.functionCode = slaves[s].functionCode;
+            job.startAddr = ranges[r].startAddr;
+            job.regQuantity = ranges[r].regQuantity;
+            job.periodMs = slaves[s].periodMs;
+            job.transport = slaves[s].transport;
+            job.lastInCycle = r + 1 == rangeCount; // The slave's reads run back-to-back, publish after the last
+        }
+    }
+    return jobCount;
+}
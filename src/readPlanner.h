@@ -0,0 +1,45 @@
+#ifndef READ_PLANNER_H
+#define READ_PLANNER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pollScheduler.h"
+
+#define MODBUS_MAX_READ_REGISTERS 125 // Function 0x03/0x04 limit per request
+
+typedef struct {
+    uint16_t startAddr;
+    uint16_t regQuantity;
+} ReadRange;
+
+// A chamber on the bus; its reads are planned from CHAMBER_REGISTER_MAP
+typedef struct {
+    uint8_t slaveAddr;
+    uint8_t functionCode; // 0x03 or 0x04
+    uint32_t periodMs;
+    ModbusTransport transport;
+    uint32_t registerMask; // Bit i reads CHAMBER_REGISTER_MAP[i], 0 reads every field
+} PollSlave;
+
+// Merge the wanted registers (any order, duplicates allowed) into the fewest reads.
+// Up to `gapTolerance` unused registers are read rather than starting a new
+// transaction, and no read exceeds `maxQuantity`. Returns the number of ranges,
+// or 0 if `out` is too small.
+size_t planReads(const uint16_t *registers, size_t count, uint16_t gapTolerance, ReadRange *out, size_t maxRanges,
+                 uint16_t maxQuantity = MODBUS_MAX_READ_REGISTERS);
+
+// Bus time of one read of `regQuantity` registers: request, response, the
+// 3.5 character silence after each RTU frame and the slave's turnaround
+uint32_t estimateReadMicros(uint16_t regQuantity, uint32_t baudRate, uint32_t turnaroundUs, ModbusTransport transport = MODBUS_RTU);
+uint32_t estimatePlanMicros(const ReadRange *ranges, size_t count, uint32_t baudRate, uint32_t turnaroundUs,
+                            ModbusTransport transport = MODBUS_RTU);
+
+// Plan the reads of the CHAMBER_REGISTER_MAP fields in `registerMask` (0 = all).
+// Returns the number of ranges, 0 if `out` is too small or the mask is empty.
+size_t planFieldReads(uint32_t registerMask, uint16_t gapTolerance, ReadRange *out, size_t maxRanges);
+
+// Expand the slave table into poll jobs covering each slave's fields of
+// CHAMBER_REGISTER_MAP. Returns the job count, 0 if `maxJobs` is too small.
+size_t planPollJobs(const PollSlave *slaves, size_t slaveCount, uint16_t gapTolerance, PollJob *jobs, size_t maxJobs);
+
+#endif
@@ -0,0 +1,310 @@
+#ifndef REGISTER_MAP_H
+#define REGISTER_MAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+
+// How a raw 16-bit register becomes a ChamberData field
+enum RegisterScale : uint8_t {
+    REG_SIGNED_DIV100,   // int16 / 100 (TEMI1500 PV/SP, two decimals)
+    REG_SIGNED_DIV10,    // int16 / 10
+    REG_UNSIGNED_DIV100, // uint16 / 100
+    REG_UNSIGNED_DIV10,  // uint16 / 10
+    REG_UNSIGNED,        // uint16 as is
+    REG_BITFIELD         // (uint16 & mask) >> shift
+};
+
+// Storage type of the ChamberData member a field lands in
+enum RegisterFieldKind : uint8_t {
+    FIELD_FLOAT,
+    FIELD_UINT16
+};
+
+typedef struct {
+    const char *key;        // Field name, also the published key
+    uint16_t reg;           // Register address (D1 = 0)
+    RegisterScale scale;
+    uint16_t mask;          // REG_BITFIELD only
+    uint8_t shift;          // REG_BITFIELD only
+    uint16_t offset;        // offsetof(ChamberData, member)
+    RegisterFieldKind kind; // Type of the member
+} RegisterField;
+
+template <typename T>
+constexpr RegisterFieldKind registerFieldKind();
+template <>
+constexpr RegisterFieldKind registerFieldKind<float>() { return FIELD_FLOAT; }
+template <>
+constexpr RegisterFieldKind registerFieldKind<uint16_t>() { return FIELD_UINT16; }
+
+#define REGISTER_FIELD(member, reg, scale) \
+    {#member, reg, scale, 0xFFFF, 0, offsetof(ChamberData, member), registerFieldKind<decltype(ChamberData::member)>()}
+#define REGISTER_BITS(member, reg, mask, shift) \
+    {#member, reg, REG_BITFIELD, mask, shift, offsetof(ChamberData, member), registerFieldKind<decltype(ChamberData::member)>()}
+
+// TEMI1500 holding registers. A new register or controller model is one entry
+// here plus its ChamberData member; decoding and publishing follow the table.
+constexpr RegisterField CHAMBER_REGISTER_MAP[] = {
+    REGISTER_FIELD(tempPV, 0, REG_SIGNED_DIV100), // D1
+    REGISTER_FIELD(tempSP, 1, REG_SIGNED_DIV100), // D2
+    REGISTER_FIELD(wetPV, 2, REG_SIGNED_DIV100),  // D3
+    REGISTER_FIELD(wetSP, 3, REG_SIGNED_DIV100),  // D4
+    REGISTER_FIELD(humiPV, 4, REG_SIGNED_DIV100), // D5
+    REGISTER_FIELD(humiSP, 5, REG_SIGNED_DIV100), // D6
+    REGISTER_FIELD(nowSTS, 9, REG_UNSIGNED),      // D10
+};
+constexpr size_t CHAMBER_REGISTER_COUNT = sizeof(CHAMBER_REGISTER_MAP) / sizeof(CHAMBER_REGISTER_MAP[0]);
+
+static_assert(CHAMBER_REGISTER_COUNT <= 32, "ChamberData::validMask has one bit per field");
+
+constexpr uint16_t registerMapMin()
+{
+    uint16_t reg = 0xFFFF;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (CHAMBER_REGISTER_MAP[i].reg < reg)
+            reg = CHAMBER_REGISTER_MAP[i].reg;
+    }
+    return reg;
+}
+
+constexpr uint16_t registerMapMax()
+{
+    uint16_t reg = 0;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (CHAMBER_REGISTER_MAP[i].reg > reg)
+            reg = CHAMBER_REGISTER_MAP[i].reg;
+    }
+    return reg;
+}
+
+constexpr uint16_t CHAMBER_REGISTER_MIN = registerMapMin();
+constexpr uint16_t CHAMBER_REGISTER_MAX = registerMapMax();
+constexpr uint32_t CHAMBER_REGISTER_ALL = CHAMBER_REGISTER_COUNT == 32 ? 0xFFFFFFFFUL : (1UL << CHAMBER_REGISTER_COUNT) - 1;
+
+// Scaled fields need a float member, raw and bitfield values a uint16_t member
+constexpr bool registerMapIsValid()
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        bool rawValue = field.scale == REG_UNSIGNED || field.scale == REG_BITFIELD;
+        if ((field.kind == FIELD_UINT16) != rawValue)
+            return false;
+    }
+    return true;
+}
+static_assert(registerMapIsValid(), "CHAMBER_REGISTER_MAP: member type does not match its scale");
+
+// Report-by-exception: how far a field may move before it is published again
+enum DeadbandKind : uint8_t {
+    DEADBAND_ABSOLUTE, // |new - last| > band, in field units
+    DEADBAND_PERCENT   // |new - last| > band % of |last|
+};
+
+typedef struct {
+    uint16_t offset; // offsetof(ChamberData, member)
+    DeadbandKind kind;
+    float band;
+} FieldDeadband;
+
+#define DEADBAND_ABS(member, band) {offsetof(ChamberData, member), DEADBAND_ABSOLUTE, band}
+#define DEADBAND_PCT(member, band) {offsetof(ChamberData, member), DEADBAND_PERCENT, band}
+
+// Deadbands of the measured values; fields not listed (set points, status)
+// are published on any change
+constexpr FieldDeadband CHAMBER_DEADBANDS[] = {
+    DEADBAND_ABS(tempPV, 0.1f),
+    DEADBAND_ABS(wetPV, 0.1f),
+    DEADBAND_PCT(humiPV, 1.0f),
+};
+constexpr size_t CHAMBER_DEADBAND_COUNT = sizeof(CHAMBER_DEADBANDS) / sizeof(CHAMBER_DEADBANDS[0]);
+
+// Deadband of CHAMBER_REGISTER_MAP[index], absolute 0 (any change) if none is listed
+constexpr FieldDeadband registerDeadband(size_t index)
+{
+    for (size_t i = 0; i < CHAMBER_DEADBAND_COUNT; i++)
+    {
+        if (CHAMBER_DEADBANDS[i].offset == CHAMBER_REGISTER_MAP[index].offset)
+            return CHAMBER_DEADBANDS[i];
+    }
+    return {CHAMBER_REGISTER_MAP[index].offset, DEADBAND_ABSOLUTE, 0.0f};
+}
+
+// Fields the SET command may write, and the range accepted for each, in field units
+typedef struct {
+    uint16_t offset; // offsetof(ChamberData, member)
+    float min;
+    float max;
+} FieldLimits;
+
+#define WRITE_LIMITS(member, min, max) {offsetof(ChamberData, member), min, max}
+
+// Set points only: process values and status are the controller's to report
+constexpr FieldLimits CHAMBER_WRITABLE[] = {
+    WRITE_LIMITS(tempSP, -100.0f, 200.0f),
+    WRITE_LIMITS(wetSP, -100.0f, 200.0f),
+    WRITE_LIMITS(humiSP, 0.0f, 100.0f),
+};
+constexpr size_t CHAMBER_WRITABLE_COUNT = sizeof(CHAMBER_WRITABLE) / sizeof(CHAMBER_WRITABLE[0]);
+
+// Limits of CHAMBER_REGISTER_MAP[index], nullptr if it is not writable
+constexpr const FieldLimits *registerWriteLimits(size_t index)
+{
+    for (size_t i = 0; i < CHAMBER_WRITABLE_COUNT; i++)
+    {
+        if (CHAMBER_WRITABLE[i].offset == CHAMBER_REGISTER_MAP[index].offset)
+            return &CHAMBER_WRITABLE[i];
+    }
+    return nullptr;
+}
+
+// A written value goes through the field's scaling backwards, which a bitfield cannot
+constexpr bool writableFieldsAreValid()
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (registerWriteLimits(i) && CHAMBER_REGISTER_MAP[i].scale == REG_BITFIELD)
+            return false;
+    }
+    return true;
+}
+static_assert(writableFieldsAreValid(), "CHAMBER_WRITABLE: bitfields cannot be written");
+
+inline float *registerFloat(ChamberData &data, const RegisterField &field)
+{
+    return reinterpret_cast<float *>(reinterpret_cast<uint8_t *>(&data) + field.offset);
+}
+
+inline uint16_t *registerUint16(ChamberData &data, const RegisterField &field)
+{
+    return reinterpret_cast<uint16_t *>(reinterpret_cast<uint8_t *>(&data) + field.offset);
+}
+
+inline float registerFloat(const ChamberData &data, const RegisterField &field)
+{
+    return *reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(&data) + field.offset);
+}
+
+inline uint16_t registerUint16(const ChamberData &data, const RegisterField &field)
+{
+    return *reinterpret_cast<const uint16_t *>(reinterpret_cast<const uint8_t *>(&data) + field.offset);
+}
+
+template <RegisterScale scale>
+inline float scaleRegister(uint16_t raw)
+{
+    if constexpr (scale == REG_SIGNED_DIV100)
+        return unsignedToSignedFloat(raw);
+    else if constexpr (scale == REG_SIGNED_DIV10)
+        return static_cast<float>(static_cast<int16_t>(raw)) / 10.0f;
+    else if constexpr (scale == REG_UNSIGNED_DIV100)
+        return static_cast<float>(raw) / 100.0f;
+    else if constexpr (scale == REG_UNSIGNED_DIV10)
+        return static_cast<float>(raw) / 10.0f;
+    else
+        return static_cast<float>(raw);
+}
+
+// Divisor of a scaled field, 1 for raw values: the published fixed-point value is field * divisor
+constexpr int32_t registerDivisor(RegisterScale scale)
+{
+    return scale == REG_SIGNED_DIV100 || scale == REG_UNSIGNED_DIV100 ? 100
+           : scale == REG_SIGNED_DIV10 || scale == REG_UNSIGNED_DIV10 ? 10
+                                                                      : 1;
+}
+
+// Decoder generated from the table at compile time: one straight-line,
+// bounds-checked block per field, with the scaling and the member type resolved
+template <bool Checked, size_t I = 0>
+inline size_t decodeRegisterFields(const uint8_t *data, size_t regCount, uint16_t startAddr, ChamberData *out)
+{
+    if constexpr (I == CHAMBER_REGISTER_COUNT)
+    {
+        return 0;
+    }
+    else
+    {
+        constexpr RegisterField field = CHAMBER_REGISTER_MAP[I];
+        size_t decoded = 0;
+        // Bounds check against what the slave actually returned
+        if (!Checked || (field.reg >= startAddr && (size_t)(field.reg - startAddr) < regCount))
+        {
+            const uint8_t *bytes = data + (field.reg - startAddr) * 2;
+            uint16_t raw = (uint16_t)((bytes[0] << 8) | bytes[1]);
+            if constexpr (field.kind == FIELD_FLOAT)
+                *registerFloat(*out, field) = scaleRegister<field.scale>(raw);
+            else if constexpr (field.scale == REG_BITFIELD)
+                *registerUint16(*out, field) = (uint16_t)((raw & field.mask) >> field.shift);
+            else
+                *registerUint16(*out, field) = raw;
+            if (Checked)
+                out->validMask |= 1UL << I;
+            decoded = 1;
+        }
+        return decoded + decodeRegisterFields<Checked, I + 1>(data, regCount, startAddr, out);
+    }
+}
+
+// Decode the fields covered by `byteCount` data bytes of registers from `startAddr`.
+// Fields outside the returned range are left untouched. Returns the number decoded.
+inline size_t decodeRegisters(const uint8_t *data, size_t byteCount, uint16_t startAddr, ChamberData *out)
+{
+    size_t regCount = byteCount / 2;
+    // Common case, the block covers the whole map: skip the per-field checks
+    if (startAddr <= CHAMBER_REGISTER_MIN && regCount > (size_t)(CHAMBER_REGISTER_MAX - startAddr))
+    {
+        out->validMask |= CHAMBER_REGISTER_ALL;
+        return decodeRegisterFields<false>(data, regCount, startAddr, out);
+    }
+    return decodeRegisterFields<true>(data, regCount, startAddr, out);
+}
+
+// Copy the fields decoded in `src` into `dst`, for slaves read in several blocks
+inline void mergeChamberFields(ChamberData &dst, const ChamberData &src)
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        if (!(src.validMask & (1UL << i)))
+        {
+            continue;
+        }
+        if (field.kind == FIELD_FLOAT)
+        {
+            *registerFloat(dst, field) = registerFloat(src, field);
+        }
+        else
+        {
+            *registerUint16(dst, field) = registerUint16(src, field);
+        }
+    }
+    dst.validMask |= src.validMask;
+}
+
+// Serializer side of the table: visit(field, value) for every decoded field,
+// value is a float or a uint16_t as declared in ChamberData
+template <typename Visitor>
+void visitChamberFields(const ChamberData &data, Visitor visit)
+{
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        if (!(data.validMask & (1UL << i)))
+        {
+            continue;
+        }
+        if (field.kind == FIELD_FLOAT)
+        {
+            visit(field, registerFloat(data, field));
+        }
+        else
+        {
+            visit(field, registerUint16(data, field));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include <Arduino.h>
+#include <atomic>
+#include "resourceGuard.h"
+
+// Updated by whichever task takes the lock, read by STATUS on the MQTT loop
+typedef struct {
+    std::atomic<uint32_t> locks;
+    std::atomic<uint32_t> contended;
+    std::atomic<uint32_t> totalWaitMs;
+    std::atomic<uint32_t> maxWaitMs;
+} ResourceWaitCounters;
+
+static SemaphoreHandle_t resourceMutexes[RESOURCE_COUNT];
+static ResourceWaitCounters resourceStats[RESOURCE_COUNT];
+
+void setupResourceGuards()
+{
+    for (size_t i = 0; i < RESOURCE_COUNT; i++)
+    {
+        resourceMutexes[i] = xSemaphoreCreateRecursiveMutex(); // Priority inheritance, unlike a binary semaphore
+    }
+}
+
+const char *resourceName(SharedResource resource)
+{
+    switch (resource)
+    {
+    case RESOURCE_RS485:
+        return "rs485";
+    case RESOURCE_HTTP:
+        return "http";
+    case RESOURCE_FLASH:
+        return "flash";
+    default:
+        return "unknown";
+    }
+}
+
+ResourceWaitStats resourceWaitStats(SharedResource resource)
+{
+    const ResourceWaitCounters &counters = resourceStats[resource];
+    ResourceWaitStats stats;
+    stats.locks = counters.locks.load(std::memory_order_relaxed);
+    stats.contended = counters.contended.load(std::memory_order_relaxed);
+    stats.totalWaitMs = counters.totalWaitMs.load(std::memory_order_relaxed);
+    stats.maxWaitMs = counters.maxWaitMs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+ResourceLock::ResourceLock(SharedResource resource) : resource(resource)
+{
+    uint32_t startMs = millis();
+    ResourceWaitCounters &stats = resourceStats[resource];
+    if (xSemaphoreTakeRecursive(resourceMutexes[resource], 0) != pdTRUE)
+    {
+        xSemaphoreTakeRecursive(resourceMutexes[resource], portMAX_DELAY);
+        uint32_t waitMs = millis() - startMs;
+        stats.contended.fetch_add(1, std::memory_order_relaxed);
+        stats.totalWaitMs.fetch_add(waitMs, std::memory_order_relaxed);
+        uint32_t maxWaitMs = stats.maxWaitMs.load(std::memory_order_relaxed);
+        while (waitMs > maxWaitMs && !stats.maxWaitMs.compare_exchange_weak(maxWaitMs, waitMs, std::memory_order_relaxed))
+        {
+        }
+    }
+    stats.locks.fetch_add(1, std::memory_order_relaxed);
+}
+
+ResourceLock::~ResourceLock()
+{
+    xSemaphoreGiveRecursive(resourceMutexes[resource]);
+}
@@ -0,0 +1,42 @@
+#ifndef RESOURCE_GUARD_H
+#define RESOURCE_GUARD_H
+
+#include <stdint.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+// Shared hardware and services, each with its own guard so one slow user
+// (an OTA download, a hung HTTP request) only blocks the users of that resource
+enum SharedResource : uint8_t {
+    RESOURCE_RS485, // Modbus bus and its UART
+    RESOURCE_HTTP,  // Backend HTTP calls (OTA, registration)
+    RESOURCE_FLASH, // OTA partition and LittleFS journal writes
+    RESOURCE_COUNT
+};
+
+typedef struct {
+    uint32_t locks;
+    uint32_t contended;   // Locks that had to wait for another task
+    uint32_t totalWaitMs; // Time spent waiting
+    uint32_t maxWaitMs;
+} ResourceWaitStats;
+
+void setupResourceGuards();
+const char *resourceName(SharedResource resource);
+ResourceWaitStats resourceWaitStats(SharedResource resource); // Snapshot, safe from any task
+
+// Scoped lock of one resource. The guards are recursive mutexes, so helpers
+// that call each other (OTACheck -> OTAUpdate) can each take the same one.
+class ResourceLock {
+public:
+    explicit ResourceLock(SharedResource resource);
+    ~ResourceLock();
+
+    ResourceLock(const ResourceLock &) = delete;
+    ResourceLock &operator=(const ResourceLock &) = delete;
+
+private:
+    SharedResource resource;
+};
+
+#endif
@@ -0,0 +1,211 @@
+#include <math.h>
+#include <string.h>
+#include "sampleAggregator.h"
+#include "jsonText.h"
+
+float runningStddev(const RunningStats &stats)
+{
+    return stats.count > 1 ? (float)sqrt(stats.m2 / (stats.count - 1)) : 0.0f;
+}
+
+void SampleAggregator::begin(uint32_t windowMs)
+{
+    windowLength = windowMs;
+    memset(windows, 0, sizeof(windows));
+}
+
+SampleAggregator::Window *SampleAggregator::windowFor(uint8_t slaveAddr)
+{
+    Window *unused = nullptr;
+    for (size_t i = 0; i < AGGREGATE_MAX_SLAVES; i++)
+    {
+        if (windows[i].used && windows[i].summary.slaveAddr == slaveAddr)
+        {
+            return &windows[i];
+        }
+        if (!windows[i].used && unused == nullptr)
+        {
+            unused = &windows[i];
+        }
+    }
+    return unused;
+}
+
+// Hand out the window's summary if it holds anything, and empty it for the next one
+bool SampleAggregator::close(Window &window, SampleSummary *closed)
+{
+    SampleSummary &summary = window.summary;
+    bool filled = summary.samples || summary.missed;
+    if (filled)
+    {
+        *closed = summary;
+        aggregateStats.summaries++;
+    }
+    uint8_t slaveAddr = summary.slaveAddr;
+    memset(&summary, 0, sizeof(summary));
+    summary.slaveAddr = slaveAddr;
+    summary.windowMs = windowLength;
+    return filled;
+}
+
+AggregateOutcome SampleAggregator::add(const TimedSample &sample, SampleSummary *closed)
+{
+    uint32_t capturedMs = sample.capturedMs;
+    Window *window = windowLength ? windowFor(sample.data.slaveAddr) : nullptr;
+    if (window == nullptr)
+    {
+        aggregateStats.noSlot++;
+        return AGGREGATE_NO_SLOT;
+    }
+    AggregateOutcome outcome = AGGREGATE_FOLDED;
+    if (!window->used)
+    {
+        window->used = true;
+        window->startMs = capturedMs;
+        window->summary.slaveAddr = sample.data.slaveAddr;
+        window->summary.windowMs = windowLength;
+    }
+    else if ((int32_t)(capturedMs - window->startMs) < 0)
+    {
+        aggregateStats.late++; // Its window closed while it was queued
+    }
+    else if (capturedMs - window->startMs >= windowLength)
+    {
+        if (close(*window, closed))
+        {
+            outcome = AGGREGATE_CLOSED;
+        }
+        window->startMs += (capturedMs - window->startMs) / windowLength * windowLength; // Whole windows, empty ones skipped
+    }
+
+    SampleSummary &summary = window->summary;
+    if (!summary.samples && !summary.missed)
+    {
+        summary.timestamp = sample.timestamp;
+    }
+    if (sample.data.validMask == 0)
+    {
+        summary.missed++;
+        return outcome;
+    }
+    summary.samples++;
+    summary.validMask |= sample.data.validMask;
+    aggregateStats.samples++;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (!(sample.data.validMask & (1UL << i)))
+        {
+            continue;
+        }
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        float value = field.kind == FIELD_FLOAT ? registerFloat(sample.data, field) : registerUint16(sample.data, field);
+        addRunningStats(summary.fields[i], value);
+    }
+    return outcome;
+}
+
+bool SampleAggregator::expired(uint32_t nowMs, SampleSummary *closed)
+{
+    for (size_t i = 0; windowLength && i < AGGREGATE_MAX_SLAVES; i++)
+    {
+        Window &window = windows[i];
+        if (!window.used || nowMs - window.startMs < windowLength)
+        {
+            continue;
+        }
+        window.startMs += (nowMs - window.startMs) / windowLength * windowLength;
+        if (close(window, closed))
+        {
+            return true;
+        }
+        window.used = false; // A whole window without a sample: the slave is gone, free its slot
+    }
+    return false;
+}
+
+bool SampleAggregator::flush(SampleSummary *closed)
+{
+    for (size_t i = 0; i < AGGREGATE_MAX_SLAVES; i++)
+    {
+        Window &window = windows[i];
+        if (window.used && (window.summary.samples || window.summary.missed))
+        {
+            return close(window, closed);
+        }
+    }
+    return false;
+}
+
+size_t SampleAggregator::openWindows() const
+{
+    size_t open = 0;
+    for (size_t i = 0; i < AGGREGATE_MAX_SLAVES; i++)
+    {
+        open += windows[i].used;
+    }
+    return open;
+}
+
+// Digits after the point of a field's register value
+static int fieldDecimals(const RegisterField &field)
+{
+    int32_t divisor = registerDivisor(field.scale);
+    return divisor >= 100 ? 2 : divisor >= 10 ? 1 : 0;
+}
+
+size_t writeSummaryJson(const SampleSummary &summary, const char *client, char *out, size_t size)
+{
+    JsonText json(out, size);
+    json.append("{\"client\":\"%s\",\"slave\":%u", client, (unsigned)summary.slaveAddr);
+    if (summary.timestamp)
+    {
+        json.append(",\"ts\":%lu", (unsigned long)summary.timestamp);
+    }
+    json.append(",\"windowMs\":%lu,\"n\":%lu,\"missed\":%lu", (unsigned long)summary.windowMs,
+                (unsigned long)summary.samples, (unsigned long)summary.missed);
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        const RunningStats &stats = summary.fields[i];
+        if (!stats.count)
+        {
+            continue;
+        }
+        if (field.kind != FIELD_FLOAT)
+        {
+            json.append(",\"%s\":%u", field.key, (unsigned)stats.last);
+            continue;
+        }
+        // Mean and spread get two digits more than the register resolves
+        int decimals = fieldDecimals(field);
+        json.append(",\"%s\":{\"mean\":%.*f,\"sd\":%.*f,\"min\":%.*f,\"max\":%.*f}", field.key,
+                    decimals + 2, stats.mean, decimals + 2, (double)runningStddev(stats),
+                    decimals, (double)stats.min, decimals, (double)stats.max);
+    }
+    json.append("}");
+    return json.length();
+}
+
+void summaryMeans(const SampleSummary &summary, ChamberData *data)
+{
+    memset(data, 0, sizeof(*data));
+    data->slaveAddr = summary.slaveAddr;
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        const RunningStats &stats = summary.fields[i];
+        if (!stats.count)
+        {
+            continue;
+        }
+        if (field.kind == FIELD_FLOAT)
+        {
+            *registerFloat(*data, field) = (float)stats.mean;
+        }
+        else
+        {
+            *registerUint16(*data, field) = (uint16_t)stats.last;
+        }
+        data->validMask |= 1UL << i;
+    }
+}
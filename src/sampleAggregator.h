@@ -0,0 +1,124 @@
+#ifndef SAMPLE_AGGREGATOR_H
+#define SAMPLE_AGGREGATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+#include "registerMap.h"
+#include "sampleQueue.h"
+#include "pollConfig.h"
+
+#define AGGREGATE_MAX_SLAVES POLL_CONFIG_MAX_SLAVES
+#define AGGREGATE_MIN_WINDOW 1000         // Shortest window accepted, ms
+#define AGGREGATE_MAX_WINDOW 86400000UL  // Longest window accepted, ms
+#define SUMMARY_PAYLOAD_SIZE 768          // One encoded summary, every field present
+
+// Running statistics of one field, O(1) memory whatever the window length.
+// Welford's update keeps the variance accurate where sum/sum-of-squares
+// would cancel (a 23.45 degree reading moving by hundredths).
+typedef struct {
+    uint32_t count;
+    float min;
+    float max;
+    float last;
+    double mean;
+    double m2; // Sum of squared differences from the mean
+} RunningStats;
+
+inline void addRunningStats(RunningStats &stats, float value)
+{
+    if (stats.count == 0)
+    {
+        stats.min = stats.max = value;
+    }
+    else if (value < stats.min)
+    {
+        stats.min = value;
+    }
+    else if (value > stats.max)
+    {
+        stats.max = value;
+    }
+    stats.count++;
+    stats.last = value;
+    double delta = value - stats.mean;
+    stats.mean += delta / stats.count;
+    stats.m2 += delta * (value - stats.mean);
+}
+
+// Sample standard deviation, 0 below two values
+float runningStddev(const RunningStats &stats);
+
+// One slave's closed window
+typedef struct {
+    uint8_t slaveAddr;
+    uint32_t timestamp; // Unix time of the first sample, 0 if NTP was not synced
+    uint32_t windowMs;
+    uint32_t samples;   // Samples with at least one decoded field
+    uint32_t missed;    // Polls that decoded nothing (timeouts, errors)
+    uint32_t validMask; // Fields seen in the window, bit per CHAMBER_REGISTER_MAP entry
+    RunningStats fields[CHAMBER_REGISTER_COUNT]; // uint16 fields only use `last`
+} SampleSummary;
+
+typedef struct {
+    uint32_t samples;   // Samples folded into a window
+    uint32_t summaries; // Windows closed with something in them
+    uint32_t noSlot;    // Samples of a slave beyond AGGREGATE_MAX_SLAVES, left raw
+    uint32_t late;      // Captured before their slave's open window, folded into it
+} AggregateStats;
+
+enum AggregateOutcome : uint8_t {
+    AGGREGATE_FOLDED, // Sample added to its slave's window
+    AGGREGATE_CLOSED, // Sample started a new window, the previous one is in `closed`
+    AGGREGATE_NO_SLOT // More slaves than windows, the sample was not aggregated
+};
+
+// Tumbling-window aggregation per slave, on the capture clock (TimedSample::capturedMs),
+// so samples that waited in the queue still land in the window they were polled in.
+// Each slave's windows follow a fixed grid from its first sample, so a late sample
+// or a missed poll does not make the windows drift. A window closes on the first
+// sample past its end or, if the slave went quiet, on the first expired() call past
+// its end.
+class SampleAggregator {
+public:
+    // 0 disables aggregation. Open windows are dropped, flush() them first.
+    void begin(uint32_t windowMs);
+    uint32_t window() const { return windowLength; }
+
+    AggregateOutcome add(const TimedSample &sample, SampleSummary *closed);
+
+    // Close one window past its end. Returns false when none is left. Call it
+    // after adding what was queued: a sample captured before `nowMs` that
+    // arrives after its window closed is only counted as late.
+    bool expired(uint32_t nowMs, SampleSummary *closed);
+
+    // Close one open window early, for a window change. Returns false when none is left.
+    bool flush(SampleSummary *closed);
+
+    size_t openWindows() const;
+    const AggregateStats &stats() const { return aggregateStats; }
+
+private:
+    typedef struct {
+        SampleSummary summary;
+        uint32_t startMs;
+        bool used;
+    } Window;
+
+    Window *windowFor(uint8_t slaveAddr);
+    bool close(Window &window, SampleSummary *closed);
+
+    Window windows[AGGREGATE_MAX_SLAVES];
+    uint32_t windowLength = 0;
+    AggregateStats aggregateStats = {};
+};
+
+// JSON summary: client, slave, ts (if known), windowMs, n, missed, then per
+// field {"mean","sd","min","max"} for scaled fields and the last value for
+// raw ones (nowSTS). Returns the length, 0 if `out` is too small.
+size_t writeSummaryJson(const SampleSummary &summary, const char *client, char *out, size_t size);
+
+// Mean of each field (last value of raw ones) as a sample, what the journal keeps of an unsent summary
+void summaryMeans(const SampleSummary &summary, ChamberData *data);
+
+#endif
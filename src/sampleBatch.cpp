@@ -0,0 +1,109 @@
+#include "sampleBatch.h"
+#include <string.h>
+
+void SampleBatch::begin(const BatchPolicy &newPolicy, BatchFraming newFraming)
+{
+    policy = newPolicy;
+    if (policy.maxSamples == 0)
+    {
+        policy.maxSamples = 1;
+    }
+    if (policy.maxBytes > SAMPLE_BATCH_CAPACITY)
+    {
+        policy.maxBytes = SAMPLE_BATCH_CAPACITY;
+    }
+    framing = newFraming;
+    memset(&batchStats, 0, sizeof(batchStats));
+    clear();
+}
+
+// Message size once wrapped: array header (and brackets) around the samples
+size_t SampleBatch::framedLength(size_t samplesLength, size_t sampleCount) const
+{
+    if (policy.maxSamples == 1)
+    {
+        return samplesLength;
+    }
+    if (framing == BATCH_JSON_ARRAY)
+    {
+        return samplesLength + 2;
+    }
+    return samplesLength + (sampleCount <= 15 ? 1 : 3);
+}
+
+bool SampleBatch::add(const uint8_t *payload, size_t length, uint32_t nowMs)
+{
+    if (length == 0 || full())
+    {
+        return false;
+    }
+    size_t separator = (framing == BATCH_JSON_ARRAY && count > 0) ? 1 : 0;
+    if (framedLength(used + separator + length, count + 1) > policy.maxBytes)
+    {
+        return false;
+    }
+
+    uint8_t *end = buffer + SAMPLE_BATCH_HEADROOM + used;
+    if (separator)
+    {
+        *end++ = ',';
+    }
+    memcpy(end, payload, length);
+    used += separator + length;
+    if (count++ == 0)
+    {
+        firstMs = nowMs;
+    }
+    return true;
+}
+
+const uint8_t *SampleBatch::message(size_t *length)
+{
+    uint8_t *samples = buffer + SAMPLE_BATCH_HEADROOM;
+    if (count == 0)
+    {
+        *length = 0;
+        return samples;
+    }
+    if (policy.maxSamples == 1)
+    {
+        *length = used;
+        return samples;
+    }
+    if (framing == BATCH_JSON_ARRAY)
+    {
+        samples[-1] = '[';
+        samples[used] = ']';
+        *length = used + 2;
+        return samples - 1;
+    }
+    if (count <= 15)
+    {
+        samples[-1] = (uint8_t)(0x90 | count);
+        *length = used + 1;
+        return samples - 1;
+    }
+    samples[-3] = 0xDC; // array16
+    samples[-2] = (uint8_t)(count >> 8);
+    samples[-1] = (uint8_t)count;
+    *length = used + 3;
+    return samples - 3;
+}
+
+void SampleBatch::sent(BatchFlushReason reason)
+{
+    batchStats.messages++;
+    batchStats.samples += count;
+    if (count > batchStats.maxSamplesPerMessage)
+    {
+        batchStats.maxSamplesPerMessage = count;
+    }
+    batchStats.flushes[reason]++;
+    clear();
+}
+
+void SampleBatch::clear()
+{
+    used = 0;
+    count = 0;
+}
@@ -0,0 +1,75 @@
+#ifndef SAMPLE_BATCH_H
+#define SAMPLE_BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SAMPLE_BATCH_CAPACITY 1024 // Bytes of encoded samples held, matches MQTT_MAX_PACKET_SIZE
+#define SAMPLE_BATCH_HEADROOM 3    // Room in front of the samples for the array header
+
+// How a batch of encoded samples is wrapped into one message
+enum BatchFraming : uint8_t {
+    BATCH_JSON_ARRAY,   // [sample,sample,...]
+    BATCH_MSGPACK_ARRAY // fixarray/array16 header followed by the samples
+};
+
+enum BatchFlushReason : uint8_t {
+    FLUSH_COUNT, // maxSamples reached
+    FLUSH_AGE,   // Oldest sample reached maxAgeMs
+    FLUSH_BYTES, // Next sample would not fit in maxBytes
+    FLUSH_REASON_COUNT
+};
+
+typedef struct {
+    uint16_t maxSamples; // Flush once this many samples are held, 1 publishes every sample on its own
+    uint32_t maxAgeMs;   // Flush once the oldest held sample is this old
+    size_t maxBytes;     // Largest message, framing included
+} BatchPolicy;
+
+// Broker-side view of the batching, reported by the STATUS command
+typedef struct {
+    uint32_t messages;             // Messages published
+    uint32_t samples;              // Samples carried by those messages
+    uint32_t maxSamplesPerMessage;
+    uint32_t flushes[FLUSH_REASON_COUNT];
+} BatchStats;
+
+// Packs already encoded samples into one message. Samples are appended in
+// place behind a few bytes of headroom, so wrapping them in an array at flush
+// time writes the header in front instead of moving the payload.
+// With maxSamples = 1 the sample is handed back unwrapped.
+class SampleBatch {
+public:
+    void begin(const BatchPolicy &policy, BatchFraming framing);
+
+    // False if the sample would push the message past maxBytes; flush and retry.
+    // A sample that does not fit an empty batch never will.
+    bool add(const uint8_t *payload, size_t length, uint32_t nowMs);
+
+    bool full() const { return count >= policy.maxSamples; }
+    bool expired(uint32_t nowMs) const { return count > 0 && nowMs - firstMs >= policy.maxAgeMs; }
+    size_t samples() const { return count; }
+
+    // Wrap the held samples into the message to publish, valid until the next add()
+    const uint8_t *message(size_t *length);
+
+    // The message was published: count it and start an empty batch
+    void sent(BatchFlushReason reason);
+    void clear();
+
+    const BatchStats &stats() const { return batchStats; }
+    const BatchPolicy &batchPolicy() const { return policy; }
+
+private:
+    size_t framedLength(size_t samplesLength, size_t sampleCount) const;
+
+    uint8_t buffer[SAMPLE_BATCH_HEADROOM + SAMPLE_BATCH_CAPACITY + 1]; // + JSON closing bracket
+    size_t used = 0; // Sample bytes behind the headroom, separators included
+    size_t count = 0;
+    uint32_t firstMs = 0;
+    BatchPolicy policy = {1, 0, SAMPLE_BATCH_CAPACITY};
+    BatchFraming framing = BATCH_JSON_ARRAY;
+    BatchStats batchStats = {};
+};
+
+#endif
@@ -0,0 +1,384 @@
+#include "sampleJournal.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "crc16.h"
+
+#define JOURNAL_MAGIC 0x4A52 // "JR"
+#define JOURNAL_VERSION 2
+#define JOURNAL_CURSOR "cursor"
+#define JOURNAL_SEGMENT_SUFFIX ".seg"
+
+typedef struct {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t ackedSeq;
+    uint16_t reserved;
+    uint16_t crc; // CRC-16/Modbus of the fields above
+} JournalCursor;
+
+typedef struct {
+    JournalRecord record;
+    uint16_t magic;
+    uint16_t crc; // CRC-16/Modbus of `record`
+} JournalSlot;
+
+// First sequence number of a segment file name ("0000002a.seg"), 0 if it is not one
+static uint32_t segmentSeq(const char *name)
+{
+    char *end;
+    unsigned long seq = strtoul(name, &end, 16);
+    return end == name + 8 && strcmp(end, JOURNAL_SEGMENT_SUFFIX) == 0 ? (uint32_t)seq : 0;
+}
+
+bool SampleJournal::begin(const char *dir, uint32_t slotCount, uint32_t segmentRecords)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    opened = false;
+    tail = nullptr;
+    tailRecords = 0;
+    segmentCount = 0;
+    perSegment = segmentRecords;
+    // One segment more than the slots need: the oldest is dropped whole
+    maxSegments = (slotCount + perSegment - 1) / perSegment + 1;
+    if (maxSegments > JOURNAL_MAX_SEGMENTS)
+    {
+        maxSegments = JOURNAL_MAX_SEGMENTS;
+    }
+    nextSeq = 1;
+    ackedSeq = 0;
+    droppedCount = 0;
+    if (strlen(dir) + 14 > sizeof(directory))
+    {
+        return false;
+    }
+    strcpy(directory, dir);
+    mkdir(directory, 0755);
+
+    DIR *listing = opendir(directory);
+    if (listing == nullptr)
+    {
+        return false;
+    }
+    // Segments sorted oldest first; beyond JOURNAL_MAX_SEGMENTS the oldest go
+    char path[64];
+    struct dirent *entry;
+    while ((entry = readdir(listing)) != nullptr)
+    {
+        uint32_t seq = segmentSeq(entry->d_name);
+        if (!seq)
+        {
+            continue;
+        }
+        if (segmentCount == JOURNAL_MAX_SEGMENTS)
+        {
+            uint32_t older = seq < segmentFirst[0] ? seq : segmentFirst[0];
+            segmentPath(older, path, sizeof(path));
+            remove(path);
+            if (older == seq)
+            {
+                continue;
+            }
+            memmove(segmentFirst, segmentFirst + 1, --segmentCount * sizeof(segmentFirst[0]));
+        }
+        uint32_t at = segmentCount++;
+        for (; at && segmentFirst[at - 1] > seq; at--)
+        {
+            segmentFirst[at] = segmentFirst[at - 1];
+        }
+        segmentFirst[at] = seq;
+    }
+    closedir(listing);
+
+    if (!readCursor())
+    {
+        // Lost or torn cursor: replay everything still on flash rather than lose it
+        ackedSeq = segmentCount ? segmentFirst[0] - 1 : 0;
+    }
+    resumeTail();
+    if (nextSeq <= ackedSeq)
+    {
+        nextSeq = ackedSeq + 1;
+    }
+    while (segmentCount > maxSegments)
+    {
+        removeOldest();
+    }
+    opened = true;
+    return true;
+}
+
+// Find where the newest segment ends and keep appending to it if it is intact and has room
+void SampleJournal::resumeTail()
+{
+    while (segmentCount)
+    {
+        uint32_t first = segmentFirst[segmentCount - 1];
+        char path[64];
+        segmentPath(first, path, sizeof(path));
+        FILE *segment = fopen(path, "r+b");
+        uint32_t valid = 0;
+        JournalRecord record;
+        while (segment != nullptr && readSlot(segment, valid, &record) && record.seq == first + valid)
+        {
+            valid++;
+        }
+        if (valid)
+        {
+            nextSeq = first + valid;
+            fseek(segment, 0, SEEK_END);
+            if (valid < perSegment && ftell(segment) == (long)(valid * sizeof(JournalSlot)))
+            {
+                tail = segment;
+                tailRecords = valid;
+            }
+            else
+            {
+                fclose(segment); // Full, or ends in a torn slot: the next append starts a new segment
+            }
+            return;
+        }
+        // Not one record made it: the next segment will start at this number again
+        if (segment != nullptr)
+        {
+            fclose(segment);
+        }
+        remove(path);
+        segmentCount--;
+        nextSeq = first;
+    }
+}
+
+void SampleJournal::end()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (tail != nullptr)
+    {
+        fclose(tail);
+        tail = nullptr;
+    }
+    opened = false;
+}
+
+bool SampleJournal::append(const ChamberData &data, uint32_t timestamp)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!opened)
+    {
+        return false;
+    }
+    if ((tail == nullptr || tailRecords == perSegment) && !openSegment(nextSeq))
+    {
+        return false;
+    }
+
+    JournalSlot slot;
+    memset(&slot, 0, sizeof(slot));
+    slot.record.seq = nextSeq;
+    slot.record.timestamp = timestamp;
+    slot.record.data = data;
+    slot.magic = JOURNAL_MAGIC;
+    slot.crc = crc16Modbus((const uint8_t *)&slot.record, sizeof(slot.record));
+
+    // Always at the end of the file, whatever peek() read from it last
+    if (fseek(tail, 0, SEEK_END) != 0 || fwrite(&slot, sizeof(slot), 1, tail) != 1)
+    {
+        fclose(tail); // The next append starts a new segment after the last good one
+        tail = nullptr;
+        if (!tailRecords)
+        {
+            char path[64];
+            segmentPath(segmentFirst[--segmentCount], path, sizeof(path));
+            remove(path); // Nothing in it, and the next one takes its name
+        }
+        return false;
+    }
+    fflush(tail);
+    fsync(fileno(tail));
+    tailRecords++;
+    nextSeq++;
+    return true;
+}
+
+size_t SampleJournal::peek(JournalRecord *out, size_t max)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!opened)
+    {
+        return 0;
+    }
+
+    uint32_t seq = ackedSeq + 1;
+    size_t count = 0;
+    for (uint32_t index = 0; index < segmentCount && count < max; index++)
+    {
+        uint32_t end = segmentEnd(index);
+        if (end <= seq)
+        {
+            continue;
+        }
+        if (seq < segmentFirst[index])
+        {
+            seq = segmentFirst[index]; // Older records were in a dropped segment
+        }
+        bool isTail = tail != nullptr && index == segmentCount - 1;
+        FILE *segment = tail;
+        if (!isTail)
+        {
+            char path[64];
+            segmentPath(segmentFirst[index], path, sizeof(path));
+            segment = fopen(path, "rb");
+        }
+        for (; segment != nullptr && seq < end && count < max; seq++)
+        {
+            if (readSlot(segment, seq - segmentFirst[index], &out[count]) && out[count].seq == seq)
+            {
+                count++;
+            }
+        }
+        if (!isTail && segment != nullptr)
+        {
+            fclose(segment);
+        }
+    }
+    return count;
+}
+
+bool SampleJournal::ack(uint32_t seq)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!opened || seq <= ackedSeq)
+    {
+        return false;
+    }
+    ackedSeq = seq < nextSeq ? seq : nextSeq - 1;
+    // Delivered segments go, except the one still being appended to
+    while (segmentCount > (tail != nullptr ? 1u : 0u) && segmentEnd(0) <= ackedSeq + 1)
+    {
+        removeOldest();
+    }
+    return writeCursor();
+}
+
+uint32_t SampleJournal::pending()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    uint32_t from = ackedSeq + 1;
+    if (segmentCount && segmentFirst[0] > from)
+    {
+        from = segmentFirst[0];
+    }
+    return nextSeq > from ? nextSeq - from : 0;
+}
+
+bool SampleJournal::openSegment(uint32_t firstSeq)
+{
+    if (tail != nullptr)
+    {
+        fclose(tail);
+        tail = nullptr;
+    }
+    while (segmentCount >= maxSegments)
+    {
+        removeOldest();
+    }
+    char path[64];
+    segmentPath(firstSeq, path, sizeof(path));
+    tail = fopen(path, "w+b");
+    if (tail == nullptr)
+    {
+        return false;
+    }
+    segmentFirst[segmentCount++] = firstSeq;
+    tailRecords = 0;
+    return true;
+}
+
+// Delete the oldest segment, counting what it held that was never delivered
+void SampleJournal::removeOldest()
+{
+    uint32_t from = ackedSeq + 1 > segmentFirst[0] ? ackedSeq + 1 : segmentFirst[0];
+    uint32_t end = segmentEnd(0);
+    if (end > from)
+    {
+        droppedCount += end - from;
+    }
+    if (segmentCount == 1 && tail != nullptr)
+    {
+        fclose(tail);
+        tail = nullptr;
+    }
+    char path[64];
+    segmentPath(segmentFirst[0], path, sizeof(path));
+    remove(path);
+    memmove(segmentFirst, segmentFirst + 1, --segmentCount * sizeof(segmentFirst[0]));
+}
+
+bool SampleJournal::readCursor()
+{
+    char path[64];
+    snprintf(path, sizeof(path), "%s/" JOURNAL_CURSOR, directory);
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    JournalCursor cursor;
+    bool valid = fread(&cursor, sizeof(cursor), 1, file) == 1 && cursor.magic == JOURNAL_MAGIC &&
+                 cursor.version == JOURNAL_VERSION &&
+                 cursor.crc == crc16Modbus((const uint8_t *)&cursor, offsetof(JournalCursor, crc));
+    fclose(file);
+    if (valid)
+    {
+        ackedSeq = cursor.ackedSeq;
+    }
+    return valid;
+}
+
+// Rewritten whole on each ack; a file this small stays inline in LittleFS metadata
+bool SampleJournal::writeCursor()
+{
+    JournalCursor cursor = {JOURNAL_MAGIC, JOURNAL_VERSION, ackedSeq, 0, 0};
+    cursor.crc = crc16Modbus((const uint8_t *)&cursor, offsetof(JournalCursor, crc));
+    char path[64];
+    snprintf(path, sizeof(path), "%s/" JOURNAL_CURSOR, directory);
+    FILE *file = fopen(path, "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    bool written = fwrite(&cursor, sizeof(cursor), 1, file) == 1;
+    fflush(file);
+    fsync(fileno(file));
+    fclose(file);
+    return written;
+}
+
+void SampleJournal::segmentPath(uint32_t firstSeq, char *path, size_t size) const
+{
+    snprintf(path, size, "%s/%08x" JOURNAL_SEGMENT_SUFFIX, directory, (unsigned)firstSeq);
+}
+
+uint32_t SampleJournal::segmentEnd(uint32_t index) const
+{
+    return index + 1 < segmentCount ? segmentFirst[index + 1] : nextSeq;
+}
+
+bool SampleJournal::readSlot(FILE *segment, uint32_t slot, JournalRecord *record)
+{
+    JournalSlot stored;
+    if (fseek(segment, (long)(slot * sizeof(JournalSlot)), SEEK_SET) != 0 ||
+        fread(&stored, sizeof(stored), 1, segment) != 1)
+    {
+        return false; // Past the end of the segment
+    }
+    if (stored.magic != JOURNAL_MAGIC ||
+        stored.crc != crc16Modbus((const uint8_t *)&stored.record, sizeof(stored.record)))
+    {
+        return false; // Torn slot
+    }
+    *record = stored.record;
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef SAMPLE_JOURNAL_H
+#define SAMPLE_JOURNAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <mutex>
+#include "modbusHelper.h"
+
+// A sample held back while the broker is unreachable
+typedef struct {
+    uint32_t seq;       // Monotonic append number
+    uint32_t timestamp; // Unix time of the sample (0 if NTP was not synced yet)
+    ChamberData data;
+} JournalRecord;
+
+#ifndef JOURNAL_SEGMENT_RECORDS
+#define JOURNAL_SEGMENT_RECORDS 92 // Slots per segment file: 92 x 44 B fill one 4 KB LittleFS block
+#endif
+#define JOURNAL_MAX_SEGMENTS 64
+
+// Append-only store-and-forward journal in a directory, on LittleFS on the
+// device and a plain directory on the host. Records go to segment files of
+// fixed-size slots, named by their first sequence number, and a write only
+// ever appends to the newest one: LittleFS rewrites a file from the first
+// changed block to its end, so nothing is updated in place. Each slot carries
+// its own sequence number and CRC, so a torn write only loses that one record.
+// The replay cursor is kept in a small file of its own and advances once per
+// delivered batch; segments that were fully delivered are deleted. When the
+// journal is full the oldest segment is dropped, delivered or not.
+class SampleJournal {
+public:
+    // Holds at least `slotCount` samples, in segments of `segmentRecords`
+    bool begin(const char *dir, uint32_t slotCount, uint32_t segmentRecords = JOURNAL_SEGMENT_RECORDS);
+    void end();
+
+    bool append(const ChamberData &data, uint32_t timestamp);
+
+    // Copy up to `max` of the oldest undelivered records, returns how many
+    size_t peek(JournalRecord *out, size_t max);
+
+    // Mark every record up to and including `seq` as delivered
+    bool ack(uint32_t seq);
+
+    uint32_t pending();
+    uint32_t dropped() const { return droppedCount; }
+    uint32_t segments() const { return segmentCount; }
+    bool isOpen() const { return opened; }
+
+private:
+    bool readCursor();
+    bool writeCursor();
+    bool openSegment(uint32_t firstSeq);
+    void removeOldest();
+    void resumeTail();
+    void segmentPath(uint32_t firstSeq, char *path, size_t size) const;
+    uint32_t segmentEnd(uint32_t index) const; // One past the last sequence number in segment `index`
+    bool readSlot(FILE *segment, uint32_t slot, JournalRecord *record);
+
+    bool opened = false;
+    char directory[48] = "";
+    FILE *tail = nullptr;   // Newest segment while it has room, appended to
+    uint32_t tailRecords = 0;
+    uint32_t segmentFirst[JOURNAL_MAX_SEGMENTS]; // First sequence number of each segment, oldest first
+    uint32_t segmentCount = 0;
+    uint32_t maxSegments = 0;
+    uint32_t perSegment = 0;
+    uint32_t nextSeq = 1;  // Sequence number of the next append
+    uint32_t ackedSeq = 0; // Everything up to here was delivered
+    uint32_t droppedCount = 0;
+    std::mutex lock; // append() runs on the Modbus task, replay on the MQTT loop
+};
+
+#endif
@@ -0,0 +1,113 @@
+#include <string.h>
+#include <math.h>
+#include <type_traits>
+#include "samplePack.h"
+#include "registerMap.h"
+#include "msgPack.h"
+
+size_t packSample(const ChamberData &data, const SampleMeta &meta, uint8_t *out, size_t outSize)
+{
+    size_t entries = 2 + (meta.timestamp ? 1 : 0) + (meta.replay ? 1 : 0);
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (data.validMask & (1UL << i))
+        {
+            entries++;
+        }
+    }
+
+    MsgPackWriter writer(out, outSize);
+    writer.mapHeader(entries);
+    writer.str("c");
+    if (meta.deviceIndex >= 0)
+    {
+        writer.uint((uint32_t)meta.deviceIndex);
+    }
+    else
+    {
+        writer.str(meta.client);
+    }
+    writer.str("s");
+    writer.uint(data.slaveAddr);
+    if (meta.timestamp)
+    {
+        writer.str("t");
+        writer.uint(meta.timestamp);
+    }
+    if (meta.replay)
+    {
+        writer.str("r");
+        writer.boolean(true);
+    }
+
+    // Floats go back to the controller's fixed-point integer, exact for every register value
+    visitChamberFields(data, [&](const RegisterField &field, auto value)
+                       {
+        writer.uint(field.reg);
+        if constexpr (std::is_same_v<decltype(value), float>)
+            writer.integer((int32_t)lroundf(value * registerDivisor(field.scale)));
+        else
+            writer.uint(value); });
+
+    return writer.length();
+}
+
+size_t packSummary(const SampleSummary &summary, const SampleMeta &meta, uint8_t *out, size_t outSize)
+{
+    size_t entries = 5 + (meta.timestamp ? 1 : 0);
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        if (summary.fields[i].count)
+        {
+            entries++;
+        }
+    }
+
+    MsgPackWriter writer(out, outSize);
+    writer.mapHeader(entries);
+    writer.str("c");
+    if (meta.deviceIndex >= 0)
+    {
+        writer.uint((uint32_t)meta.deviceIndex);
+    }
+    else
+    {
+        writer.str(meta.client);
+    }
+    writer.str("s");
+    writer.uint(summary.slaveAddr);
+    if (meta.timestamp)
+    {
+        writer.str("t");
+        writer.uint(meta.timestamp);
+    }
+    writer.str("w");
+    writer.uint(summary.windowMs);
+    writer.str("n");
+    writer.uint(summary.samples);
+    writer.str("m");
+    writer.uint(summary.missed);
+
+    for (size_t i = 0; i < CHAMBER_REGISTER_COUNT; i++)
+    {
+        const RegisterField &field = CHAMBER_REGISTER_MAP[i];
+        const RunningStats &stats = summary.fields[i];
+        if (!stats.count)
+        {
+            continue;
+        }
+        writer.uint(field.reg);
+        if (field.kind != FIELD_FLOAT)
+        {
+            writer.uint((uint32_t)stats.last);
+            continue;
+        }
+        int32_t divisor = registerDivisor(field.scale);
+        writer.arrayHeader(4);
+        writer.float32((float)stats.mean);
+        writer.float32(runningStddev(stats));
+        writer.integer((int32_t)lroundf(stats.min * divisor));
+        writer.integer((int32_t)lroundf(stats.max * divisor));
+    }
+    return writer.length();
+}
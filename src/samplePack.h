@@ -0,0 +1,47 @@
+#ifndef SAMPLE_PACK_H
+#define SAMPLE_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "modbusHelper.h"
+#include "sampleAggregator.h"
+
+// Payload encoding of published samples, select with -DPAYLOAD_ENCODING=<n>
+#define PAYLOAD_JSON 0    // ArduinoJson document, field names as keys, float values
+#define PAYLOAD_MSGPACK 1 // MessagePack map, register addresses as keys, fixed-point integers
+
+#ifndef PAYLOAD_ENCODING
+#define PAYLOAD_ENCODING PAYLOAD_JSON
+#endif
+
+// Binary samples go to <data topic>/mp so consumers can tell the encodings apart
+#define PAYLOAD_MSGPACK_TOPIC_SUFFIX "/mp"
+
+// Sample envelope shared by every encoding
+typedef struct {
+    const char *client;  // Board ID, sent when deviceIndex < 0
+    int32_t deviceIndex; // Numeric device index replacing the board ID, -1 if not assigned
+    uint32_t timestamp;  // Unix time, 0 if not synced (omitted)
+    bool replay;         // Sample comes from the offline journal
+} SampleMeta;
+
+// MessagePack map of one sample:
+//   "c": device index (uint) or board ID (str)
+//   "s": slave address
+//   "t": timestamp (only if known)
+//   "r": true (only for replayed samples)
+//   <register address>: register value as an integer, scaled fields times
+//                       their divisor (tempPV 23.45 -> 2345), see registerMap.h
+// Only decoded fields are sent. Returns the payload length, 0 if `out` is too small.
+size_t packSample(const ChamberData &data, const SampleMeta &meta, uint8_t *out, size_t outSize);
+
+// MessagePack map of one window summary (see sampleAggregator.h):
+//   "c", "s", "t": as in a sample, "t" is the time of the first sample
+//   "w": window length in ms
+//   "n": samples aggregated, "m": polls that decoded nothing
+//   <register address>: [mean, sd, min, max] for scaled fields, mean and sd as
+//                       float32 in field units, min and max fixed-point like a
+//                       sample; the last value for raw fields
+size_t packSummary(const SampleSummary &summary, const SampleMeta &meta, uint8_t *out, size_t outSize);
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef SAMPLE_QUEUE_H
+#define SAMPLE_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <atomic>
+#include <type_traits>
+#include "modbusHelper.h"
+
+// A sample stamped on the task that acquired it
+typedef struct {
+    ChamberData data;
+    uint32_t timestamp;  // Unix time, 0 if NTP was not synced yet
+    uint32_t capturedMs; // millis() when it was polled, however long it then waits in the queue
+} TimedSample;
+
+// What the producer does when the queue is full, select with -DSAMPLE_QUEUE_POLICY=<n>
+#define QUEUE_DROP_OLDEST 0 // Discard the oldest queued sample to make room
+#define QUEUE_DROP_NEWEST 1 // Discard the new sample
+#define QUEUE_SPILL 2       // Discard the new sample; the consumer moves a backlog to the offline journal
+
+#ifndef SAMPLE_QUEUE_POLICY
+#define SAMPLE_QUEUE_POLICY QUEUE_DROP_NEWEST
+#endif
+
+typedef struct {
+    uint32_t pushed;        // Samples queued
+    uint32_t overflows;     // Pushes that found the queue full
+    uint32_t droppedOldest;
+    uint32_t droppedNewest;
+    uint32_t spilled;       // Journaled by the consumer instead of published
+    uint32_t highWater;     // Most samples queued at once
+} QueueStats;
+
+// Lock-free single-producer/single-consumer ring. Head is written only by the
+// producer and tail only by the consumer, except for dropOldest(), which lets
+// the producer claim the oldest slot; pop() takes its slot with a CAS on tail
+// and retries if the producer claimed it while it was being copied. A claimed
+// slot may be refilled during that copy, so slots are held as relaxed atomic
+// words: the torn copy that gets thrown away is not a data race.
+template <typename T, size_t N>
+class SpscQueue {
+    static_assert(N && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+    static_assert(std::is_trivially_copyable<T>::value, "SpscQueue items are copied word by word");
+
+public:
+    // Producer side. False if the queue is full.
+    bool push(const T &item)
+    {
+        size_t head = headIndex.load(std::memory_order_relaxed);
+        if (head - tailIndex.load(std::memory_order_acquire) >= N)
+        {
+            return false;
+        }
+        store(head & (N - 1), item);
+        headIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side, discard the oldest item. False if the consumer took it first.
+    bool dropOldest()
+    {
+        size_t tail = tailIndex.load(std::memory_order_acquire);
+        if (tail == headIndex.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        return tailIndex.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel);
+    }
+
+    // Consumer side. False if the queue is empty.
+    bool pop(T *out)
+    {
+        size_t tail = tailIndex.load(std::memory_order_acquire);
+        while (tail != headIndex.load(std::memory_order_acquire))
+        {
+            load(tail & (N - 1), out);
+            // A failed CAS means the producer dropped this slot (and may be refilling it): discard the copy
+            if (tailIndex.compare_exchange_weak(tail, tail + 1, std::memory_order_acq_rel))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const
+    {
+        size_t tail = tailIndex.load(std::memory_order_acquire);
+        return headIndex.load(std::memory_order_acquire) - tail;
+    }
+    static constexpr size_t capacity() { return N; }
+
+private:
+    static constexpr size_t WORDS = (sizeof(T) + 3) / 4;
+
+    void store(size_t slot, const T &item)
+    {
+        uint32_t words[WORDS] = {};
+        memcpy(words, &item, sizeof(T));
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            slots[slot][i].store(words[i], std::memory_order_relaxed);
+        }
+    }
+
+    void load(size_t slot, T *out) const
+    {
+        uint32_t words[WORDS];
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            words[i] = slots[slot][i].load(std::memory_order_relaxed);
+        }
+        memcpy(out, words, sizeof(T));
+    }
+
+    std::atomic<uint32_t> slots[N][WORDS];
+    std::atomic<size_t> headIndex{0}; // Next slot to fill
+    std::atomic<size_t> tailIndex{0}; // Oldest filled slot
+};
+
+#endif
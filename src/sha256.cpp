@@ -0,0 +1,68 @@
+#include <string.h>
+#include <mbedtls/version.h>
+#include "sha256.h"
+
+// mbedtls 3 (ESP-IDF 5) dropped the _ret suffix of the 2.x calls (ESP-IDF 4)
+#if MBEDTLS_VERSION_MAJOR >= 3
+#define sha256Starts mbedtls_sha256_starts
+#define sha256Update mbedtls_sha256_update
+#define sha256Finish mbedtls_sha256_finish
+#else
+#define sha256Starts mbedtls_sha256_starts_ret
+#define sha256Update mbedtls_sha256_update_ret
+#define sha256Finish mbedtls_sha256_finish_ret
+#endif
+
+namespace
+{
+    int hexNibble(char c)
+    {
+        if (c >= '0' && c <= '9')
+            return c - '0';
+        if (c >= 'a' && c <= 'f')
+            return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F')
+            return c - 'A' + 10;
+        return -1;
+    }
+}
+
+Sha256::Sha256()
+{
+    mbedtls_sha256_init(&context);
+}
+
+Sha256::~Sha256()
+{
+    mbedtls_sha256_free(&context);
+}
+
+void Sha256::begin()
+{
+    sha256Starts(&context, 0); // 0: SHA-256, not SHA-224
+}
+
+void Sha256::update(const uint8_t *data, size_t len)
+{
+    sha256Update(&context, data, len);
+}
+
+void Sha256::finish(uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    sha256Finish(&context, digest);
+}
+
+bool parseSha256Hex(const char *hex, uint8_t digest[SHA256_DIGEST_SIZE])
+{
+    if (!hex || strlen(hex) != SHA256_DIGEST_SIZE * 2)
+        return false;
+    for (size_t i = 0; i < SHA256_DIGEST_SIZE; i++)
+    {
+        int high = hexNibble(hex[i * 2]);
+        int low = hexNibble(hex[i * 2 + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        digest[i] = (uint8_t)((high << 4) | low);
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mbedtls/sha256.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Streaming SHA-256, fed chunk by chunk as the firmware is written. A thin
+// wrapper over mbedtls, which the ESP32 core runs on the SHA accelerator.
+class Sha256 {
+public:
+    Sha256();
+    ~Sha256();
+    Sha256(const Sha256 &) = delete; // The hardware context cannot be copied byte for byte
+    Sha256 &operator=(const Sha256 &) = delete;
+
+    void begin();
+    void update(const uint8_t *data, size_t len);
+    void finish(uint8_t digest[SHA256_DIGEST_SIZE]);
+
+private:
+    mbedtls_sha256_context context;
+};
+
+// Parse a 64-character hex digest, as sent by the update server. False if malformed.
+bool parseSha256Hex(const char *hex, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+#endif
@@ -0,0 +1,236 @@
+#include <string.h>
+#include "taskProfiler.h"
+#include "jsonText.h"
+
+size_t TaskProfiler::slotOf(const TaskSnapshot &task)
+{
+    size_t free = PROFILER_MAX_TASKS;
+    for (size_t i = 0; i < PROFILER_MAX_TASKS; i++)
+    {
+        if (tasks[i].used && tasks[i].number == task.number)
+            return i;
+        if (!tasks[i].used && free == PROFILER_MAX_TASKS)
+            free = i;
+    }
+    if (free == PROFILER_MAX_TASKS)
+        return free;
+    // New task: its counter started at 0, which is what the older samples should read
+    for (size_t h = 0; h < PROFILER_HISTORY; h++)
+        runTimes[h][free] = 0;
+    TaskSlot &slot = tasks[free];
+    slot.used = true;
+    slot.number = task.number;
+    size_t i = 0;
+    for (; task.name && task.name[i] && i < PROFILER_NAME_LENGTH - 1; i++)
+        slot.name[i] = task.name[i] == '"' || task.name[i] == '\\' ? '_' : task.name[i]; // Written into JSON as is
+    slot.name[i] = '\0';
+    return free;
+}
+
+void TaskProfiler::record(uint32_t totalRunTime, const TaskSnapshot *snapshots, size_t count, const HeapSnapshot &heapSample)
+{
+    for (size_t i = 0; i < PROFILER_MAX_TASKS; i++)
+        tasks[i].seen = false;
+    uint32_t *sample = runTimes[head];
+    uint32_t untracked = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t index = slotOf(snapshots[i]);
+        if (index == PROFILER_MAX_TASKS)
+        {
+            untracked++;
+            continue;
+        }
+        TaskSlot &slot = tasks[index];
+        slot.seen = true;
+        slot.idle = snapshots[i].idle;
+        slot.core = snapshots[i].core;
+        slot.priority = snapshots[i].priority;
+        slot.stackFree = snapshots[i].stackFree;
+        sample[index] = snapshots[i].runTime;
+    }
+    // Deleted tasks free their slot
+    for (size_t i = 0; i < PROFILER_MAX_TASKS; i++)
+    {
+        if (!tasks[i].seen)
+        {
+            tasks[i].used = false;
+            sample[i] = 0;
+        }
+    }
+    totals[head] = totalRunTime;
+    head = (head + 1) % PROFILER_HISTORY;
+    if (filled < PROFILER_HISTORY)
+        filled++;
+
+    heap = heapSample;
+    profilerStats.samples++;
+    profilerStats.untracked = untracked;
+    if (profilerStats.samples == 1 || heap.largestBlock < profilerStats.minLargestBlock)
+        profilerStats.minLargestBlock = heap.largestBlock;
+    uint16_t fragmented = fragmentation();
+    if (fragmented > profilerStats.maxFragmentation)
+        profilerStats.maxFragmentation = fragmented;
+}
+
+void TaskProfiler::recordCost(uint32_t costUs)
+{
+    profilerStats.lastCostUs = costUs;
+    if (costUs > profilerStats.maxCostUs)
+        profilerStats.maxCostUs = costUs;
+}
+
+int32_t TaskProfiler::taskLoad(size_t slot, size_t window) const
+{
+    if (slot >= PROFILER_MAX_TASKS || !tasks[slot].used || filled < 2)
+        return -1;
+    size_t ago = PROFILER_WINDOWS[window] < filled - 1 ? PROFILER_WINDOWS[window] : filled - 1; // Shorter until the history fills
+    size_t newest = sampleAgo(0), oldest = sampleAgo(ago);
+    uint32_t elapsed = totals[newest] - totals[oldest]; // Both counters wrap, the differences do not
+    if (!elapsed)
+        return -1;
+    uint64_t load = (uint64_t)(runTimes[newest][slot] - runTimes[oldest][slot]) * 1000 / elapsed;
+    return load < 1000 ? (int32_t)load : 1000; // Over a core only by sampling skew
+}
+
+int32_t TaskProfiler::coreLoad(uint8_t core, size_t window) const
+{
+    for (size_t i = 0; i < PROFILER_MAX_TASKS; i++)
+    {
+        if (tasks[i].used && tasks[i].idle && tasks[i].core == core)
+        {
+            int32_t idle = taskLoad(i, window);
+            return idle < 0 ? -1 : 1000 - idle;
+        }
+    }
+    return -1;
+}
+
+uint16_t TaskProfiler::fragmentation() const
+{
+    if (!heap.freeBytes || heap.largestBlock >= heap.freeBytes)
+        return 0;
+    return (uint16_t)(1000 - (uint64_t)heap.largestBlock * 1000 / heap.freeBytes);
+}
+
+size_t TaskProfiler::busiest(size_t window, size_t *slots, size_t maxSlots) const
+{
+    size_t found = 0;
+    int32_t loads[PROFILER_MAX_TASKS];
+    for (size_t i = 0; i < PROFILER_MAX_TASKS; i++)
+    {
+        if (!tasks[i].used || tasks[i].idle)
+            continue;
+        int32_t load = taskLoad(i, window);
+        // Insertion into the sorted prefix, dropping what falls off the end
+        size_t at = found < maxSlots ? found : maxSlots;
+        while (at > 0 && loads[at - 1] < load)
+        {
+            if (at < maxSlots)
+            {
+                slots[at] = slots[at - 1];
+                loads[at] = loads[at - 1];
+            }
+            at--;
+        }
+        if (at < maxSlots)
+        {
+            slots[at] = i;
+            loads[at] = load;
+            if (found < maxSlots)
+                found++;
+        }
+    }
+    return found;
+}
+
+// Permille as percent with one decimal, null while unknown
+static void appendPercent(JsonText &json, const char *separator, int32_t permille)
+{
+    if (permille < 0)
+        json.append("%snull", separator);
+    else
+        json.append("%s%d.%d", separator, (int)(permille / 10), (int)(permille % 10));
+}
+
+size_t TaskProfiler::writeJson(char *out, size_t size) const
+{
+    JsonText json(out, size);
+    json.append("{\"samples\":%u,\"windowsMs\":[", (unsigned)profilerStats.samples);
+    for (size_t w = 0; w < PROFILER_WINDOW_COUNT; w++)
+        json.append(w ? ",%u" : "%u", (unsigned)(PROFILER_WINDOWS[w] * PROFILER_SAMPLE_MS));
+    json.append("],\"cores\":[");
+    for (uint8_t core = 0; core < PROFILER_CORES; core++)
+    {
+        json.append(core ? ",[" : "[");
+        for (size_t w = 0; w < PROFILER_WINDOW_COUNT; w++)
+            appendPercent(json, w ? "," : "", coreLoad(core, w));
+        json.append("]");
+    }
+    json.append("],\"tasks\":[");
+    size_t order[PROFILER_MAX_TASKS];
+    size_t listed = busiest(PROFILER_WINDOW_COUNT - 1, order, PROFILER_MAX_TASKS);
+    for (size_t i = 0; i < listed; i++)
+    {
+        const TaskSlot &task = tasks[order[i]];
+        json.append("%s{\"name\":\"%s\",\"core\":%d,\"priority\":%u,\"stackFree\":%u,\"cpu\":[",
+                    i ? "," : "", task.name, (int)task.core, (unsigned)task.priority, (unsigned)task.stackFree);
+        for (size_t w = 0; w < PROFILER_WINDOW_COUNT; w++)
+            appendPercent(json, w ? "," : "", taskLoad(order[i], w));
+        json.append("]}");
+    }
+    json.append("],\"heap\":{\"free\":%u,\"largestBlock\":%u,\"minLargestBlock\":%u,\"fragmentation\":",
+                (unsigned)heap.freeBytes, (unsigned)heap.largestBlock, (unsigned)profilerStats.minLargestBlock);
+    appendPercent(json, "", fragmentation());
+    appendPercent(json, ",\"maxFragmentation\":", profilerStats.maxFragmentation);
+    json.append("},\"untracked\":%u,\"costUs\":{\"last\":%u,\"max\":%u}}",
+                (unsigned)profilerStats.untracked, (unsigned)profilerStats.lastCostUs, (unsigned)profilerStats.maxCostUs);
+    return json.length();
+}
+
+#ifndef NATIVE_BUILD
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_heap_caps.h>
+
+#define PROFILER_STATUS_SLACK 8 // Extra entries, so a task list longer than the tracked tasks still comes back
+
+void sampleTaskProfiler(TaskProfiler &profiler)
+{
+    static TaskStatus_t statuses[PROFILER_MAX_TASKS + PROFILER_STATUS_SLACK];
+    static TaskSnapshot snapshots[PROFILER_MAX_TASKS + PROFILER_STATUS_SLACK];
+    uint32_t startUs = micros();
+
+    // Suspends the scheduler while it walks the task lists
+    uint32_t totalRunTime = 0;
+    UBaseType_t count = uxTaskGetSystemState(statuses, PROFILER_MAX_TASKS + PROFILER_STATUS_SLACK, &totalRunTime);
+    if (count == 0)
+    {
+        return; // More tasks than entries, nothing was filled in
+    }
+
+    TaskHandle_t idleTasks[PROFILER_CORES] = {};
+    for (uint8_t core = 0; core < PROFILER_CORES && core < portNUM_PROCESSORS; core++)
+    {
+        idleTasks[core] = xTaskGetIdleTaskHandleForCPU(core);
+    }
+    for (UBaseType_t i = 0; i < count; i++)
+    {
+        const TaskStatus_t &status = statuses[i];
+        BaseType_t affinity = xTaskGetAffinity(status.xHandle);
+        TaskSnapshot &snapshot = snapshots[i];
+        snapshot.number = status.xTaskNumber;
+        snapshot.name = status.pcTaskName;
+        snapshot.runTime = status.ulRunTimeCounter;
+        snapshot.core = affinity == tskNO_AFFINITY ? -1 : (int8_t)affinity;
+        snapshot.priority = (uint8_t)status.uxCurrentPriority;
+        snapshot.stackFree = status.usStackHighWaterMark; // Stack is counted in bytes on ESP-IDF
+        snapshot.idle = snapshot.core >= 0 && snapshot.core < PROFILER_CORES && status.xHandle == idleTasks[snapshot.core];
+    }
+
+    HeapSnapshot heap = {heap_caps_get_free_size(MALLOC_CAP_8BIT), heap_caps_get_largest_free_block(MALLOC_CAP_8BIT)};
+    profiler.record(totalRunTime, snapshots, count, heap);
+    profiler.recordCost(micros() - startUs);
+}
+#endif
@@ -0,0 +1,101 @@
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef PROFILER_SAMPLE_MS
+#define PROFILER_SAMPLE_MS 1000 // Interval between samples of the task list
+#endif
+#ifndef PROFILER_MAX_TASKS
+#define PROFILER_MAX_TASKS 24 // Tasks tracked, later ones are counted as untracked
+#endif
+#define PROFILER_WINDOW_COUNT 3
+#define PROFILER_HISTORY 61 // Samples kept: the longest window plus one
+#define PROFILER_CORES 2
+#define PROFILER_NAME_LENGTH 16 // configMAX_TASK_NAME_LEN
+
+// Sliding windows, in samples of PROFILER_SAMPLE_MS
+static const uint8_t PROFILER_WINDOWS[PROFILER_WINDOW_COUNT] = {1, 10, 60};
+
+// One task as uxTaskGetSystemState reports it
+typedef struct {
+    uint32_t number;    // xTaskNumber, unique for the life of the task
+    const char *name;
+    uint32_t runTime;   // Run-time counter, wraps
+    int8_t core;        // Pinned core, -1 if it runs on either
+    uint8_t priority;
+    uint32_t stackFree; // High-water mark, bytes never used
+    bool idle;          // Idle task of `core`
+} TaskSnapshot;
+
+typedef struct {
+    uint32_t freeBytes;
+    uint32_t largestBlock; // Largest single allocation that can still succeed
+} HeapSnapshot;
+
+typedef struct {
+    uint32_t samples;
+    uint32_t untracked;  // Tasks seen in the last sample without a free slot
+    uint32_t lastCostUs; // Time one sample took, task list included
+    uint32_t maxCostUs;
+    uint32_t minLargestBlock;
+    uint16_t maxFragmentation; // Permille
+} ProfilerStats;
+
+// CPU use per task from the FreeRTOS run-time counters, over sliding windows.
+// Each sample stores every task's counter; a window's load is the counter
+// difference between the newest sample and the one `window` samples earlier,
+// divided by the elapsed run-time clock. Loads are permille of one core, so a
+// busy dual-core system adds up to 2000.
+class TaskProfiler {
+public:
+    // One sample: `totalRunTime` is the run-time clock the task counters are measured against
+    void record(uint32_t totalRunTime, const TaskSnapshot *tasks, size_t count, const HeapSnapshot &heap);
+    void recordCost(uint32_t costUs);
+
+    // Permille of one core used by the task in `slot` over window `window`, -1 before two samples
+    int32_t taskLoad(size_t slot, size_t window) const;
+    // Permille of `core` not spent in its idle task, -1 if its idle task is not known
+    int32_t coreLoad(uint8_t core, size_t window) const;
+    // Fragmentation of the last heap sample, permille of the free heap outside the largest block
+    uint16_t fragmentation() const;
+
+    // Tracked tasks by descending load over `window`, returns how many were written to `slots`
+    size_t busiest(size_t window, size_t *slots, size_t maxSlots) const;
+    const char *taskName(size_t slot) const { return tasks[slot].name; }
+    const ProfilerStats &stats() const { return profilerStats; }
+
+    // JSON report, percent with one decimal. Returns the length, 0 if `out` is too small.
+    size_t writeJson(char *out, size_t size) const;
+
+private:
+    typedef struct {
+        bool used;
+        bool seen;
+        bool idle;
+        int8_t core;
+        uint8_t priority;
+        uint32_t number;
+        uint32_t stackFree;
+        char name[PROFILER_NAME_LENGTH];
+    } TaskSlot;
+
+    size_t slotOf(const TaskSnapshot &task);
+    size_t sampleAgo(size_t ago) const { return (head + PROFILER_HISTORY - 1 - ago) % PROFILER_HISTORY; }
+
+    TaskSlot tasks[PROFILER_MAX_TASKS] = {};
+    uint32_t runTimes[PROFILER_HISTORY][PROFILER_MAX_TASKS] = {};
+    uint32_t totals[PROFILER_HISTORY] = {};
+    size_t head = 0;   // Next sample to write
+    size_t filled = 0; // Samples in the history
+    HeapSnapshot heap = {};
+    ProfilerStats profilerStats = {};
+};
+
+#ifndef NATIVE_BUILD
+// Samples every task with uxTaskGetSystemState, timing itself
+void sampleTaskProfiler(TaskProfiler &profiler);
+#endif
+
+#endif